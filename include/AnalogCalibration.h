@@ -0,0 +1,51 @@
+#ifndef ANALOG_CALIBRATION_H
+#define ANALOG_CALIBRATION_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "AnalogPipeline.h"
+
+// Calibration configuration
+#define CALIBRATION_FILE "/calibration.json"
+#define CALIBRATION_MAX_POINTS 8          // Reference points per input
+#define CALIBRATION_SLOPE_BITS 16         // Fraction bits of the compiled slopes
+
+// Inputs convert to integer engineering units: millivolts for the 0-10 V
+// inputs (AIN_V*) and microamps for the 0-20 mA inputs (AIN_I*)
+
+// One reference point: a filtered reading and the value it stands for
+struct CalibrationPoint {
+  uint32_t counts;   // ADC counts << ANALOG_FRACTION_BITS
+  int32_t value;     // mV or uA
+};
+
+// Reference points of one input, sorted by counts. With no points the
+// factory curve (the divider and shunt formulas) applies; one point trims
+// the factory curve's offset; two or more define a piecewise-linear curve.
+struct InputCalibration {
+  uint8_t pointCount;
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+};
+
+// Load the calibration file (factory curves if there is none) and compile it
+void loadAnalogCalibration();
+bool saveAnalogCalibration();
+
+// Convert filtered counts of every input to mV / uA with the compiled
+// fixed-point segments
+void convertAnalogInputs(const uint32_t counts[ANALOG_INPUT_COUNT], int32_t values[ANALOG_INPUT_COUNT]);
+int32_t convertAnalogInput(uint8_t input, uint32_t counts);
+
+// Calibration API: add a reference point at counts (replacing points
+// within one ADC count of it), or drop the input's points to return to the
+// factory curve. Both recompile at once; neither saves.
+bool addCalibrationPoint(uint8_t input, uint32_t counts, int32_t value);
+void resetCalibration(uint8_t input);
+InputCalibration getCalibration(uint8_t input);
+
+// API handlers: GET lists the points, POST captures the present reading
+// of an input as a reference (?input=V1&value=5000) or resets it (?input=V1&reset=1)
+void handleGetCalibration(AsyncWebServerRequest *request);
+void handleSetCalibration(AsyncWebServerRequest *request);
+
+#endif // ANALOG_CALIBRATION_H
@@ -0,0 +1,109 @@
+#ifndef ANALOG_PIPELINE_H
+#define ANALOG_PIPELINE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Analog pipeline configuration
+#define ANALOG_INPUT_COUNT 6             // AI_V1, AI_V2, AI_I1 .. AI_I4
+#define ANALOG_FRACTION_BITS 4           // Filtered values are ADC counts << 4
+#define ANALOG_MAX_MEDIAN 9              // Longest median window
+#define ANALOG_MAX_OVERSAMPLE 1024
+#define ANALOG_READ_SAMPLES 128          // Samples taken from the backend per read
+#define ANALOG_DMA_MIN_RATE_HZ 20000     // Slowest rate of the ESP32 continuous (I2S DMA) mode
+#define ANALOG_MIN_RATE_HZ 600
+#define ANALOG_MAX_RATE_HZ 120000
+#define ANALOG_STACK_SIZE 4096
+
+// Inputs in pipeline order
+enum AnalogInput {
+  AIN_V1 = 0,
+  AIN_V2,
+  AIN_I1,
+  AIN_I2,
+  AIN_I3,
+  AIN_I4
+};
+
+// Runtime settings: every input is sampled at sampleRateHz / ANALOG_INPUT_COUNT,
+// oversample raw samples are averaged, then a median over medianWindow
+// averages and an EMA with weight 1 / 2^emaShift give the published value
+struct AnalogPipelineConfig {
+  uint32_t sampleRateHz;   // Conversions per second over all inputs
+  uint16_t oversample;     // Raw samples averaged per filter step (1-1024)
+  uint8_t medianWindow;    // Averages in the median (1 = no median, up to 9)
+  uint8_t emaShift;        // EMA weight 1 / 2^emaShift (0 = no smoothing, up to 8)
+};
+
+// One conversion from a backend
+struct AnalogSample {
+  uint8_t input;           // AnalogInput
+  uint16_t raw;            // 12-bit ADC count
+};
+
+// Source of samples. The default backend runs the ADC in continuous mode
+// into the driver's DMA ring buffer; another one (e.g. a host mock feeding
+// recorded samples) can be installed with setAnalogBackend().
+struct AnalogBackend {
+  const char* name;
+  bool (*start)(uint32_t sampleRateHz);
+  // Block until samples arrive (about 100 ms at most) and return how many
+  // were stored; overrun is set if the backend had to drop samples
+  uint16_t (*read)(AnalogSample* samples, uint16_t maxSamples, bool* overrun);
+  void (*stop)();
+};
+
+// Filter state of one input: oversampling -> median -> EMA
+struct AnalogFilter {
+  uint32_t sum;
+  uint16_t summed;
+  uint32_t window[ANALOG_MAX_MEDIAN];
+  uint8_t windowCount;
+  uint8_t windowNext;
+  uint32_t ema;            // EMA << emaShift
+  bool primed;
+};
+
+struct AnalogPipelineStats {
+  const char* backend;                        // Backend in use (NULL before the first start)
+  uint32_t sampleRateHz;                      // Rate the backend runs at
+  uint32_t samples;                           // Raw samples processed
+  uint32_t overruns;                          // Reads where the backend dropped samples
+  uint32_t restarts;                          // Backend (re)starts
+  uint32_t outputs[ANALOG_INPUT_COUNT];       // Filtered values produced per input
+  uint16_t lastRaw[ANALOG_INPUT_COUNT];       // Most recent raw count per input
+};
+
+// Filter kernels, independent of the task so they can run on the host
+void analogFilterReset(AnalogFilter& filter);
+bool analogFilterPush(AnalogFilter& filter, const AnalogPipelineConfig& config, uint16_t raw, uint32_t& value);
+
+// Create the sampling task (safe to call more than once). On the device it
+// runs the continuous backend, falling back to polling if that cannot start.
+void startAnalogPipeline();
+
+// Create the sampling task with the given default backends; either may be
+// NULL (the task then waits for setAnalogBackend). startAnalogPipeline()
+// calls this with the ADC backends, the native tests with none.
+void startAnalogSampling(const AnalogBackend* primary, const AnalogBackend* fallback);
+
+// Apply new settings; the backend restarts and the filters start over.
+// Returns false (and changes nothing) if a value is out of range.
+bool setAnalogPipelineConfig(const AnalogPipelineConfig& config);
+AnalogPipelineConfig getAnalogPipelineConfig();
+
+// Install a sample backend (NULL restores continuous mode) and restart
+void setAnalogBackend(const AnalogBackend* backend);
+
+// Latest filtered value of every input, in ADC counts << ANALOG_FRACTION_BITS
+void getAnalogFiltered(uint32_t values[ANALOG_INPUT_COUNT]);
+
+// Copy of the current counters
+AnalogPipelineStats getAnalogPipelineStats();
+
+// API handlers: GET reports settings and counters, POST changes settings
+// (?rate=&oversample=&median=&ema=)
+void handleGetAnalogPipeline(AsyncWebServerRequest *request);
+void handleSetAnalogPipeline(AsyncWebServerRequest *request);
+
+#endif // ANALOG_PIPELINE_H
@@ -0,0 +1,47 @@
+#ifndef DIGITAL_INPUTS_H
+#define DIGITAL_INPUTS_H
+
+#include <Arduino.h>
+
+// Digital input scanner configuration
+#define DI_INPUT_COUNT 8
+#define DI_SCAN_MS 1              // 74HC165 scan period (1 kHz)
+#define DI_DEBOUNCE_SCANS 4       // Equal scans before a change is accepted (2-bit vertical counter)
+#define DI_STACK_SIZE 2048
+
+// Vertical counter debouncer: bit n of count0/count1 form the 2-bit
+// counter of input n, so all 8 inputs advance with a few byte operations
+struct DebounceState {
+  uint8_t state;     // Debounced inputs, set bit = active
+  uint8_t count0;    // Counter low bits
+  uint8_t count1;    // Counter high bits
+};
+
+// Debounced inputs with their edge history
+struct DigitalInputState {
+  uint8_t state;                          // Set bit = active input
+  uint8_t rising;                         // Inputs that became active since the last takeDigitalInputEdges()
+  uint8_t falling;                        // Inputs that became inactive since then
+  uint32_t changedMs[DI_INPUT_COUNT];     // millis() of each input's last accepted change
+  uint32_t risingCount[DI_INPUT_COUNT];
+  uint32_t fallingCount[DI_INPUT_COUNT];
+  uint32_t scans;                         // 74HC165 reads so far
+  uint32_t unsettledScans;                // Scans where an input differed from its debounced state (bounce or pending change)
+};
+
+// Debounce kernel, independent of the task so it can run on the host.
+// Returns the inputs whose debounced state changed with this sample.
+void debounceReset(DebounceState& debounce, uint8_t state);
+uint8_t debouncePush(DebounceState& debounce, uint8_t sample);
+
+// Create the scanner task (safe to call more than once)
+void startDigitalInputScanner();
+bool digitalInputScannerRunning();
+
+// Copy of the debounced inputs, counters and pending edge masks
+DigitalInputState getDigitalInputs();
+
+// Return the edges seen since the previous call and clear them (one consumer)
+void takeDigitalInputEdges(uint8_t& rising, uint8_t& falling);
+
+#endif // DIGITAL_INPUTS_H
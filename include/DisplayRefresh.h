@@ -0,0 +1,28 @@
+#ifndef DISPLAY_REFRESH_H
+#define DISPLAY_REFRESH_H
+
+#include <Arduino.h>
+
+// Display refresh configuration
+#define DISPLAY_DIGITS 4
+#define DISPLAY_DIGIT_US 1250     // Time each digit stays lit (4 digits refresh at 200 Hz)
+#define DISPLAY_TIMER 0           // Hardware timer driving the refresh
+
+// Take over the 74HC595 chain: a timer interrupt lights one digit at a time
+// from the frame buffer, always together with the current relayState byte.
+// Safe to call more than once.
+void startDisplayRefresh();
+bool displayRefreshRunning();
+
+// Shift relays out now (task context), with the digit that is lit if the
+// refresh runs or a dark display if it does not
+void shiftOutputFrame(uint8_t relays);
+
+// Display contents. Only the frame buffer is written; the timer picks it up.
+void displaySetSegments(const uint8_t segments[DISPLAY_DIGITS]);
+void displayShowNumber(uint16_t value);   // 0-9999 with leading zeros
+void displayShowText(const char* text);   // 0-9 A b C c d E F H h L n N o P r t U - and space
+void displayShowError(uint8_t code);      // "E" and the code, e.g. "E 12"
+void displayShowRelays(uint8_t relays);   // "----" when idle, otherwise "on" and the lowest relay on
+
+#endif // DISPLAY_REFRESH_H
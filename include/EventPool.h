@@ -0,0 +1,72 @@
+#ifndef EVENT_POOL_H
+#define EVENT_POOL_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+
+// Event pool configuration
+#define EVENT_POOL_MIN_BLOCK 8        // Events in the smallest block
+#define EVENT_POOL_CLASSES eventPoolClasses(MAX_EVENTS) // Block sizes 8, 16, 32, ... MAX_EVENTS
+#define EVENT_POOL_HEAP_RESERVE 32768 // Free heap the pool always leaves for WiFi and the web server
+#define SCHEDULE_TABLE_MIN 4          // Slots of a schedule table when it is first allocated
+
+// Number of block sizes from EVENT_POOL_MIN_BLOCK up to maxEvents
+constexpr uint8_t eventPoolClasses(uint32_t maxEvents) {
+  return maxEvents <= EVENT_POOL_MIN_BLOCK ? 1 : 1 + eventPoolClasses(maxEvents / 2);
+}
+static_assert((EVENT_POOL_MIN_BLOCK << (EVENT_POOL_CLASSES - 1)) == MAX_EVENTS,
+              "MAX_EVENTS must be an event pool block size");
+
+// Memory accounting for /api/scheduler/status
+struct EventPoolStats {
+  uint32_t budgetEvents;      // Cap on reservedEvents (0 = only the heap reserve limits it)
+  uint32_t reservedEvents;    // Slots taken from the heap (in use plus free lists)
+  uint32_t inUseEvents;       // Slots in blocks owned by schedules
+  uint32_t blocksInUse;
+  uint32_t blocksFree;        // Blocks parked on the free lists
+  uint32_t allocFailures;     // Requests refused (budget or heap reserve reached)
+  uint32_t availableEvents;   // More slots the heap reserve (and budget, if set) allows right now
+};
+
+// Cap the event slots the pool may take from the heap (0 = no cap beyond
+// EVENT_POOL_HEAP_RESERVE). Blocks already reserved are kept; a lower cap
+// only refuses new ones. Starts at SCHEDULER_EVENT_BUDGET.
+void setEventPoolBudget(uint32_t events);
+
+// Block of at least minEvents events; capacity receives its real size.
+// Blocks come from a per-size free list when possible (O(1)) and from the
+// heap otherwise. Returns NULL if the budget or the heap reserve would be
+// exceeded.
+Event* allocEventBlock(uint16_t minEvents, uint16_t& capacity);
+
+// Return a block to its free list (O(1))
+void freeEventBlock(Event* block, uint16_t capacity);
+
+// Every schedule slot below scheduleCount owns its event block; slots at or
+// above it own none. These helpers keep that true.
+
+// Grow the schedule table to at least count slots (at most MAX_SCHEDULES),
+// keeping the schedules in it. New slots own no block.
+bool reserveSchedules(SchedulerState& state, uint8_t count);
+
+// Make room for count events, keeping the existing ones
+bool reserveScheduleEvents(Schedule& sch, uint16_t count);
+
+// Give the schedule's block back to the pool
+void releaseScheduleEvents(Schedule& sch);
+
+// Deep copies into dst, reusing its block when it is large enough
+bool copySchedule(Schedule& dst, const Schedule& src);
+bool copySchedulerState(SchedulerState& dst, const SchedulerState& src);
+
+// Release every schedule of state and leave it empty (the table is kept
+// for the next copy)
+void releaseSchedulerState(SchedulerState& state);
+
+// Release every schedule and the table too, before state itself is freed
+void freeSchedulerState(SchedulerState& state);
+
+// Copy of the current accounting
+EventPoolStats getEventPoolStats();
+
+#endif // EVENT_POOL_H
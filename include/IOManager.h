@@ -5,30 +5,77 @@
 #include <Arduino.h>
 #include "TestMode.h" // Add this include
 
+// Relay output configuration
+#define RELAY_REFRESH_MS 1000   // Re-send unchanged outputs this often to undo glitches (0 = only on change)
+
+// Numbered relayState write, so a change can be followed to the 74HC595 latch
+struct RelayWrite {
+  uint32_t sequence;
+  uint32_t cycles;     // CPU cycle counter when relayState was written
+};
+
+// Counters of the 74HC595 writer task
+struct RelayOutputStats {
+  uint32_t changeShifts;        // Frames sent because relayState changed
+  uint32_t refreshShifts;       // Frames sent by the periodic refresh
+  uint32_t criticalSections;    // Times the writer read relayState in its critical section
+  uint64_t criticalCycles;      // CPU cycles spent inside it
+  uint32_t maxCriticalCycles;   // Longest single stay
+  uint64_t shiftCycles;         // CPU cycles spent clocking frames out
+  uint32_t startMs;             // millis() when the writer task started
+};
+
+// One coherent sample of all inputs, published by the analog task
+struct IOSnapshot {
+  uint32_t sequence;       // Publication number (0 = nothing published yet)
+  uint32_t timestampMs;    // millis() when the inputs were sampled
+  float voltages[4];       // 0-10 V inputs, V
+  float currents[4];       // 0-20 mA inputs, mA
+  bool buttons[4];
+  bool inputs[8];          // 74HC165 digital inputs, debounced
+  uint8_t inputsRising;    // Inputs that became active since the previous snapshot
+  uint8_t inputsFalling;   // Inputs that became inactive since the previous snapshot
+  uint8_t relays;          // relayState at publication
+};
+
 // Initialize IO manager
 void initIOManager();
 
-// Relay functions
+// Writers of the relays. Each one only sets its own mask and relayState is
+// their union, so a relay stays on while anyone holds it: a pulse ending
+// cannot switch off a relay the plan holds, and a manual OFF does not cut a
+// running plan or pulse.
+enum RelayOwner {
+  RELAY_OWNER_PLAN,     // Scheduler task, following the relay plan
+  RELAY_OWNER_PULSE,    // Relay actuator, timed pulses
+  RELAY_OWNER_MANUAL,   // Web API, relay tests and diagnostics
+  RELAY_OWNER_COUNT
+};
+
+// Relay functions. relayState is only written through these, so that the
+// writer task is woken to shift the change out. setRelay() and
+// setAllRelays() change the manual mask.
 void setRelay(uint8_t relay, bool state);
 void setAllRelays(uint8_t state);
+RelayWrite applyRelayTransitions(RelayOwner owner, uint8_t onMask, uint8_t offMask);
 uint8_t getRelayState();
+uint8_t getRelayOwnerMask(RelayOwner owner);
+RelayOutputStats getRelayOutputStats();
+
+// Copy the latest IO snapshot. Wait-free for the analog task; a reader
+// only retries if a publication completed during its copy.
+void getIOSnapshot(IOSnapshot& snapshot);
 
-// Read input values
+// Read single input values (use getIOSnapshot() for several at once)
 bool getButtonState(uint8_t button);
 bool getInputState(uint8_t input);
 float getVoltageValue(uint8_t channel);
 float getCurrentValue(uint8_t channel);
 
-// Get array pointers for use in API responses
-float* getVoltageValues();
-float* getCurrentValues();
-bool* getButtonStates();
-bool* getInputStates();
-
 // Task for 74HC595 initialization
 void initTestModeTask(void *pvParameters);
 
-// Relay update task
+// Relay update task: shifts relayState out when it changes
 void vRelayUpdateTask(void *pvParameters);
 
 // Analog update task
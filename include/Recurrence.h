@@ -0,0 +1,73 @@
+#ifndef RECURRENCE_H
+#define RECURRENCE_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+
+// Recurrence configuration
+#define RECURRENCE_DAYS 32                // Local days compiled into each snapshot, from yesterday on
+#define RECURRENCE_ALL_WEEKDAYS 0x7F
+#define RECURRENCE_TABLE_FULL 0xFF        // internRecurrence() result when a schedule has no free rule
+
+// Rules compiled to one bit per rule and day: bit n of masks[d][s] is set
+// when rule n of schedule s matches local day firstDay + d (bit 0, "every
+// day", is always set). Checking an event is then a single bit test.
+// Each local day starts at its own UTC instant, so a DST change within the
+// window moves the day boundaries after it.
+struct RecurrenceDays {
+  uint16_t firstDay;       // Local epoch day of masks[0]
+  int32_t utcOffset;       // Offset at the instant the days were compiled for
+  time_t dayStarts[RECURRENCE_DAYS + 1];  // UTC instant of each local midnight, and the end
+  uint8_t masks[RECURRENCE_DAYS][MAX_SCHEDULES];
+};
+
+// Rule that fires every day
+bool recurrenceIsEveryDay(const Recurrence& rule);
+
+// Whether the rule fires on a local epoch day
+bool recurrenceMatchesDay(const Recurrence& rule, uint16_t localDay);
+
+// Event.rule value for a rule, adding it to the schedule's table if it is
+// new. Returns RECURRENCE_TABLE_FULL if the table has no room for it.
+uint8_t internRecurrence(Schedule& sch, const Recurrence& rule);
+
+// Compile every schedule's rules for the RECURRENCE_DAYS local days
+// starting the day before now
+void compileRecurrenceDays(const SchedulerState& state, time_t now, RecurrenceDays& days);
+
+// Whether an event of schedule scheduleIdx starting at UTC instant start
+// fires (false outside the compiled days)
+bool eventFiresAt(const RecurrenceDays& days, uint8_t scheduleIdx, const Event& event, time_t start);
+
+// First UTC instant after the compiled days
+time_t recurrenceDaysEnd(const RecurrenceDays& days);
+
+// Recurrence fields of an event, the one schema of every JSON reader
+// (streaming upload, legacy file import, WebSocket edits):
+//   "weekdays": 1-127, bit 0 = Sunday     "everyDays": 0-255 (0 or 1 = every day)
+//   "anchor": "YYYY-MM-DD", phase of everyDays (default 1970-01-01)
+//   "seasonStart"/"seasonEnd": "MM-DD" local dates, both or neither
+// A reader starts a rule with beginRecurrence(), passes every field of the
+// event to applyRecurrenceField() and ends with finishRecurrence().
+void beginRecurrence(Recurrence& rule);
+
+// Whether key is one of the fields above
+bool isRecurrenceField(const char* key);
+
+// Apply one field: value is the text of a string (isString) or the literal
+// of any other value. Returns false if key is a recurrence field and the
+// value is not valid for it; other keys are ignored.
+bool applyRecurrenceField(Recurrence& rule, const char* key, const char* value, bool isString);
+
+// Check the rule as a whole and normalize it. Returns false if invalid.
+bool finishRecurrence(Recurrence& rule);
+
+// "YYYY-MM-DD" <-> local epoch day (buffer of at least 11 chars)
+bool parseRecurrenceDate(const char* text, uint16_t& localDay);
+void formatRecurrenceDate(uint16_t localDay, char* buffer);
+
+// "MM-DD" <-> month * 100 + day (buffer of at least 6 chars)
+bool parseSeasonDate(const char* text, uint16_t& monthDay);
+void formatSeasonDate(uint16_t monthDay, char* buffer);
+
+#endif // RECURRENCE_H
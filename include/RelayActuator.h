@@ -0,0 +1,33 @@
+#ifndef RELAY_ACTUATOR_H
+#define RELAY_ACTUATOR_H
+
+#include <Arduino.h>
+
+// Relay actuator configuration
+#define RELAY_ACTUATOR_MAX_DEADLINES 64   // Pending relay-off deadlines held in the heap
+#define RELAY_ACTUATOR_QUEUE_LENGTH 16    // Pulse requests waiting for the actuator task
+#define RELAY_ACTUATOR_STACK_SIZE 3072
+
+// Counters for comparing the actuator against the old task-per-pulse approach
+struct RelayActuatorStats {
+  uint32_t queuedDeadlines;   // Relay-off deadlines currently pending
+  uint32_t peakDeadlines;     // Highest number of pending deadlines seen
+  uint32_t pulsesAccepted;    // Pulse requests applied
+  uint32_t pulsesDropped;     // Pulse requests rejected (queue or heap full)
+  uint32_t relayUpdates;      // Batched relayState writes
+  uint32_t lastLatencyUs;     // Latency of the most recent transition
+  uint32_t maxLatencyUs;      // Worst latency seen
+  uint64_t totalLatencyUs;    // Sum of latencies, for averaging
+  uint32_t latencySamples;    // Number of latencies summed
+};
+
+// Create the actuator task (safe to call more than once)
+void startRelayActuator();
+
+// Turn a relay on now and off again after durationSeconds
+bool queueRelayPulse(uint8_t relay, uint16_t durationSeconds);
+
+// Copy of the current counters
+RelayActuatorStats getRelayActuatorStats();
+
+#endif // RELAY_ACTUATOR_H
@@ -0,0 +1,90 @@
+#ifndef RELAY_PLAN_H
+#define RELAY_PLAN_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+#include "Recurrence.h"
+
+#define RELAY_PLAN_MIN_CAPACITY 16   // Intervals allocated for a relay on first use
+
+// Time a relay is held on, in seconds of the UTC day (end exclusive)
+struct RelayInterval {
+  uint32_t start;
+  uint32_t end;
+};
+
+// On/off plan per relay for one UTC day. Events that overlap on a relay are
+// merged into one interval, so the relay gets a single on and a single off
+// edge. Only events that fire that day are included, plus whatever is left
+// of the previous day's runs past midnight, so a plan is compiled per day.
+// Interval arrays grow with the schedule and are reused by the next build.
+struct RelayPlan {
+  RelayInterval* intervals[8];
+  uint16_t count[8];
+  uint16_t capacity[8];
+  uint32_t version;   // New with every buildRelayPlan(), so cursors notice a rebuild
+};
+
+// A reader's place in a plan: per relay, the first interval that ends after
+// the second it last looked at. Time only moves forward between executor
+// wakes, so the next look steps past the intervals that ended since
+// (amortized O(1)); another plan, a rebuild or an earlier second seeks again.
+struct RelayPlanCursor {
+  uint32_t version;       // RelayPlan.version of index (0 = not positioned)
+  uint32_t secondOfDay;
+  uint16_t index[8];
+};
+
+// One relay of one event after zone sequencing. Times are UTC seconds from
+// the start of the event's day and may run past midnight.
+struct ZoneRun {
+  uint32_t start;
+  uint32_t end;
+  uint8_t relay;
+  uint16_t eventIdx;
+};
+
+// Pump slots of a schedule while sequencing: when each slot frees up, in
+// seconds from the midnight of the day being sequenced. Runs queued past
+// midnight keep their slot busy into the next day.
+struct ZoneSlots {
+  int32_t freeAt[8];
+  bool used[8];
+};
+
+// Runs sequenceScheduleZones() can produce for a schedule (buffer size)
+uint32_t countScheduleZoneRuns(const Schedule& schedule);
+
+// Expand the events of schedule scheduleIdx that fire on UTC epoch day
+// into per-relay runs. With maxOpenZones set, runs due together are queued
+// so no more than that many relays are on at once, each queued run starting
+// zoneGapSeconds after the one before it on its pump slot. slots holds the
+// pump at the day's midnight on entry and at the end of its runs on return.
+// Returns the number of runs written (at most maxRuns), sorted by requested
+// start.
+uint16_t sequenceScheduleZones(const Schedule& schedule, uint8_t scheduleIdx, const RecurrenceDays& days,
+                               uint32_t day, ZoneRun* runs, uint16_t maxRuns, ZoneSlots& slots);
+
+// Pump with no zone running
+void clearZoneSlots(ZoneSlots& slots);
+
+// Move slots from the day they were sequenced for to the next one
+void advanceZoneSlots(ZoneSlots& slots);
+
+// Pump slots at the midnight starting day, still taken by the runs of the
+// day before (runs is scratch space for them)
+void zoneSlotsAtMidnight(const Schedule& schedule, uint8_t scheduleIdx, const RecurrenceDays& days,
+                         uint32_t day, ZoneRun* runs, uint16_t maxRuns, ZoneSlots& slots);
+
+// Compile the plan of a scheduler state for UTC epoch day
+void buildRelayPlan(const SchedulerState& state, const RecurrenceDays& days, uint32_t day, RelayPlan& plan);
+
+// Relays the plan holds on at secondOfDay
+uint8_t relayPlanMaskAt(const RelayPlan& plan, uint32_t secondOfDay);
+uint8_t relayPlanMaskAt(const RelayPlan& plan, RelayPlanCursor& cursor, uint32_t secondOfDay);
+
+// Seconds from secondOfDay until any relay changes (0 if the plan is empty)
+uint32_t secondsUntilRelayPlanEdge(const RelayPlan& plan, uint32_t secondOfDay);
+uint32_t secondsUntilRelayPlanEdge(const RelayPlan& plan, RelayPlanCursor& cursor, uint32_t secondOfDay);
+
+#endif // RELAY_PLAN_H
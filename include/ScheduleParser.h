@@ -0,0 +1,82 @@
+#ifndef SCHEDULE_PARSER_H
+#define SCHEDULE_PARSER_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+
+// Streaming parser configuration
+#define SCHEDULE_PARSER_MAX_DEPTH 8     // Nesting allowed in the uploaded document
+#define SCHEDULE_PARSER_KEY_LEN 24      // Longer keys are truncated (they are never ones we read)
+#define SCHEDULE_PARSER_TOKEN_LEN 128   // Longest string or number value accepted
+#define SCHEDULE_UPLOAD_MAX_BYTES 262144 // Bodies larger than this are rejected up front
+
+// Incremental parser for the /api/scheduler/save document. Bytes can be fed
+// in chunks of any size; schedules are written straight into the target
+// state, so memory use does not depend on the size of the upload.
+// Times in the document are local and are stored as UTC.
+struct ScheduleParser {
+  SchedulerState* target;
+  const char* error;             // NULL while the input is still valid
+
+  // Tokenizer
+  uint8_t state;
+  uint8_t depth;
+  char containers[SCHEDULE_PARSER_MAX_DEPTH];       // '{' or '[' per open level
+  char keys[SCHEDULE_PARSER_MAX_DEPTH][SCHEDULE_PARSER_KEY_LEN];
+  char token[SCHEDULE_PARSER_TOKEN_LEN];
+  uint16_t tokenLen;
+  bool tokenIsKey;
+  uint8_t unicodeDigits;         // Remaining hex digits of a \u escape
+  uint16_t unicodeValue;
+
+  // Document position
+  bool inSchedules;
+  bool inSchedule;
+  bool inEvents;
+  bool inEvent;
+  bool scheduleDropped;          // Schedule beyond MAX_SCHEDULES or the heap, read but not kept
+  bool eventTimeValid;
+  bool eventRuleValid;
+  Event pendingEvent;
+  Recurrence pendingRule;        // Recurrence fields of pendingEvent, interned when it closes
+};
+
+// Start parsing into target (which is cleared)
+void beginScheduleParser(ScheduleParser& parser, SchedulerState* target);
+
+// Feed the next chunk. Returns false once the input is invalid.
+bool feedScheduleParser(ScheduleParser& parser, const uint8_t* data, size_t len);
+
+// Check that the document is complete. Returns false if it was cut short.
+bool finishScheduleParser(ScheduleParser& parser);
+
+// ---- Upload session ----
+// One /api/scheduler/save upload is parsed at a time. The owner is whatever
+// identifies the upload to the caller (the AsyncWebServerRequest); chunks
+// from any other owner while it is in progress are turned away.
+
+// feedScheduleUpload results other than an HTTP error status
+#define SCHEDULE_UPLOAD_RECEIVING 0      // Chunk parsed, more of the body to come
+#define SCHEDULE_UPLOAD_IGNORED 1        // Chunk of an upload that was already answered
+#define SCHEDULE_UPLOAD_PARSED 200       // Whole document parsed into *parsed
+
+// Feed one body chunk. index and total are the chunk offset and body size.
+// Returns SCHEDULE_UPLOAD_PARSED once the last chunk completes the document;
+// the caller then owns *parsed and must commit it or discardScheduleUpload()
+// it. Errors are HTTP statuses the upload should be answered with:
+// 409 another upload is in progress, 413 body too large, 400 invalid
+// document, 500 out of memory. The staging state is freed on any error.
+int feedScheduleUpload(const void* owner, const uint8_t* data, size_t len,
+                       size_t index, size_t total, SchedulerState** parsed);
+
+// The owner went away (client disconnected). Frees its staging state if it
+// is the upload in progress, otherwise does nothing.
+void abandonScheduleUpload(const void* owner);
+
+// Release a parsed upload that is not being committed
+void discardScheduleUpload(SchedulerState*& state);
+
+// True while an upload is between its first and last chunk
+bool scheduleUploadInProgress();
+
+#endif // SCHEDULE_PARSER_H
@@ -6,40 +6,78 @@
 #include <ESPAsyncWebServer.h>
 
 // Scheduler configuration
-#define SCHEDULER_FILE "/scheduler.json"
-#define MAX_EVENTS 50
-#define MAX_SCHEDULES 8
+#define SCHEDULER_FILE "/scheduler.json"   // Legacy JSON store, imported once into SchedulerStore
+#ifndef SCHEDULER_EVENT_BUDGET
+#define SCHEDULER_EVENT_BUDGET 0    // Event slots the pool may take from the heap across every copy of
+#endif                              // the state; 0 = whatever the heap reserve allows (see setEventPoolBudget)
+#define MAX_EVENTS 2048             // Per schedule; largest event pool block (see EventPool.h)
+#define MAX_SCHEDULES 32            // The schedule table grows on demand up to this (see reserveSchedules)
+#define SCHEDULE_MAX_RULES 7        // Distinct recurrence rules per schedule (Event.rule 1-7)
 #define SCHEDULER_TIMEOUT_MS 300000  // 5 minutes (300,000 ms)
+#define EVENT_ID_LEN 18              // Frontend ids look like "1709500000000_49"
+#define SCHEDULER_ARENA_SIZE 1024    // Bytes shared by all schedule names and metadata
+#define ARENA_NONE 0xFFFF            // Arena reference for an empty string
+#define MINUTES_PER_DAY 1440
+#define SECONDS_PER_DAY 86400UL
+#define SCHEDULER_MAX_SLEEP_S 3600   // Upper bound on one scheduler task sleep
+#define SCHEDULER_CATCHUP_S 60       // A late scheduler wake still records events this many seconds old
+#define SCHEDULER_HISTORY_PAGE 64    // Most events one /api/scheduler/history response lists
+#define SCHEDULER_RUN_BATCH 32       // Firings of one executor wake journaled together
 
 // Declare the WebSocket as external so it can be used across files
 extern AsyncWebSocket schedulerWs;
 
+// Interned string storage; schedules hold offsets into it instead of Strings
+struct StringArena {
+  uint16_t used;                     // Bytes in use
+  char data[SCHEDULER_ARENA_SIZE];   // NUL-terminated strings back to back
+};
+
+// Recurrence rule, evaluated against the local date an event starts on.
+// An event fires on a day only if every part of its rule matches.
+struct Recurrence {
+  uint8_t weekdays;       // Bit 0 = Sunday ... bit 6 = Saturday (0x7F = any day)
+  uint8_t intervalDays;   // Every N days counted from anchorDay (0 or 1 = every day)
+  uint16_t anchorDay;     // Local epoch day the interval is counted from
+  uint16_t seasonStart;   // First date of the season as month * 100 + day (0 = all year)
+  uint16_t seasonEnd;     // Last date of the season (inclusive); may wrap over New Year
+};
+
 // Event structure
 // Each event represents a single activation at a specific time
 struct Event {
-  String id;             // Unique identifier for the event
-  String time;           // Time in UTC format "HH:MM"
-  uint16_t duration;     // Duration in seconds
-  uint32_t executedMask; // Flags for tracking execution status
+  char id[EVENT_ID_LEN];  // Unique identifier for the event
+  uint8_t rule;           // Recurrence: 0 = every day, n = the schedule's rules[n - 1]
+  uint32_t secondOfDay;   // Start time in UTC seconds since midnight
+  uint16_t duration;      // Duration in seconds
+  uint32_t lastRun;       // UTC epoch second of the last firing (0 = never); one word, so
+                          // readers of a published snapshot never see half a stamp
 };
 
 // Schedule structure
 // A schedule contains metadata and a collection of events
 struct Schedule {
-  String name;           // User-defined name for the schedule
-  String metadata;       // Additional information (e.g., creation date)
-  uint8_t relayMask;     // Bitmask of relays controlled by this schedule
-  String lightsOnTime;   // "Lights on" time (metadata) in UTC "HH:MM"
-  String lightsOffTime;  // "Lights off" time (metadata) in UTC "HH:MM"
-  Event events[MAX_EVENTS]; // Array of events
-  uint8_t eventCount;    // Number of events in this schedule
+  uint16_t name;            // Arena reference: user-defined name for the schedule
+  uint16_t metadata;        // Arena reference: additional information (e.g., creation date)
+  uint16_t lightsOnMinute;  // "Lights on" time (metadata) in UTC minutes since midnight
+  uint16_t lightsOffMinute; // "Lights off" time (metadata) in UTC minutes since midnight
+  uint8_t relayMask;        // Bitmask of relays controlled by this schedule
+  uint8_t maxOpenZones;     // Relays of this schedule allowed on at once (0 = no limit)
+  uint16_t zoneGapSeconds;  // Pause between zones run back-to-back on the same pump
+  uint8_t ruleCount;        // Recurrence rules in use
+  Recurrence rules[SCHEDULE_MAX_RULES]; // Distinct rules of the events (see Event.rule)
+  uint16_t eventCount;      // Number of events in this schedule
+  uint16_t eventCapacity;   // Size of the event block (not persisted from here on)
+  Event* events;            // Event pool block owned by this schedule
 };
 
 // Global scheduler state
 struct SchedulerState {
-  Schedule schedules[MAX_SCHEDULES]; // Array of schedules
+  Schedule* schedules;               // Schedule table from the heap, scheduleCapacity slots
+  uint8_t scheduleCapacity;          // Slots in the table (grown by reserveSchedules)
   uint8_t scheduleCount;             // Number of schedules
   uint8_t currentScheduleIndex;      // Index of currently selected schedule
+  StringArena strings;               // Names and metadata of all schedules
 };
 
 // Enum for state management
@@ -56,20 +94,41 @@ struct EditSession {
   SchedulerMode mode;
   int editingScheduleIndex;  // -1 for new schedule
   Schedule pendingSchedule;  // Temporary schedule being edited
+  StringArena strings;       // Name and metadata of the pending schedule
   bool isDirty;              // Whether changes have been made
 };
 
 // Global scheduler state instance
 extern SchedulerState schedulerState;
 
+// Time source for the scheduler task (UTC epoch seconds)
+typedef time_t (*SchedulerClock)();
+
 // Core scheduler functions
 void initScheduler();
 void startSchedulerTask();
 void stopSchedulerTask();
+void wakeSchedulerTask();
+void setSchedulerClock(SchedulerClock clock);  // NULL restores time()
+time_t getSchedulerTime();                     // Current time of the scheduler clock
+bool schedulerClockIsSystem();                 // Whether the clock is the real time() one
+struct SchedulerTimeline;
+struct SchedulerSnapshot;
+struct RelayPlanCursor;
+uint32_t secondsUntilNextSchedulerWake(const SchedulerTimeline& timeline, time_t now);
+uint32_t secondsUntilNextSchedulerStep(const SchedulerSnapshot& snapshot, time_t now,
+                                       RelayPlanCursor* cursor = NULL);  // The caller's place in the relay plan
+
+// Stamp the events of snapshot that are due at now and return how many there
+// were. Each one is passed to sink if it is set (and logged otherwise).
+typedef void (*SchedulerFiringSink)(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx,
+                                    time_t now, void* context);
+uint16_t stampDueEvents(SchedulerSnapshot& snapshot, time_t now, SchedulerFiringSink sink, void* context);
+void logSchedulerFiring(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx);
 void executeRelayCommand(uint8_t relay, uint16_t duration);
 void loadSchedulerState();
-void saveSchedulerState();
-void addNewSchedule(const String& name);
+void saveSchedulerState(const SchedulerState& state);
+bool addNewSchedule(const String& name);
 void schedulerMonitorTask(void *pvParameters);
 bool verifyTimeSync();
 void testRelayControl();
@@ -86,6 +145,25 @@ void schedulerDiagnosticsTask(void *pvParameters);
 // Time conversion utilities
 String localTimeToUTC(const String& localTime);
 String utcToLocalTime(const String& utcTime);
+uint16_t localMinuteToUTC(uint16_t localMinute);
+uint16_t utcMinuteToLocal(uint16_t utcMinute);
+bool parseMinuteOfDay(const char* timeStr, uint16_t& minuteOfDay);
+void formatMinuteOfDay(uint16_t minuteOfDay, char* buffer); // buffer needs 6 bytes
+uint32_t localSecondToUTC(uint32_t localSecond);
+uint32_t utcSecondToLocal(uint32_t utcSecond);
+bool parseSecondOfDay(const char* timeStr, uint32_t& secondOfDay);   // "HH:MM" or "HH:MM:SS"
+void formatSecondOfDay(uint32_t secondOfDay, char* buffer); // "HH:MM" on whole minutes; buffer needs 9 bytes
+
+// String arena utilities
+const char* arenaString(const StringArena& arena, uint16_t ref);
+uint16_t internString(StringArena& arena, const char* str);
+uint16_t internSchedulerString(const char* str);
+
+// Execution stamps. The executor stamps events inside a published snapshot
+// while readers look at it, so a stamp is only written and read whole.
+uint16_t schedulerEpochDay(time_t t);   // UTC days since 1970-01-01
+void markEventRun(Event& event, time_t now);
+uint32_t eventLastRun(const Event& event);
 
 // API handlers
 void handleLoadSchedulerState(AsyncWebServerRequest *request);
@@ -94,6 +172,10 @@ void handleSchedulerStatus(AsyncWebServerRequest *request);
 void handleActivateScheduler(AsyncWebServerRequest *request);
 void handleDeactivateScheduler(AsyncWebServerRequest *request);
 void handleManualWatering(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+void handleSchedulerHistory(AsyncWebServerRequest *request);
+void handleSchedulerSequence(AsyncWebServerRequest *request);
+void handleSchedulerUpcoming(AsyncWebServerRequest *request);
+void handleSchedulerLatency(AsyncWebServerRequest *request);
 
 // WebSocket handlers
 void initSchedulerWebSocket(AsyncWebServer& server);
@@ -0,0 +1,48 @@
+#ifndef SCHEDULER_LATENCY_H
+#define SCHEDULER_LATENCY_H
+
+#include <Arduino.h>
+
+// Latency histogram configuration
+#define LATENCY_HISTOGRAM_BUCKETS 24   // Bucket b holds 2^(b-1) .. 2^b - 1 us; the last is open-ended
+
+// Stages a scheduled relay change passes through
+enum LatencyStage {
+  LATENCY_PICKUP = 0,  // Planned instant -> scheduler task running
+  LATENCY_WRITE,       // Scheduler task running -> relayState written
+  LATENCY_LATCH,       // relayState written -> 74HC595 latched
+  LATENCY_TOTAL,       // Planned instant -> 74HC595 latched
+  LATENCY_STAGE_COUNT
+};
+
+// Power-of-two histogram of one stage, in microseconds
+struct LatencyHistogram {
+  uint32_t count;
+  uint32_t maxUs;
+  uint32_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+};
+
+struct SchedulerLatencyStats {
+  LatencyHistogram stages[LATENCY_STAGE_COUNT];
+  uint32_t unlatched;   // Samples replaced before their write reached the latch
+};
+
+// Start a sample when the scheduler task picks up the relay change planned
+// for dueTime (UTC). The cycle-counter stamps are only comparable on one
+// core, so the scheduler and relay update tasks must share a core.
+void beginLatencySample(time_t dueTime);
+
+// The change reached relayState as write number sequence at writeCycles
+void recordLatencyWrite(uint32_t sequence, uint32_t writeCycles);
+
+// The relay update task latched relayState as of write number sequence
+void recordRelayLatch(uint32_t sequence, uint32_t latchCycles);
+
+// Copy of the histograms, and clearing them
+SchedulerLatencyStats getSchedulerLatencyStats();
+void resetSchedulerLatencyStats();
+
+// Upper bound of the bucket holding the given percentile (0 with no samples)
+uint32_t latencyPercentileUs(const LatencyHistogram& histogram, uint8_t percentile);
+
+#endif // SCHEDULER_LATENCY_H
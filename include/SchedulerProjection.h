@@ -0,0 +1,25 @@
+#ifndef SCHEDULER_PROJECTION_H
+#define SCHEDULER_PROJECTION_H
+
+#include <Arduino.h>
+#include "SchedulerSnapshot.h"
+
+#define SCHEDULER_UPCOMING_MAX 32   // Firings kept in the projection cache
+
+// One future firing of an event
+struct UpcomingFiring {
+  time_t time;           // UTC start of the firing
+  uint16_t duration;     // Seconds
+  uint8_t scheduleIdx;   // Index into the snapshot's schedules
+  uint16_t eventIdx;     // Index into that schedule's events
+  uint8_t relayMask;     // Relays of the schedule
+};
+
+// Next n firings after the current second, walking the snapshot's compiled
+// timeline and wrapping into the following days, as far as its recurrence
+// days reach. Indexes refer to snapshot, so keep it acquired while using
+// them. Returns the number written, which is less than n only if fewer
+// events fire within those days (or n > SCHEDULER_UPCOMING_MAX).
+uint16_t getUpcomingFirings(const SchedulerSnapshot& snapshot, time_t now, UpcomingFiring* out, uint16_t n);
+
+#endif // SCHEDULER_PROJECTION_H
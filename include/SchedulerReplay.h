@@ -0,0 +1,45 @@
+#ifndef SCHEDULER_REPLAY_H
+#define SCHEDULER_REPLAY_H
+
+#include <Arduino.h>
+#include "SchedulerSnapshot.h"
+
+// Receives every line of the firing log, "SIM,<utc>,<local>,<kind>,<details>"
+typedef void (*ReplayLogSink)(const char* line, void* context);
+
+// A scheduler state stepped through the executor's logic on a virtual clock
+// that jumps straight to the next due instant. The snapshot is private to
+// the replay, so the live executor is not affected.
+struct SchedulerReplay {
+  SchedulerSnapshot snapshot;
+  time_t now;               // Virtual clock (UTC)
+  time_t end;
+  uint8_t relays;           // Relays the plan held on after the last step
+  RelayPlanCursor relayCursor; // Place in the relay plan, as the executor keeps it
+  bool compiled;
+  uint32_t firings;         // Events stamped
+  uint32_t relayChanges;    // Relay plan mask changes
+  uint32_t recompiles;      // Day rollovers and UTC offset changes
+  uint32_t offsetChanges;   // DST transitions crossed
+  uint32_t logDigest;       // FNV-1a of the firing log, for comparing runs
+  uint32_t maxRecompileUs;  // Slowest day compile
+  ReplayLogSink sink;       // Optional
+  void* context;
+};
+
+// Copy source with every run stamp cleared, so earlier history does not
+// hide the first replayed day. Returns false if the event pool is full.
+bool beginSchedulerReplay(SchedulerReplay& replay, const SchedulerState& source, time_t start, uint16_t days,
+                          ReplayLogSink sink, void* context);
+
+// Whether the virtual clock has reached the end of the run
+bool schedulerReplayDone(const SchedulerReplay& replay);
+
+// One executor step (recompile if stale, relays, events) and the jump to the
+// next due instant. Returns an error message, or NULL on success.
+const char* stepSchedulerReplay(SchedulerReplay& replay);
+
+// Give back the replay's copy of the schedules and compiled buffers
+void endSchedulerReplay(SchedulerReplay& replay);
+
+#endif // SCHEDULER_REPLAY_H
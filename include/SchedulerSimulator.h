@@ -0,0 +1,47 @@
+#ifndef SCHEDULER_SIMULATOR_H
+#define SCHEDULER_SIMULATOR_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Scheduler simulator configuration
+#define SIMULATOR_MAX_DAYS 3660         // Ten years of virtual time per run
+#define SIMULATOR_STACK_SIZE 6144
+#define SIMULATOR_YIELD_STEPS 256       // Steps between yields to other tasks
+
+// Outcome of the last simulation run
+struct SimulationReport {
+  bool running;
+  bool completed;           // Ran to the end (false while running or after an error)
+  const char* error;        // Why the run stopped early (NULL if it did not)
+  time_t start;             // UTC start of the virtual clock
+  uint16_t days;
+  uint32_t steps;           // Executor steps taken (virtual wakes)
+  uint32_t firings;         // Events stamped
+  uint32_t relayChanges;    // Relay plan mask changes
+  uint32_t recompiles;      // Day rollovers and UTC offset changes
+  uint32_t offsetChanges;   // DST transitions crossed
+  uint32_t logDigest;       // FNV-1a of the firing log, for comparing runs
+  uint32_t wallUs;          // Real time the run took
+  uint32_t maxStepUs;       // Slowest executor step
+  uint32_t maxRecompileUs;  // Slowest day compile
+};
+
+// Replay the published schedules on a virtual clock from start (UTC) for
+// the given number of days, in a background task. The executor's own step
+// functions run against a private snapshot and relay changes go to a log
+// instead of the outputs, so the live scheduler is not affected. With echo
+// each firing and relay change is printed to the serial port.
+bool startSchedulerSimulation(time_t start, uint16_t days, bool echo);
+
+// Copy of the report of the current or last run
+SimulationReport getSimulationReport();
+
+// Serial "simulate <days> [YYYY-MM-DD] [log]" command
+void handleSimulateCommand(const String& args);
+
+// API handlers: POST starts a run (?days=N&start=YYYY-MM-DD), GET reports it
+void handleStartSimulation(AsyncWebServerRequest *request);
+void handleGetSimulation(AsyncWebServerRequest *request);
+
+#endif // SCHEDULER_SIMULATOR_H
@@ -0,0 +1,68 @@
+#ifndef SCHEDULER_SNAPSHOT_H
+#define SCHEDULER_SNAPSHOT_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+#include "SchedulerTimeline.h"
+#include "RelayPlan.h"
+#include "Recurrence.h"
+
+#define SCHEDULER_PUBLISH_TIMEOUT_MS 1000   // Longest an editor waits for readers to release the spare buffer
+#define SCHEDULER_RECOMPILE_RETRY_MS 100    // Executor retry when an editor holds the buffer at midnight
+
+// Published copy of schedulerState. Editors only ever change schedulerState
+// and then publish it; once published a snapshot is never modified by them.
+// The executor is the only writer of the event run stamps inside it (each
+// a single word, see markEventRun), and carries them into a new copy before
+// that copy becomes visible.
+struct SchedulerSnapshot {
+  SchedulerState state;
+  SchedulerTimeline timeline;
+  RecurrenceDays recurrence; // Which rules match on the days around planDay
+  RelayPlan relayPlan;       // Merged per-relay on intervals of planDay
+  uint32_t planDay;          // UTC epoch day the snapshot was compiled for
+  uint32_t generation;       // Incremented on every publish
+  bool persist;              // Executor saves this generation when it adopts it
+};
+
+// Copy source into the spare buffer, compiled for the scheduler's current
+// day. Before the executor runs it becomes the current generation at once;
+// afterwards it is left pending and the executor makes it current on its
+// next wake. Blocks only until the spare buffer is free (no readers, and an
+// earlier pending copy adopted). Returns false
+// (and changes nothing the executor sees) on timeout or when the copy does
+// not fit the heap.
+bool publishSchedulerStateFrom(const SchedulerState& source, bool persist);
+bool publishSchedulerState(bool persist);   // From schedulerState
+
+// Executor side: publish held again, compiled for the day of now (at
+// midnight or after a UTC offset change), and move held to it. Never waits:
+// returns false if an editor is publishing, a pending copy has to be
+// adopted first, or the spare buffer is still being read.
+bool recompileSchedulerSnapshot(SchedulerSnapshot*& held, time_t now);
+
+// Build the timeline, recurrence days and relay plan of snapshot's state
+// for the day of now. Returns false if the timeline does not fit the heap.
+// Only the publisher (and the simulator, on its own snapshot) calls this.
+bool compileSchedulerSnapshot(SchedulerSnapshot& snapshot, time_t now);
+
+// Whether a snapshot has to be recompiled to be used at now
+bool schedulerSnapshotIsStale(const SchedulerSnapshot& snapshot, time_t now);
+
+// Reference to the latest generation (NULL before the first publish).
+// Never blocks; release it with releaseSchedulerSnapshot().
+SchedulerSnapshot* acquireSchedulerSnapshot();
+void releaseSchedulerSnapshot(SchedulerSnapshot* snapshot);
+
+// Executor side: make a pending editor copy current, carrying held's run
+// stamps into it before anyone else can see it, and move held to it (or to
+// the latest generation, before the executor first attached). Returns true
+// if a new generation was adopted.
+bool adoptSchedulerSnapshot(SchedulerSnapshot*& held);
+
+// Run day of an event in the latest generation (0 if never run or unknown)
+uint16_t getPublishedRunDay(int scheduleIdx, int eventIdx);
+
+uint32_t getSchedulerGeneration();
+
+#endif // SCHEDULER_SNAPSHOT_H
@@ -0,0 +1,63 @@
+#ifndef SCHEDULER_STORE_H
+#define SCHEDULER_STORE_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+
+// Binary schedule store configuration
+#define SCHEDULER_STORE_FILE "/scheduler.bin"
+#define SCHEDULER_STORE_TEMP_FILE "/scheduler.tmp"
+#define SCHEDULER_STORE_MAGIC 0x44484353   // "SCHD"
+#define SCHEDULER_STORE_VERSION 1          // Bump whenever the record layout in SchedulerStore.cpp changes
+#define SCHEDULER_STORE_HEADER_SIZE 16     // magic, version, headerSize, payloadSize, crc32
+#define SCHEDULER_RUNS_FILE "/scheduler.runs"  // Run stamps journaled since the store was saved
+#define SCHEDULER_RUNS_COMPACT 256         // Journal records before the store is saved again
+
+// File header, followed by payloadSize bytes covered by crc32. Every field
+// of the file is written little-endian one by one (see SchedulerStore.cpp),
+// so the format does not depend on how the compiler lays out the structs.
+struct SchedulerStoreHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t headerSize;       // SCHEDULER_STORE_HEADER_SIZE when written
+  uint32_t payloadSize;
+  uint32_t crc32;
+};
+
+// Timings of the most recent load and save, for comparing against the JSON path
+struct SchedulerStoreStats {
+  uint32_t lastLoadUs;
+  uint32_t lastSaveUs;
+  uint32_t lastBytesWritten;
+  uint32_t saveCount;
+  uint32_t runRecords;       // Run stamps in the journal
+  uint32_t runAppends;       // Journal appends since boot
+};
+
+// An event that fired, by position in the state it fired in
+struct SchedulerRunRef {
+  uint8_t scheduleIdx;
+  uint16_t eventIdx;
+};
+
+// Load state from the binary store, with the run stamps journaled since it
+// was saved. Returns false if there is no valid store (missing file, wrong
+// version or CRC mismatch) and leaves state empty in that case.
+bool loadSchedulerStore(SchedulerState& state);
+
+// Write state to a temp file and rename it over the store. The journal is
+// dropped afterwards, so state must carry the newest run stamps (the
+// executor's generation).
+bool saveSchedulerStore(const SchedulerState& state);
+
+// Append the run stamps of count fired events of state to the journal,
+// one small record each, instead of rewriting the store for every firing.
+// Returns false once the journal holds SCHEDULER_RUNS_COMPACT records (or
+// the append failed); the caller then saves the store, which folds the
+// stamps in and starts the journal over.
+bool appendSchedulerRuns(const SchedulerState& state, const SchedulerRunRef* runs, uint16_t count);
+
+// Copy of the current timings
+SchedulerStoreStats getSchedulerStoreStats();
+
+#endif // SCHEDULER_STORE_H
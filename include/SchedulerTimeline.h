@@ -0,0 +1,30 @@
+#ifndef SCHEDULER_TIMELINE_H
+#define SCHEDULER_TIMELINE_H
+
+#include <Arduino.h>
+#include "Scheduler.h"
+
+// One compiled firing slot: event eventIdx of schedule scheduleIdx starts at secondOfDay
+struct TimelineEntry {
+  uint32_t secondOfDay;  // UTC seconds since midnight (0-86399)
+  uint8_t scheduleIdx;   // Index into the state's schedules
+  uint16_t eventIdx;     // Index into that schedule's events
+};
+
+// All events of all active schedules, sorted by secondOfDay.
+// Built once per published state, so the executor never scans every event.
+// The entry array is sized to the state and reused by the next build.
+struct SchedulerTimeline {
+  TimelineEntry* entries;
+  uint16_t count;
+  uint16_t capacity;
+};
+
+// Compile the timeline for a scheduler state. Returns false (and leaves the
+// timeline empty) if the entries do not fit in the heap.
+bool buildSchedulerTimeline(const SchedulerState& state, SchedulerTimeline& timeline);
+
+// Index of the first entry at or after secondOfDay (count if there is none)
+uint16_t findFirstTimelineEntry(const SchedulerTimeline& timeline, uint32_t secondOfDay);
+
+#endif // SCHEDULER_TIMELINE_H
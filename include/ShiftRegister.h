@@ -0,0 +1,36 @@
+#ifndef SHIFT_REGISTER_H
+#define SHIFT_REGISTER_H
+
+#include <Arduino.h>
+
+// Shift register configuration
+#define SH595_FRAME_BYTES 3   // Relay byte, digit select byte, segment byte
+
+// Pin access behind the shift register driver. Masks are GPIO bit masks
+// (1 << pin); all 74HC595 and 74HC165 pins are below GPIO 32. The default
+// backend writes the GPIO W1TS/W1TC registers and reads GPIO_IN directly;
+// another backend (e.g. a host mock recording the bit sequence) can be
+// installed with setShiftRegisterBackend().
+struct ShiftRegisterBackend {
+  void (*setPins)(uint32_t mask);     // Drive the pins in mask high
+  void (*clearPins)(uint32_t mask);   // Drive the pins in mask low
+  uint32_t (*readPins)();             // Levels of GPIO 0-31
+};
+
+// Install a pin backend (NULL restores the register backend)
+void setShiftRegisterBackend(const ShiftRegisterBackend* backend);
+
+// Clock bytes into the 74HC595 chain, first byte first and each MSB first,
+// then latch them to the outputs. The pins must be outputs already. Callers
+// share the chain through the display refresh lock (see DisplayRefresh.h).
+void shiftOut595(const uint8_t* bytes, uint8_t count);
+
+// shiftOut595() for interrupt context: in IRAM, and always through the GPIO
+// registers, whatever backend is installed
+void shiftOut595FromIsr(const uint8_t* bytes, uint8_t count);
+
+// Load the 74HC165 and clock its 8 inputs in, first bit as MSB. Inputs are
+// active low, so a set bit is an active input.
+uint8_t shiftIn165();
+
+#endif // SHIFT_REGISTER_H
@@ -3,6 +3,7 @@
 
 #include <time.h>
 #include <ESPAsyncWebServer.h>
+#include "UtcOffset.h"   // getUtcOffsetSeconds(), makeUtcTime()
 
 // Initializes the time manager (sets up NTP and starts the background task)
 void initTimeManager();
@@ -0,0 +1,17 @@
+#ifndef UTC_OFFSET_H
+#define UTC_OFFSET_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// UTC offset of the current timezone at instant now (local = UTC + offset).
+// Cached until the next DST transition or the next invalidateUtcOffsetCache().
+int32_t getUtcOffsetSeconds(time_t now);
+
+// Drop the cached offset; call after changing TZ
+void invalidateUtcOffsetCache();
+
+// Seconds since the epoch for a broken-down UTC time (timegm without touching TZ)
+time_t makeUtcTime(const struct tm* tm);
+
+#endif // UTC_OFFSET_H
@@ -0,0 +1,107 @@
+// Arduino.h (native host)
+// The subset of the Arduino core the host-built sources use. Time comes
+// from the host's monotonic clock; FreeRTOS runs on pthreads.
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+long random(long max);
+long random(long min, long max);
+
+// Not in every C library; the ESP-IDF newlib has it
+static inline size_t nativeStrlcpy(char* dst, const char* src, size_t size) {
+  size_t length = strlen(src);
+  if (size > 0) {
+    size_t count = length < size - 1 ? length : size - 1;
+    memcpy(dst, src, count);
+    dst[count] = 0;
+  }
+  return length;
+}
+#define strlcpy nativeStrlcpy
+
+class String {
+public:
+  String() {}
+  String(const char* text) : value(text ? text : "") {}
+  String(const std::string& text) : value(text) {}
+  String(char c) : value(1, c) {}
+  String(int number) : value(std::to_string(number)) {}
+  String(unsigned int number) : value(std::to_string(number)) {}
+  String(long number) : value(std::to_string(number)) {}
+  String(unsigned long number) : value(std::to_string(number)) {}
+
+  const char* c_str() const { return value.c_str(); }
+  size_t length() const { return value.size(); }
+  bool isEmpty() const { return value.empty(); }
+  void reserve(size_t size) { value.reserve(size); }
+  bool concat(const char* text, size_t length) { value.append(text, length); return true; }
+  long toInt() const { return atol(value.c_str()); }
+  void trim();
+  int indexOf(char c, unsigned int from = 0) const;
+  String substring(unsigned int from, unsigned int to = 0xFFFFFFFF) const;
+  bool startsWith(const String& prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+
+  bool operator==(const String& other) const { return value == other.value; }
+  bool operator==(const char* other) const { return value == (other ? other : ""); }
+  bool operator!=(const String& other) const { return value != other.value; }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  String& operator+=(const String& other) { value += other.value; return *this; }
+  String& operator+=(const char* other) { value += other ? other : ""; return *this; }
+  String& operator+=(char c) { value += c; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a.value + b.value); }
+  friend String operator+(const String& a, const char* b) { return String(a.value + (b ? b : "")); }
+  friend String operator+(const char* a, const String& b) { return String((a ? a : "") + b.value); }
+
+private:
+  std::string value;
+};
+
+// Serial goes to stdout
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) {}
+  size_t print(const char* text) { return fputs(text, stdout) >= 0 ? strlen(text) : 0; }
+  size_t print(const String& text) { return print(text.c_str()); }
+  size_t println(const char* text = "") { return print(text) + print("\n"); }
+  size_t println(const String& text) { return println(text.c_str()); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  void flush() { fflush(stdout); }
+};
+extern HardwareSerial Serial;
+
+// Heap figures of the target. The free heap is whatever the test sets
+// (nativeSetFreeHeap), so heap-reserve paths can be exercised.
+class EspClass {
+public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap() { return getFreeHeap(); }
+  uint32_t getMaxAllocHeap() { return getFreeHeap(); }
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getCycleCount() { return micros() * 240; }
+};
+extern EspClass ESP;
+
+#endif // NATIVE_ARDUINO_H
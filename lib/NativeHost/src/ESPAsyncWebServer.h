@@ -0,0 +1,17 @@
+// ESPAsyncWebServer.h (native host)
+// Only the names the shared headers mention. Handlers are not built on the
+// host, so none of these types needs a body.
+#ifndef NATIVE_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_ESP_ASYNC_WEB_SERVER_H
+
+#include <Arduino.h>
+
+class AsyncWebServer;
+class AsyncWebServerRequest;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+struct AwsFrameInfo;
+
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+
+#endif // NATIVE_ESP_ASYNC_WEB_SERVER_H
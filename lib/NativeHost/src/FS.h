@@ -0,0 +1,63 @@
+// FS.h (native host)
+// In-memory file system with the SPIFFS calls the store uses. Every write
+// is counted, so tests can report the bytes a save puts on flash.
+#ifndef NATIVE_FS_H
+#define NATIVE_FS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+struct NativeFileData {
+  std::vector<uint8_t> bytes;
+};
+
+class File {
+public:
+  File() : position_(0), writable(false) {}
+  File(std::shared_ptr<NativeFileData> data, const String& path, bool writable, size_t position)
+    : data(data), path(path), position_(position), writable(writable) {}
+
+  operator bool() const { return data != nullptr; }
+  size_t size() const { return data ? data->bytes.size() : 0; }
+  size_t position() const { return position_; }
+  int available() const { return data ? (int)(data->bytes.size() - position_) : 0; }
+  const char* name() const { return path.c_str(); }
+  bool seek(uint32_t position);
+  size_t read(uint8_t* buffer, size_t size);
+  int read();
+  size_t readBytes(char* buffer, size_t size) { return read((uint8_t*)buffer, size); }
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t write(uint8_t byte) { return write(&byte, 1); }
+  void close() { data.reset(); }
+
+private:
+  std::shared_ptr<NativeFileData> data;
+  String path;
+  size_t position_;
+  bool writable;
+};
+
+namespace fs {
+class FS {
+public:
+  bool begin(bool formatOnFail = false) { return true; }
+  File open(const char* path, const char* mode = FILE_READ);
+  File open(const String& path, const char* mode = FILE_READ) { return open(path.c_str(), mode); }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  size_t totalBytes() { return 1441792; }   // huge_app.csv SPIFFS partition
+  size_t usedBytes();
+};
+}  // namespace fs
+
+using fs::FS;
+
+#endif // NATIVE_FS_H
@@ -0,0 +1,406 @@
+// NativeHost.cpp
+// Host implementations of the Arduino, FreeRTOS and SPIFFS stand-ins, and
+// of the debug output functions Utils.cpp provides on the device.
+#include "NativeHost.h"
+#include <FS.h>
+#include <SPIFFS.h>
+#include <errno.h>
+#include <malloc.h>
+#include <algorithm>
+#include <map>
+#include <chrono>
+#include "Utils.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+fs::FS SPIFFS;
+
+static uint32_t freeHeap = 200000;
+static bool debugOutput = getenv("NATIVE_DEBUG") != NULL;
+
+// ---- Time --------------------------------------------------------------
+
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long millis() {
+  return micros() / 1000;
+}
+
+void delay(uint32_t ms) {
+  vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+long random(long max) {
+  return max > 0 ? rand() % max : 0;
+}
+
+long random(long min, long max) {
+  return max > min ? min + random(max - min) : min;
+}
+
+// ---- String ------------------------------------------------------------
+
+void String::trim() {
+  size_t first = value.find_first_not_of(" \t\r\n");
+  size_t last = value.find_last_not_of(" \t\r\n");
+  value = first == std::string::npos ? std::string() : value.substr(first, last - first + 1);
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t position = value.find(c, from);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from >= value.size()) return String();
+  return String(value.substr(from, to == 0xFFFFFFFF ? std::string::npos : to - from));
+}
+
+size_t HardwareSerial::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vprintf(format, args);
+  va_end(args);
+  return written > 0 ? written : 0;
+}
+
+// ---- Heap --------------------------------------------------------------
+
+uint32_t EspClass::getFreeHeap() {
+  return freeHeap;
+}
+
+void nativeSetFreeHeap(uint32_t bytes) {
+  freeHeap = bytes;
+}
+
+size_t nativeHeapInUse() {
+  return mallinfo2().uordblks;
+}
+
+// ---- Debug output (Utils.cpp on the device) ----------------------------
+
+void nativeSetDebugOutput(bool enabled) {
+  debugOutput = enabled;
+}
+
+void debugPrint(const char* message) {
+  if (debugOutput) fputs(message, stdout);
+}
+
+void debugPrintln(const char* message) {
+  if (debugOutput) puts(message);
+}
+
+void debugPrintf(const char* format, ...) {
+  if (!debugOutput) return;
+  va_list args;
+  va_start(args, format);
+  vprintf(format, args);
+  va_end(args);
+}
+
+// ---- FreeRTOS ----------------------------------------------------------
+
+struct NativeTask {
+  pthread_mutex_t lock;
+  pthread_cond_t notify;
+  uint32_t notifications;
+  TaskFunction_t function;
+  void* parameter;
+};
+
+struct NativeSemaphore {
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  uint32_t count;
+};
+
+static thread_local NativeTask* currentTask = NULL;
+
+static NativeTask* newTask() {
+  NativeTask* task = new NativeTask();
+  pthread_mutex_init(&task->lock, NULL);
+  pthread_cond_init(&task->notify, NULL);
+  return task;
+}
+
+// Absolute CLOCK_REALTIME deadline ticks milliseconds from now
+static timespec deadlineAfter(TickType_t ticks) {
+  timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += ticks / 1000;
+  deadline.tv_nsec += (long)(ticks % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+  return deadline;
+}
+
+static void* runTask(void* argument) {
+  currentTask = (NativeTask*)argument;
+  currentTask->function(currentTask->parameter);
+  return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameter,
+                                   UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+  NativeTask* task = newTask();
+  task->function = function;
+  task->parameter = parameter;
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, runTask, task) != 0) {
+    delete task;
+    return pdFAIL;
+  }
+  pthread_detach(thread);
+  if (handle) *handle = task;
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == NULL) {
+    pthread_exit(NULL);
+  }
+}
+
+void vTaskDelay(TickType_t ticks) {
+  timespec pause = {(time_t)(ticks / 1000), (long)(ticks % 1000) * 1000000L};
+  while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+  }
+}
+
+void vTaskDelayUntil(TickType_t* previousWake, TickType_t period) {
+  *previousWake += period;
+  TickType_t now = xTaskGetTickCount();
+  if ((int32_t)(*previousWake - now) > 0) {
+    vTaskDelay(*previousWake - now);
+  }
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)millis();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  if (currentTask == NULL) {
+    currentTask = newTask();   // Threads the test started itself
+  }
+  return currentTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  pthread_mutex_lock(&task->lock);
+  task->notifications++;
+  pthread_cond_signal(&task->notify);
+  pthread_mutex_unlock(&task->lock);
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  NativeTask* task = xTaskGetCurrentTaskHandle();
+  timespec deadline = deadlineAfter(ticks);
+  pthread_mutex_lock(&task->lock);
+  while (task->notifications == 0 && ticks != 0) {
+    if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&task->notify, &task->lock);
+    } else if (pthread_cond_timedwait(&task->notify, &task->lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  uint32_t value = task->notifications;
+  if (value > 0) {
+    task->notifications = clearOnExit ? 0 : value - 1;
+  }
+  pthread_mutex_unlock(&task->lock);
+  return value;
+}
+
+static SemaphoreHandle_t newSemaphore(uint32_t count) {
+  NativeSemaphore* semaphore = new NativeSemaphore();
+  pthread_mutex_init(&semaphore->lock, NULL);
+  pthread_cond_init(&semaphore->changed, NULL);
+  semaphore->count = count;
+  return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return newSemaphore(1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return newSemaphore(0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+  timespec deadline = deadlineAfter(ticks);
+  pthread_mutex_lock(&semaphore->lock);
+  while (semaphore->count == 0) {
+    if (ticks == 0) {
+      break;
+    } else if (ticks == portMAX_DELAY) {
+      pthread_cond_wait(&semaphore->changed, &semaphore->lock);
+    } else if (pthread_cond_timedwait(&semaphore->changed, &semaphore->lock, &deadline) == ETIMEDOUT) {
+      break;
+    }
+  }
+  BaseType_t taken = semaphore->count > 0 ? pdTRUE : pdFALSE;
+  if (taken) {
+    semaphore->count--;
+  }
+  pthread_mutex_unlock(&semaphore->lock);
+  return taken;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  pthread_mutex_lock(&semaphore->lock);
+  BaseType_t given = semaphore->count == 0 ? pdTRUE : pdFALSE;
+  semaphore->count = 1;
+  pthread_cond_signal(&semaphore->changed);
+  pthread_mutex_unlock(&semaphore->lock);
+  return given;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  pthread_cond_destroy(&semaphore->changed);
+  pthread_mutex_destroy(&semaphore->lock);
+  delete semaphore;
+}
+
+// ---- GPIO --------------------------------------------------------------
+
+static uint32_t gpioOutputs = 0;
+static const NativeGpioDevice* gpioDevice = NULL;
+
+void nativeSetGpioDevice(const NativeGpioDevice* device) {
+  gpioDevice = device;
+}
+
+uint32_t nativeGpioOutputs() {
+  return gpioOutputs;
+}
+
+static void writeGpioOutputs(uint32_t levels) {
+  gpioOutputs = levels;
+  if (gpioDevice && gpioDevice->outputsChanged) {
+    gpioDevice->outputsChanged(levels);
+  }
+}
+
+void nativeGpioSet(uint32_t mask) {
+  writeGpioOutputs(gpioOutputs | mask);
+}
+
+void nativeGpioClear(uint32_t mask) {
+  writeGpioOutputs(gpioOutputs & ~mask);
+}
+
+void nativeRegWrite(uint32_t reg, uint32_t value) {
+  switch (reg) {
+    case GPIO_OUT_REG: writeGpioOutputs(value); break;
+    case GPIO_OUT_W1TS_REG: nativeGpioSet(value); break;
+    case GPIO_OUT_W1TC_REG: nativeGpioClear(value); break;
+    default: break;
+  }
+}
+
+uint32_t nativeRegRead(uint32_t reg) {
+  if (reg == GPIO_OUT_REG) return gpioOutputs;
+  if (reg == GPIO_IN_REG && gpioDevice && gpioDevice->inputs) return gpioDevice->inputs(gpioOutputs);
+  return 0;
+}
+
+// ---- SPIFFS ------------------------------------------------------------
+
+static std::map<std::string, std::shared_ptr<NativeFileData>> files;
+static size_t bytesWritten = 0;
+
+void nativeFormatSpiffs() {
+  files.clear();
+  bytesWritten = 0;
+}
+
+size_t nativeSpiffsBytesWritten() {
+  return bytesWritten;
+}
+
+bool File::seek(uint32_t position) {
+  if (!data || position > data->bytes.size()) return false;
+  position_ = position;
+  return true;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!data) return 0;
+  size_t count = std::min(size, data->bytes.size() - position_);
+  memcpy(buffer, data->bytes.data() + position_, count);
+  position_ += count;
+  return count;
+}
+
+int File::read() {
+  uint8_t byte;
+  return read(&byte, 1) == 1 ? byte : -1;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!data || !writable) return 0;
+  if (position_ + size > data->bytes.size()) {
+    data->bytes.resize(position_ + size);
+  }
+  memcpy(data->bytes.data() + position_, buffer, size);
+  position_ += size;
+  bytesWritten += size;
+  return size;
+}
+
+namespace fs {
+
+File FS::open(const char* path, const char* mode) {
+  auto found = files.find(path);
+  if (mode[0] == 'r') {
+    return found == files.end() ? File() : File(found->second, path, false, 0);
+  }
+  if (found == files.end() || mode[0] == 'w') {
+    files[path] = std::make_shared<NativeFileData>();
+  }
+  std::shared_ptr<NativeFileData> data = files[path];
+  return File(data, path, true, data->bytes.size());
+}
+
+bool FS::exists(const char* path) {
+  return files.count(path) > 0;
+}
+
+bool FS::remove(const char* path) {
+  return files.erase(path) > 0;
+}
+
+// Like SPIFFS, renaming over an existing file fails
+bool FS::rename(const char* from, const char* to) {
+  auto found = files.find(from);
+  if (found == files.end() || files.count(to) > 0) {
+    return false;
+  }
+  files[to] = found->second;
+  files.erase(found);
+  return true;
+}
+
+size_t FS::usedBytes() {
+  size_t used = 0;
+  for (auto& file : files) {
+    used += file.second->bytes.size();
+  }
+  return used;
+}
+
+}  // namespace fs
@@ -0,0 +1,42 @@
+// NativeHost.h
+// Test controls of the host stand-ins
+#ifndef NATIVE_HOST_H
+#define NATIVE_HOST_H
+
+#include <Arduino.h>
+
+// What ESP.getFreeHeap() reports (default: a freshly booted ESP32 with WiFi up)
+void nativeSetFreeHeap(uint32_t bytes);
+
+// Bytes currently allocated from the host heap, for peak measurements
+size_t nativeHeapInUse();
+
+// Drop every file of the in-memory SPIFFS
+void nativeFormatSpiffs();
+
+// Bytes written to the in-memory SPIFFS since the last format
+size_t nativeSpiffsBytesWritten();
+
+// Show debugPrint output (quiet by default; NATIVE_DEBUG=1 also enables it)
+void nativeSetDebugOutput(bool enabled);
+
+// Emulated GPIO 0-31 behind REG_WRITE/REG_READ. A device model sees every
+// change of the output levels and supplies the input levels, so a test can
+// put e.g. a shift register chain on the pins.
+struct NativeGpioDevice {
+  void (*outputsChanged)(uint32_t levels);   // After every output register write
+  uint32_t (*inputs)(uint32_t outputs);      // Levels GPIO_IN reads
+};
+
+// Attach a device model (NULL detaches it; inputs then read as 0)
+void nativeSetGpioDevice(const NativeGpioDevice* device);
+
+// Current output levels
+uint32_t nativeGpioOutputs();
+
+// Drive output pins as the GPIO registers would (for backends of drivers
+// that take one; REG_WRITE does the same)
+void nativeGpioSet(uint32_t mask);
+void nativeGpioClear(uint32_t mask);
+
+#endif // NATIVE_HOST_H
@@ -0,0 +1,9 @@
+// SPIFFS.h (native host)
+#ifndef NATIVE_SPIFFS_H
+#define NATIVE_SPIFFS_H
+
+#include "FS.h"
+
+extern fs::FS SPIFFS;
+
+#endif // NATIVE_SPIFFS_H
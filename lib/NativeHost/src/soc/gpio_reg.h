@@ -0,0 +1,11 @@
+// soc/gpio_reg.h (native host)
+// The GPIO registers the firmware touches, at their ESP32 addresses
+#ifndef NATIVE_GPIO_REG_H
+#define NATIVE_GPIO_REG_H
+
+#define GPIO_OUT_REG 0x3FF44004
+#define GPIO_OUT_W1TS_REG 0x3FF44008
+#define GPIO_OUT_W1TC_REG 0x3FF4400C
+#define GPIO_IN_REG 0x3FF4403C
+
+#endif // NATIVE_GPIO_REG_H
@@ -0,0 +1,14 @@
+// soc/soc.h (native host)
+// Register access goes to the emulated GPIO of NativeHost.cpp
+#ifndef NATIVE_SOC_H
+#define NATIVE_SOC_H
+
+#include <stdint.h>
+
+void nativeRegWrite(uint32_t reg, uint32_t value);
+uint32_t nativeRegRead(uint32_t reg);
+
+#define REG_WRITE(reg, value) nativeRegWrite((reg), (value))
+#define REG_READ(reg) nativeRegRead(reg)
+
+#endif // NATIVE_SOC_H
@@ -0,0 +1,306 @@
+// AnalogCalibration.cpp
+// Reference points per input are compiled into piecewise-linear segments
+// with fixed-point slopes, so a conversion is a segment lookup, one 64-bit
+// multiply and a shift instead of a chain of float operations.
+#include "AnalogCalibration.h"
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+#include "Utils.h"
+
+// Compiled curve of one input; segment i starts at start[i] and the first
+// and last segments extend past the outer points
+struct CalibrationCurve {
+  uint8_t segmentCount;
+  uint32_t start[CALIBRATION_MAX_POINTS - 1];
+  int32_t base[CALIBRATION_MAX_POINTS - 1];    // Value at start
+  int32_t slope[CALIBRATION_MAX_POINTS - 1];   // Value per count << CALIBRATION_SLOPE_BITS
+};
+
+#define CALIBRATION_FULL_SCALE (4095UL << ANALOG_FRACTION_BITS)
+#define CALIBRATION_MAX_VALUE 100000             // Largest |mV| or |uA| accepted
+
+static const char* inputNames[ANALOG_INPUT_COUNT] = {"V1", "V2", "I1", "I2", "I3", "I4"};
+static InputCalibration calibrations[ANALOG_INPUT_COUNT];
+static CalibrationCurve curves[ANALOG_INPUT_COUNT];
+static portMUX_TYPE calibrationMux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool isVoltageInput(uint8_t input) {
+  return input == AIN_V1 || input == AIN_V2;
+}
+
+// Factory curves of the board: 0-10 V inputs through a 5.3:1 divider read
+// 0.6 V low, 0-20 mA inputs across 91 ohm read 120 mV low (3.3 V over 4096 counts)
+static int32_t factoryValue(uint8_t input, uint32_t counts) {
+  // Rounded to the nearest mV / uA
+  const uint64_t fullScale = 4096ULL << ANALOG_FRACTION_BITS;
+  if (isVoltageInput(input)) {
+    return 600 + (int32_t)(((uint64_t)counts * 3300 * 53 + fullScale * 5) / (fullScale * 10));
+  }
+  return (int32_t)(((uint64_t)counts * 3300000 + 120000 * fullScale + fullScale * 91 / 2) / (fullScale * 91));
+}
+
+// Points the curve is built from: the input's own, the factory curve's
+// ends shifted by a single point's offset, or the plain factory curve
+static uint8_t effectivePoints(uint8_t input, const InputCalibration& calibration, CalibrationPoint* points) {
+  if (calibration.pointCount >= 2) {
+    memcpy(points, calibration.points, calibration.pointCount * sizeof(CalibrationPoint));
+    return calibration.pointCount;
+  }
+
+  int32_t offset = 0;
+  if (calibration.pointCount == 1) {
+    offset = calibration.points[0].value - factoryValue(input, calibration.points[0].counts);
+  }
+  points[0].counts = 0;
+  points[0].value = factoryValue(input, 0) + offset;
+  points[1].counts = CALIBRATION_FULL_SCALE;
+  points[1].value = factoryValue(input, CALIBRATION_FULL_SCALE) + offset;
+  return 2;
+}
+
+static void compileCurve(uint8_t input, const InputCalibration& calibration, CalibrationCurve& curve) {
+  CalibrationPoint points[CALIBRATION_MAX_POINTS];
+  uint8_t count = effectivePoints(input, calibration, points);
+
+  curve.segmentCount = count - 1;
+  for (uint8_t i = 0; i + 1 < count; i++) {
+    curve.start[i] = points[i].counts;
+    curve.base[i] = points[i].value;
+    curve.slope[i] = (int32_t)(((int64_t)(points[i + 1].value - points[i].value) << CALIBRATION_SLOPE_BITS) /
+                               (int64_t)(points[i + 1].counts - points[i].counts));
+  }
+}
+
+// Compile one input and swap it in
+static void recompileInput(uint8_t input) {
+  CalibrationCurve curve;
+  portENTER_CRITICAL(&calibrationMux);
+  InputCalibration calibration = calibrations[input];
+  portEXIT_CRITICAL(&calibrationMux);
+
+  compileCurve(input, calibration, curve);
+
+  portENTER_CRITICAL(&calibrationMux);
+  curves[input] = curve;
+  portEXIT_CRITICAL(&calibrationMux);
+}
+
+static int32_t evaluateCurve(const CalibrationCurve& curve, uint32_t counts) {
+  uint8_t segment = 0;
+  while (segment + 1 < curve.segmentCount && counts >= curve.start[segment + 1]) {
+    segment++;
+  }
+  int64_t delta = (int64_t)counts - curve.start[segment];
+  int64_t half = 1LL << (CALIBRATION_SLOPE_BITS - 1);
+  return curve.base[segment] + (int32_t)((delta * curve.slope[segment] + half) >> CALIBRATION_SLOPE_BITS);
+}
+
+void convertAnalogInputs(const uint32_t counts[ANALOG_INPUT_COUNT], int32_t values[ANALOG_INPUT_COUNT]) {
+  portENTER_CRITICAL(&calibrationMux);
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+    values[i] = evaluateCurve(curves[i], counts[i]);
+  }
+  portEXIT_CRITICAL(&calibrationMux);
+}
+
+int32_t convertAnalogInput(uint8_t input, uint32_t counts) {
+  if (input >= ANALOG_INPUT_COUNT) {
+    return 0;
+  }
+  portENTER_CRITICAL(&calibrationMux);
+  int32_t value = evaluateCurve(curves[input], counts);
+  portEXIT_CRITICAL(&calibrationMux);
+  return value;
+}
+
+bool addCalibrationPoint(uint8_t input, uint32_t counts, int32_t value) {
+  if (input >= ANALOG_INPUT_COUNT || counts > CALIBRATION_FULL_SCALE ||
+      value > CALIBRATION_MAX_VALUE || value < -CALIBRATION_MAX_VALUE) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&calibrationMux);
+  InputCalibration& calibration = calibrations[input];
+
+  // A new reference replaces points less than one ADC count away
+  const uint32_t sameCounts = 1 << ANALOG_FRACTION_BITS;
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < calibration.pointCount; i++) {
+    uint32_t existing = calibration.points[i].counts;
+    uint32_t distance = counts > existing ? counts - existing : existing - counts;
+    if (distance >= sameCounts) {
+      calibration.points[kept++] = calibration.points[i];
+    }
+  }
+  calibration.pointCount = kept;
+
+  bool stored = false;
+  if (calibration.pointCount < CALIBRATION_MAX_POINTS) {
+    // Insert in counts order
+    uint8_t i = calibration.pointCount++;
+    while (i > 0 && calibration.points[i - 1].counts > counts) {
+      calibration.points[i] = calibration.points[i - 1];
+      i--;
+    }
+    calibration.points[i].counts = counts;
+    calibration.points[i].value = value;
+    stored = true;
+  }
+  portEXIT_CRITICAL(&calibrationMux);
+
+  if (stored) {
+    recompileInput(input);
+  }
+  return stored;
+}
+
+void resetCalibration(uint8_t input) {
+  if (input >= ANALOG_INPUT_COUNT) {
+    return;
+  }
+  portENTER_CRITICAL(&calibrationMux);
+  calibrations[input].pointCount = 0;
+  portEXIT_CRITICAL(&calibrationMux);
+  recompileInput(input);
+}
+
+InputCalibration getCalibration(uint8_t input) {
+  InputCalibration copy = {};
+  if (input < ANALOG_INPUT_COUNT) {
+    portENTER_CRITICAL(&calibrationMux);
+    copy = calibrations[input];
+    portEXIT_CRITICAL(&calibrationMux);
+  }
+  return copy;
+}
+
+void loadAnalogCalibration() {
+  memset(calibrations, 0, sizeof(calibrations));
+
+  File file;
+  if (SPIFFS.exists(CALIBRATION_FILE)) {
+    file = SPIFFS.open(CALIBRATION_FILE, FILE_READ);
+  }
+  if (file) {
+    DynamicJsonDocument doc(2048);
+    DeserializationError error = deserializeJson(doc, file);
+    file.close();
+
+    if (error) {
+      debugPrintf("ERROR: Failed to parse calibration JSON: %s\n", error.c_str());
+    } else {
+      for (uint8_t input = 0; input < ANALOG_INPUT_COUNT; input++) {
+        JsonArray points = doc[inputNames[input]];
+        for (JsonArray point : points) {
+          if (!addCalibrationPoint(input, point[0] | 0UL, point[1] | 0L)) {
+            debugPrintf("WARNING: Ignoring calibration point of %s\n", inputNames[input]);
+          }
+        }
+      }
+      debugPrintln("DEBUG: Analog calibration loaded");
+    }
+  } else {
+    debugPrintln("DEBUG: No calibration file, using factory curves");
+  }
+
+  for (uint8_t input = 0; input < ANALOG_INPUT_COUNT; input++) {
+    recompileInput(input);
+  }
+}
+
+bool saveAnalogCalibration() {
+  DynamicJsonDocument doc(2048);
+  for (uint8_t input = 0; input < ANALOG_INPUT_COUNT; input++) {
+    InputCalibration calibration = getCalibration(input);
+    JsonArray points = doc.createNestedArray(inputNames[input]);
+    for (uint8_t i = 0; i < calibration.pointCount; i++) {
+      JsonArray point = points.createNestedArray();
+      point.add(calibration.points[i].counts);
+      point.add(calibration.points[i].value);
+    }
+  }
+
+  File file = SPIFFS.open(CALIBRATION_FILE, FILE_WRITE);
+  if (!file) {
+    debugPrintln("ERROR: Failed to open calibration file for writing");
+    return false;
+  }
+  bool written = serializeJson(doc, file) > 0;
+  file.close();
+  if (!written) {
+    debugPrintln("ERROR: Failed to write calibration file");
+  }
+  return written;
+}
+
+static int8_t inputFromName(const String& name) {
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+    if (name == inputNames[i]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void handleGetCalibration(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Analog calibration");
+
+  uint32_t counts[ANALOG_INPUT_COUNT];
+  int32_t values[ANALOG_INPUT_COUNT];
+  getAnalogFiltered(counts);
+  convertAnalogInputs(counts, values);
+
+  DynamicJsonDocument doc(3072);
+  JsonArray inputs = doc.createNestedArray("inputs");
+  for (uint8_t input = 0; input < ANALOG_INPUT_COUNT; input++) {
+    InputCalibration calibration = getCalibration(input);
+    JsonObject inputObj = inputs.createNestedObject();
+    inputObj["name"] = inputNames[input];
+    inputObj["unit"] = isVoltageInput(input) ? "mV" : "uA";
+    inputObj["counts"] = counts[input];
+    inputObj["value"] = values[input];
+    inputObj["mode"] = calibration.pointCount == 0 ? "factory" : calibration.pointCount == 1 ? "offset" : "points";
+    JsonArray points = inputObj.createNestedArray("points");
+    for (uint8_t i = 0; i < calibration.pointCount; i++) {
+      JsonObject point = points.createNestedObject();
+      point["counts"] = calibration.points[i].counts;
+      point["value"] = calibration.points[i].value;
+    }
+  }
+
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
+
+void handleSetCalibration(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Analog calibration point");
+
+  int8_t input = request->hasParam("input") ? inputFromName(request->getParam("input")->value()) : -1;
+  if (input < 0) {
+    request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"input must be V1, V2 or I1-I4\"}");
+    return;
+  }
+
+  if (request->hasParam("reset") && request->getParam("reset")->value() == "1") {
+    resetCalibration(input);
+  } else if (request->hasParam("value")) {
+    // The reference goes with what the pipeline reads right now
+    uint32_t counts[ANALOG_INPUT_COUNT];
+    getAnalogFiltered(counts);
+    long value = request->getParam("value")->value().toInt();
+    if (!addCalibrationPoint(input, counts[input], value)) {
+      request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Value out of range or too many points\"}");
+      return;
+    }
+  } else {
+    request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"value or reset=1 required\"}");
+    return;
+  }
+
+  if (!saveAnalogCalibration()) {
+    request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Failed to save calibration\"}");
+    return;
+  }
+  request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Calibration updated\"}");
+}
@@ -0,0 +1,195 @@
+// AnalogPipeline.cpp
+// All analog inputs are sampled continuously at a fixed rate and every raw
+// count goes through an oversampling average, a median and an EMA before it
+// is published. The sampling task only wakes once per backend read. This
+// file holds the ADC backends and the API handlers; the filters and the task
+// are in AnalogPipelineCore.cpp.
+#include "AnalogPipeline.h"
+#include <ArduinoJson.h>
+#include "driver/adc.h"
+#include "PinConfig.h"
+#include "Utils.h"
+
+// Pins and ADC1 channels of the inputs, in AnalogInput order
+struct AnalogChannel {
+  uint8_t pin;
+  uint8_t adcChannel;
+};
+
+static const AnalogChannel analogChannels[ANALOG_INPUT_COUNT] = {
+  {AI_V1, 4}, {AI_V2, 5}, {AI_I1, 0}, {AI_I2, 3}, {AI_I3, 6}, {AI_I4, 7},
+};
+
+//---------------------------------------------------------------------
+// Continuous mode backend: the ADC digital controller converts the inputs
+// in a pattern and DMA fills the driver's ring buffer
+//---------------------------------------------------------------------
+static uint8_t inputForChannel[8];
+
+static bool dmaStart(uint32_t sampleRateHz) {
+  if (sampleRateHz < ANALOG_DMA_MIN_RATE_HZ) {
+    return false;
+  }
+
+  adc_digi_init_config_t init = {};
+  init.max_store_buf_size = ANALOG_READ_SAMPLES * sizeof(adc_digi_output_data_t) * 8;
+  init.conv_num_each_intr = ANALOG_READ_SAMPLES * sizeof(adc_digi_output_data_t);
+  memset(inputForChannel, 0xFF, sizeof(inputForChannel));
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+    init.adc1_chan_mask |= 1 << analogChannels[i].adcChannel;
+    inputForChannel[analogChannels[i].adcChannel] = i;
+  }
+  if (adc_digi_initialize(&init) != ESP_OK) {
+    return false;
+  }
+
+  adc_digi_pattern_config_t pattern[ANALOG_INPUT_COUNT];
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+    pattern[i].atten = ADC_ATTEN_DB_11;   // Same range as analogRead()
+    pattern[i].channel = analogChannels[i].adcChannel;
+    pattern[i].unit = 0;                  // ADC1
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_digi_configuration_t digi = {};
+  digi.conv_limit_en = true;              // Required on the ESP32
+  digi.conv_limit_num = 250;
+  digi.pattern_num = ANALOG_INPUT_COUNT;
+  digi.adc_pattern = pattern;
+  digi.sample_freq_hz = sampleRateHz;
+  digi.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  digi.format = ADC_DIGI_OUTPUT_FORMAT_TYPE1;
+
+  if (adc_digi_controller_configure(&digi) != ESP_OK || adc_digi_start() != ESP_OK) {
+    adc_digi_deinitialize();
+    return false;
+  }
+  return true;
+}
+
+static uint16_t dmaRead(AnalogSample* samples, uint16_t maxSamples, bool* overrun) {
+  uint8_t bytes[ANALOG_READ_SAMPLES * sizeof(adc_digi_output_data_t)];
+  uint32_t length = 0;
+  uint16_t wanted = maxSamples < ANALOG_READ_SAMPLES ? maxSamples : ANALOG_READ_SAMPLES;
+
+  esp_err_t result = adc_digi_read_bytes(bytes, wanted * sizeof(adc_digi_output_data_t), &length, 100);
+  if (result == ESP_ERR_INVALID_STATE) {
+    *overrun = true;   // The ring buffer was full; what it holds is still valid
+  } else if (result != ESP_OK) {
+    return 0;
+  }
+
+  uint16_t count = 0;
+  for (uint32_t i = 0; i + sizeof(adc_digi_output_data_t) <= length; i += sizeof(adc_digi_output_data_t)) {
+    const adc_digi_output_data_t* data = (const adc_digi_output_data_t*)&bytes[i];
+    uint8_t channel = data->type1.channel;
+    if (channel < 8 && inputForChannel[channel] != 0xFF) {
+      samples[count].input = inputForChannel[channel];
+      samples[count].raw = data->type1.data;
+      count++;
+    }
+  }
+  return count;
+}
+
+static void dmaStop() {
+  adc_digi_stop();
+  adc_digi_deinitialize();
+}
+
+static const AnalogBackend dmaBackend = {"continuous", dmaStart, dmaRead, dmaStop};
+
+//---------------------------------------------------------------------
+// Polled backend, for rates below the continuous mode's: one analogRead()
+// of every input per round, at most one round per tick
+//---------------------------------------------------------------------
+static TickType_t pollPeriod = 1;
+static TickType_t pollWake = 0;
+
+static bool pollStart(uint32_t sampleRateHz) {
+  uint32_t roundMs = 1000UL * ANALOG_INPUT_COUNT / sampleRateHz;
+  pollPeriod = pdMS_TO_TICKS(roundMs);
+  if (pollPeriod == 0) pollPeriod = 1;
+  pollWake = xTaskGetTickCount();
+  return true;
+}
+
+static uint16_t pollRead(AnalogSample* samples, uint16_t maxSamples, bool* overrun) {
+  vTaskDelayUntil(&pollWake, pollPeriod);
+  uint16_t count = 0;
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT && count < maxSamples; i++) {
+    samples[count].input = i;
+    samples[count].raw = analogRead(analogChannels[i].pin);
+    count++;
+  }
+  return count;
+}
+
+static void pollStop() {
+}
+
+static const AnalogBackend pollBackend = {"polled", pollStart, pollRead, pollStop};
+
+void startAnalogPipeline() {
+  startAnalogSampling(&dmaBackend, &pollBackend);
+}
+
+//---------------------------------------------------------------------
+// API handlers
+//---------------------------------------------------------------------
+void handleGetAnalogPipeline(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Analog pipeline status");
+
+  static const char* inputNames[ANALOG_INPUT_COUNT] = {"V1", "V2", "I1", "I2", "I3", "I4"};
+  AnalogPipelineConfig current = getAnalogPipelineConfig();
+  AnalogPipelineStats counters = getAnalogPipelineStats();
+  uint32_t values[ANALOG_INPUT_COUNT];
+  getAnalogFiltered(values);
+
+  DynamicJsonDocument doc(1536);
+  JsonObject configObj = doc.createNestedObject("config");
+  configObj["rate"] = current.sampleRateHz;
+  configObj["oversample"] = current.oversample;
+  configObj["median"] = current.medianWindow;
+  configObj["ema"] = current.emaShift;
+
+  doc["backend"] = counters.backend ? counters.backend : "stopped";
+  doc["sampleRateHz"] = counters.sampleRateHz;
+  doc["samples"] = counters.samples;
+  doc["overruns"] = counters.overruns;
+  doc["restarts"] = counters.restarts;
+
+  JsonArray inputs = doc.createNestedArray("inputs");
+  for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+    JsonObject input = inputs.createNestedObject();
+    input["name"] = inputNames[i];
+    input["raw"] = counters.lastRaw[i];
+    input["filtered"] = (float)values[i] / (1 << ANALOG_FRACTION_BITS);
+    input["outputs"] = counters.outputs[i];
+  }
+
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
+
+void handleSetAnalogPipeline(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Analog pipeline config");
+
+  // Missing parameters keep their value; out-of-range ones fail validation
+  AnalogPipelineConfig current = getAnalogPipelineConfig();
+  long rate = request->hasParam("rate") ? request->getParam("rate")->value().toInt() : current.sampleRateHz;
+  long oversample = request->hasParam("oversample") ? request->getParam("oversample")->value().toInt() : current.oversample;
+  long median = request->hasParam("median") ? request->getParam("median")->value().toInt() : current.medianWindow;
+  long ema = request->hasParam("ema") ? request->getParam("ema")->value().toInt() : current.emaShift;
+
+  bool inRange = rate > 0 && oversample > 0 && oversample <= ANALOG_MAX_OVERSAMPLE &&
+                 median > 0 && median <= ANALOG_MAX_MEDIAN && ema >= 0 && ema <= 8;
+  AnalogPipelineConfig updated = {(uint32_t)rate, (uint16_t)oversample, (uint8_t)median, (uint8_t)ema};
+  if (!inRange || !setAnalogPipelineConfig(updated)) {
+    request->send(400, "application/json",
+                  "{\"status\":\"error\",\"message\":\"rate 600-120000, oversample 1-1024, median 1-9, ema 0-8\"}");
+    return;
+  }
+  request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Analog pipeline restarting\"}");
+}
@@ -0,0 +1,204 @@
+// AnalogPipelineCore.cpp
+// The parts of the analog pipeline that do not touch the ADC: the filter
+// kernels, the sampling task and its settings and counters. The ADC
+// backends and the API handlers are in AnalogPipeline.cpp; the native
+// tests run this file with a mock backend.
+#include "AnalogPipeline.h"
+#include "Utils.h"
+
+static AnalogPipelineConfig config = {ANALOG_DMA_MIN_RATE_HZ, 64, 5, 2};
+static AnalogPipelineStats stats = {};
+static AnalogFilter filters[ANALOG_INPUT_COUNT];
+static uint32_t filtered[ANALOG_INPUT_COUNT];
+static const AnalogBackend* customBackend = NULL;
+static const AnalogBackend* defaultBackend = NULL;    // Set by startAnalogSampling()
+static const AnalogBackend* fallbackBackend = NULL;
+static volatile bool restartPending = true;
+static TaskHandle_t analogTaskHandle = NULL;
+static portMUX_TYPE analogMux = portMUX_INITIALIZER_UNLOCKED;
+//---------------------------------------------------------------------
+// Filter kernels
+//---------------------------------------------------------------------
+void analogFilterReset(AnalogFilter& filter) {
+  memset(&filter, 0, sizeof(filter));
+}
+
+// Median of a few values by insertion sort of a copy
+static uint32_t medianOf(const uint32_t* values, uint8_t count) {
+  uint32_t sorted[ANALOG_MAX_MEDIAN];
+  for (uint8_t i = 0; i < count; i++) {
+    uint32_t v = values[i];
+    int8_t j = i - 1;
+    while (j >= 0 && sorted[j] > v) {
+      sorted[j + 1] = sorted[j];
+      j--;
+    }
+    sorted[j + 1] = v;
+  }
+  return sorted[count / 2];
+}
+
+bool analogFilterPush(AnalogFilter& filter, const AnalogPipelineConfig& config, uint16_t raw, uint32_t& value) {
+  filter.sum += raw;
+  if (++filter.summed < config.oversample) {
+    return false;
+  }
+  uint32_t average = (filter.sum << ANALOG_FRACTION_BITS) / filter.summed;
+  filter.sum = 0;
+  filter.summed = 0;
+
+  if (config.medianWindow > 1) {
+    filter.window[filter.windowNext] = average;
+    filter.windowNext = (filter.windowNext + 1) % config.medianWindow;
+    if (filter.windowCount < config.medianWindow) filter.windowCount++;
+    average = medianOf(filter.window, filter.windowCount);
+  }
+
+  // The accumulator holds the EMA << emaShift, so the output settles on the
+  // input from either side; shifting the signed difference instead rounds
+  // toward -inf and leaves a rising input short of its level
+  if (!filter.primed) {
+    filter.ema = average << config.emaShift;
+    filter.primed = true;
+  } else {
+    filter.ema += average - (filter.ema >> config.emaShift);
+  }
+  value = filter.ema >> config.emaShift;
+  return true;
+}
+
+//---------------------------------------------------------------------
+// Sampling task
+//---------------------------------------------------------------------
+static void analogPipelineTask(void* pvParameters) {
+  const AnalogBackend* backend = NULL;
+  AnalogPipelineConfig active;
+  static AnalogSample samples[ANALOG_READ_SAMPLES];
+
+  for (;;) {
+    if (restartPending) {
+      if (backend) {
+        backend->stop();
+      }
+
+      portENTER_CRITICAL(&analogMux);
+      active = config;
+      backend = customBackend ? customBackend : defaultBackend;
+      restartPending = false;
+      portEXIT_CRITICAL(&analogMux);
+
+      if (backend == NULL) {
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        restartPending = true;
+        continue;
+      }
+      if (!backend->start(active.sampleRateHz)) {
+        if (backend == defaultBackend && fallbackBackend != NULL) {
+          debugPrintf("WARNING: Analog backend '%s' unavailable at %u Hz, using '%s'\n", backend->name,
+                      active.sampleRateHz, fallbackBackend->name);
+          backend = fallbackBackend;
+          backend->start(active.sampleRateHz);
+        } else {
+          debugPrintf("ERROR: Analog backend '%s' failed to start\n", backend->name);
+          backend = NULL;
+          vTaskDelay(pdMS_TO_TICKS(1000));
+          restartPending = true;
+          continue;
+        }
+      }
+
+      for (uint8_t i = 0; i < ANALOG_INPUT_COUNT; i++) {
+        analogFilterReset(filters[i]);
+      }
+      portENTER_CRITICAL(&analogMux);
+      stats.backend = backend->name;
+      stats.sampleRateHz = active.sampleRateHz;
+      stats.restarts++;
+      portEXIT_CRITICAL(&analogMux);
+      debugPrintf("DEBUG: Analog pipeline running on %s backend at %u Hz\n", backend->name, active.sampleRateHz);
+    }
+
+    bool overrun = false;
+    uint16_t count = backend->read(samples, ANALOG_READ_SAMPLES, &overrun);
+
+    // Filter outside the lock, then publish the read's results at once
+    uint32_t produced[ANALOG_INPUT_COUNT];
+    uint8_t producedMask = 0;
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t input = samples[i].input;
+      if (analogFilterPush(filters[input], active, samples[i].raw, produced[input])) {
+        producedMask |= 1 << input;
+      }
+    }
+
+    portENTER_CRITICAL(&analogMux);
+    stats.samples += count;
+    if (overrun) stats.overruns++;
+    for (uint16_t i = 0; i < count; i++) {
+      stats.lastRaw[samples[i].input] = samples[i].raw;
+    }
+    for (uint8_t input = 0; input < ANALOG_INPUT_COUNT; input++) {
+      if (producedMask & (1 << input)) {
+        filtered[input] = produced[input];
+        stats.outputs[input]++;
+      }
+    }
+    portEXIT_CRITICAL(&analogMux);
+  }
+}
+
+void startAnalogSampling(const AnalogBackend* primary, const AnalogBackend* fallback) {
+  if (analogTaskHandle != NULL) {
+    return;
+  }
+  portENTER_CRITICAL(&analogMux);
+  defaultBackend = primary;
+  fallbackBackend = fallback;
+  portEXIT_CRITICAL(&analogMux);
+  xTaskCreatePinnedToCore(analogPipelineTask, "AnalogPipeline", ANALOG_STACK_SIZE, NULL, 1, &analogTaskHandle, 1);
+  if (analogTaskHandle == NULL) {
+    debugPrintln("ERROR: Failed to create analog pipeline task");
+  }
+}
+
+bool setAnalogPipelineConfig(const AnalogPipelineConfig& newConfig) {
+  if (newConfig.sampleRateHz < ANALOG_MIN_RATE_HZ || newConfig.sampleRateHz > ANALOG_MAX_RATE_HZ ||
+      newConfig.oversample < 1 || newConfig.oversample > ANALOG_MAX_OVERSAMPLE ||
+      newConfig.medianWindow < 1 || newConfig.medianWindow > ANALOG_MAX_MEDIAN ||
+      newConfig.emaShift > 8) {
+    return false;
+  }
+
+  portENTER_CRITICAL(&analogMux);
+  config = newConfig;
+  restartPending = true;
+  portEXIT_CRITICAL(&analogMux);
+  return true;
+}
+
+AnalogPipelineConfig getAnalogPipelineConfig() {
+  portENTER_CRITICAL(&analogMux);
+  AnalogPipelineConfig copy = config;
+  portEXIT_CRITICAL(&analogMux);
+  return copy;
+}
+
+void setAnalogBackend(const AnalogBackend* backend) {
+  portENTER_CRITICAL(&analogMux);
+  customBackend = backend;
+  restartPending = true;
+  portEXIT_CRITICAL(&analogMux);
+}
+
+void getAnalogFiltered(uint32_t values[ANALOG_INPUT_COUNT]) {
+  portENTER_CRITICAL(&analogMux);
+  memcpy(values, filtered, sizeof(filtered));
+  portEXIT_CRITICAL(&analogMux);
+}
+
+AnalogPipelineStats getAnalogPipelineStats() {
+  portENTER_CRITICAL(&analogMux);
+  AnalogPipelineStats copy = stats;
+  portEXIT_CRITICAL(&analogMux);
+  return copy;
+}
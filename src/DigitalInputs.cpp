@@ -0,0 +1,115 @@
+// DigitalInputs.cpp
+// The 74HC165 inputs are scanned every millisecond and debounced with a
+// vertical counter: a change is accepted after DI_DEBOUNCE_SCANS equal
+// scans, for all 8 inputs at once. Readers get the debounced state and the
+// edges instead of sampling the chip themselves.
+#include "DigitalInputs.h"
+#include "IOManager.h"
+#include "ShiftRegister.h"
+#include "Utils.h"
+
+static DigitalInputState inputs = {};
+static DebounceState debounce = {};
+static TaskHandle_t scannerTaskHandle = NULL;
+static portMUX_TYPE inputsMux = portMUX_INITIALIZER_UNLOCKED;
+
+//---------------------------------------------------------------------
+// Debounce kernel
+//---------------------------------------------------------------------
+void debounceReset(DebounceState& debounce, uint8_t state) {
+  debounce.state = state;
+  debounce.count0 = 0xFF;
+  debounce.count1 = 0xFF;
+}
+
+uint8_t debouncePush(DebounceState& debounce, uint8_t sample) {
+  // Inputs that differ from the debounced state count down from 3 and an
+  // input that agrees again goes back to 3. The fourth differing scan in a
+  // row wraps the counter to 3 and flips the debounced bit.
+  uint8_t differs = debounce.state ^ sample;
+  debounce.count0 = ~(debounce.count0 & differs);
+  debounce.count1 = debounce.count0 ^ (debounce.count1 & differs);
+  uint8_t changed = differs & debounce.count0 & debounce.count1;
+  debounce.state ^= changed;
+  return changed;
+}
+
+//---------------------------------------------------------------------
+// Scanner task
+//---------------------------------------------------------------------
+static void digitalInputScannerTask(void* pvParameters) {
+  debugPrintln("DEBUG: Digital input scanner started");
+
+  // The first scan is taken as it is, there is nothing to debounce against
+  uint8_t first = shiftIn165();
+  debounceReset(debounce, first);
+  portENTER_CRITICAL(&inputsMux);
+  inputs.state = first;
+  inputs.scans = 1;
+  portEXIT_CRITICAL(&inputsMux);
+
+  TickType_t lastWake = xTaskGetTickCount();
+  const TickType_t period = pdMS_TO_TICKS(DI_SCAN_MS) > 0 ? pdMS_TO_TICKS(DI_SCAN_MS) : 1;
+
+  for (;;) {
+    vTaskDelayUntil(&lastWake, period);
+
+    uint8_t sample = shiftIn165();
+    uint8_t changed = debouncePush(debounce, sample);
+    uint8_t state = debounce.state;
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&inputsMux);
+    inputs.scans++;
+    if (sample != state) {
+      inputs.unsettledScans++;
+    }
+    if (changed) {
+      inputs.state = state;
+      inputs.rising |= changed & state;
+      inputs.falling |= changed & ~state;
+      for (uint8_t i = 0; i < DI_INPUT_COUNT; i++) {
+        if (changed & (1 << i)) {
+          inputs.changedMs[i] = now;
+          if (state & (1 << i)) {
+            inputs.risingCount[i]++;
+          } else {
+            inputs.fallingCount[i]++;
+          }
+        }
+      }
+    }
+    portEXIT_CRITICAL(&inputsMux);
+  }
+}
+
+void startDigitalInputScanner() {
+  if (scannerTaskHandle != NULL) {
+    return;
+  }
+  // Above the other IO tasks so the scan period holds while they run
+  xTaskCreatePinnedToCore(digitalInputScannerTask, "DIScanner", DI_STACK_SIZE, NULL, 2, &scannerTaskHandle, 1);
+  if (scannerTaskHandle == NULL) {
+    debugPrintln("ERROR: Failed to create digital input scanner task");
+  }
+}
+
+bool digitalInputScannerRunning() {
+  return scannerTaskHandle != NULL;
+}
+
+DigitalInputState getDigitalInputs() {
+  portENTER_CRITICAL(&inputsMux);
+  DigitalInputState copy = inputs;
+  portEXIT_CRITICAL(&inputsMux);
+  return copy;
+}
+
+void takeDigitalInputEdges(uint8_t& rising, uint8_t& falling) {
+  portENTER_CRITICAL(&inputsMux);
+  rising = inputs.rising;
+  falling = inputs.falling;
+  inputs.rising = 0;
+  inputs.falling = 0;
+  portEXIT_CRITICAL(&inputsMux);
+}
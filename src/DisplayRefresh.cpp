@@ -0,0 +1,136 @@
+// DisplayRefresh.cpp
+// The 74HC595 chain carries the relay byte, the digit select byte and the
+// segment byte. A hardware timer interrupt shifts one frame per digit, so
+// the display multiplexes without any task time, and every frame carries
+// the current relayState. The relay task shifts its changes at once under
+// the same lock instead of waiting for the next digit.
+#include "DisplayRefresh.h"
+#include "IOManager.h"
+#include "ShiftRegister.h"
+#include "Utils.h"
+
+// Segment patterns (common anode, bit 0 = segment a)
+#define SEG_BLANK 0x00
+#define SEG_DASH 0x40
+
+static const uint8_t DRAM_ATTR digitSelect[DISPLAY_DIGITS] = {0xFE, 0xFD, 0xFB, 0xF7};
+static const uint8_t digitSegments[10] = {0x3F, 0x06, 0x5B, 0x4F, 0x66, 0x6D, 0x7D, 0x07, 0x7F, 0x6F};
+
+// Letters the display can show
+struct SegmentGlyph {
+  char c;
+  uint8_t segments;
+};
+
+static const SegmentGlyph letterSegments[] = {
+  {'A', 0x77}, {'b', 0x7C}, {'C', 0x39}, {'c', 0x58}, {'d', 0x5E}, {'E', 0x79},
+  {'F', 0x71}, {'H', 0x76}, {'h', 0x74}, {'L', 0x38}, {'n', 0x54}, {'N', 0x37},
+  {'o', 0x5C}, {'P', 0x73}, {'r', 0x50}, {'t', 0x78}, {'U', 0x3E}, {'-', SEG_DASH},
+};
+
+static volatile uint8_t frameSegments[DISPLAY_DIGITS] = {SEG_DASH, SEG_DASH, SEG_DASH, SEG_DASH};
+static volatile uint8_t litDigit = 0;
+static hw_timer_t* refreshTimer = NULL;
+static portMUX_TYPE chainMux = portMUX_INITIALIZER_UNLOCKED;   // Owns the 595 chain
+
+static void IRAM_ATTR onDisplayTimer() {
+  portENTER_CRITICAL_ISR(&chainMux);
+  uint8_t digit = (litDigit + 1) % DISPLAY_DIGITS;
+  litDigit = digit;
+  uint8_t frame[SH595_FRAME_BYTES] = {relayState, digitSelect[digit], frameSegments[digit]};
+  shiftOut595FromIsr(frame, SH595_FRAME_BYTES);
+  portEXIT_CRITICAL_ISR(&chainMux);
+}
+
+void startDisplayRefresh() {
+  if (refreshTimer != NULL) {
+    return;
+  }
+
+  // 1 MHz timer ticks (80 MHz APB clock / 80)
+  refreshTimer = timerBegin(DISPLAY_TIMER, 80, true);
+  if (refreshTimer == NULL) {
+    debugPrintln("ERROR: Failed to start display refresh timer");
+    return;
+  }
+  timerAttachInterrupt(refreshTimer, &onDisplayTimer, true);
+  timerAlarmWrite(refreshTimer, DISPLAY_DIGIT_US, true);
+  timerAlarmEnable(refreshTimer);
+  debugPrintf("DEBUG: Display refresh started, %d us per digit\n", DISPLAY_DIGIT_US);
+}
+
+bool displayRefreshRunning() {
+  return refreshTimer != NULL;
+}
+
+void shiftOutputFrame(uint8_t relays) {
+  portENTER_CRITICAL(&chainMux);
+  uint8_t frame[SH595_FRAME_BYTES] = {relays, 0, 0};
+  if (refreshTimer != NULL) {
+    frame[1] = digitSelect[litDigit];
+    frame[2] = frameSegments[litDigit];
+  }
+  shiftOut595(frame, SH595_FRAME_BYTES);
+  portEXIT_CRITICAL(&chainMux);
+}
+
+void displaySetSegments(const uint8_t segments[DISPLAY_DIGITS]) {
+  portENTER_CRITICAL(&chainMux);
+  for (uint8_t i = 0; i < DISPLAY_DIGITS; i++) {
+    frameSegments[i] = segments[i];
+  }
+  portEXIT_CRITICAL(&chainMux);
+}
+
+static uint8_t segmentsForChar(char c) {
+  if (c >= '0' && c <= '9') {
+    return digitSegments[c - '0'];
+  }
+  for (uint8_t i = 0; i < sizeof(letterSegments) / sizeof(letterSegments[0]); i++) {
+    if (letterSegments[i].c == c) {
+      return letterSegments[i].segments;
+    }
+  }
+  return SEG_BLANK;
+}
+
+void displayShowNumber(uint16_t value) {
+  uint8_t segments[DISPLAY_DIGITS];
+  value %= 10000;
+  for (int8_t i = DISPLAY_DIGITS - 1; i >= 0; i--) {
+    segments[i] = digitSegments[value % 10];
+    value /= 10;
+  }
+  displaySetSegments(segments);
+}
+
+void displayShowText(const char* text) {
+  uint8_t segments[DISPLAY_DIGITS];
+  bool ended = false;
+  for (uint8_t i = 0; i < DISPLAY_DIGITS; i++) {
+    ended = ended || text[i] == '\0';
+    segments[i] = ended ? SEG_BLANK : segmentsForChar(text[i]);
+  }
+  displaySetSegments(segments);
+}
+
+void displayShowError(uint8_t code) {
+  char text[DISPLAY_DIGITS + 2];
+  snprintf(text, sizeof(text), "E%3u", code);
+  displayShowText(text);
+}
+
+void displayShowRelays(uint8_t relays) {
+  if (relays == 0) {
+    displayShowText("----");
+    return;
+  }
+
+  uint8_t relay = 0;
+  while (!(relays & (1 << relay))) {
+    relay++;
+  }
+  char text[DISPLAY_DIGITS + 1];
+  snprintf(text, sizeof(text), "on %u", relay + 1);
+  displayShowText(text);
+}
@@ -0,0 +1,280 @@
+// EventPool.cpp
+// Segregated free lists of power-of-two event blocks. A schedule's events
+// stay contiguous, so indexing them is unchanged; only the storage moved
+// from fixed MAX_EVENTS arrays into blocks sized to what is actually used.
+#include "EventPool.h"
+#include <freertos/semphr.h>
+#include "Utils.h"
+
+// Freed blocks are linked through their first bytes
+struct FreeEventBlock {
+  FreeEventBlock* next;
+};
+
+static FreeEventBlock* freeLists[EVENT_POOL_CLASSES] = {};
+static EventPoolStats poolStats = {SCHEDULER_EVENT_BUDGET, 0, 0, 0, 0, 0, 0};
+static SemaphoreHandle_t poolMutex = NULL;
+
+static void lockPool() {
+  // First allocation happens from setup(), before any other task uses the pool
+  if (poolMutex == NULL) {
+    poolMutex = xSemaphoreCreateMutex();
+  }
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+}
+
+static void unlockPool() {
+  xSemaphoreGive(poolMutex);
+}
+
+// Whether size more slots fit the budget and leave the heap reserve
+static bool poolHasRoom(uint32_t size) {
+  bool inBudget = poolStats.budgetEvents == 0 || poolStats.reservedEvents + size <= poolStats.budgetEvents;
+  return inBudget && ESP.getFreeHeap() >= size * sizeof(Event) + EVENT_POOL_HEAP_RESERVE;
+}
+
+// Smallest class whose blocks hold minEvents (EVENT_POOL_CLASSES if none)
+static uint8_t blockClass(uint16_t minEvents) {
+  uint8_t cls = 0;
+  while (cls < EVENT_POOL_CLASSES && (uint32_t)(EVENT_POOL_MIN_BLOCK << cls) < minEvents) {
+    cls++;
+  }
+  return cls;
+}
+
+// Hand parked blocks back to the heap so another size class can use the budget
+static void trimFreeLists() {
+  for (uint8_t cls = 0; cls < EVENT_POOL_CLASSES; cls++) {
+    while (freeLists[cls]) {
+      FreeEventBlock* block = freeLists[cls];
+      freeLists[cls] = block->next;
+      free(block);
+      poolStats.reservedEvents -= EVENT_POOL_MIN_BLOCK << cls;
+      poolStats.blocksFree--;
+    }
+  }
+}
+
+Event* allocEventBlock(uint16_t minEvents, uint16_t& capacity) {
+  uint8_t cls = blockClass(minEvents);
+  if (cls >= EVENT_POOL_CLASSES) {
+    debugPrintf("ERROR: %u events exceed the largest event block (%d)\n", minEvents, MAX_EVENTS);
+    capacity = 0;
+    return NULL;
+  }
+  uint16_t size = EVENT_POOL_MIN_BLOCK << cls;
+
+  lockPool();
+
+  Event* block = NULL;
+  if (freeLists[cls]) {
+    FreeEventBlock* head = freeLists[cls];
+    freeLists[cls] = head->next;
+    poolStats.blocksFree--;
+    block = (Event*)head;
+  } else {
+    if (!poolHasRoom(size)) {
+      trimFreeLists();
+    }
+    if (poolHasRoom(size)) {
+      block = (Event*)malloc(size * sizeof(Event));
+      if (block) {
+        poolStats.reservedEvents += size;
+      }
+    }
+  }
+
+  if (block) {
+    poolStats.inUseEvents += size;
+    poolStats.blocksInUse++;
+    capacity = size;
+  } else {
+    poolStats.allocFailures++;
+    capacity = 0;
+  }
+
+  unlockPool();
+
+  if (!block) {
+    debugPrintf("ERROR: Event pool exhausted (%u events requested, %u/%u reserved, free heap %u)\n",
+               size, poolStats.reservedEvents, poolStats.budgetEvents, ESP.getFreeHeap());
+  }
+  return block;
+}
+
+void freeEventBlock(Event* block, uint16_t capacity) {
+  if (block == NULL || capacity == 0) {
+    return;
+  }
+  uint8_t cls = blockClass(capacity);
+
+  lockPool();
+  FreeEventBlock* head = (FreeEventBlock*)block;
+  head->next = freeLists[cls];
+  freeLists[cls] = head;
+  poolStats.inUseEvents -= capacity;
+  poolStats.blocksInUse--;
+  poolStats.blocksFree++;
+  unlockPool();
+}
+
+void setEventPoolBudget(uint32_t events) {
+  lockPool();
+  poolStats.budgetEvents = events;
+  unlockPool();
+  debugPrintf("DEBUG: Event pool budget set to %u events\n", events);
+}
+
+bool reserveSchedules(SchedulerState& state, uint8_t count) {
+  if (count <= state.scheduleCapacity) {
+    return true;
+  }
+  if (count > MAX_SCHEDULES) {
+    debugPrintf("ERROR: %u schedules exceed the schedule limit (%d)\n", count, MAX_SCHEDULES);
+    return false;
+  }
+
+  uint8_t capacity = state.scheduleCapacity ? state.scheduleCapacity : SCHEDULE_TABLE_MIN;
+  while (capacity < count) {
+    capacity *= 2;
+  }
+  if (capacity > MAX_SCHEDULES) {
+    capacity = MAX_SCHEDULES;
+  }
+
+  size_t bytes = capacity * sizeof(Schedule);
+  Schedule* table = NULL;
+  if (ESP.getFreeHeap() >= bytes + EVENT_POOL_HEAP_RESERVE) {
+    table = (Schedule*)malloc(bytes);
+  }
+  if (!table) {
+    debugPrintf("ERROR: No memory for a table of %u schedules\n", capacity);
+    return false;
+  }
+
+  // Slots move with their blocks; the new ones own none
+  if (state.scheduleCapacity > 0) {
+    memcpy(table, state.schedules, state.scheduleCapacity * sizeof(Schedule));
+  }
+  memset(table + state.scheduleCapacity, 0, (capacity - state.scheduleCapacity) * sizeof(Schedule));
+  free(state.schedules);
+  state.schedules = table;
+  state.scheduleCapacity = capacity;
+  return true;
+}
+
+bool reserveScheduleEvents(Schedule& sch, uint16_t count) {
+  if (count <= sch.eventCapacity) {
+    return true;
+  }
+
+  // Grow by at least doubling so appending one event at a time stays cheap
+  uint16_t wanted = count;
+  if (wanted < sch.eventCapacity * 2) {
+    wanted = sch.eventCapacity * 2;
+  }
+  if (wanted > MAX_EVENTS) {
+    wanted = MAX_EVENTS;
+  }
+
+  uint16_t capacity;
+  Event* block = allocEventBlock(wanted < count ? count : wanted, capacity);
+  if (!block) {
+    return false;
+  }
+
+  if (sch.eventCount > 0) {
+    memcpy(block, sch.events, sch.eventCount * sizeof(Event));
+  }
+  freeEventBlock(sch.events, sch.eventCapacity);
+  sch.events = block;
+  sch.eventCapacity = capacity;
+  return true;
+}
+
+void releaseScheduleEvents(Schedule& sch) {
+  freeEventBlock(sch.events, sch.eventCapacity);
+  sch.events = NULL;
+  sch.eventCapacity = 0;
+  sch.eventCount = 0;
+}
+
+bool copySchedule(Schedule& dst, const Schedule& src) {
+  // Drop dst's events first so a shrinking copy does not need a second block
+  dst.eventCount = 0;
+  if (!reserveScheduleEvents(dst, src.eventCount)) {
+    return false;
+  }
+
+  Event* events = dst.events;
+  uint16_t capacity = dst.eventCapacity;
+  dst = src;
+  dst.events = events;
+  dst.eventCapacity = capacity;
+  if (src.eventCount > 0) {
+    memcpy(dst.events, src.events, src.eventCount * sizeof(Event));
+  }
+  return true;
+}
+
+bool copySchedulerState(SchedulerState& dst, const SchedulerState& src) {
+  if (!reserveSchedules(dst, src.scheduleCount)) {
+    releaseSchedulerState(dst);
+    return false;
+  }
+
+  for (int i = src.scheduleCount; i < dst.scheduleCount; i++) {
+    releaseScheduleEvents(dst.schedules[i]);
+  }
+
+  for (int i = 0; i < src.scheduleCount; i++) {
+    if (!copySchedule(dst.schedules[i], src.schedules[i])) {
+      // Leave dst empty rather than half copied
+      int owned = i + 1 > dst.scheduleCount ? i + 1 : dst.scheduleCount;
+      for (int j = 0; j < owned; j++) {
+        releaseScheduleEvents(dst.schedules[j]);
+      }
+      dst.scheduleCount = 0;
+      dst.strings.used = 0;
+      return false;
+    }
+  }
+
+  dst.scheduleCount = src.scheduleCount;
+  dst.currentScheduleIndex = src.currentScheduleIndex;
+  dst.strings = src.strings;
+  return true;
+}
+
+void releaseSchedulerState(SchedulerState& state) {
+  for (int i = 0; i < state.scheduleCount; i++) {
+    releaseScheduleEvents(state.schedules[i]);
+  }
+  state.scheduleCount = 0;
+  state.currentScheduleIndex = 0;
+  state.strings.used = 0;
+}
+
+void freeSchedulerState(SchedulerState& state) {
+  releaseSchedulerState(state);
+  free(state.schedules);
+  state.schedules = NULL;
+  state.scheduleCapacity = 0;
+}
+
+EventPoolStats getEventPoolStats() {
+  lockPool();
+  EventPoolStats stats = poolStats;
+  unlockPool();
+
+  uint32_t freeHeap = ESP.getFreeHeap();
+  stats.availableEvents = freeHeap > EVENT_POOL_HEAP_RESERVE ?
+    (freeHeap - EVENT_POOL_HEAP_RESERVE) / sizeof(Event) : 0;
+  if (stats.budgetEvents != 0) {
+    uint32_t left = stats.budgetEvents > stats.reservedEvents ? stats.budgetEvents - stats.reservedEvents : 0;
+    if (left < stats.availableEvents) {
+      stats.availableEvents = left;
+    }
+  }
+  return stats;
+}
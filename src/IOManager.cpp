@@ -3,17 +3,31 @@
 #include "PinConfig.h"
 #include "Utils.h"
 #include "TestMode.h"
+#include "SchedulerLatency.h"
+#include "ShiftRegister.h"
+#include "DisplayRefresh.h"
+#include "AnalogPipeline.h"
+#include "AnalogCalibration.h"
+#include "DigitalInputs.h"
 
 // Global variables for IO state
 volatile uint8_t relayState = 0;
+static uint8_t relayOwnerMasks[RELAY_OWNER_COUNT] = {};  // Under mux; relayState is their union
+static volatile uint32_t relayWriteSequence = 0;  // Bumped with every applyRelayTransitions()
 volatile bool initTestModeComplete = false;
 portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
 
-// IO state arrays
-float voltageValues[4] = {0.0, 0.0, 0.0, 0.0};
-float currentValues[4] = {0.0, 0.0, 0.0, 0.0};
-bool buttonStates[4] = {false, false, false, false};
-bool inputStates[8] = {false, false, false, false, false, false, false, false};
+// 74HC595 writer task and its counters
+static TaskHandle_t relayTaskHandle = NULL;
+static RelayOutputStats outputStats = {};
+static portMUX_TYPE outputStatsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Published IO state: two copies behind a latch sequence. The analog task
+// bumps the sequence before rewriting each copy, so readers always have one
+// copy that is not being written (the even sequence picks ioCopies[0], the
+// odd one ioCopies[1]) and never wait for the writer, even a preempted one.
+static IOSnapshot ioCopies[2];
+static volatile uint32_t ioLatch = 0;
 
 void initIOManager() {
   debugPrintln("DEBUG: Initializing IO manager...");
@@ -55,6 +69,12 @@ void initIOManager() {
     debugPrintln("\nDEBUG: 74HC595 initialization timed out, continuing anyway");
   }
   
+  // Multiplex the display from a timer; it shares the 595 chain with the relays
+  startDisplayRefresh();
+  
+  // Scan and debounce the 74HC165 inputs at 1 kHz
+  startDigitalInputScanner();
+  
   // Create relay update task
   xTaskCreatePinnedToCore(
     vRelayUpdateTask,
@@ -62,10 +82,15 @@ void initIOManager() {
     2048,
     NULL,
     1,
-    NULL,
+    &relayTaskHandle,
     1
   );
   
+  // Sample the analog inputs continuously; the analog task publishes the
+  // results through the board's calibration
+  loadAnalogCalibration();
+  startAnalogPipeline();
+  
   // Create analog update task
   xTaskCreatePinnedToCore(
     vAnalogTask,
@@ -89,14 +114,9 @@ void initTestModeTask(void *pvParameters) {
   pinMode(SH595_LATCH, OUTPUT);
   pinMode(SH595_OE, OUTPUT);
   
-  // Try to clear display - simplified version
-  digitalWrite(SH595_LATCH, LOW);
-  for (int i = 0; i < 24; i++) {
-    digitalWrite(SH595_DATA, LOW);
-    digitalWrite(SH595_CLOCK, HIGH);
-    digitalWrite(SH595_CLOCK, LOW);
-  }
-  digitalWrite(SH595_LATCH, HIGH);
+  // Try to clear display - simplified version (under the chain lock, the
+  // display refresh may already be running)
+  shiftOutputFrame(0);
   digitalWrite(SH595_OE, LOW);  // Enable outputs
   
   // Try a more careful approach to the original function
@@ -116,40 +136,52 @@ void initTestModeTask(void *pvParameters) {
 void vRelayUpdateTask(void *pvParameters) {
   debugPrintln("DEBUG: Relay update task started");
   
-  // Local variable to track relay state changes for debugging
-  uint8_t lastRelayState = 0xFF; // Initialize to a different value to force first update
+  portENTER_CRITICAL(&outputStatsMux);
+  outputStats.startMs = millis();
+  portEXIT_CRITICAL(&outputStatsMux);
+  
+  // Differs from any write number, to force the first frame out
+  uint32_t latchedSequence = relayWriteSequence - 1;
+  uint32_t notified = 1;
   
   for (;;) {
-    // Check if relay state has changed
-    if (relayState != lastRelayState) {
-      lastRelayState = relayState;
-      debugPrintf("DEBUG: Relay state changed to 0x%02X\n", relayState);
-    }
-    
-    // Send the current relay state to the shift register
-    // We need to disable interrupts briefly to ensure the shift register operations aren't interrupted
+    // Only the state and its write number are read with interrupts off
+    uint32_t enterCycles = ESP.getCycleCount();
     portENTER_CRITICAL(&mux);
+    uint8_t state = relayState;
+    uint32_t sequence = relayWriteSequence;
+    portEXIT_CRITICAL(&mux);
+    uint32_t criticalCycles = ESP.getCycleCount() - enterCycles;
     
-    // Send relay state byte directly
-    digitalWrite(SH595_LATCH, LOW);
-    
-    // Send relay state as first byte
-    for (uint8_t i = 0; i < 8; i++) {
-      digitalWrite(SH595_DATA, (relayState & (0x80 >> i)) ? HIGH : LOW);
-      digitalWrite(SH595_CLOCK, LOW);
-      digitalWrite(SH595_CLOCK, HIGH);
-    }
+    bool changed = (sequence != latchedSequence);
+    bool refresh = !changed && notified == 0;
+    uint32_t shiftCycles = 0;
     
-    // Send zero for other bytes (display control) to avoid interference
-    for (uint8_t i = 0; i < 16; i++) { // 16 more bits (2 bytes) for display control
-      digitalWrite(SH595_DATA, LOW);
-      digitalWrite(SH595_CLOCK, LOW);
-      digitalWrite(SH595_CLOCK, HIGH);
+    if (changed || refresh) {
+      if (changed) {
+        debugPrintf("DEBUG: Relay state changed to 0x%02X\n", state);
+        displayShowRelays(state);
+      }
+      
+      uint32_t shiftStart = ESP.getCycleCount();
+      shiftOutputFrame(state);
+      uint32_t latchCycles = ESP.getCycleCount();
+      shiftCycles = latchCycles - shiftStart;
+      latchedSequence = sequence;
+      
+      if (changed) {
+        recordRelayLatch(sequence, latchCycles);
+      }
     }
     
-    digitalWrite(SH595_LATCH, HIGH);
-    
-    portEXIT_CRITICAL(&mux);
+    portENTER_CRITICAL(&outputStatsMux);
+    outputStats.criticalSections++;
+    outputStats.criticalCycles += criticalCycles;
+    if (criticalCycles > outputStats.maxCriticalCycles) outputStats.maxCriticalCycles = criticalCycles;
+    outputStats.shiftCycles += shiftCycles;
+    if (changed) outputStats.changeShifts++;
+    if (refresh) outputStats.refreshShifts++;
+    portEXIT_CRITICAL(&outputStatsMux);
     
     // Brief debug message every 10 seconds for monitoring
     static uint32_t lastDebugTime = 0;
@@ -158,100 +190,79 @@ void vRelayUpdateTask(void *pvParameters) {
       debugPrintf("DEBUG: Relay update task running, current state: 0x%02X\n", relayState);
     }
     
-    // Update at a reasonable rate
-    vTaskDelay(pdMS_TO_TICKS(50)); // 50ms delay (20Hz update rate)
+    // Sleep until a relay write notifies us, or until the refresh is due
+    notified = ulTaskNotifyTake(pdTRUE, RELAY_REFRESH_MS > 0 ? pdMS_TO_TICKS(RELAY_REFRESH_MS) : portMAX_DELAY);
   }
 }
 
+static void bumpIOLatch() {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  ioLatch = ioLatch + 1;
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+// Single writer: the analog task
+static void publishIOSnapshot(const IOSnapshot& snapshot) {
+  bumpIOLatch();              // Odd: readers use ioCopies[1]
+  ioCopies[0] = snapshot;
+  bumpIOLatch();              // Even: readers use ioCopies[0]
+  ioCopies[1] = snapshot;
+}
+
+void getIOSnapshot(IOSnapshot& snapshot) {
+  uint32_t latch;
+  do {
+    latch = ioLatch;
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    snapshot = ioCopies[latch & 1];
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  } while (ioLatch != latch);   // The writer moved on during the copy
+}
+
 void vAnalogTask(void *pvParameters) {
   debugPrintln("DEBUG: Analog task started");
   
+  IOSnapshot snapshot = {};
+  
   for (;;) {
-    // Read analog inputs (similar to sensorTestLoop in TestMode.cpp)
-    int analog_value[8];
+    // Filtered counts from the analog pipeline, converted to mV / uA by the
+    // calibrated fixed-point curves (V3/V4 share pins with WiFi and are not sampled)
+    uint32_t filtered[ANALOG_INPUT_COUNT];
+    int32_t calibrated[ANALOG_INPUT_COUNT];
+    getAnalogFiltered(filtered);
+    convertAnalogInputs(filtered, calibrated);
+    snapshot.timestampMs = millis();
     
-    // Safely read analog inputs with error handling
-    try {
-      analog_value[0] = analogRead(AI_V1);
-    } catch (...) {
-      analog_value[0] = 0;
-    }
+    snapshot.voltages[0] = calibrated[AIN_V1] / 1000.0f;
+    snapshot.voltages[1] = calibrated[AIN_V2] / 1000.0f;
+    snapshot.voltages[2] = 0;
+    snapshot.voltages[3] = 0;
     
-    try {
-      analog_value[1] = analogRead(AI_V2);
-    } catch (...) {
-      analog_value[1] = 0;
-    }
-    
-    /* try {
-      analog_value[2] = analogRead(AI_V3);
-    } catch (...) {
-      analog_value[2] = 0;
-    }
-    
-    try {
-      analog_value[3] = analogRead(AI_V4);
-    } catch (...) {
-      analog_value[3] = 0;
-    } */
-    
-    try {
-      analog_value[4] = analogRead(AI_I1);
-    } catch (...) {
-      analog_value[4] = 0;
-    }
-    
-    try {
-      analog_value[5] = analogRead(AI_I2);
-    } catch (...) {
-      analog_value[5] = 0;
-    }
-    
-    try {
-      analog_value[6] = analogRead(AI_I3);
-    } catch (...) {
-      analog_value[6] = 0;
-    }
-    
-    try {
-      analog_value[7] = analogRead(AI_I4);
-    } catch (...) {
-      analog_value[7] = 0;
-    }
-    
-    // Convert to voltage (same formula as in TestMode.cpp)
-    voltageValues[0] = (float)analog_value[0] * 3300 / 4096 / 1000 * 53 / 10 + 0.6;
-    voltageValues[1] = (float)analog_value[1] * 3300 / 4096 / 1000 * 53 / 10 + 0.6;
-    voltageValues[2] = (float)analog_value[2] * 3300 / 4096 / 1000 * 53 / 10 + 0.6;
-    voltageValues[3] = (float)analog_value[3] * 3300 / 4096 / 1000 * 53 / 10 + 0.6;
-    
-    // Convert to current (same formula as in TestMode.cpp)
-    currentValues[0] = ((float)analog_value[4] * 3300 / 4096 / 1000 + 0.12) / 91 * 1000;
-    currentValues[1] = ((float)analog_value[5] * 3300 / 4096 / 1000 + 0.12) / 91 * 1000;
-    currentValues[2] = ((float)analog_value[6] * 3300 / 4096 / 1000 + 0.12) / 91 * 1000;
-    currentValues[3] = ((float)analog_value[7] * 3300 / 4096 / 1000 + 0.12) / 91 * 1000;
+    snapshot.currents[0] = calibrated[AIN_I1] / 1000.0f;
+    snapshot.currents[1] = calibrated[AIN_I2] / 1000.0f;
+    snapshot.currents[2] = calibrated[AIN_I3] / 1000.0f;
+    snapshot.currents[3] = calibrated[AIN_I4] / 1000.0f;
     
     // Read button states - with error handling
     try {
-      buttonStates[0] = (digitalRead(BTN1) == LOW);
-      buttonStates[1] = (digitalRead(BTN2) == LOW);
-      buttonStates[2] = (digitalRead(BTN3) == LOW);
-      buttonStates[3] = (digitalRead(BTN4) == LOW);
+      snapshot.buttons[0] = (digitalRead(BTN1) == LOW);
+      snapshot.buttons[1] = (digitalRead(BTN2) == LOW);
+      snapshot.buttons[2] = (digitalRead(BTN3) == LOW);
+      snapshot.buttons[3] = (digitalRead(BTN4) == LOW);
     } catch (...) {
       // Keep previous button states on error
     }
     
-    // Read input states from 74HC165 - only if initialization completed
-    if (initTestModeComplete) {
-      try {
-        uint8_t diStatus = Get_DI_Value();
-        for (int i = 0; i < 8; i++) {
-          inputStates[i] = (diStatus & (1 << i)) != 0;
-        }
-      } catch (...) {
-        // Keep previous input states on error
-      }
+    // Debounced 74HC165 inputs and the edges since the previous snapshot
+    DigitalInputState digitalInputs = getDigitalInputs();
+    for (int i = 0; i < 8; i++) {
+      snapshot.inputs[i] = (digitalInputs.state & (1 << i)) != 0;
     }
+    takeDigitalInputEdges(snapshot.inputsRising, snapshot.inputsFalling);
+    
+    snapshot.relays = relayState;
+    snapshot.sequence++;
+    publishIOSnapshot(snapshot);
     
     // Print debug every 5 seconds
     static uint32_t lastDebugTime = 0;
@@ -259,11 +270,11 @@ void vAnalogTask(void *pvParameters) {
       lastDebugTime = millis();
       debugPrintln("DEBUG: Analog readings update...");
       debugPrintf("V1=%.2fV, V2=%.2fV, V3=%.2fV, V4=%.2fV\n", 
-                 voltageValues[0], voltageValues[1], voltageValues[2], voltageValues[3]);
+                 snapshot.voltages[0], snapshot.voltages[1], snapshot.voltages[2], snapshot.voltages[3]);
       debugPrintf("I1=%.2fmA, I2=%.2fmA, I3=%.2fmA, I4=%.2fmA\n", 
-                 currentValues[0], currentValues[1], currentValues[2], currentValues[3]);
+                 snapshot.currents[0], snapshot.currents[1], snapshot.currents[2], snapshot.currents[3]);
       debugPrintf("BTN: %d %d %d %d, Relay state: 0x%02X\n", 
-                 buttonStates[0], buttonStates[1], buttonStates[2], buttonStates[3], relayState);
+                 snapshot.buttons[0], snapshot.buttons[1], snapshot.buttons[2], snapshot.buttons[3], snapshot.relays);
     }
     
     vTaskDelay(pdMS_TO_TICKS(200)); // Update every 200ms
@@ -276,7 +287,7 @@ void startRelayTest() {
       debugPrintln("DEBUG: Relay test task started");
       
       // First turn all relays off
-      relayState = 0x00;
+      setAllRelays(0x00);
       vTaskDelay(pdMS_TO_TICKS(500));
       
       // Turn each relay on and off in sequence
@@ -284,24 +295,24 @@ void startRelayTest() {
         debugPrintf("DEBUG: Testing relay %d - ON\n", i + 1);
         
         // Turn on this relay
-        relayState = (1 << i);
+        setAllRelays(1 << i);
         vTaskDelay(pdMS_TO_TICKS(500));
         
         debugPrintf("DEBUG: Testing relay %d - OFF\n", i + 1);
         
         // Turn off this relay
-        relayState = 0x00;
+        setAllRelays(0x00);
         vTaskDelay(pdMS_TO_TICKS(500));
       }
       
       // Turn all relays on
       debugPrintln("DEBUG: All relays ON");
-      relayState = 0xFF;
+      setAllRelays(0xFF);
       vTaskDelay(pdMS_TO_TICKS(1000));
       
       // Turn all relays off
       debugPrintln("DEBUG: All relays OFF");
-      relayState = 0x00;
+      setAllRelays(0x00);
       vTaskDelay(pdMS_TO_TICKS(500));
       
       debugPrintln("DEBUG: Relay test completed");
@@ -318,69 +329,103 @@ void startRelayTest() {
   );
 }
 
+// Update one owner's mask and relayState under the lock, number the write
+// and wake the writer task to shift it out (ON wins over OFF for the same relay)
+static RelayWrite writeRelayState(RelayOwner owner, uint8_t onMask, uint8_t offMask,
+                                  uint8_t& oldState, uint8_t& newState) {
+  RelayWrite write;
+  portENTER_CRITICAL(&mux);
+  relayOwnerMasks[owner] = (relayOwnerMasks[owner] & ~offMask) | onMask;
+  oldState = relayState;
+  relayState = relayOwnerMasks[RELAY_OWNER_PLAN] | relayOwnerMasks[RELAY_OWNER_PULSE] |
+               relayOwnerMasks[RELAY_OWNER_MANUAL];
+  newState = relayState;
+  write.sequence = ++relayWriteSequence;
+  write.cycles = ESP.getCycleCount();
+  portEXIT_CRITICAL(&mux);
+  
+  if (relayTaskHandle != NULL) {
+    xTaskNotifyGive(relayTaskHandle);
+  }
+  return write;
+}
+
 void setRelay(uint8_t relay, bool state) {
   if (relay >= 0 && relay < 8) {
-    uint8_t oldState = relayState;
-    
-    if (state) {
-      relayState |= (1 << relay);
-    } else {
-      relayState &= ~(1 << relay);
-    }
+    uint8_t oldState, newState;
+    uint8_t bit = 1 << relay;
+    writeRelayState(RELAY_OWNER_MANUAL, state ? bit : 0, state ? 0 : bit, oldState, newState);
     
-    debugPrintf("DEBUG: Relay state changed: 0x%02X -> 0x%02X\n", oldState, relayState);
+    debugPrintf("DEBUG: Relay state changed: 0x%02X -> 0x%02X\n", oldState, newState);
   }
 }
 
 void setAllRelays(uint8_t state) {
-  relayState = state;
-  debugPrintf("DEBUG: All relays set to: 0x%02X\n", state);
+  uint8_t oldState, newState;
+  writeRelayState(RELAY_OWNER_MANUAL, state, 0xFF, oldState, newState);
+  debugPrintf("DEBUG: Manual relays set to: 0x%02X, relays now 0x%02X\n", state, newState);
+}
+
+// Apply several relay changes of one owner as one relayState update (ON wins over OFF for the same relay)
+RelayWrite applyRelayTransitions(RelayOwner owner, uint8_t onMask, uint8_t offMask) {
+  uint8_t oldState, newState;
+  RelayWrite write = writeRelayState(owner, onMask, offMask, oldState, newState);
+  
+  debugPrintf("DEBUG: Relay state changed: 0x%02X -> 0x%02X\n", oldState, newState);
+  return write;
 }
 
 uint8_t getRelayState() {
   return relayState;
 }
 
+uint8_t getRelayOwnerMask(RelayOwner owner) {
+  portENTER_CRITICAL(&mux);
+  uint8_t mask = relayOwnerMasks[owner];
+  portEXIT_CRITICAL(&mux);
+  return mask;
+}
+
+RelayOutputStats getRelayOutputStats() {
+  portENTER_CRITICAL(&outputStatsMux);
+  RelayOutputStats copy = outputStats;
+  portEXIT_CRITICAL(&outputStatsMux);
+  return copy;
+}
+
+// Single values, each from the latest snapshot
 bool getButtonState(uint8_t button) {
   if (button < 4) {
-    return buttonStates[button];
+    IOSnapshot snapshot;
+    getIOSnapshot(snapshot);
+    return snapshot.buttons[button];
   }
   return false;
 }
 
 bool getInputState(uint8_t input) {
   if (input < 8) {
-    return inputStates[input];
+    IOSnapshot snapshot;
+    getIOSnapshot(snapshot);
+    return snapshot.inputs[input];
   }
   return false;
 }
 
 float getVoltageValue(uint8_t channel) {
   if (channel < 4) {
-    return voltageValues[channel];
+    IOSnapshot snapshot;
+    getIOSnapshot(snapshot);
+    return snapshot.voltages[channel];
   }
   return 0.0;
 }
 
 float getCurrentValue(uint8_t channel) {
   if (channel < 4) {
-    return currentValues[channel];
+    IOSnapshot snapshot;
+    getIOSnapshot(snapshot);
+    return snapshot.currents[channel];
   }
   return 0.0;
 }
-
-float* getVoltageValues() {
-  return voltageValues;
-}
-
-float* getCurrentValues() {
-  return currentValues;
-}
-
-bool* getButtonStates() {
-  return buttonStates;
-}
-
-bool* getInputStates() {
-  return inputStates;
-}
\ No newline at end of file
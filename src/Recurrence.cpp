@@ -0,0 +1,210 @@
+// Recurrence.cpp
+// Weekday, every-N-days and seasonal rules are evaluated once per snapshot
+// for a window of local days, so the executor and the projection only test
+// a bit per event instead of doing calendar arithmetic.
+#include "Recurrence.h"
+#include "UtcOffset.h"
+
+// Longest each month can be; February 29 is only a date in leap years
+static const uint8_t daysInMonth[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+static bool isLeapYear(int year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+bool recurrenceIsEveryDay(const Recurrence& rule) {
+  return rule.weekdays == RECURRENCE_ALL_WEEKDAYS && rule.intervalDays <= 1 && rule.seasonStart == 0;
+}
+
+bool recurrenceMatchesDay(const Recurrence& rule, uint16_t localDay) {
+  // 1970-01-01 was a Thursday
+  uint8_t weekday = (localDay + 4) % 7;
+  if (!(rule.weekdays & (1 << weekday))) {
+    return false;
+  }
+
+  // The anchor only sets the phase, so days before it match too
+  if (rule.intervalDays > 1) {
+    int32_t sinceAnchor = (int32_t)localDay - rule.anchorDay;
+    if (((sinceAnchor % rule.intervalDays) + rule.intervalDays) % rule.intervalDays != 0) {
+      return false;
+    }
+  }
+
+  if (rule.seasonStart != 0) {
+    time_t dayStart = (time_t)localDay * 86400;
+    struct tm date;
+    gmtime_r(&dayStart, &date);
+    uint16_t monthDay = (date.tm_mon + 1) * 100 + date.tm_mday;
+
+    if (rule.seasonStart <= rule.seasonEnd) {
+      if (monthDay < rule.seasonStart || monthDay > rule.seasonEnd) return false;
+    } else {
+      // Season over New Year, e.g. 11-01 to 02-28
+      if (monthDay < rule.seasonStart && monthDay > rule.seasonEnd) return false;
+    }
+  }
+  return true;
+}
+
+uint8_t internRecurrence(Schedule& sch, const Recurrence& rule) {
+  if (recurrenceIsEveryDay(rule)) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < sch.ruleCount; i++) {
+    if (memcmp(&sch.rules[i], &rule, sizeof(Recurrence)) == 0) {
+      return i + 1;
+    }
+  }
+
+  if (sch.ruleCount >= SCHEDULE_MAX_RULES) {
+    return RECURRENCE_TABLE_FULL;
+  }
+  sch.rules[sch.ruleCount] = rule;
+  return ++sch.ruleCount;
+}
+
+// UTC instant of the midnight starting a local day. The offset is taken at
+// that midnight, found from the offset at the day's nominal start.
+static time_t localDayStart(uint16_t localDay) {
+  time_t nominal = (time_t)localDay * 86400;
+  time_t start = nominal - getUtcOffsetSeconds(nominal);
+  return nominal - getUtcOffsetSeconds(start);
+}
+
+void compileRecurrenceDays(const SchedulerState& state, time_t now, RecurrenceDays& days) {
+  days.utcOffset = getUtcOffsetSeconds(now);
+
+  // Yesterday is included for runs that started then and are still going
+  days.firstDay = (uint16_t)((now + days.utcOffset) / 86400 - 1);
+  memset(days.masks, 0, sizeof(days.masks));
+
+  for (uint8_t d = 0; d <= RECURRENCE_DAYS; d++) {
+    days.dayStarts[d] = localDayStart(days.firstDay + d);
+  }
+
+  for (uint8_t d = 0; d < RECURRENCE_DAYS; d++) {
+    uint16_t localDay = days.firstDay + d;
+    for (uint8_t s = 0; s < state.scheduleCount; s++) {
+      const Schedule& sch = state.schedules[s];
+      uint8_t mask = 1;
+      for (uint8_t r = 0; r < sch.ruleCount; r++) {
+        if (recurrenceMatchesDay(sch.rules[r], localDay)) {
+          mask |= 1 << (r + 1);
+        }
+      }
+      days.masks[d][s] = mask;
+    }
+  }
+}
+
+bool eventFiresAt(const RecurrenceDays& days, uint8_t scheduleIdx, const Event& event, time_t start) {
+  // Guess the day with the offset at compile time, then correct it by the
+  // day's own start: a DST change in the window moves it by at most one
+  int32_t d = (int32_t)((start + days.utcOffset) / 86400) - days.firstDay;
+  if (d >= 0 && d <= RECURRENCE_DAYS && start < days.dayStarts[d]) {
+    d--;
+  } else if (d >= -1 && d < RECURRENCE_DAYS && start >= days.dayStarts[d + 1]) {
+    d++;
+  }
+  if (d < 0 || d >= RECURRENCE_DAYS) {
+    return false;
+  }
+  return (days.masks[d][scheduleIdx] >> event.rule) & 1;
+}
+
+time_t recurrenceDaysEnd(const RecurrenceDays& days) {
+  return days.dayStarts[RECURRENCE_DAYS];
+}
+
+bool parseRecurrenceDate(const char* text, uint16_t& localDay) {
+  int year, month, day;
+  char extra;
+  if (!text || sscanf(text, "%4d-%2d-%2d%c", &year, &month, &day, &extra) != 3) {
+    return false;
+  }
+  if (year < 1970 || year > 2099 || month < 1 || month > 12 || day < 1 || day > daysInMonth[month - 1]) {
+    return false;
+  }
+  if (month == 2 && day == 29 && !isLeapYear(year)) {
+    return false;
+  }
+
+  struct tm date = {};
+  date.tm_year = year - 1900;
+  date.tm_mon = month - 1;
+  date.tm_mday = day;
+  localDay = (uint16_t)(makeUtcTime(&date) / 86400);
+  return true;
+}
+
+void formatRecurrenceDate(uint16_t localDay, char* buffer) {
+  time_t dayStart = (time_t)localDay * 86400;
+  struct tm date;
+  gmtime_r(&dayStart, &date);
+  sprintf(buffer, "%04d-%02d-%02d", date.tm_year + 1900, date.tm_mon + 1, date.tm_mday);
+}
+
+bool parseSeasonDate(const char* text, uint16_t& monthDay) {
+  int month, day;
+  char extra;
+  if (!text || sscanf(text, "%2d-%2d%c", &month, &day, &extra) != 2) {
+    return false;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > daysInMonth[month - 1]) {
+    return false;
+  }
+  monthDay = month * 100 + day;
+  return true;
+}
+
+void formatSeasonDate(uint16_t monthDay, char* buffer) {
+  sprintf(buffer, "%02u-%02u", monthDay / 100, monthDay % 100);
+}
+
+void beginRecurrence(Recurrence& rule) {
+  memset(&rule, 0, sizeof(rule));
+  rule.weekdays = RECURRENCE_ALL_WEEKDAYS;
+}
+
+bool isRecurrenceField(const char* key) {
+  return strcmp(key, "weekdays") == 0 || strcmp(key, "everyDays") == 0 || strcmp(key, "anchor") == 0 ||
+         strcmp(key, "seasonStart") == 0 || strcmp(key, "seasonEnd") == 0;
+}
+
+// Whole integer literal within [min, max]
+static bool parseRecurrenceNumber(const char* literal, long min, long max, long& value) {
+  char* end;
+  value = strtol(literal, &end, 10);
+  return end != literal && *end == 0 && value >= min && value <= max;
+}
+
+bool applyRecurrenceField(Recurrence& rule, const char* key, const char* value, bool isString) {
+  long number;
+
+  if (strcmp(key, "weekdays") == 0) {
+    if (isString || !parseRecurrenceNumber(value, 1, RECURRENCE_ALL_WEEKDAYS, number)) return false;
+    rule.weekdays = (uint8_t)number;
+  } else if (strcmp(key, "everyDays") == 0) {
+    if (isString || !parseRecurrenceNumber(value, 0, 255, number)) return false;
+    rule.intervalDays = (uint8_t)number;
+  } else if (strcmp(key, "anchor") == 0) {
+    return isString && parseRecurrenceDate(value, rule.anchorDay);
+  } else if (strcmp(key, "seasonStart") == 0) {
+    return isString && parseSeasonDate(value, rule.seasonStart);
+  } else if (strcmp(key, "seasonEnd") == 0) {
+    return isString && parseSeasonDate(value, rule.seasonEnd);
+  }
+  return true;
+}
+
+bool finishRecurrence(Recurrence& rule) {
+  // The anchor only matters with an interval
+  if (rule.intervalDays <= 1) {
+    rule.intervalDays = 0;
+    rule.anchorDay = 0;
+  }
+  // Valid season dates are never 0, so 0 means the field was missing
+  return (rule.seasonStart == 0) == (rule.seasonEnd == 0);
+}
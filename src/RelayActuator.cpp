@@ -0,0 +1,223 @@
+// RelayActuator.cpp
+// One task owns every timed relay pulse: ON requests arrive through a queue and
+// the matching OFF deadlines sit in a min-heap, so the task only wakes when
+// there is a request to apply or a deadline that is due. The pulses only set
+// the pulse owner's mask (see RelayOwner), and a relay leaves it when the
+// last pulse on it ends.
+#include "RelayActuator.h"
+#include "IOManager.h"
+#include "Utils.h"
+#include "esp_timer.h"
+
+// Pulse request passed from producers to the actuator task
+struct RelayCommand {
+  uint8_t relay;
+  uint16_t duration;     // Seconds
+  int64_t queuedAtUs;    // esp_timer time when the request was queued
+};
+
+// Pending relay-off deadline
+struct RelayDeadline {
+  int64_t deadlineUs;    // esp_timer time at which the relay must turn off
+  uint8_t relay;
+};
+
+static TaskHandle_t actuatorTaskHandle = NULL;
+static QueueHandle_t commandQueue = NULL;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Heap and pulse counts are only touched by the actuator task
+static RelayDeadline deadlineHeap[RELAY_ACTUATOR_MAX_DEADLINES];
+static uint16_t deadlineCount = 0;
+static uint8_t activePulses[8] = {};   // Pending deadlines per relay
+
+static RelayActuatorStats stats = {};
+
+static void swapDeadlines(uint16_t a, uint16_t b) {
+  RelayDeadline tmp = deadlineHeap[a];
+  deadlineHeap[a] = deadlineHeap[b];
+  deadlineHeap[b] = tmp;
+}
+
+static bool pushDeadline(uint8_t relay, int64_t deadlineUs) {
+  if (deadlineCount >= RELAY_ACTUATOR_MAX_DEADLINES) {
+    return false;
+  }
+
+  uint16_t i = deadlineCount++;
+  deadlineHeap[i].relay = relay;
+  deadlineHeap[i].deadlineUs = deadlineUs;
+
+  // Sift up
+  while (i > 0) {
+    uint16_t parent = (i - 1) / 2;
+    if (deadlineHeap[parent].deadlineUs <= deadlineHeap[i].deadlineUs) break;
+    swapDeadlines(parent, i);
+    i = parent;
+  }
+  return true;
+}
+
+static RelayDeadline popDeadline() {
+  RelayDeadline top = deadlineHeap[0];
+  deadlineHeap[0] = deadlineHeap[--deadlineCount];
+
+  // Sift down
+  uint16_t i = 0;
+  for (;;) {
+    uint16_t left = 2 * i + 1;
+    uint16_t right = left + 1;
+    uint16_t smallest = i;
+    if (left < deadlineCount && deadlineHeap[left].deadlineUs < deadlineHeap[smallest].deadlineUs) smallest = left;
+    if (right < deadlineCount && deadlineHeap[right].deadlineUs < deadlineHeap[smallest].deadlineUs) smallest = right;
+    if (smallest == i) break;
+    swapDeadlines(i, smallest);
+    i = smallest;
+  }
+  return top;
+}
+
+static void recordLatency(int64_t latencyUs) {
+  if (latencyUs < 0) latencyUs = 0;
+  portENTER_CRITICAL(&statsMux);
+  stats.lastLatencyUs = (uint32_t)latencyUs;
+  if (stats.lastLatencyUs > stats.maxLatencyUs) stats.maxLatencyUs = stats.lastLatencyUs;
+  stats.totalLatencyUs += latencyUs;
+  stats.latencySamples++;
+  portEXIT_CRITICAL(&statsMux);
+}
+
+// Ticks to block until the earliest deadline (forever if there is none)
+static TickType_t ticksUntilNextDeadline() {
+  if (deadlineCount == 0) {
+    return portMAX_DELAY;
+  }
+  int64_t remainingUs = deadlineHeap[0].deadlineUs - esp_timer_get_time();
+  if (remainingUs <= 0) {
+    return 0;
+  }
+  TickType_t ticks = pdMS_TO_TICKS((remainingUs + 999) / 1000);
+  return ticks > 0 ? ticks : 1;
+}
+
+static void relayActuatorTask(void* pvParameters) {
+  debugPrintln("DEBUG: Relay actuator task started");
+
+  for (;;) {
+    uint8_t onMask = 0;
+    uint8_t offMask = 0;
+    int64_t onQueuedAtUs[8];
+    RelayCommand cmd;
+
+    // Sleep until a new request arrives or the next deadline is due,
+    // then take every request that is already waiting
+    if (xQueueReceive(commandQueue, &cmd, ticksUntilNextDeadline()) == pdTRUE) {
+      do {
+        int64_t deadlineUs = esp_timer_get_time() + (int64_t)cmd.duration * 1000000LL;
+        if (pushDeadline(cmd.relay, deadlineUs)) {
+          activePulses[cmd.relay]++;
+          onMask |= (1 << cmd.relay);
+          onQueuedAtUs[cmd.relay] = cmd.queuedAtUs;
+        } else {
+          debugPrintf("ERROR: Relay actuator deadline heap full, dropping pulse for relay %d\n", cmd.relay);
+          portENTER_CRITICAL(&statsMux);
+          stats.pulsesDropped++;
+          portEXIT_CRITICAL(&statsMux);
+        }
+      } while (xQueueReceive(commandQueue, &cmd, 0) == pdTRUE);
+    }
+
+    // Collect every deadline that has passed; a relay with a longer pulse
+    // still pending stays on
+    int64_t nowUs = esp_timer_get_time();
+    int64_t offDueUs[8];
+    bool expired = false;
+    while (deadlineCount > 0 && deadlineHeap[0].deadlineUs <= nowUs) {
+      RelayDeadline due = popDeadline();
+      expired = true;
+      if (--activePulses[due.relay] == 0) {
+        offMask |= (1 << due.relay);
+        offDueUs[due.relay] = due.deadlineUs;
+      }
+    }
+
+    if (onMask == 0 && offMask == 0) {
+      if (expired) {
+        portENTER_CRITICAL(&statsMux);
+        stats.queuedDeadlines = deadlineCount;
+        portEXIT_CRITICAL(&statsMux);
+      }
+      continue;
+    }
+
+    // All transitions of this instant become a single relayState write
+    applyRelayTransitions(RELAY_OWNER_PULSE, onMask, offMask);
+    int64_t appliedUs = esp_timer_get_time();
+
+    for (uint8_t relay = 0; relay < 8; relay++) {
+      if (onMask & (1 << relay)) {
+        recordLatency(appliedUs - onQueuedAtUs[relay]);
+      } else if (offMask & (1 << relay)) {
+        recordLatency(appliedUs - offDueUs[relay]);
+      }
+    }
+
+    portENTER_CRITICAL(&statsMux);
+    stats.relayUpdates++;
+    stats.pulsesAccepted += __builtin_popcount(onMask);
+    stats.queuedDeadlines = deadlineCount;
+    if (deadlineCount > stats.peakDeadlines) stats.peakDeadlines = deadlineCount;
+    portEXIT_CRITICAL(&statsMux);
+  }
+}
+
+void startRelayActuator() {
+  if (actuatorTaskHandle != NULL) {
+    return;
+  }
+
+  commandQueue = xQueueCreate(RELAY_ACTUATOR_QUEUE_LENGTH, sizeof(RelayCommand));
+  if (commandQueue == NULL) {
+    debugPrintln("ERROR: Failed to create relay actuator queue");
+    return;
+  }
+
+  xTaskCreatePinnedToCore(
+    relayActuatorTask,
+    "RelayActuator",
+    RELAY_ACTUATOR_STACK_SIZE,
+    NULL,
+    2,     // Higher priority to ensure timely execution
+    &actuatorTaskHandle,
+    1      // Run on core 1
+  );
+  debugPrintln("DEBUG: Relay actuator task created");
+}
+
+bool queueRelayPulse(uint8_t relay, uint16_t durationSeconds) {
+  if (commandQueue == NULL) {
+    debugPrintln("ERROR: Relay actuator not started");
+    return false;
+  }
+
+  RelayCommand cmd;
+  cmd.relay = relay;
+  cmd.duration = durationSeconds;
+  cmd.queuedAtUs = esp_timer_get_time();
+
+  if (xQueueSend(commandQueue, &cmd, 0) != pdTRUE) {
+    debugPrintf("ERROR: Relay actuator queue full, dropping pulse for relay %d\n", relay);
+    portENTER_CRITICAL(&statsMux);
+    stats.pulsesDropped++;
+    portEXIT_CRITICAL(&statsMux);
+    return false;
+  }
+  return true;
+}
+
+RelayActuatorStats getRelayActuatorStats() {
+  portENTER_CRITICAL(&statsMux);
+  RelayActuatorStats copy = stats;
+  portEXIT_CRITICAL(&statsMux);
+  return copy;
+}
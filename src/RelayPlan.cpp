@@ -0,0 +1,303 @@
+// RelayPlan.cpp
+#include "RelayPlan.h"
+#include "Utils.h"
+
+// Runs of the schedule being compiled; only used while building, which is
+// serialized by the snapshot publisher
+static ZoneRun* planRuns = NULL;
+static uint32_t planRunCapacity = 0;
+static uint32_t planVersions = 0;   // Last RelayPlan.version handed out
+
+static int compareIntervals(const void* a, const void* b) {
+  const RelayInterval* ia = (const RelayInterval*)a;
+  const RelayInterval* ib = (const RelayInterval*)b;
+  if (ia->start != ib->start) return ia->start < ib->start ? -1 : 1;
+  return 0;
+}
+
+// Order by requested start, then relay, so queued zones run in relay order
+static int compareZoneRuns(const void* a, const void* b) {
+  const ZoneRun* ra = (const ZoneRun*)a;
+  const ZoneRun* rb = (const ZoneRun*)b;
+  if (ra->start != rb->start) return ra->start < rb->start ? -1 : 1;
+  return (int)ra->relay - (int)rb->relay;
+}
+
+uint32_t countScheduleZoneRuns(const Schedule& schedule) {
+  return (uint32_t)schedule.eventCount * __builtin_popcount(schedule.relayMask);
+}
+
+void clearZoneSlots(ZoneSlots& slots) {
+  memset(&slots, 0, sizeof(slots));
+}
+
+void advanceZoneSlots(ZoneSlots& slots) {
+  for (uint8_t slot = 0; slot < 8; slot++) {
+    slots.freeAt[slot] -= SECONDS_PER_DAY;
+  }
+}
+
+void zoneSlotsAtMidnight(const Schedule& schedule, uint8_t scheduleIdx, const RecurrenceDays& days,
+                         uint32_t day, ZoneRun* runs, uint16_t maxRuns, ZoneSlots& slots) {
+  // Queues longer than a day are not followed further back
+  clearZoneSlots(slots);
+  sequenceScheduleZones(schedule, scheduleIdx, days, day - 1, runs, maxRuns, slots);
+  advanceZoneSlots(slots);
+}
+
+uint16_t sequenceScheduleZones(const Schedule& schedule, uint8_t scheduleIdx, const RecurrenceDays& days,
+                               uint32_t day, ZoneRun* runs, uint16_t maxRuns, ZoneSlots& slots) {
+  uint16_t count = 0;
+  time_t dayStart = (time_t)day * SECONDS_PER_DAY;
+
+  for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
+    const Event& event = schedule.events[eventIdx];
+    if (event.duration == 0) continue;
+    if (!eventFiresAt(days, scheduleIdx, event, dayStart + event.secondOfDay)) continue;
+
+    for (uint8_t relay = 0; relay < 8 && count < maxRuns; relay++) {
+      if (!(schedule.relayMask & (1 << relay))) continue;
+
+      ZoneRun& run = runs[count++];
+      run.start = event.secondOfDay;
+      run.end = run.start + event.duration;
+      run.relay = relay;
+      run.eventIdx = eventIdx;
+    }
+  }
+
+  qsort(runs, count, sizeof(ZoneRun), compareZoneRuns);
+
+  if (schedule.maxOpenZones == 0 || schedule.maxOpenZones >= 8) {
+    return count;
+  }
+
+  // Each slot is one zone the pump can feed; a run takes the slot that lets
+  // it start soonest, which keeps the pump busy and the queue short. Slots
+  // still taken by yesterday's queue count like any other.
+  uint8_t slotCount = schedule.maxOpenZones;
+
+  for (uint16_t i = 0; i < count; i++) {
+    ZoneRun& run = runs[i];
+    uint32_t duration = run.end - run.start;
+
+    uint8_t bestSlot = 0;
+    int32_t bestStart = 0;
+    for (uint8_t slot = 0; slot < slotCount; slot++) {
+      int32_t start = run.start;
+      if (slots.used[slot] && slots.freeAt[slot] + schedule.zoneGapSeconds > start) {
+        start = slots.freeAt[slot] + schedule.zoneGapSeconds;
+      }
+      if (slot == 0 || start < bestStart) {
+        bestSlot = slot;
+        bestStart = start;
+      }
+    }
+
+    run.start = bestStart;
+    run.end = bestStart + duration;
+    slots.freeAt[bestSlot] = run.end;
+    slots.used[bestSlot] = true;
+  }
+  return count;
+}
+
+// Sort and merge overlapping or touching intervals in place
+static uint16_t mergeIntervals(RelayInterval* intervals, uint16_t count) {
+  if (count == 0) return 0;
+
+  qsort(intervals, count, sizeof(RelayInterval), compareIntervals);
+
+  uint16_t merged = 0;
+  for (uint16_t i = 1; i < count; i++) {
+    if (intervals[i].start <= intervals[merged].end) {
+      if (intervals[i].end > intervals[merged].end) {
+        intervals[merged].end = intervals[i].end;
+      }
+    } else {
+      intervals[++merged] = intervals[i];
+    }
+  }
+  return merged + 1;
+}
+
+// Append an interval within one day. A full list is merged first and only
+// grown if that frees less than half of it. Returns false if it cannot grow.
+static bool appendInterval(RelayPlan& plan, uint8_t relay, uint32_t start, uint32_t end) {
+  uint16_t& count = plan.count[relay];
+  uint16_t& capacity = plan.capacity[relay];
+
+  if (count >= capacity) {
+    count = mergeIntervals(plan.intervals[relay], count);
+
+    if ((uint32_t)count * 2 >= capacity) {
+      uint32_t grown = capacity ? (uint32_t)capacity * 2 : RELAY_PLAN_MIN_CAPACITY;
+      if (grown > 0xFFFF) grown = 0xFFFF;
+      RelayInterval* intervals = (RelayInterval*)realloc(plan.intervals[relay], grown * sizeof(RelayInterval));
+      if (intervals) {
+        plan.intervals[relay] = intervals;
+        capacity = grown;
+      }
+    }
+    if (count >= capacity) {
+      return false;
+    }
+  }
+  plan.intervals[relay][count].start = start;
+  plan.intervals[relay][count].end = end;
+  count++;
+  return true;
+}
+
+// Add the part of a run that falls within the plan's day. Times are
+// relative to the plan's midnight, so yesterday's runs start below zero.
+static bool addRun(RelayPlan& plan, uint8_t relay, int32_t start, int32_t end) {
+  if (start < 0) start = 0;
+  if (end > (int32_t)SECONDS_PER_DAY) end = SECONDS_PER_DAY;
+  if (start >= end) {
+    return true;
+  }
+  return appendInterval(plan, relay, start, end);
+}
+
+void buildRelayPlan(const SchedulerState& state, const RecurrenceDays& days, uint32_t day, RelayPlan& plan) {
+  uint8_t overflow = 0;
+  memset(plan.count, 0, sizeof(plan.count));
+  plan.version = __atomic_add_fetch(&planVersions, 1, __ATOMIC_RELAXED);
+
+  for (int scheduleIdx = 0; scheduleIdx < state.scheduleCount; scheduleIdx++) {
+    const Schedule& schedule = state.schedules[scheduleIdx];
+    if (schedule.relayMask == 0) continue;
+
+    uint32_t needed = countScheduleZoneRuns(schedule);
+    if (needed > planRunCapacity) {
+      free(planRuns);
+      planRuns = (ZoneRun*)malloc(needed * sizeof(ZoneRun));
+      planRunCapacity = planRuns ? needed : 0;
+    }
+    if (!planRuns) {
+      debugPrintf("ERROR: Out of memory sequencing %u zone runs\n", needed);
+      overflow |= schedule.relayMask;
+      continue;
+    }
+
+    // Yesterday's firings for runs still going after midnight, then today's,
+    // queued behind whatever of yesterday still holds the pump
+    ZoneSlots slots;
+    clearZoneSlots(slots);
+    for (uint32_t runDay = day - 1; runDay <= day; runDay++) {
+      int32_t shift = (runDay < day) ? -(int32_t)SECONDS_PER_DAY : 0;
+      if (runDay == day) {
+        advanceZoneSlots(slots);
+      }
+      uint16_t runCount = sequenceScheduleZones(schedule, scheduleIdx, days, runDay, planRuns, needed, slots);
+      for (uint16_t i = 0; i < runCount; i++) {
+        const ZoneRun& run = planRuns[i];
+        if (!addRun(plan, run.relay, (int32_t)run.start + shift, (int32_t)run.end + shift)) {
+          overflow |= (1 << run.relay);
+        }
+      }
+    }
+  }
+
+  for (uint8_t relay = 0; relay < 8; relay++) {
+    plan.count[relay] = mergeIntervals(plan.intervals[relay], plan.count[relay]);
+    if (overflow & (1 << relay)) {
+      debugPrintf("ERROR: Relay %d plan is incomplete (out of memory)\n", relay);
+    }
+  }
+}
+
+// Index of the first interval of a relay that ends after secondOfDay
+static uint16_t findInterval(const RelayPlan& plan, uint8_t relay, uint32_t secondOfDay) {
+  uint16_t low = 0;
+  uint16_t high = plan.count[relay];
+
+  while (low < high) {
+    uint16_t mid = (low + high) / 2;
+    if (plan.intervals[relay][mid].end <= secondOfDay) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// Bring the cursor to secondOfDay: step forward from where it is, or
+// search again if it belongs to another plan or a later second
+static void seekRelayPlanCursor(const RelayPlan& plan, RelayPlanCursor& cursor, uint32_t secondOfDay) {
+  if (cursor.version != plan.version || secondOfDay < cursor.secondOfDay) {
+    for (uint8_t relay = 0; relay < 8; relay++) {
+      cursor.index[relay] = findInterval(plan, relay, secondOfDay);
+    }
+    cursor.version = plan.version;
+  } else {
+    for (uint8_t relay = 0; relay < 8; relay++) {
+      uint16_t& i = cursor.index[relay];
+      while (i < plan.count[relay] && plan.intervals[relay][i].end <= secondOfDay) {
+        i++;
+      }
+    }
+  }
+  cursor.secondOfDay = secondOfDay;
+}
+
+static uint8_t maskAtIndex(const RelayPlan& plan, const uint16_t* index, uint32_t secondOfDay) {
+  uint8_t mask = 0;
+
+  for (uint8_t relay = 0; relay < 8; relay++) {
+    uint16_t i = index[relay];
+    if (i < plan.count[relay] && plan.intervals[relay][i].start <= secondOfDay) {
+      mask |= (1 << relay);
+    }
+  }
+  return mask;
+}
+
+static uint32_t edgeAtIndex(const RelayPlan& plan, const uint16_t* index, uint32_t secondOfDay) {
+  uint32_t nearest = 0;
+
+  for (uint8_t relay = 0; relay < 8; relay++) {
+    if (plan.count[relay] == 0) continue;
+
+    // Next edge is the current interval's end, the next interval's start,
+    // or (if tomorrow's plan starts the same way) the first start tomorrow
+    uint32_t edge;
+    uint16_t i = index[relay];
+    if (i < plan.count[relay]) {
+      const RelayInterval& interval = plan.intervals[relay][i];
+      edge = (interval.start <= secondOfDay) ? interval.end : interval.start;
+    } else {
+      edge = SECONDS_PER_DAY + plan.intervals[relay][0].start;
+    }
+
+    uint32_t seconds = edge - secondOfDay;
+    if (nearest == 0 || seconds < nearest) {
+      nearest = seconds;
+    }
+  }
+  return nearest;
+}
+
+uint8_t relayPlanMaskAt(const RelayPlan& plan, uint32_t secondOfDay) {
+  RelayPlanCursor cursor = {};
+  seekRelayPlanCursor(plan, cursor, secondOfDay);
+  return maskAtIndex(plan, cursor.index, secondOfDay);
+}
+
+uint8_t relayPlanMaskAt(const RelayPlan& plan, RelayPlanCursor& cursor, uint32_t secondOfDay) {
+  seekRelayPlanCursor(plan, cursor, secondOfDay);
+  return maskAtIndex(plan, cursor.index, secondOfDay);
+}
+
+uint32_t secondsUntilRelayPlanEdge(const RelayPlan& plan, uint32_t secondOfDay) {
+  RelayPlanCursor cursor = {};
+  seekRelayPlanCursor(plan, cursor, secondOfDay);
+  return edgeAtIndex(plan, cursor.index, secondOfDay);
+}
+
+uint32_t secondsUntilRelayPlanEdge(const RelayPlan& plan, RelayPlanCursor& cursor, uint32_t secondOfDay) {
+  seekRelayPlanCursor(plan, cursor, secondOfDay);
+  return edgeAtIndex(plan, cursor.index, secondOfDay);
+}
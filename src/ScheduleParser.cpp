@@ -0,0 +1,479 @@
+// ScheduleParser.cpp
+// Byte-at-a-time JSON tokenizer that only keeps the current key and value,
+// plus the handful of document positions the scheduler cares about:
+//   { "currentScheduleIndex": n,
+//     "schedules": [ { "name", "metadata", "relayMask", "maxOpenZones",
+//                      "zoneGapSeconds", "lightsOnTime", "lightsOffTime",
+//                      "events": [ { "id", "time", "duration", "weekdays",
+//                                    "everyDays", "anchor", "seasonStart",
+//                                    "seasonEnd" } ] } ] }
+// Anything else is tokenized and discarded.
+//
+// The upload session below owns the parser and the staging state for the
+// one upload allowed at a time; it knows nothing about the web server, so
+// chunking, concurrent uploads and disconnects are testable on the host.
+#include "ScheduleParser.h"
+#include "EventPool.h"
+#include "Recurrence.h"
+#include "Utils.h"
+
+enum ScheduleParserState {
+  PARSE_VALUE,            // Expecting any value
+  PARSE_VALUE_OR_END,     // Just after '['
+  PARSE_KEY_OR_END,       // Just after '{'
+  PARSE_KEY,              // After ',' in an object
+  PARSE_COLON,
+  PARSE_STRING,
+  PARSE_STRING_ESCAPE,
+  PARSE_STRING_UNICODE,
+  PARSE_LITERAL,          // Number, true, false or null
+  PARSE_AFTER_VALUE,      // Expecting ',' or the end of the container
+  PARSE_DONE
+};
+
+static bool fail(ScheduleParser& p, const char* message) {
+  if (!p.error) {
+    p.error = message;
+    debugPrintf("ERROR: Schedule upload rejected: %s\n", message);
+  }
+  return false;
+}
+
+static bool appendToken(ScheduleParser& p, char c) {
+  if (p.tokenLen >= SCHEDULE_PARSER_TOKEN_LEN - 1) {
+    return fail(p, "Value too long");
+  }
+  p.token[p.tokenLen++] = c;
+  p.token[p.tokenLen] = 0;
+  return true;
+}
+
+// Key of the object at level, or "" if that level is an array
+static const char* keyAt(const ScheduleParser& p, int level) {
+  return p.containers[level] == '{' ? p.keys[level] : "";
+}
+
+// ---- Document semantics ----
+
+static void onContainerOpen(ScheduleParser& p, char type) {
+  int level = p.depth - 1;
+
+  if (level == 1 && type == '[' && strcmp(keyAt(p, 0), "schedules") == 0) {
+    p.inSchedules = true;
+  } else if (level == 2 && type == '{' && p.inSchedules) {
+    p.inSchedule = true;
+    p.scheduleDropped = !reserveSchedules(*p.target, p.target->scheduleCount + 1);
+    if (p.scheduleDropped) {
+      debugPrintf("WARNING: Schedule limit reached (%d) or out of memory, skipping additional schedules\n",
+                  MAX_SCHEDULES);
+      return;
+    }
+
+    // Counted from the start, so a failed upload still releases its event block
+    Schedule& sch = p.target->schedules[p.target->scheduleCount++];
+    sch.name = ARENA_NONE;
+    sch.metadata = ARENA_NONE;
+    sch.relayMask = 0;
+    sch.maxOpenZones = 0;
+    sch.zoneGapSeconds = 0;
+    sch.lightsOnMinute = 6 * 60;
+    sch.lightsOffMinute = 18 * 60;
+    sch.ruleCount = 0;
+    sch.eventCount = 0;
+  } else if (level == 3 && type == '[' && p.inSchedule && strcmp(keyAt(p, 2), "events") == 0) {
+    p.inEvents = true;
+  } else if (level == 4 && type == '{' && p.inEvents) {
+    p.inEvent = true;
+    memset(&p.pendingEvent, 0, sizeof(p.pendingEvent));
+    beginRecurrence(p.pendingRule);
+    p.eventTimeValid = false;
+    p.eventRuleValid = true;
+  } else if (level == 5 && p.inEvent && isRecurrenceField(keyAt(p, 4))) {
+    // An array or object is never a valid recurrence value
+    p.eventRuleValid = false;
+  }
+}
+
+static void onContainerClose(ScheduleParser& p) {
+  int level = p.depth - 1;
+
+  if (level == 4 && p.inEvent) {
+    p.inEvent = false;
+    if (p.scheduleDropped) return;
+
+    Schedule& sch = p.target->schedules[p.target->scheduleCount - 1];
+    p.eventRuleValid &= finishRecurrence(p.pendingRule);
+    uint8_t ruleRef = (p.eventTimeValid && p.eventRuleValid) ? internRecurrence(sch, p.pendingRule)
+                                                             : RECURRENCE_TABLE_FULL;
+
+    if (!p.eventTimeValid) {
+      debugPrintf("WARNING: Skipping event \"%s\" with invalid time\n", p.pendingEvent.id);
+    } else if (!p.eventRuleValid) {
+      debugPrintf("WARNING: Skipping event \"%s\" with invalid recurrence\n", p.pendingEvent.id);
+    } else if (ruleRef == RECURRENCE_TABLE_FULL) {
+      debugPrintf("WARNING: Skipping event \"%s\", schedule already has %d recurrence rules\n",
+                 p.pendingEvent.id, SCHEDULE_MAX_RULES);
+    } else if (sch.eventCount >= MAX_EVENTS || !reserveScheduleEvents(sch, sch.eventCount + 1)) {
+      debugPrintf("WARNING: Event limit reached (%d), skipping additional events\n", sch.eventCount);
+    } else {
+      p.pendingEvent.rule = ruleRef;
+      sch.events[sch.eventCount++] = p.pendingEvent;
+    }
+  } else if (level == 3 && p.inEvents) {
+    p.inEvents = false;
+  } else if (level == 2 && p.inSchedule) {
+    p.inSchedule = false;
+  } else if (level == 1 && p.inSchedules) {
+    p.inSchedules = false;
+  }
+}
+
+static void onScalar(ScheduleParser& p, bool isString) {
+  int level = p.depth - 1;
+  const char* key = keyAt(p, level);
+  const char* value = p.token;
+
+  if (level == 0) {
+    if (!isString && strcmp(key, "currentScheduleIndex") == 0) {
+      p.target->currentScheduleIndex = (uint8_t)strtol(value, NULL, 10);
+    }
+    return;
+  }
+
+  if (level == 2 && p.inSchedule && !p.scheduleDropped) {
+    Schedule& sch = p.target->schedules[p.target->scheduleCount - 1];
+    uint16_t minute;
+
+    if (isString && strcmp(key, "name") == 0) {
+      sch.name = internString(p.target->strings, value);
+    } else if (isString && strcmp(key, "metadata") == 0) {
+      sch.metadata = internString(p.target->strings, value);
+    } else if (!isString && strcmp(key, "relayMask") == 0) {
+      sch.relayMask = (uint8_t)strtol(value, NULL, 10);
+    } else if (!isString && strcmp(key, "maxOpenZones") == 0) {
+      sch.maxOpenZones = (uint8_t)strtol(value, NULL, 10);
+    } else if (!isString && strcmp(key, "zoneGapSeconds") == 0) {
+      sch.zoneGapSeconds = (uint16_t)strtol(value, NULL, 10);
+    } else if (isString && strcmp(key, "lightsOnTime") == 0 && parseMinuteOfDay(value, minute)) {
+      sch.lightsOnMinute = localMinuteToUTC(minute);
+    } else if (isString && strcmp(key, "lightsOffTime") == 0 && parseMinuteOfDay(value, minute)) {
+      sch.lightsOffMinute = localMinuteToUTC(minute);
+    }
+    return;
+  }
+
+  if (level == 4 && p.inEvent) {
+    uint32_t second;
+
+    if (isString && strcmp(key, "id") == 0) {
+      strlcpy(p.pendingEvent.id, value, sizeof(p.pendingEvent.id));
+    } else if (isString && strcmp(key, "time") == 0) {
+      p.eventTimeValid = parseSecondOfDay(value, second);
+      if (p.eventTimeValid) {
+        p.pendingEvent.secondOfDay = localSecondToUTC(second);
+      }
+    } else if (!isString && strcmp(key, "duration") == 0) {
+      p.pendingEvent.duration = (uint16_t)strtoul(value, NULL, 10);
+    } else {
+      p.eventRuleValid &= applyRecurrenceField(p.pendingRule, key, value, isString);
+    }
+  }
+}
+
+// ---- Tokenizer ----
+
+static bool openContainer(ScheduleParser& p, char type) {
+  if (p.depth == 0 && type != '{') {
+    return fail(p, "Document must be a JSON object");
+  }
+  if (p.depth >= SCHEDULE_PARSER_MAX_DEPTH) {
+    return fail(p, "Document nested too deeply");
+  }
+  p.containers[p.depth] = type;
+  p.keys[p.depth][0] = 0;
+  p.depth++;
+  onContainerOpen(p, type);
+  p.state = (type == '{') ? PARSE_KEY_OR_END : PARSE_VALUE_OR_END;
+  return true;
+}
+
+static bool closeContainer(ScheduleParser& p, char type) {
+  if (p.depth == 0 || p.containers[p.depth - 1] != (type == '}' ? '{' : '[')) {
+    return fail(p, "Mismatched bracket");
+  }
+  onContainerClose(p);
+  p.depth--;
+  p.state = (p.depth == 0) ? PARSE_DONE : PARSE_AFTER_VALUE;
+  return true;
+}
+
+static bool isLiteralChar(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static bool finishLiteral(ScheduleParser& p) {
+  if (strcmp(p.token, "true") != 0 && strcmp(p.token, "false") != 0 && strcmp(p.token, "null") != 0) {
+    char* end;
+    strtod(p.token, &end);
+    if (end == p.token || *end != 0) {
+      return fail(p, "Invalid literal");
+    }
+  }
+  onScalar(p, false);
+  p.state = PARSE_AFTER_VALUE;
+  return true;
+}
+
+static bool finishString(ScheduleParser& p) {
+  if (p.tokenIsKey) {
+    strlcpy(p.keys[p.depth - 1], p.token, SCHEDULE_PARSER_KEY_LEN);
+    p.state = PARSE_COLON;
+  } else {
+    onScalar(p, true);
+    p.state = PARSE_AFTER_VALUE;
+  }
+  return true;
+}
+
+static bool startToken(ScheduleParser& p, bool isKey) {
+  p.tokenLen = 0;
+  p.token[0] = 0;
+  p.tokenIsKey = isKey;
+  return true;
+}
+
+// Encode a \u escape as UTF-8
+static bool appendUnicode(ScheduleParser& p, uint16_t cp) {
+  if (cp < 0x80) {
+    return appendToken(p, (char)cp);
+  }
+  if (cp < 0x800) {
+    return appendToken(p, (char)(0xC0 | (cp >> 6))) && appendToken(p, (char)(0x80 | (cp & 0x3F)));
+  }
+  return appendToken(p, (char)(0xE0 | (cp >> 12))) &&
+         appendToken(p, (char)(0x80 | ((cp >> 6) & 0x3F))) &&
+         appendToken(p, (char)(0x80 | (cp & 0x3F)));
+}
+
+static bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool feedChar(ScheduleParser& p, char c) {
+  switch (p.state) {
+    case PARSE_VALUE_OR_END:
+      if (c == ']') return closeContainer(p, c);
+      // Fall through
+    case PARSE_VALUE:
+      if (isWhitespace(c)) return true;
+      if (c == '{' || c == '[') return openContainer(p, c);
+      if (p.depth == 0) return fail(p, "Document must be a JSON object");
+      if (c == '"') {
+        p.state = PARSE_STRING;
+        return startToken(p, false);
+      }
+      if (c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n') {
+        p.state = PARSE_LITERAL;
+        startToken(p, false);
+        return appendToken(p, c);
+      }
+      return fail(p, "Unexpected character");
+
+    case PARSE_KEY_OR_END:
+      if (c == '}') return closeContainer(p, c);
+      // Fall through
+    case PARSE_KEY:
+      if (isWhitespace(c)) return true;
+      if (c == '"') {
+        p.state = PARSE_STRING;
+        return startToken(p, true);
+      }
+      return fail(p, "Expected object key");
+
+    case PARSE_COLON:
+      if (isWhitespace(c)) return true;
+      if (c == ':') {
+        p.state = PARSE_VALUE;
+        return true;
+      }
+      return fail(p, "Expected ':'");
+
+    case PARSE_STRING:
+      if (c == '"') return finishString(p);
+      if (c == '\\') {
+        p.state = PARSE_STRING_ESCAPE;
+        return true;
+      }
+      if ((uint8_t)c < 0x20) return fail(p, "Control character in string");
+      // Keys only need to be recognized, so long ones are truncated rather than rejected
+      if (p.tokenIsKey && p.tokenLen >= SCHEDULE_PARSER_KEY_LEN - 1) return true;
+      return appendToken(p, c);
+
+    case PARSE_STRING_ESCAPE:
+      p.state = PARSE_STRING;
+      switch (c) {
+        case '"': case '\\': case '/': return appendToken(p, c);
+        case 'b': return appendToken(p, '\b');
+        case 'f': return appendToken(p, '\f');
+        case 'n': return appendToken(p, '\n');
+        case 'r': return appendToken(p, '\r');
+        case 't': return appendToken(p, '\t');
+        case 'u':
+          p.state = PARSE_STRING_UNICODE;
+          p.unicodeDigits = 4;
+          p.unicodeValue = 0;
+          return true;
+      }
+      return fail(p, "Invalid escape");
+
+    case PARSE_STRING_UNICODE: {
+      uint8_t digit;
+      if (c >= '0' && c <= '9') digit = c - '0';
+      else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+      else return fail(p, "Invalid unicode escape");
+
+      p.unicodeValue = (p.unicodeValue << 4) | digit;
+      if (--p.unicodeDigits == 0) {
+        p.state = PARSE_STRING;
+        return appendUnicode(p, p.unicodeValue);
+      }
+      return true;
+    }
+
+    case PARSE_LITERAL:
+      if (isLiteralChar(c)) return appendToken(p, c);
+      if (!finishLiteral(p)) return false;
+      // The terminating character belongs to the container
+      return feedChar(p, c);
+
+    case PARSE_AFTER_VALUE:
+      if (isWhitespace(c)) return true;
+      if (c == '}' || c == ']') return closeContainer(p, c);
+      if (c == ',') {
+        p.state = (p.containers[p.depth - 1] == '{') ? PARSE_KEY : PARSE_VALUE;
+        return true;
+      }
+      return fail(p, "Expected ',' or end of container");
+
+    case PARSE_DONE:
+      if (isWhitespace(c)) return true;
+      return fail(p, "Trailing data after document");
+  }
+  return fail(p, "Parser state error");
+}
+
+void beginScheduleParser(ScheduleParser& parser, SchedulerState* target) {
+  memset(&parser, 0, sizeof(parser));
+  parser.target = target;
+  parser.state = PARSE_VALUE;
+
+  releaseSchedulerState(*target);
+}
+
+bool feedScheduleParser(ScheduleParser& parser, const uint8_t* data, size_t len) {
+  if (parser.error) {
+    return false;
+  }
+  for (size_t i = 0; i < len; i++) {
+    if (!feedChar(parser, (char)data[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool finishScheduleParser(ScheduleParser& parser) {
+  if (parser.error) {
+    return false;
+  }
+  if (parser.state != PARSE_DONE) {
+    return fail(parser, "Document is incomplete");
+  }
+  return true;
+}
+
+// ---- Upload session ----
+
+static ScheduleParser uploadParser;
+static SchedulerState* uploadStaging = NULL;
+static const void* uploadOwner = NULL;
+
+void discardScheduleUpload(SchedulerState*& state) {
+  if (state) {
+    freeSchedulerState(*state);
+    free(state);
+    state = NULL;
+  }
+}
+
+static void endScheduleUpload() {
+  uploadOwner = NULL;
+  discardScheduleUpload(uploadStaging);
+}
+
+int feedScheduleUpload(const void* owner, const uint8_t* data, size_t len,
+                       size_t index, size_t total, SchedulerState** parsed) {
+  *parsed = NULL;
+
+  if (index == 0) {
+    // Never reset an upload in progress: its client would not get an answer
+    if (uploadOwner != NULL && uploadOwner != owner) {
+      debugPrintln("ERROR: Schedule upload rejected, another upload is in progress");
+      return 409;
+    }
+    endScheduleUpload();
+
+    // Reject oversized uploads before reading any of them
+    if (total > SCHEDULE_UPLOAD_MAX_BYTES) {
+      debugPrintf("ERROR: Scheduler upload too large (%d > %d bytes)\n", total, SCHEDULE_UPLOAD_MAX_BYTES);
+      return 413;
+    }
+
+    // The staging state has a fixed size; its events come from the pool
+    uploadStaging = (SchedulerState*)calloc(1, sizeof(SchedulerState));
+    if (!uploadStaging) {
+      debugPrintf("ERROR: Failed to allocate %d bytes for scheduler upload, free heap: %d bytes\n",
+                 sizeof(SchedulerState), ESP.getFreeHeap());
+      return 500;
+    }
+    beginScheduleParser(uploadParser, uploadStaging);
+    uploadOwner = owner;
+  }
+
+  // Remaining chunks of a rejected or abandoned upload
+  if (owner != uploadOwner) {
+    return SCHEDULE_UPLOAD_IGNORED;
+  }
+
+  if (!feedScheduleParser(uploadParser, data, len)) {
+    endScheduleUpload();
+    return 400;
+  }
+
+  // Wait for the rest of the body
+  if (index + len < total) {
+    return SCHEDULE_UPLOAD_RECEIVING;
+  }
+
+  if (!finishScheduleParser(uploadParser)) {
+    endScheduleUpload();
+    return 400;
+  }
+
+  *parsed = uploadStaging;
+  uploadStaging = NULL;
+  uploadOwner = NULL;
+  return SCHEDULE_UPLOAD_PARSED;
+}
+
+void abandonScheduleUpload(const void* owner) {
+  if (owner != NULL && owner == uploadOwner) {
+    debugPrintln("WARNING: Scheduler upload abandoned by the client");
+    endScheduleUpload();
+  }
+}
+
+bool scheduleUploadInProgress() {
+  return uploadOwner != NULL;
+}
@@ -1,8 +1,18 @@
 #include "Scheduler.h"
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
+#include <StreamString.h>
 #include <time.h>
 #include "IOManager.h"
+#include "SchedulerSnapshot.h"
+#include "SchedulerProjection.h"
+#include "SchedulerLatency.h"
+#include "EventPool.h"
+#include "Recurrence.h"
+#include "RelayActuator.h"
+#include "SchedulerStore.h"
+#include "TimeManager.h"
+#include "ScheduleParser.h"
 #include <ESPAsyncWebServer.h>
 
 // Reference to the web server defined elsewhere in the project
@@ -16,11 +26,20 @@ extern AsyncWebServer server;
   #define debugPrintf(fmt, ...) Serial.printf(fmt, __VA_ARGS__)
 #endif
 
-// Global scheduler state
-SchedulerState schedulerState;
-static TaskHandle_t schedulerTaskHandle = NULL;
+// Scheduler state, clock and task handle live in SchedulerCore.cpp
+extern TaskHandle_t schedulerTaskHandle;
 static bool schedulerActive = false;
-static time_t lastEventCheckTime = 0;
+static uint32_t schedulerWakeups = 0;       // Times the scheduler task has run
+static time_t schedulerNextWake = 0;        // UTC time the task is sleeping until (0 when idle)
+static uint8_t scheduledRelayMask = 0;      // Relays the relay plan currently holds on
+static RelayPlanCursor relayPlanCursor = {}; // Executor's place in the relay plan
+
+// State versioning for the delta WebSocket protocol. Clients keep the
+// version of the state they hold and only receive schedules changed since.
+static uint32_t schedulerStateId = 0;             // Random per boot so a reboot is never mistaken for a match
+static uint32_t schedulerStateVersion = 0;        // Incremented on every committed change
+static uint32_t schedulerStructureVersion = 0;    // Last change that moved or removed schedules
+static uint32_t scheduleModVersion[MAX_SCHEDULES] = {};
 
 // Global WebSocket objects
 AsyncWebSocket schedulerWs("/scheduler-ws");
@@ -28,134 +47,249 @@ EditSession currentSession;
 unsigned long lastTimeoutCheck = 0;
 
 // Forward declarations
-void checkAndExecuteScheduledEvents();
+void checkAndExecuteScheduledEvents(SchedulerSnapshot& snapshot, time_t now);
 void handleWebSocketEvent(AsyncWebSocket* webSocket, AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
 void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len);
-JsonObject serializeSchedule(Schedule& schedule, bool convertToLocalTime);
+void serializeSchedule(JsonObject obj, const Schedule& schedule, const StringArena& strings, bool convertToLocalTime);
+bool adoptPendingSchedule(Schedule& target);
+static bool importSchedulerJsonFile();
 void sendSchedulerState(AsyncWebSocketClient* client);
+bool serializeSchedulerPatch(uint32_t sinceVersion, StreamString& out);
 void resetSession();
 String generateSessionId();
 void sendErrorResponse(AsyncWebSocketClient* client, const String& message);
-void broadcastSchedulerUpdate();
+void broadcastSchedulerUpdate(uint32_t fromVersion);
 void checkSchedulerTimeouts();
 void updateSchedulerWebSocket();
 
-// If timegm is not available on your platform, use this implementation:
-time_t timegm(struct tm *tm) {
-  time_t ret;
-  char *tz;
-  
-  tz = getenv("TZ");
-  setenv("TZ", "", 1);
-  tzset();
-  ret = mktime(tm);
-  if (tz)
-    setenv("TZ", tz, 1);
-  else
-    unsetenv("TZ");
-  tzset();
-  return ret;
+// Read a "HH:MM" JSON field into UTC minutes, converting from local time if requested
+static bool readTimeField(JsonVariant value, bool isLocalTime, uint16_t& utcMinute) {
+  uint16_t minute;
+  if (!parseMinuteOfDay(value.as<const char*>(), minute)) {
+    return false;
+  }
+  utcMinute = isLocalTime ? localMinuteToUTC(minute) : minute;
+  return true;
 }
 
-// Convert times between local and UTC formats
-String localTimeToUTC(const String& localTime) {
-  // Parse the input time
-  int hours, minutes;
-  if (sscanf(localTime.c_str(), "%d:%d", &hours, &minutes) != 2) {
-    debugPrintf("ERROR: Invalid time format: %s\n", localTime.c_str());
-    return localTime; // Return unchanged if format is invalid
+// Read an event's optional recurrence fields (schema in Recurrence.h, shared
+// with the streaming upload parser)
+static bool recurrenceFromJson(JsonObject evtObj, Recurrence& rule) {
+  beginRecurrence(rule);
+  bool valid = true;
+  for (JsonPair field : evtObj) {
+    const char* key = field.key().c_str();
+    if (!isRecurrenceField(key)) continue;
+    
+    JsonVariant value = field.value();
+    if (value.is<const char*>()) {
+      valid &= applyRecurrenceField(rule, key, value.as<const char*>(), true);
+    } else {
+      // Numbers (and anything else) as their JSON literal, as the parser sees them
+      char literal[24];
+      serializeJson(value, literal, sizeof(literal));
+      valid &= applyRecurrenceField(rule, key, literal, false);
+    }
+  }
+  return finishRecurrence(rule) && valid;
+}
+
+// Fill an event of sch from its JSON form; events with an invalid time or
+// recurrence are rejected
+static bool eventFromJson(JsonObject evtObj, bool timesAreLocal, Schedule& sch, Event& evt) {
+  uint32_t second;
+  if (!parseSecondOfDay(evtObj["time"].as<const char*>(), second)) {
+    debugPrintf("WARNING: Skipping event \"%s\" with invalid time\n", evtObj["id"] | "");
+    return false;
   }
   
-  debugPrintf("DEBUG: Converting local time %02d:%02d to UTC\n", hours, minutes);
-  
-  // Get current time to determine time zone offset
-  time_t now = time(NULL);
-  
-  // Get local and UTC time structures
-  struct tm localTimeInfo;
-  localtime_r(&now, &localTimeInfo);
+  Recurrence rule;
+  if (!recurrenceFromJson(evtObj, rule)) {
+    debugPrintf("WARNING: Skipping event \"%s\" with invalid recurrence\n", evtObj["id"] | "");
+    return false;
+  }
+  uint8_t ruleRef = internRecurrence(sch, rule);
+  if (ruleRef == RECURRENCE_TABLE_FULL) {
+    debugPrintf("WARNING: Skipping event \"%s\", schedule already has %d recurrence rules\n",
+               evtObj["id"] | "", SCHEDULE_MAX_RULES);
+    return false;
+  }
+  evt.rule = ruleRef;
+  evt.secondOfDay = timesAreLocal ? localSecondToUTC(second) : second;
+  strlcpy(evt.id, evtObj["id"] | "", sizeof(evt.id));
+  evt.duration = evtObj["duration"].as<uint16_t>();
+  evt.lastRun = 0; // Never run
+  return true;
+}
+
+// Fill a schedule from its JSON form, interning its strings into the given arena
+static void scheduleFromJson(JsonObject schObj, bool timesAreLocal, Schedule& sch, StringArena& strings) {
+  sch.name = internString(strings, schObj["name"] | "");
+  sch.metadata = internString(strings, schObj["metadata"] | "");
+  sch.relayMask = schObj["relayMask"].as<uint8_t>();
+  sch.maxOpenZones = schObj["maxOpenZones"] | 0;
+  sch.zoneGapSeconds = schObj["zoneGapSeconds"] | 0;
+  
+  if (!readTimeField(schObj["lightsOnTime"], timesAreLocal, sch.lightsOnMinute)) {
+    sch.lightsOnMinute = 6 * 60;
+  }
+  if (!readTimeField(schObj["lightsOffTime"], timesAreLocal, sch.lightsOffMinute)) {
+    sch.lightsOffMinute = 18 * 60;
+  }
   
-  // Create a tm structure with today's date but the specified local time
-  struct tm targetLocalTime = localTimeInfo;
-  targetLocalTime.tm_hour = hours;
-  targetLocalTime.tm_min = minutes;
-  targetLocalTime.tm_sec = 0;
+  sch.eventCount = 0;
+  sch.ruleCount = 0;
+  JsonArray events = schObj["events"].as<JsonArray>();
+  if (!reserveScheduleEvents(sch, events.size() < MAX_EVENTS ? events.size() : MAX_EVENTS)) {
+    debugPrintf("WARNING: Event pool exhausted, schedule \"%s\" loaded without events\n", arenaString(strings, sch.name));
+    return;
+  }
+  for (JsonObject evtObj : events) {
+    if (sch.eventCount >= sch.eventCapacity) {
+      debugPrintf("WARNING: Event limit reached (%d), skipping additional events\n", sch.eventCapacity);
+      break;
+    }
+    if (eventFromJson(evtObj, timesAreLocal, sch, sch.events[sch.eventCount])) {
+      sch.eventCount++;
+    }
+  }
+}
+
+// Write the fields of a rule that differ from "every day"
+static void recurrenceToJson(JsonObject evtObj, const Recurrence& rule) {
+  char dateStr[11];
   
-  // Convert local time structure to time_t (seconds since epoch)
-  time_t targetLocalTimeT = mktime(&targetLocalTime);
+  if (rule.weekdays != RECURRENCE_ALL_WEEKDAYS) {
+    evtObj["weekdays"] = rule.weekdays;
+  }
+  if (rule.intervalDays > 1) {
+    evtObj["everyDays"] = rule.intervalDays;
+    formatRecurrenceDate(rule.anchorDay, dateStr);
+    evtObj["anchor"] = dateStr;
+  }
+  if (rule.seasonStart != 0) {
+    formatSeasonDate(rule.seasonStart, dateStr);
+    evtObj["seasonStart"] = dateStr;
+    formatSeasonDate(rule.seasonEnd, dateStr);
+    evtObj["seasonEnd"] = dateStr;
+  }
+}
+
+// Write a schedule into a JSON object, optionally converting times to local
+static void scheduleToJson(JsonObject obj, const Schedule& sch, const StringArena& strings, bool convertToLocalTime) {
+  char timeStr[9];
   
-  // Convert to UTC time structure
-  struct tm targetUtcTime;
-  gmtime_r(&targetLocalTimeT, &targetUtcTime);
+  obj["name"] = arenaString(strings, sch.name);
+  obj["metadata"] = arenaString(strings, sch.metadata);
+  obj["relayMask"] = sch.relayMask;
+  obj["maxOpenZones"] = sch.maxOpenZones;
+  obj["zoneGapSeconds"] = sch.zoneGapSeconds;
   
-  // Format the UTC time as a string
-  char buffer[6]; // HH:MM\0
-  sprintf(buffer, "%02d:%02d", targetUtcTime.tm_hour, targetUtcTime.tm_min);
+  formatMinuteOfDay(convertToLocalTime ? utcMinuteToLocal(sch.lightsOnMinute) : sch.lightsOnMinute, timeStr);
+  obj["lightsOnTime"] = timeStr;
+  formatMinuteOfDay(convertToLocalTime ? utcMinuteToLocal(sch.lightsOffMinute) : sch.lightsOffMinute, timeStr);
+  obj["lightsOffTime"] = timeStr;
   
-  debugPrintf("DEBUG: Converted to UTC time %s\n", buffer);
-  return String(buffer);
+  // Add events
+  JsonArray events = obj.createNestedArray("events");
+  for (int i = 0; i < sch.eventCount; i++) {
+    const Event& evt = sch.events[i];
+    JsonObject evtObj = events.createNestedObject();
+    evtObj["id"] = evt.id;
+    formatSecondOfDay(convertToLocalTime ? utcSecondToLocal(evt.secondOfDay) : evt.secondOfDay, timeStr);
+    evtObj["time"] = timeStr;
+    evtObj["duration"] = evt.duration;
+    if (evt.rule > 0 && evt.rule <= sch.ruleCount) {
+      recurrenceToJson(evtObj, sch.rules[evt.rule - 1]);
+    }
+  }
 }
 
-String utcToLocalTime(const String& utcTime) {
-  // Parse the input time
-  int hours, minutes;
-  if (sscanf(utcTime.c_str(), "%d:%d", &hours, &minutes) != 2) {
-    debugPrintf("ERROR: Invalid time format: %s\n", utcTime.c_str());
-    return utcTime; // Return unchanged if format is invalid
+// Record a change to one schedule whose position did not move
+static void markScheduleChanged(int index) {
+  schedulerStateVersion++;
+  scheduleModVersion[index] = schedulerStateVersion;
+}
+
+// Record a change that added, removed or reordered schedules
+static void markSchedulerStructureChanged() {
+  schedulerStateVersion++;
+  schedulerStructureVersion = schedulerStateVersion;
+  for (int i = 0; i < MAX_SCHEDULES; i++) {
+    scheduleModVersion[i] = schedulerStateVersion;
   }
-  
-  debugPrintf("DEBUG: Converting UTC time %02d:%02d to local time\n", hours, minutes);
-  
-  // Get current time
-  time_t now = time(NULL);
-  
-  // Get UTC time structure
-  struct tm utcTimeInfo;
-  gmtime_r(&now, &utcTimeInfo);
-  
-  // Create a tm structure with today's date but the specified UTC time
-  struct tm targetUtcTime = utcTimeInfo;
-  targetUtcTime.tm_hour = hours;
-  targetUtcTime.tm_min = minutes;
-  targetUtcTime.tm_sec = 0;
-  
-  // Convert UTC time to time_t using a workaround for timegm
-  // We temporarily change timezone to UTC, call mktime, then restore timezone
-  char* tz = getenv("TZ");
-  setenv("TZ", "", 1);
-  tzset();
-  time_t targetUtcTimeT = mktime(&targetUtcTime);
-  if (tz)
-    setenv("TZ", tz, 1);
-  else
-    unsetenv("TZ");
-  tzset();
-  
-  // Convert to local time structure
-  struct tm targetLocalTime;
-  localtime_r(&targetUtcTimeT, &targetLocalTime);
-  
-  // Format the local time as a string
-  char buffer[6]; // HH:MM\0
-  sprintf(buffer, "%02d:%02d", targetLocalTime.tm_hour, targetLocalTime.tm_min);
-  
-  debugPrintf("DEBUG: Converted to local time %s\n", buffer);
-  return String(buffer);
 }
 
-bool isValidTimeFormat(const String& timeStr) {
-  int hours, minutes;
-  int parsed = sscanf(timeStr.c_str(), "%d:%d", &hours, &minutes);
-  return (parsed == 2 && hours >= 0 && hours < 24 && minutes >= 0 && minutes < 60);
+// A publish failed: put schedulerState back to the generation the executor
+// runs, so editors never show schedules that are not in effect
+static void revertToPublishedState() {
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  if (snapshot == NULL) {
+    releaseSchedulerState(schedulerState);
+  } else if (!copySchedulerState(schedulerState, snapshot->state)) {
+    debugPrintln("ERROR: Could not restore the published scheduler state");
+  }
+  releaseSchedulerSnapshot(snapshot);
+  markSchedulerStructureChanged();
+  debugPrintln("WARNING: Scheduler change not applied, reverted to the running state");
+}
+
+// JSON capacity needed for one serialized schedule
+static size_t scheduleJsonCapacity(const Schedule& sch) {
+  // Events with a recurrence rule carry up to five more fields
+  return 256 + sch.eventCount * (sch.ruleCount > 0 ? 176 : 80);
+}
+
+// Write a document's object without its closing brace, so that members
+// printed after it (schedule by schedule) complete it
+static size_t printOpenObject(Print& out, const JsonDocument& doc) {
+  String text;
+  serializeJson(doc, text);
+  return text.length() > 1 ? out.write((const uint8_t*)text.c_str(), text.length() - 1) : 0;
+}
+
+// Write one schedule (local times) through a document of its own, so the
+// largest allocation is one schedule rather than the whole state. Returns
+// false if the document or the output ran out of memory.
+static bool printScheduleJson(Print& out, const Schedule& sch, const StringArena& strings) {
+  DynamicJsonDocument doc(scheduleJsonCapacity(sch));
+  if (doc.capacity() == 0) {
+    debugPrintf("ERROR: No memory to serialize a schedule of %u events\n", sch.eventCount);
+    return false;
+  }
+  scheduleToJson(doc.to<JsonObject>(), sch, strings, true);
+  if (doc.overflowed()) {
+    debugPrintf("ERROR: Schedule of %u events overflowed its JSON document\n", sch.eventCount);
+    return false;
+  }
+  return serializeJson(doc, out) == measureJson(doc);
 }
 
+// Write schedules as the members of a "<key>": [...] array and close the
+// object printOpenObject() started
+static bool printSchedulesJson(Print& out, const char* key, const SchedulerState& state) {
+  out.printf(",\"%s\":[", key);
+  for (int i = 0; i < state.scheduleCount; i++) {
+    if (i > 0) out.print(',');
+    if (!printScheduleJson(out, state.schedules[i], state.strings)) {
+      return false;
+    }
+  }
+  return out.print("]}") == 2;
+}
 
 // Initialize the scheduler system
 void initScheduler() {
   debugPrintln("Initializing Scheduler system");
+  
+  // New id every boot, so WebSocket clients holding an older state resync
+  schedulerStateId = random(1, 0x7FFFFFFF);
     
   testTimeConversion();
   
+  // Single task that owns all timed relay pulses
+  startRelayActuator();
+  
   // Always start the scheduler task automatically
   startSchedulerTask();
   debugPrintln("Scheduler task started automatically");
@@ -174,7 +308,9 @@ void initScheduler() {
   // If no schedules exist, create a default empty schedule
   if (schedulerState.scheduleCount == 0) {
     debugPrintln("No schedules found, creating default empty schedule");
-    addNewSchedule("Default Schedule");
+    if (!addNewSchedule("Default Schedule")) {
+      debugPrintln("ERROR: Could not create the default schedule");
+    }
   }
   
   // Don't start the scheduler task automatically
@@ -182,23 +318,89 @@ void initScheduler() {
   debugPrintln("Scheduler initialized successfully");
 }
 
+// Drive the relays the plan owns to the level it wants, touching only the
+// ones that change. Pulses and manual switching hold relays of their own.
+// dueTime is the planned instant of the change (0 if it was not a timed edge)
+// and is used to measure actuation latency.
+static void applyScheduledRelays(uint8_t desired, time_t dueTime) {
+  uint8_t onMask = desired & ~scheduledRelayMask;
+  uint8_t offMask = scheduledRelayMask & ~desired;
+
+  if (onMask || offMask) {
+    if (dueTime) {
+      beginLatencySample(dueTime);
+    }
+    RelayWrite write = applyRelayTransitions(RELAY_OWNER_PLAN, onMask, offMask);
+    if (dueTime) {
+      recordLatencyWrite(write.sequence, write.cycles);
+    }
+    debugPrintf("DEBUG: Scheduled relays 0x%02X -> 0x%02X\n", scheduledRelayMask, desired);
+    scheduledRelayMask = desired;
+  }
+}
+
+static void schedulerTask(void* parameter) {
+  debugPrintln("Scheduler task started");
+  
+  // Generation this task is executing; only this task writes its run stamps
+  SchedulerSnapshot* snapshot = NULL;
+
+  while (true) {
+    TickType_t waitTicks = portMAX_DELAY;
+    schedulerWakeups++;
+    
+    // Move to the newest published state, even while deactivated, so
+    // editors always get their spare buffer back
+    if (adoptSchedulerSnapshot(snapshot) && snapshot->persist) {
+      saveSchedulerState(snapshot->state);
+    }
+
+    if (schedulerActive && snapshot) {
+      time_t now = getSchedulerTime();
+      uint32_t secondOfDay = now % 86400;
+      
+      // The relay plan and recurrence bits are per day; compile the new day
+      // (or UTC offset) into a fresh generation before using them. If an
+      // editor is publishing right now, hold the relays and retry shortly
+      // rather than wait for it (its publish wakes the task anyway).
+      if (schedulerSnapshotIsStale(*snapshot, now) && !recompileSchedulerSnapshot(snapshot, now)) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SCHEDULER_RECOMPILE_RETRY_MS));
+        continue;
+      }
+      
+      // A change found on a timed wake belongs to the edge the task slept
+      // until; early wakes (edits, NTP steps) and test clocks are not timed
+      time_t dueTime = 0;
+      if (schedulerClockIsSystem() && schedulerNextWake != 0 &&
+          schedulerNextWake <= now && now - schedulerNextWake <= SCHEDULER_CATCHUP_S) {
+        dueTime = schedulerNextWake;
+      }
+      
+      applyScheduledRelays(relayPlanMaskAt(snapshot->relayPlan, relayPlanCursor, secondOfDay), dueTime);
+      checkAndExecuteScheduledEvents(*snapshot, now);
+
+      // Wake for whichever comes first: the next event, relay edge or midnight
+      uint32_t seconds = secondsUntilNextSchedulerStep(*snapshot, now, &relayPlanCursor);
+      schedulerNextWake = now + seconds;
+      waitTicks = pdMS_TO_TICKS(seconds * 1000);
+    } else {
+      // Release anything the plan was holding when the scheduler is stopped
+      applyScheduledRelays(0, 0);
+      schedulerNextWake = 0;
+    }
+
+    // Sleep until the next due instant; edits, activation changes and
+    // NTP time steps notify the task to recompute it early
+    ulTaskNotifyTake(pdTRUE, waitTicks);
+  }
+}
+
 // Start the scheduler task
 void startSchedulerTask() {
   if (schedulerTaskHandle == NULL) {
     schedulerActive = true;
     xTaskCreatePinnedToCore(
-      [](void* parameter) {
-        debugPrintln("Scheduler task started");
-        
-        while (true) {
-          if (schedulerActive) {
-            // Check and execute scheduled events
-            checkAndExecuteScheduledEvents();
-          }
-          // Check every second
-          vTaskDelay(pdMS_TO_TICKS(1000));
-        }
-      },
+      schedulerTask,
       "SchedulerTask",
       4096,
       NULL,
@@ -209,6 +411,7 @@ void startSchedulerTask() {
     debugPrintln("Scheduler task created");
   } else {
     schedulerActive = true;
+    wakeSchedulerTask();
     debugPrintln("Scheduler activated");
   }
 }
@@ -216,14 +419,33 @@ void startSchedulerTask() {
 // Stop the scheduler task
 void stopSchedulerTask() {
   schedulerActive = false;
+  wakeSchedulerTask();
   debugPrintln("Scheduler deactivated");
 }
 
-// This is an improved version of the checkAndExecuteScheduledEvents function for src/Scheduler.cpp
+// Firings of one executor wake, for the run journal
+struct SchedulerRunBatch {
+  SchedulerRunRef runs[SCHEDULER_RUN_BATCH];
+  uint16_t count;
+  bool overflow;
+};
 
-void checkAndExecuteScheduledEvents() {
-  // Get current time in UTC
-  time_t now = time(NULL);
+static void collectSchedulerRun(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx,
+                                time_t now, void* context) {
+  SchedulerRunBatch& batch = *(SchedulerRunBatch*)context;
+  logSchedulerFiring(snapshot, scheduleIdx, eventIdx);
+  if (batch.count < SCHEDULER_RUN_BATCH) {
+    batch.runs[batch.count].scheduleIdx = scheduleIdx;
+    batch.runs[batch.count].eventIdx = eventIdx;
+    batch.count++;
+  } else {
+    batch.overflow = true;
+  }
+}
+
+// Record the events starting this second. The relays themselves follow the
+// snapshot's relay plan, so overlapping events share one on/off cycle.
+void checkAndExecuteScheduledEvents(SchedulerSnapshot& snapshot, time_t now) {
   struct tm utcTime;
   gmtime_r(&now, &utcTime);
   
@@ -242,156 +464,38 @@ void checkAndExecuteScheduledEvents() {
     
     lastHour = utcTime.tm_hour;
   }
-    
-  // Get current time in UTC
-  now = time(NULL);
-  gmtime_r(&now, &utcTime);
-  
-  // Only check events if we have active schedules and we're at a new minute
-  if (now == lastEventCheckTime || schedulerState.scheduleCount == 0) {
-    return;
-  }
-  
-  lastEventCheckTime = now;
-  
-  // Format current time for logging
-  char timeStr[20];
-  strftime(timeStr, sizeof(timeStr), "%H:%M:%S", &utcTime);
-  debugPrintf("DEBUG: Checking scheduled events at %s UTC\n", timeStr);
-  
-  // Current time in minutes since midnight (UTC)
-  int currentMinute = utcTime.tm_hour * 60 + utcTime.tm_min;
-  
-  debugPrintf("DEBUG: Checking events at %02d:%02d (minute %d)\n", 
-    utcTime.tm_hour, utcTime.tm_min, currentMinute);
-  
-  // Iterate through all schedules
-  for (int scheduleIdx = 0; scheduleIdx < schedulerState.scheduleCount; scheduleIdx++) {
-    Schedule& schedule = schedulerState.schedules[scheduleIdx];
-    
-    // Skip inactive schedules (those without assigned relays)
-    if (schedule.relayMask == 0) {
-      continue;
-    }
-    
-    debugPrintf("DEBUG: Checking schedule '%s' (relayMask: 0x%02X)\n", 
-               schedule.name.c_str(), schedule.relayMask);
-    
-    // Check each event in this schedule
-    for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
-      Event& event = schedule.events[eventIdx];
-      
-      // Parse event time
-      int eventHour = 0, eventMinute = 0;
-      sscanf(event.time.c_str(), "%d:%d", &eventHour, &eventMinute);
-      int eventStartMinute = eventHour * 60 + eventMinute;
-      
-      // Check if this event should start now (compare minutes since midnight)
-      if (eventStartMinute == currentMinute) {
-        // Check if this event has already been executed today
-        // Bit 0 in executedMask is for today's execution status
-        bool alreadyExecuted = (event.executedMask & 0x01) != 0;
-        
-        if (!alreadyExecuted) {
-          debugPrintf("DEBUG: Executing event from schedule '%s': time %s, duration %d seconds, relayMask 0x%02X\n", 
-                     schedule.name.c_str(), event.time.c_str(), event.duration, schedule.relayMask);
-          
-          // Set the executed flag for this event
-          event.executedMask |= 0x01;
-          
-          // Activate the relays specified by the schedule's relay mask
-          for (int relay = 0; relay < 8; relay++) {
-            if (schedule.relayMask & (1 << relay)) {
-              debugPrintf("DEBUG: Activating relay %d for %d seconds\n", relay, event.duration);
-              executeRelayCommand(relay, event.duration);
-            }
-          }
-        } else {
-          debugPrintf("DEBUG: Event at %s already executed today, skipping\n", event.time.c_str());
-        }
-      }
-    }
-  }
   
-  // Check if day has changed since last check
-  static int lastDay = -1;
-  if (lastDay != utcTime.tm_mday) {
-    debugPrintf("DEBUG: Day changed from %d to %d, resetting execution flags\n", 
-               lastDay, utcTime.tm_mday);
-    
-    // Reset all execution flags when the day changes
-    for (int scheduleIdx = 0; scheduleIdx < schedulerState.scheduleCount; scheduleIdx++) {
-      Schedule& schedule = schedulerState.schedules[scheduleIdx];
-      for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
-        schedule.events[eventIdx].executedMask = 0;
-      }
+  // Persist the new run stamps so a reboot within the window does not
+  // re-record them: one journal append per wake, and a full store save
+  // only when the journal is full (or the wake fired more than a batch)
+  SchedulerRunBatch batch;
+  batch.count = 0;
+  batch.overflow = false;
+  if (stampDueEvents(snapshot, now, collectSchedulerRun, &batch) > 0) {
+    if (batch.overflow || !appendSchedulerRuns(snapshot.state, batch.runs, batch.count)) {
+      saveSchedulerState(snapshot.state);
     }
-    
-    lastDay = utcTime.tm_mday;
   }
 }
 
-// This is an improved version of the executeRelayCommand function for src/Scheduler.cpp
-
+// Hand a timed relay pulse to the relay actuator task
 void executeRelayCommand(uint8_t relay, uint16_t duration) {
   // Validate parameters
   if (relay >= 8 || duration == 0) {
     debugPrintf("ERROR: Invalid relay (%d) or duration (%d)\n", relay, duration);
     return;
   }
-
-  // Structure to pass parameters to the relay task
-  struct RelayTaskParams {
-    uint8_t relay;
-    uint16_t duration;
-  };
-  
-  // Allocate memory for parameters
-  RelayTaskParams* params = new RelayTaskParams;
-  params->relay = relay;
-  params->duration = duration;
-  
-  debugPrintf("DEBUG: Creating relay task for relay %d, duration %d seconds\n", relay, duration);
-  
-  // Create a task that will turn on the relay and then turn it off after the duration
-  xTaskCreatePinnedToCore(
-    [](void* parameter) {
-      RelayTaskParams* params = (RelayTaskParams*)parameter;
-      
-      // Turn on the relay
-      setRelay(params->relay, true);
-      debugPrintf("DEBUG: Relay %d turned ON, will remain on for %d seconds\n", 
-                 params->relay, params->duration);
-      
-      // Wait for the specified duration
-      vTaskDelay(pdMS_TO_TICKS(params->duration * 1000));
-      
-      // Turn off the relay
-      setRelay(params->relay, false);
-      debugPrintf("DEBUG: Relay %d turned OFF after %d seconds\n", 
-                 params->relay, params->duration);
-      
-      // Clean up
-      delete params;
-      vTaskDelete(NULL);
-    },
-    "RelayTask",
-    4096,  // Increased stack size for safety
-    params,
-    2,     // Higher priority to ensure timely execution
-    NULL,
-    1      // Run on core 1
-  );
-  
-  // Log after task creation for debugging
-  debugPrintln("DEBUG: Relay task created successfully");
+  
+  debugPrintf("DEBUG: Queueing relay %d for %d seconds\n", relay, duration);
+  queueRelayPulse(relay, duration);
 }
 
-// Create a new empty schedule
-void addNewSchedule(const String& name) {
-  if (schedulerState.scheduleCount >= MAX_SCHEDULES) {
-    debugPrintln("Cannot add new schedule: maximum number of schedules reached");
-    return;
+// Create a new empty schedule. Returns false if the limit is reached or the
+// executor could not take the new state (nothing changes then).
+bool addNewSchedule(const String& name) {
+  if (!reserveSchedules(schedulerState, schedulerState.scheduleCount + 1)) {
+    debugPrintln("Cannot add new schedule: maximum number of schedules reached or out of memory");
+    return false;
   }
   
   // Get the current time
@@ -405,21 +509,29 @@ void addNewSchedule(const String& name) {
   
   // Create the new schedule
   Schedule& newSchedule = schedulerState.schedules[schedulerState.scheduleCount];
-  newSchedule.name = name;
-  newSchedule.metadata = timeStr;
+  newSchedule.name = internSchedulerString(name.c_str());
+  newSchedule.metadata = internSchedulerString(timeStr);
   newSchedule.relayMask = 0; // No relays assigned (inactive)
-  newSchedule.lightsOnTime = "06:00"; // Default in UTC
-  newSchedule.lightsOffTime = "18:00"; // Default in UTC
+  newSchedule.maxOpenZones = 0; // All relays run together
+  newSchedule.zoneGapSeconds = 0;
+  newSchedule.lightsOnMinute = 6 * 60; // Default 06:00 UTC
+  newSchedule.lightsOffMinute = 18 * 60; // Default 18:00 UTC
+  newSchedule.ruleCount = 0;
   newSchedule.eventCount = 0;
   
   // Increment the schedule count
   schedulerState.scheduleCount++;
+  markScheduleChanged(schedulerState.scheduleCount - 1);
   
-  // Save to SPIFFS
-  saveSchedulerState();
+  // Hand the new state to the executor, which also saves it
+  if (!publishSchedulerState(true)) {
+    revertToPublishedState();
+    return false;
+  }
   
   debugPrintf("Created new schedule '%s', total schedules: %d\n", 
              name.c_str(), schedulerState.scheduleCount);
+  return true;
 }
 
 // Load scheduler state from SPIFFS
@@ -428,20 +540,48 @@ void loadSchedulerState() {
   debugPrintln("DEBUG: Loading scheduler state from SPIFFS");
   
   // Initialize empty state
-  schedulerState.scheduleCount = 0;
-  schedulerState.currentScheduleIndex = 0;
+  releaseSchedulerState(schedulerState);
+  
+  // Binary store is the primary format; the JSON file is only imported
+  // when there is no valid store yet (first boot after upgrading)
+  bool migrate = false;
+  if (!loadSchedulerStore(schedulerState) && importSchedulerJsonFile()) {
+    debugPrintln("DEBUG: Migrating scheduler JSON file to binary store");
+    migrate = true;
+  }
+  
+  for (int i = 0; i < schedulerState.scheduleCount; i++) {
+    Schedule& sch = schedulerState.schedules[i];
+    debugPrintf("DEBUG: Loaded schedule [%d]: \"%s\", relay mask 0x%02X, %d events\n", 
+               i, arenaString(schedulerState.strings, sch.name), sch.relayMask, sch.eventCount);
+  }
   
+  debugPrintf("DEBUG: Loaded %d schedules from SPIFFS\n", schedulerState.scheduleCount);
+  EventPoolStats pool = getEventPoolStats();
+  debugPrintf("DEBUG: %d/%d schedule slots, string arena %d/%d bytes, event pool %u events (%u more available), free heap %d bytes\n",
+             schedulerState.scheduleCapacity, MAX_SCHEDULES, schedulerState.strings.used, SCHEDULER_ARENA_SIZE,
+             pool.reservedEvents, pool.availableEvents, ESP.getFreeHeap());
+  markSchedulerStructureChanged();
+  if (!publishSchedulerState(migrate)) {
+    debugPrintln("ERROR: Could not publish the loaded scheduler state");
+  }
+}
+
+// Import the legacy JSON scheduler file into schedulerState
+static bool importSchedulerJsonFile() {
   // Check if the scheduler file exists
   if (!SPIFFS.exists(SCHEDULER_FILE)) {
     debugPrintln("DEBUG: Scheduler file not found, using defaults");
-    return;
+    return false;
   }
   
+  uint32_t startUs = micros();
+  
   // Open the file
   File file = SPIFFS.open(SCHEDULER_FILE, FILE_READ);
   if (!file) {
     debugPrintln("DEBUG: Failed to open scheduler file for reading");
-    return;
+    return false;
   }
   
   // Check file size
@@ -450,137 +590,64 @@ void loadSchedulerState() {
   if (size == 0) {
     debugPrintln("DEBUG: Scheduler file is empty");
     file.close();
-    return;
+    return false;
   }
   
-  // Parse JSON
-  DynamicJsonDocument doc(4096);
+  // Parse JSON into a document sized from the file (values take at most
+  // about half as much again as their text)
+  DynamicJsonDocument doc(size + size / 2 + 1024);
+  if (doc.capacity() == 0) {
+    debugPrintf("ERROR: No memory to import a %d byte scheduler file\n", size);
+    file.close();
+    return false;
+  }
   DeserializationError error = deserializeJson(doc, file);
   file.close();
   
   // Check for parsing errors
   if (error) {
     debugPrintf("DEBUG: Failed to parse scheduler JSON: %s\n", error.c_str());
-    return;
+    return false;
   }
   
   // Load scheduler state
-  schedulerState.scheduleCount = doc["scheduleCount"] | 0;
   schedulerState.currentScheduleIndex = doc["currentScheduleIndex"] | 0;
   
-  // Load schedules
+  // Load schedules (times are stored in UTC)
   JsonArray schedules = doc["schedules"].as<JsonArray>();
-  schedulerState.scheduleCount = 0; // Reset counter
-  
-  debugPrintln("DEBUG: Loading scheduler state from SPIFFS");
   
   for (JsonObject schObj : schedules) {
-    if (schedulerState.scheduleCount < MAX_SCHEDULES) {
-      Schedule& sch = schedulerState.schedules[schedulerState.scheduleCount];
-      sch.name = schObj["name"].as<String>();
-      sch.metadata = schObj["metadata"].as<String>();
-      sch.relayMask = schObj["relayMask"].as<uint8_t>();
-      sch.lightsOnTime = schObj["lightsOnTime"].as<String>();
-      sch.lightsOffTime = schObj["lightsOffTime"].as<String>();
-      
-      debugPrintf("DEBUG: Loading schedule [%d]: \"%s\"\n", 
-                 schedulerState.scheduleCount, sch.name.c_str());
-      debugPrintf("DEBUG:   - Relay Mask: 0x%02X\n", sch.relayMask);
-      debugPrintf("DEBUG:   - Lights: ON %s, OFF %s\n", 
-                 sch.lightsOnTime.c_str(), sch.lightsOffTime.c_str());
-      
-      // Load events
-      JsonArray events = schObj["events"].as<JsonArray>();
-      sch.eventCount = 0;
-      
-      debugPrintf("DEBUG:   - Events to load: %d\n", events.size());
-      
-      for (JsonObject evt : events) {
-        if (sch.eventCount < MAX_EVENTS) {
-          Event& e = sch.events[sch.eventCount];
-          e.id = evt["id"].as<String>();
-          e.time = evt["time"].as<String>();
-          e.duration = evt["duration"].as<uint16_t>();
-          e.executedMask = 0; // Reset execution flag
-          
-          debugPrintf("DEBUG:     Event [%d]: Time %s, Duration %d seconds, ID \"%s\"\n", 
-                     sch.eventCount, e.time.c_str(), e.duration, e.id.c_str());
-          
-          sch.eventCount++;
-        } else {
-          debugPrintf("DEBUG:     WARNING: Event limit reached (%d), skipping additional events\n", 
-                     MAX_EVENTS);
-          break;
-        }
-      }
-      schedulerState.scheduleCount++;
-    } else {
-      debugPrintf("DEBUG:   WARNING: Schedule limit reached (%d), skipping additional schedules\n", 
+    if (!reserveSchedules(schedulerState, schedulerState.scheduleCount + 1)) {
+      debugPrintf("DEBUG:   WARNING: Schedule limit reached (%d) or out of memory, skipping additional schedules\n", 
                  MAX_SCHEDULES);
       break;
     }
+    
+    Schedule& sch = schedulerState.schedules[schedulerState.scheduleCount];
+    scheduleFromJson(schObj, false, sch, schedulerState.strings);
+    schedulerState.scheduleCount++;
   }
   
-  debugPrintf("DEBUG: Loaded %d schedules from SPIFFS\n", schedulerState.scheduleCount);
+  debugPrintf("DEBUG: Imported scheduler JSON: %d bytes in %u us\n", size, (unsigned)(micros() - startUs));
+  return true;
 }
 
-// Save scheduler state to SPIFFS
-// 1. Enhanced schedule saving debug output
-void saveSchedulerState() {
+// Save a scheduler state to SPIFFS (called by the executor with its snapshot,
+// so the file always includes the latest run stamps)
+void saveSchedulerState(const SchedulerState& state) {
   debugPrintln("DEBUG: Saving scheduler state to SPIFFS");
   
-  // Create JSON document
-  DynamicJsonDocument doc(4096);
-  doc["scheduleCount"] = schedulerState.scheduleCount;
-  doc["currentScheduleIndex"] = schedulerState.currentScheduleIndex;
-  
-  debugPrintln("DEBUG: Saving scheduler state with following schedules:");
-  
-  // Add schedules
-  JsonArray schedules = doc.createNestedArray("schedules");
-  for (int i = 0; i < schedulerState.scheduleCount; i++) {
-    Schedule& sch = schedulerState.schedules[i];
-    JsonObject schObj = schedules.createNestedObject();
-    schObj["name"] = sch.name;
-    schObj["metadata"] = sch.metadata;
-    schObj["relayMask"] = sch.relayMask;
-    schObj["lightsOnTime"] = sch.lightsOnTime;
-    schObj["lightsOffTime"] = sch.lightsOffTime;
-    
-    // Print schedule info
-    debugPrintf("DEBUG: Schedule [%d]: \"%s\"\n", i, sch.name.c_str());
-    debugPrintf("DEBUG:   - Relay Mask: 0x%02X\n", sch.relayMask);
-    debugPrintf("DEBUG:   - Lights: ON %s, OFF %s\n", sch.lightsOnTime.c_str(), sch.lightsOffTime.c_str());
-    debugPrintf("DEBUG:   - Event count: %d\n", sch.eventCount);
-    
-    // Add events
-    JsonArray events = schObj.createNestedArray("events");
-    for (int j = 0; j < sch.eventCount; j++) {
-      Event& evt = sch.events[j];
-      JsonObject evtObj = events.createNestedObject();
-      evtObj["id"] = evt.id;
-      evtObj["time"] = evt.time;
-      evtObj["duration"] = evt.duration;
-      
-      // Print event info
-      debugPrintf("DEBUG:     Event [%d]: Time %s, Duration %d seconds, ID \"%s\"\n", 
-                 j, evt.time.c_str(), evt.duration, evt.id.c_str());
-    }
+  for (int i = 0; i < state.scheduleCount; i++) {
+    const Schedule& sch = state.schedules[i];
+    debugPrintf("DEBUG: Schedule [%d]: \"%s\", relay mask 0x%02X, %d events\n", 
+               i, arenaString(state.strings, sch.name), sch.relayMask, sch.eventCount);
   }
   
-  // Open file for writing
-  File file = SPIFFS.open(SCHEDULER_FILE, FILE_WRITE);
-  if (!file) {
-    debugPrintln("DEBUG: Failed to open scheduler file for writing");
+  if (!saveSchedulerStore(state)) {
+    debugPrintln("ERROR: Failed to save scheduler state");
     return;
   }
   
-  // Write JSON to file
-  if (serializeJson(doc, file) == 0) {
-    debugPrintln("DEBUG: Failed to write to scheduler file");
-  }
-  
-  file.close();
   debugPrintln("DEBUG: Scheduler state saved to SPIFFS");
 }
 
@@ -589,8 +656,8 @@ void saveSchedulerState() {
 void handleLoadSchedulerState(AsyncWebServerRequest *request) {
   debugPrintln("API request: Load scheduler state");
   
-  // Create JSON document
-  DynamicJsonDocument doc(4096);
+  // Everything but the schedules, which are written one at a time below
+  DynamicJsonDocument doc(1024);
   doc["scheduleCount"] = schedulerState.scheduleCount;
   doc["currentScheduleIndex"] = schedulerState.currentScheduleIndex;
   
@@ -614,53 +681,32 @@ void handleLoadSchedulerState(AsyncWebServerRequest *request) {
     relayObj["relay"] = relay;
     relayObj["assignedToSchedule"] = relayOwnership[relay] - 1; // Convert back to 0-based (-1 means unassigned)
     relayObj["assignedToScheduleName"] = relayOwnership[relay] > 0 ? 
-      schedulerState.schedules[relayOwnership[relay] - 1].name : "";
+      arenaString(schedulerState.strings, schedulerState.schedules[relayOwnership[relay] - 1].name) : "";
   }
   
-  // Add schedules
-  JsonArray schedules = doc.createNestedArray("schedules");
-  for (int i = 0; i < schedulerState.scheduleCount; i++) {
-    Schedule& sch = schedulerState.schedules[i];
-    JsonObject schObj = schedules.createNestedObject();
-    schObj["name"] = sch.name;
-    schObj["metadata"] = sch.metadata;
-    schObj["relayMask"] = sch.relayMask;
-    
-    // Convert UTC times to local time for the frontend
-    schObj["lightsOnTime"] = utcToLocalTime(sch.lightsOnTime);
-    schObj["lightsOffTime"] = utcToLocalTime(sch.lightsOffTime);
-    
-    // Add events
-    JsonArray events = schObj.createNestedArray("events");
-    for (int j = 0; j < sch.eventCount; j++) {
-      Event& evt = sch.events[j];
-      JsonObject evtObj = events.createNestedObject();
-      evtObj["id"] = evt.id;
-      // Convert UTC times to local time for the frontend
-      evtObj["time"] = utcToLocalTime(evt.time);
-      evtObj["duration"] = evt.duration;
-    }
+  // Stream the schedules (local times) into the response, so only the
+  // response text and one schedule's document are in memory at once
+  AsyncResponseStream* response = request->beginResponseStream("application/json");
+  if (doc.capacity() == 0 || doc.overflowed() || printOpenObject(*response, doc) == 0 ||
+      !printSchedulesJson(*response, "schedules", schedulerState)) {
+    delete response;
+    request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Not enough memory for the scheduler state\"}");
+    return;
   }
-  
-  // Serialize and send response
-  String response;
-  serializeJson(doc, response);
-  request->send(200, "application/json", response);
+  request->send(response);
 }
 
 // Add this helper function before handleSaveSchedulerState
 
 // Check if relays are already assigned to other schedules
-bool validateRelayAssignments(JsonArray schedules, int currentScheduleIndex) {
+bool validateRelayAssignments(const SchedulerState& state) {
   uint8_t relayAssignmentMap[8] = {0}; // Tracks which schedule owns which relay
   
-  int scheduleIndex = 0;
-  for (JsonObject schObj : schedules) {
-    uint8_t relayMask = schObj["relayMask"].as<uint8_t>();
+  for (int scheduleIndex = 0; scheduleIndex < state.scheduleCount; scheduleIndex++) {
+    uint8_t relayMask = state.schedules[scheduleIndex].relayMask;
     
     // Skip the current schedule being edited
-    if (scheduleIndex == currentScheduleIndex) {
-      scheduleIndex++;
+    if (scheduleIndex == state.currentScheduleIndex) {
       continue;
     }
     
@@ -676,156 +722,432 @@ bool validateRelayAssignments(JsonArray schedules, int currentScheduleIndex) {
         relayAssignmentMap[relay] = scheduleIndex + 1; // Store 1-based index
       }
     }
-    scheduleIndex++;
   }
   
   return true;
 }
 
+// Answer an upload that feedScheduleUpload() rejected
+static void sendUploadError(AsyncWebServerRequest *request, int status) {
+  switch (status) {
+    case 409:
+      request->send(409, "application/json", "{\"status\":\"error\",\"message\":\"Another schedule upload is in progress\"}");
+      break;
+    case 413:
+      request->send(413, "application/json", "{\"status\":\"error\",\"message\":\"Payload too large\"}");
+      break;
+    case 500:
+      request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Memory allocation failed\"}");
+      break;
+    default:
+      request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"JSON parsing error\"}");
+      break;
+  }
+}
+
+// Body handler for /api/scheduler/save, called for every chunk. The
+// document is parsed as it arrives into a staging state, which only
+// replaces schedulerState once the whole upload has parsed and validated.
 void handleSaveSchedulerState(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-  static uint8_t *jsonBuffer = NULL;
-  static size_t bufferSize = 0;
-  
-  debugPrintln("API request: Save scheduler state");
-  
-  // First chunk or single chunk
   if (index == 0) {
-    // Free previous buffer if it exists
-    if (jsonBuffer) {
-      free(jsonBuffer);
-      jsonBuffer = NULL;
-      bufferSize = 0;
+    debugPrintf("API request: Save scheduler state (%d bytes)\n", total);
+  }
+  
+  SchedulerState* staging;
+  int status = feedScheduleUpload(request, data, len, index, total, &staging);
+  if (status == SCHEDULE_UPLOAD_IGNORED) {
+    return;
+  }
+  if (status == SCHEDULE_UPLOAD_RECEIVING) {
+    if (index == 0) {
+      // A client that drops mid-upload must not keep its staging blocks
+      request->onDisconnect([request]() { abandonScheduleUpload(request); });
     }
+    return;
+  }
+  if (status != SCHEDULE_UPLOAD_PARSED) {
+    sendUploadError(request, status);
+    return;
+  }
+  
+  // Check for relay assignment conflicts
+  if (!validateRelayAssignments(*staging)) {
+    debugPrintln("ERROR: Relay assignment conflict detected");
+    request->send(400, "application/json", 
+      "{\"status\":\"error\",\"message\":\"One or more relays are already assigned to another schedule\"}");
+    discardScheduleUpload(staging);
+    return;
+  }
+  
+  // Hand the parsed schedules to the executor, which also saves them, before
+  // committing them (times were converted to UTC while parsing). Run stamps
+  // of unchanged events are carried over when the executor adopts them.
+  if (!publishSchedulerStateFrom(*staging, true)) {
+    discardScheduleUpload(staging);
+    request->send(503, "application/json",
+      "{\"status\":\"error\",\"message\":\"Scheduler busy or out of memory, try again\"}");
+    return;
+  }
+  
+  // The staging schedules' event blocks move to schedulerState with them
+  releaseSchedulerState(schedulerState);
+  schedulerState = *staging;
+  free(staging);
+  
+  debugPrintf("Updated scheduler state with %d schedules\n", schedulerState.scheduleCount);
+  uint32_t previousVersion = schedulerStateVersion;
+  markSchedulerStructureChanged();
+  broadcastSchedulerUpdate(previousVersion);
+  
+  // Send success response
+  request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Scheduler state saved\"}");
+}
+
+void handleSchedulerStatus(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler status");
+  
+  // Create JSON document
+  DynamicJsonDocument doc(1280);
+  doc["isActive"] = schedulerActive;
+  doc["scheduleCount"] = schedulerState.scheduleCount;
+  doc["freeHeap"] = ESP.getFreeHeap();
+  doc["wakeups"] = schedulerWakeups;
+  doc["nextWake"] = (uint32_t)schedulerNextWake;
+  doc["generation"] = getSchedulerGeneration();
+  
+  // Relays held on by each owner, and when the compiled relay plan next changes
+  doc["scheduledRelayMask"] = scheduledRelayMask;
+  doc["pulseRelayMask"] = getRelayOwnerMask(RELAY_OWNER_PULSE);
+  doc["manualRelayMask"] = getRelayOwnerMask(RELAY_OWNER_MANUAL);
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  if (snapshot) {
+    uint32_t secondOfDay = getSchedulerTime() % 86400;
+    doc["planRelayMask"] = relayPlanMaskAt(snapshot->relayPlan, secondOfDay);
+    doc["nextRelayChangeIn"] = secondsUntilRelayPlanEdge(snapshot->relayPlan, secondOfDay);
+    releaseSchedulerSnapshot(snapshot);
+  }
+  
+  // Binary store timings
+  SchedulerStoreStats store = getSchedulerStoreStats();
+  JsonObject storeObj = doc.createNestedObject("store");
+  storeObj["lastLoadUs"] = store.lastLoadUs;
+  storeObj["lastSaveUs"] = store.lastSaveUs;
+  storeObj["lastBytesWritten"] = store.lastBytesWritten;
+  storeObj["saveCount"] = store.saveCount;
+  storeObj["runRecords"] = store.runRecords;
+  storeObj["runAppends"] = store.runAppends;
+  
+  // Event pool accounting (slots of sizeof(Event) bytes, all state copies)
+  EventPoolStats pool = getEventPoolStats();
+  JsonObject poolObj = doc.createNestedObject("eventPool");
+  poolObj["budgetEvents"] = pool.budgetEvents;
+  poolObj["reservedEvents"] = pool.reservedEvents;
+  poolObj["availableEvents"] = pool.availableEvents;
+  poolObj["inUseEvents"] = pool.inUseEvents;
+  poolObj["blocksInUse"] = pool.blocksInUse;
+  poolObj["blocksFree"] = pool.blocksFree;
+  poolObj["reservedBytes"] = pool.reservedEvents * sizeof(Event);
+  poolObj["allocFailures"] = pool.allocFailures;
+  
+  // Relay actuator counters
+  RelayActuatorStats actuator = getRelayActuatorStats();
+  JsonObject actuatorObj = doc.createNestedObject("actuator");
+  actuatorObj["queuedDeadlines"] = actuator.queuedDeadlines;
+  actuatorObj["peakDeadlines"] = actuator.peakDeadlines;
+  actuatorObj["pulsesAccepted"] = actuator.pulsesAccepted;
+  actuatorObj["pulsesDropped"] = actuator.pulsesDropped;
+  actuatorObj["relayUpdates"] = actuator.relayUpdates;
+  actuatorObj["lastLatencyUs"] = actuator.lastLatencyUs;
+  actuatorObj["maxLatencyUs"] = actuator.maxLatencyUs;
+  actuatorObj["avgLatencyUs"] = actuator.latencySamples > 0 ?
+    (uint32_t)(actuator.totalLatencyUs / actuator.latencySamples) : 0;
+  
+  // Serialize and send response
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
+
+// Actuation latency of scheduled relay changes per stage (?reset=1 clears it after reading)
+void handleSchedulerLatency(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler latency");
+  
+  static const char* stageNames[LATENCY_STAGE_COUNT] = {"pickup", "write", "latch", "total"};
+  SchedulerLatencyStats stats = getSchedulerLatencyStats();
+  if (request->hasParam("reset") && request->getParam("reset")->value() == "1") {
+    resetSchedulerLatencyStats();
+  }
+  
+  DynamicJsonDocument doc(256 + LATENCY_STAGE_COUNT * (192 + LATENCY_HISTOGRAM_BUCKETS * 48));
+  doc["unlatched"] = stats.unlatched;
+  
+  JsonObject stages = doc.createNestedObject("stages");
+  for (uint8_t s = 0; s < LATENCY_STAGE_COUNT; s++) {
+    const LatencyHistogram& histogram = stats.stages[s];
+    JsonObject stage = stages.createNestedObject(stageNames[s]);
+    stage["count"] = histogram.count;
+    stage["p50Us"] = latencyPercentileUs(histogram, 50);
+    stage["p99Us"] = latencyPercentileUs(histogram, 99);
+    stage["maxUs"] = histogram.maxUs;
     
-    // Allocate new buffer with extra space as safety margin
-    size_t allocSize = total + 64; // Add extra padding
-    jsonBuffer = (uint8_t*)malloc(allocSize);
-    if (!jsonBuffer) {
-      debugPrintln("Failed to allocate memory for JSON data");
-      debugPrintf("Attempted to allocate: %d bytes\n", allocSize);
-      debugPrintf("Free heap: %d bytes\n", ESP.getFreeHeap());
-      request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Memory allocation failed\"}");
-      return;
+    // Non-empty buckets as [upper bound in us, count]; the last bucket is open-ended
+    JsonArray buckets = stage.createNestedArray("buckets");
+    for (uint8_t b = 0; b < LATENCY_HISTOGRAM_BUCKETS; b++) {
+      if (histogram.buckets[b] == 0) continue;
+      JsonArray bucket = buckets.createNestedArray();
+      if (b < LATENCY_HISTOGRAM_BUCKETS - 1) {
+        bucket.add((1UL << b) - 1);
+      } else {
+        bucket.add(nullptr);
+      }
+      bucket.add(histogram.buckets[b]);
     }
-    bufferSize = allocSize;
-    debugPrintf("Buffer allocated: %d bytes (requested: %d)\n", bufferSize, total);
-  }
-  
-  // Make sure buffer exists and has enough space
-  if (!jsonBuffer || bufferSize < index + len) {
-    debugPrintln("JSON buffer error or buffer too small");
-    debugPrintf("Buffer size: %d, index: %d, chunk length: %d\n", bufferSize, index, len);
-    request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Buffer error\"}");
-    if (jsonBuffer) {
-      free(jsonBuffer);
-      jsonBuffer = NULL;
+  }
+  
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
+
+// Next n firings (default 5) with local and UTC times
+void handleSchedulerUpcoming(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler upcoming");
+  
+  uint16_t n = 5;
+  if (request->hasParam("n")) {
+    long requested = request->getParam("n")->value().toInt();
+    if (requested < 1 || requested > SCHEDULER_UPCOMING_MAX) {
+      char message[80];
+      snprintf(message, sizeof(message), "{\"status\":\"error\",\"message\":\"n must be between 1 and %u\"}",
+               (unsigned)SCHEDULER_UPCOMING_MAX);
+      request->send(400, "application/json", message);
+      return;
     }
-    bufferSize = 0;
+    n = requested;
+  }
+  
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  if (!snapshot) {
+    request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Scheduler not loaded\"}");
     return;
   }
   
-  // Copy this chunk to the buffer
-  memcpy(jsonBuffer + index, data, len);
+  time_t now = getSchedulerTime();
+  UpcomingFiring firings[SCHEDULER_UPCOMING_MAX];
+  uint16_t count = getUpcomingFirings(*snapshot, now, firings, n);
   
-  debugPrintf("Received data chunk: %d bytes, index: %d, total: %d\n", len, index, total);
+  DynamicJsonDocument doc(256 + count * 256);
+  doc["now"] = (uint32_t)now;
+  doc["generation"] = snapshot->generation;
   
-  // Only parse after receiving all chunks
-  if (index + len == total) {
-    debugPrintf("All data received (%d bytes), parsing JSON\n", total);
+  JsonArray items = doc.createNestedArray("upcoming");
+  char localStr[20];
+  for (uint16_t i = 0; i < count; i++) {
+    const UpcomingFiring& firing = firings[i];
+    const Schedule& schedule = snapshot->state.schedules[firing.scheduleIdx];
     
-    // Add null terminator to treat as string
-    jsonBuffer[total] = 0;
+    struct tm localTm;
+    localtime_r(&firing.time, &localTm);
+    strftime(localStr, sizeof(localStr), "%Y-%m-%d %H:%M", &localTm);
     
-    // Parse JSON with larger buffer
-    DynamicJsonDocument doc(16384); // Further increased buffer size
-    DeserializationError error = deserializeJson(doc, jsonBuffer, total);
-    
-    // Free the buffer after use
-    free(jsonBuffer);
-    jsonBuffer = NULL;
-    bufferSize = 0;
+    JsonObject item = items.createNestedObject();
+    item["time"] = (uint32_t)firing.time;
+    item["local"] = localStr;
+    item["inSeconds"] = (uint32_t)(firing.time - now);
+    item["schedule"] = arenaString(snapshot->state.strings, schedule.name);
+    item["eventId"] = schedule.events[firing.eventIdx].id;
+    item["relayMask"] = firing.relayMask;
+    item["duration"] = firing.duration;
+  }
+  
+  String response;
+  serializeJson(doc, response);
+  releaseSchedulerSnapshot(snapshot);
+  request->send(200, "application/json", response);
+}
+
+// "HH:MM:SS" local form of a UTC second of the day
+static void formatLocalSecondOfDay(uint32_t utcSecond, int32_t offsetSeconds, char* buffer) {
+  uint32_t second = (uint32_t)(((int32_t)(utcSecond % 86400) + offsetSeconds + 2 * 86400) % 86400);
+  sprintf(buffer, "%02u:%02u:%02u", second / 3600, (second / 60) % 60, second % 60);
+}
+
+// Projected zone runs of every schedule after pump sequencing (local times),
+// for the events that fire on the snapshot's day
+void handleSchedulerSequence(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler sequence");
+  
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  if (!snapshot) {
+    request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Scheduler not loaded\"}");
+    return;
+  }
+  const SchedulerState& state = snapshot->state;
+  
+  size_t runTotal = 0;
+  uint32_t runMax = 1;
+  for (int i = 0; i < state.scheduleCount; i++) {
+    uint32_t scheduleRuns = countScheduleZoneRuns(state.schedules[i]);
+    runTotal += scheduleRuns;
+    if (scheduleRuns > runMax) runMax = scheduleRuns;
+  }
+  
+  ZoneRun* runs = (ZoneRun*)malloc(runMax * sizeof(ZoneRun));
+  if (!runs) {
+    releaseSchedulerSnapshot(snapshot);
+    request->send(500, "application/json", "{\"status\":\"error\",\"message\":\"Out of memory\"}");
+    return;
+  }
+  
+  DynamicJsonDocument doc(256 + state.scheduleCount * 192 + runTotal * 128);
+  // The scheduler clock, so a simulated run describes the day it compiled
+  int32_t offset = getUtcOffsetSeconds(getSchedulerTime());
+  char startStr[9];
+  char finishStr[9];
+  
+  doc["day"] = snapshot->planDay;
+  JsonArray schedules = doc.createNestedArray("schedules");
+  for (int scheduleIdx = 0; scheduleIdx < state.scheduleCount; scheduleIdx++) {
+    const Schedule& schedule = state.schedules[scheduleIdx];
+    JsonObject schObj = schedules.createNestedObject();
+    schObj["name"] = arenaString(state.strings, schedule.name);
+    schObj["maxOpenZones"] = schedule.maxOpenZones;
+    schObj["zoneGapSeconds"] = schedule.zoneGapSeconds;
     
-    // Check for parsing errors
-    if (error) {
-      debugPrintf("Failed to parse scheduler JSON: %s\n", error.c_str());
-      request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"JSON parsing error\"}");
-      return;
+    // Runs queue behind what is left of yesterday's on the pump
+    ZoneSlots slots;
+    zoneSlotsAtMidnight(schedule, scheduleIdx, snapshot->recurrence, snapshot->planDay, runs, runMax, slots);
+    uint16_t runCount = sequenceScheduleZones(schedule, scheduleIdx, snapshot->recurrence, snapshot->planDay,
+                                              runs, runMax, slots);
+    uint32_t lastFinish = 0;
+    JsonArray runArray = schObj.createNestedArray("runs");
+    for (uint16_t i = 0; i < runCount; i++) {
+      const ZoneRun& run = runs[i];
+      const Event& event = schedule.events[run.eventIdx];
+      
+      formatLocalSecondOfDay(run.start, offset, startStr);
+      formatLocalSecondOfDay(run.end, offset, finishStr);
+      
+      JsonObject runObj = runArray.createNestedObject();
+      runObj["eventId"] = event.id;
+      runObj["relay"] = run.relay;
+      runObj["start"] = startStr;
+      runObj["finish"] = finishStr;
+      runObj["queuedSeconds"] = (int32_t)run.start - (int32_t)event.secondOfDay;
+      
+      if (run.end > lastFinish) {
+        lastFinish = run.end;
+      }
     }
     
-    // Check for relay assignment conflicts
-    JsonArray schedules = doc["schedules"].as<JsonArray>();
-    int currentScheduleIndex = doc["currentScheduleIndex"] | 0;
-
-    if (!validateRelayAssignments(schedules, currentScheduleIndex)) {
-      debugPrintln("ERROR: Relay assignment conflict detected");
-      request->send(400, "application/json", 
-        "{\"status\":\"error\",\"message\":\"One or more relays are already assigned to another schedule\"}");
-      return;
+    if (runCount > 0) {
+      formatLocalSecondOfDay(lastFinish, offset, finishStr);
+      schObj["projectedFinish"] = finishStr;
+    } else {
+      schObj["projectedFinish"] = nullptr;
     }
+  }
+  
+  free(runs);
+  releaseSchedulerSnapshot(snapshot);
+  
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
 
-    // Update scheduler state from JSON
-    schedulerState.scheduleCount = doc["scheduleCount"] | 0;
-    schedulerState.currentScheduleIndex = doc["currentScheduleIndex"] | 0;
-
-    // Clear all schedules first
-    for (int i = 0; i < MAX_SCHEDULES; i++) {
-      schedulerState.schedules[i].eventCount = 0;
+// Last firing of every event, for auditing (all times UTC)
+void handleSchedulerHistory(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler history");
+  
+  // Run stamps live in the executor's generation, not in schedulerState
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  if (!snapshot) {
+    request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Scheduler not loaded\"}");
+    return;
+  }
+  const SchedulerState& state = snapshot->state;
+  
+  uint32_t eventTotal = 0;
+  for (int i = 0; i < state.scheduleCount; i++) {
+    eventTotal += state.schedules[i].eventCount;
+  }
+  
+  // One page of events, in schedule order
+  uint32_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+  long limit = SCHEDULER_HISTORY_PAGE;
+  if (request->hasParam("limit")) {
+    limit = request->getParam("limit")->value().toInt();
+    if (limit < 1 || limit > SCHEDULER_HISTORY_PAGE) {
+      releaseSchedulerSnapshot(snapshot);
+      char message[80];
+      snprintf(message, sizeof(message), "{\"status\":\"error\",\"message\":\"limit must be between 1 and %u\"}",
+               (unsigned)SCHEDULER_HISTORY_PAGE);
+      request->send(400, "application/json", message);
+      return;
     }
-
-    // Process schedules
-    schedulerState.scheduleCount = 0;
-    for (JsonObject schObj : schedules) {
-      if (schedulerState.scheduleCount >= MAX_SCHEDULES) break;
-      
-      Schedule& sch = schedulerState.schedules[schedulerState.scheduleCount];
-      sch.name = schObj["name"].as<String>();
-      sch.metadata = schObj["metadata"].as<String>();
-      sch.relayMask = schObj["relayMask"].as<uint8_t>();
-      
-      // Convert local times back to UTC for storage
-      sch.lightsOnTime = localTimeToUTC(schObj["lightsOnTime"].as<String>());
-      sch.lightsOffTime = localTimeToUTC(schObj["lightsOffTime"].as<String>());
-      
-      // Process events
-      sch.eventCount = 0;
-      JsonArray events = schObj["events"].as<JsonArray>();
-      for (JsonObject evt : events) {
-        if (sch.eventCount >= MAX_EVENTS) break;
-        
-        Event& e = sch.events[sch.eventCount];
-        e.id = evt["id"].as<String>();
-        // Convert local time back to UTC for storage
-        e.time = localTimeToUTC(evt["time"].as<String>());
-        e.duration = evt["duration"].as<uint16_t>();
-        e.executedMask = 0; // Reset execution flag
-        
-        sch.eventCount++;
+  }
+  uint32_t count = offset < eventTotal ? eventTotal - offset : 0;
+  if (count > (uint32_t)limit) count = limit;
+  
+  DynamicJsonDocument doc(256 + count * 192);
+  if (doc.capacity() == 0) {
+    releaseSchedulerSnapshot(snapshot);
+    request->send(503, "application/json", "{\"status\":\"error\",\"message\":\"Not enough memory for the history\"}");
+    return;
+  }
+  doc["today"] = schedulerEpochDay(getSchedulerTime());
+  doc["total"] = eventTotal;
+  doc["offset"] = offset;
+  if (offset + count < eventTotal) {
+    doc["nextOffset"] = offset + count;
+  } else {
+    doc["nextOffset"] = nullptr;
+  }
+  
+  JsonArray events = doc.createNestedArray("events");
+  char timeStr[9];
+  char dateStr[12];
+  uint32_t position = 0;
+  for (int scheduleIdx = 0; scheduleIdx < state.scheduleCount; scheduleIdx++) {
+    const Schedule& schedule = state.schedules[scheduleIdx];
+    if (position + schedule.eventCount <= offset) {
+      position += schedule.eventCount;
+      continue;
+    }
+    for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++, position++) {
+      if (position < offset) continue;
+      if (position >= offset + count) break;
+      const Event& event = schedule.events[eventIdx];
+      JsonObject evtObj = events.createNestedObject();
+      evtObj["scheduleIndex"] = scheduleIdx;
+      evtObj["schedule"] = arenaString(state.strings, schedule.name);
+      evtObj["id"] = event.id;
+      formatSecondOfDay(event.secondOfDay, timeStr);
+      evtObj["time"] = timeStr;
+      
+      // The executor may be stamping this event right now; take the stamp once
+      time_t runTime = eventLastRun(event);
+      if (runTime == 0) {
+        evtObj["lastRun"] = nullptr;
+        continue;
       }
       
-      schedulerState.scheduleCount++;
+      struct tm runTm;
+      gmtime_r(&runTime, &runTm);
+      strftime(dateStr, sizeof(dateStr), "%Y-%m-%d", &runTm);
+      formatSecondOfDay(runTime % 86400, timeStr);
+      
+      JsonObject lastRun = evtObj.createNestedObject("lastRun");
+      lastRun["day"] = schedulerEpochDay(runTime);
+      lastRun["date"] = dateStr;
+      lastRun["time"] = timeStr;
     }
-
-    debugPrintf("Updated scheduler state with %d schedules\n", schedulerState.scheduleCount);
-    
-    // After processing, save to SPIFFS
-    saveSchedulerState();
-    
-    // Send success response
-    request->send(200, "application/json", "{\"status\":\"success\",\"message\":\"Scheduler state saved\"}");
   }
-}
-
-void handleSchedulerStatus(AsyncWebServerRequest *request) {
-  debugPrintln("API request: Scheduler status");
-  
-  // Create JSON document
-  DynamicJsonDocument doc(512);
-  doc["isActive"] = schedulerActive;
-  doc["scheduleCount"] = schedulerState.scheduleCount;
   
-  // Serialize and send response
   String response;
   serializeJson(doc, response);
+  releaseSchedulerSnapshot(snapshot);
   request->send(200, "application/json", response);
 }
 
@@ -1006,27 +1328,31 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
       currentSession.editingScheduleIndex = -1;
       currentSession.isDirty = false;
       
-      // Initialize empty pending schedule
-      currentSession.pendingSchedule = {};
-      currentSession.pendingSchedule.name = "New Schedule";
-      currentSession.pendingSchedule.relayMask = 0;
-      currentSession.pendingSchedule.lightsOnTime = "06:00";  // Default UTC time
-      currentSession.pendingSchedule.lightsOffTime = "18:00"; // Default UTC time
-      currentSession.pendingSchedule.eventCount = 0;
-      
       // Get the current time for metadata
       time_t now = time(NULL);
       struct tm timeInfo;
       localtime_r(&now, &timeInfo);
       char timeStr[64];
       strftime(timeStr, sizeof(timeStr), "Created on %Y-%m-%d %H:%M", &timeInfo);
-      currentSession.pendingSchedule.metadata = timeStr;
+      
+      // Initialize empty pending schedule
+      currentSession.strings.used = 0;
+      currentSession.pendingSchedule.name = internString(currentSession.strings, "New Schedule");
+      currentSession.pendingSchedule.metadata = internString(currentSession.strings, timeStr);
+      currentSession.pendingSchedule.relayMask = 0;
+      currentSession.pendingSchedule.maxOpenZones = 0;
+      currentSession.pendingSchedule.zoneGapSeconds = 0;
+      currentSession.pendingSchedule.lightsOnMinute = 6 * 60;   // Default 06:00 UTC
+      currentSession.pendingSchedule.lightsOffMinute = 18 * 60; // Default 18:00 UTC
+      currentSession.pendingSchedule.ruleCount = 0;
+      currentSession.pendingSchedule.eventCount = 0;
       
       // Send response
       DynamicJsonDocument responseDoc(4096);
       responseDoc["type"] = "create_started";
       responseDoc["sessionId"] = currentSession.sessionId;
-      responseDoc["schedule"] = serializeSchedule(currentSession.pendingSchedule, true); // Convert times to local
+      serializeSchedule(responseDoc.createNestedObject("schedule"), currentSession.pendingSchedule,
+                        currentSession.strings, true); // Convert times to local
       
       String response;
       serializeJson(responseDoc, response);
@@ -1052,15 +1378,26 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
       currentSession.editingScheduleIndex = scheduleIndex;
       currentSession.isDirty = false;
       
-      // Create a copy of the schedule for editing
-      currentSession.pendingSchedule = schedulerState.schedules[scheduleIndex];
+      // Create a copy of the schedule for editing, with its strings in the session arena
+      const Schedule& original = schedulerState.schedules[scheduleIndex];
+      if (!copySchedule(currentSession.pendingSchedule, original)) {
+        resetSession();
+        sendErrorResponse(client, "Not enough memory to edit this schedule");
+        return;
+      }
+      currentSession.strings.used = 0;
+      currentSession.pendingSchedule.name = 
+        internString(currentSession.strings, arenaString(schedulerState.strings, original.name));
+      currentSession.pendingSchedule.metadata = 
+        internString(currentSession.strings, arenaString(schedulerState.strings, original.metadata));
       
       // Send response
       DynamicJsonDocument responseDoc(4096);
       responseDoc["type"] = "edit_started";
       responseDoc["sessionId"] = currentSession.sessionId;
       responseDoc["scheduleIndex"] = scheduleIndex;
-      responseDoc["schedule"] = serializeSchedule(currentSession.pendingSchedule, true); // Convert times to local
+      serializeSchedule(responseDoc.createNestedObject("schedule"), currentSession.pendingSchedule,
+                        currentSession.strings, true); // Convert times to local
       
       String response;
       serializeJson(responseDoc, response);
@@ -1084,41 +1421,53 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
       JsonObject scheduleData = doc["schedule"];
       
       // Update the pending schedule
+      Schedule& pending = currentSession.pendingSchedule;
+      
       if (scheduleData.containsKey("name")) {
-        currentSession.pendingSchedule.name = scheduleData["name"].as<String>();
+        // Re-intern the strings still in use so renames don't fill the session arena
+        String metadata = arenaString(currentSession.strings, pending.metadata);
+        currentSession.strings.used = 0;
+        pending.name = internString(currentSession.strings, scheduleData["name"] | "");
+        pending.metadata = internString(currentSession.strings, metadata.c_str());
       }
       
       if (scheduleData.containsKey("relayMask")) {
-        currentSession.pendingSchedule.relayMask = scheduleData["relayMask"].as<uint8_t>();
+        pending.relayMask = scheduleData["relayMask"].as<uint8_t>();
+      }
+      
+      if (scheduleData.containsKey("maxOpenZones")) {
+        pending.maxOpenZones = scheduleData["maxOpenZones"].as<uint8_t>();
+      }
+      
+      if (scheduleData.containsKey("zoneGapSeconds")) {
+        pending.zoneGapSeconds = scheduleData["zoneGapSeconds"].as<uint16_t>();
       }
       
+      // Convert from local to UTC
       if (scheduleData.containsKey("lightsOnTime")) {
-        // Convert from local to UTC
-        currentSession.pendingSchedule.lightsOnTime = 
-          localTimeToUTC(scheduleData["lightsOnTime"].as<String>());
+        readTimeField(scheduleData["lightsOnTime"], true, pending.lightsOnMinute);
       }
       
       if (scheduleData.containsKey("lightsOffTime")) {
-        // Convert from local to UTC
-        currentSession.pendingSchedule.lightsOffTime = 
-          localTimeToUTC(scheduleData["lightsOffTime"].as<String>());
+        readTimeField(scheduleData["lightsOffTime"], true, pending.lightsOffMinute);
       }
       
       // Handle events if present
       if (scheduleData.containsKey("events")) {
         JsonArray events = scheduleData["events"].as<JsonArray>();
-        currentSession.pendingSchedule.eventCount = 0;
+        pending.eventCount = 0;
+        pending.ruleCount = 0;
+        
+        if (!reserveScheduleEvents(pending, events.size() < MAX_EVENTS ? events.size() : MAX_EVENTS)) {
+          sendErrorResponse(client, "Not enough memory for these events");
+          return;
+        }
         
         for (JsonObject evt : events) {
-          if (currentSession.pendingSchedule.eventCount >= MAX_EVENTS) break;
-          
-          Event& e = currentSession.pendingSchedule.events[currentSession.pendingSchedule.eventCount];
-          e.id = evt["id"].as<String>();
-          e.time = localTimeToUTC(evt["time"].as<String>());
-          e.duration = evt["duration"].as<uint16_t>();
-          e.executedMask = 0; // Reset execution flag
-          
-          currentSession.pendingSchedule.eventCount++;
+          if (pending.eventCount >= pending.eventCapacity) break;
+          if (eventFromJson(evt, true, pending, pending.events[pending.eventCount])) {
+            pending.eventCount++;
+          }
         }
       }
       
@@ -1147,24 +1496,45 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
         return;
       }
       
+      uint32_t previousVersion = schedulerStateVersion;
+      
       // For creating mode, append new schedule
       if (currentSession.mode == MODE_CREATING) {
         if (schedulerState.scheduleCount >= MAX_SCHEDULES) {
           sendErrorResponse(client, "Maximum number of schedules reached");
           return;
         }
+        if (!reserveSchedules(schedulerState, schedulerState.scheduleCount + 1)) {
+          sendErrorResponse(client, "Not enough memory to save schedule");
+          return;
+        }
         
         // Add the new schedule
-        schedulerState.schedules[schedulerState.scheduleCount] = currentSession.pendingSchedule;
+        if (!adoptPendingSchedule(schedulerState.schedules[schedulerState.scheduleCount])) {
+          sendErrorResponse(client, "Not enough memory to save schedule");
+          return;
+        }
         schedulerState.scheduleCount++;
+        markScheduleChanged(schedulerState.scheduleCount - 1);
       }
       // For editing mode, update existing schedule
       else if (currentSession.mode == MODE_EDITING) {
-        schedulerState.schedules[currentSession.editingScheduleIndex] = currentSession.pendingSchedule;
+        if (!adoptPendingSchedule(schedulerState.schedules[currentSession.editingScheduleIndex])) {
+          sendErrorResponse(client, "Not enough memory to save schedule");
+          return;
+        }
+        markScheduleChanged(currentSession.editingScheduleIndex);
       }
       
-      // Save to SPIFFS
-      saveSchedulerState();
+      // Hand the new state to the executor, which also saves it. If it
+      // cannot take it, undo the change; the session keeps the pending
+      // schedule so the client can save again.
+      if (!publishSchedulerState(true)) {
+        revertToPublishedState();
+        sendErrorResponse(client, "Scheduler busy or out of memory, schedule not saved");
+        broadcastSchedulerUpdate(previousVersion);
+        return;
+      }
       
       // Reset session to view-only mode
       resetSession();
@@ -1178,8 +1548,8 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
       serializeJson(responseDoc, response);
       client->text(response);
       
-      // Broadcast to all clients that data has changed
-      broadcastSchedulerUpdate();
+      // Push the changed schedule to all clients
+      broadcastSchedulerUpdate(previousVersion);
     }
     else if (messageType == "cancel") {
       // Cancel editing/creating
@@ -1215,22 +1585,35 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
         return;
       }
       
-      // Shift remaining schedules
+      uint32_t previousVersion = schedulerStateVersion;
+      
+      // Free the deleted schedule's events, then shift the remaining schedules
+      // (their event blocks move with them)
+      releaseScheduleEvents(schedulerState.schedules[scheduleIndex]);
       for (int i = scheduleIndex; i < schedulerState.scheduleCount - 1; i++) {
         schedulerState.schedules[i] = schedulerState.schedules[i + 1];
       }
       
-      // Decrement count
+      // Decrement count; the vacated slot no longer owns the block it still points at
       schedulerState.scheduleCount--;
+      schedulerState.schedules[schedulerState.scheduleCount].events = NULL;
+      schedulerState.schedules[schedulerState.scheduleCount].eventCapacity = 0;
+      schedulerState.schedules[schedulerState.scheduleCount].eventCount = 0;
       
       // Update current index if needed
       if (schedulerState.currentScheduleIndex >= schedulerState.scheduleCount) {
         schedulerState.currentScheduleIndex = schedulerState.scheduleCount > 0 ? 
                                              schedulerState.scheduleCount - 1 : 0;
       }
+      markSchedulerStructureChanged();
       
-      // Save changes
-      saveSchedulerState();
+      // Hand the new state to the executor, which also saves it
+      if (!publishSchedulerState(true)) {
+        revertToPublishedState();
+        sendErrorResponse(client, "Scheduler busy or out of memory, schedule not deleted");
+        broadcastSchedulerUpdate(previousVersion);
+        return;
+      }
       
       // Reset any active editing session
       resetSession();
@@ -1243,12 +1626,20 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
       serializeJson(responseDoc, response);
       client->text(response);
       
-      // Broadcast to all clients that data has changed
-      broadcastSchedulerUpdate();
+      // Indices shifted, so clients have to take a fresh snapshot
+      broadcastSchedulerUpdate(previousVersion);
     }
     else if (messageType == "get_state") {
-      // Send current scheduler state
-      sendSchedulerState(client);
+      // Clients that already hold a state send its id and version and
+      // only get the schedules that changed since
+      uint32_t clientStateId = doc["stateId"] | 0;
+      StreamString patch;
+      if (doc.containsKey("version") && clientStateId == schedulerStateId &&
+          serializeSchedulerPatch(doc["version"].as<uint32_t>(), patch)) {
+        client->text(patch);
+      } else {
+        sendSchedulerState(client);
+      }
     }
     else {
       // Unknown message type
@@ -1258,46 +1649,26 @@ void handleWebSocketMessage(AsyncWebSocket* webSocket, AsyncWebSocketClient* cli
 }
 
 // Helper to serialize a schedule to JSON
-JsonObject serializeSchedule(Schedule& schedule, bool convertToLocalTime) {
-  DynamicJsonDocument doc(4096);
-  JsonObject obj = doc.to<JsonObject>();
-  
-  obj["name"] = schedule.name;
-  obj["metadata"] = schedule.metadata;
-  obj["relayMask"] = schedule.relayMask;
-  
-  // Handle time conversion
-  if (convertToLocalTime) {
-    obj["lightsOnTime"] = utcToLocalTime(schedule.lightsOnTime);
-    obj["lightsOffTime"] = utcToLocalTime(schedule.lightsOffTime);
-  } else {
-    obj["lightsOnTime"] = schedule.lightsOnTime;
-    obj["lightsOffTime"] = schedule.lightsOffTime;
-  }
-  
-  // Add events
-  JsonArray events = obj.createNestedArray("events");
-  for (int i = 0; i < schedule.eventCount; i++) {
-    Event& evt = schedule.events[i];
-    JsonObject evtObj = events.createNestedObject();
-    evtObj["id"] = evt.id;
-    
-    if (convertToLocalTime) {
-      evtObj["time"] = utcToLocalTime(evt.time);
-    } else {
-      evtObj["time"] = evt.time;
-    }
-    
-    evtObj["duration"] = evt.duration;
+void serializeSchedule(JsonObject obj, const Schedule& schedule, const StringArena& strings, bool convertToLocalTime) {
+  scheduleToJson(obj, schedule, strings, convertToLocalTime);
+}
+
+// Copy the pending schedule into the scheduler state, moving its strings into the shared arena
+bool adoptPendingSchedule(Schedule& target) {
+  if (!copySchedule(target, currentSession.pendingSchedule)) {
+    return false;
   }
-  
-  return obj;
+  target.name = internSchedulerString(arenaString(currentSession.strings, currentSession.pendingSchedule.name));
+  target.metadata = internSchedulerString(arenaString(currentSession.strings, currentSession.pendingSchedule.metadata));
+  return true;
 }
 
 // Send current scheduler state to client
 void sendSchedulerState(AsyncWebSocketClient* client) {
-  DynamicJsonDocument doc(8192);
+  DynamicJsonDocument doc(512);
   doc["type"] = "scheduler_state";
+  doc["stateId"] = schedulerStateId;
+  doc["version"] = schedulerStateVersion;
   doc["scheduleCount"] = schedulerState.scheduleCount;
   doc["currentScheduleIndex"] = schedulerState.currentScheduleIndex;
   doc["mode"] = currentSession.mode;
@@ -1307,37 +1678,56 @@ void sendSchedulerState(AsyncWebSocketClient* client) {
     doc["editingIndex"] = currentSession.editingScheduleIndex;
   }
   
-  // Add schedules
-  JsonArray schedules = doc.createNestedArray("schedules");
+  // Schedules are serialized one at a time straight into the message
+  StreamString message;
+  if (doc.capacity() == 0 || printOpenObject(message, doc) == 0 ||
+      !printSchedulesJson(message, "schedules", schedulerState)) {
+    sendErrorResponse(client, "Not enough memory for the scheduler state");
+    return;
+  }
+  client->text(message);
+}
+
+// Serialize the schedules changed after sinceVersion as a scheduler_patch
+// message. Returns false when the client has to take a full snapshot
+// instead (version from the future, or schedules moved since).
+bool serializeSchedulerPatch(uint32_t sinceVersion, StreamString& out) {
+  if (sinceVersion > schedulerStateVersion || sinceVersion < schedulerStructureVersion) {
+    return false;
+  }
+  
+  DynamicJsonDocument doc(512);
+  doc["type"] = "scheduler_patch";
+  doc["stateId"] = schedulerStateId;
+  doc["fromVersion"] = sinceVersion;
+  doc["version"] = schedulerStateVersion;
+  doc["scheduleCount"] = schedulerState.scheduleCount;
+  doc["currentScheduleIndex"] = schedulerState.currentScheduleIndex;
+  doc["mode"] = currentSession.mode;
+  if (doc.capacity() == 0 || printOpenObject(out, doc) == 0) {
+    return false;
+  }
+  
+  // Schedules are only ever appended or edited in place between structure
+  // changes, so index + content is enough for the client to apply a change
+  out.print(",\"changes\":[");
+  bool first = true;
   for (int i = 0; i < schedulerState.scheduleCount; i++) {
-    JsonObject schObj = schedules.createNestedObject();
-    Schedule& sch = schedulerState.schedules[i];
-    
-    schObj["name"] = sch.name;
-    schObj["metadata"] = sch.metadata;
-    schObj["relayMask"] = sch.relayMask;
-    schObj["lightsOnTime"] = utcToLocalTime(sch.lightsOnTime);
-    schObj["lightsOffTime"] = utcToLocalTime(sch.lightsOffTime);
-    
-    // Add events
-    JsonArray events = schObj.createNestedArray("events");
-    for (int j = 0; j < sch.eventCount; j++) {
-      JsonObject evtObj = events.createNestedObject();
-      Event& evt = sch.events[j];
-      
-      evtObj["id"] = evt.id;
-      evtObj["time"] = utcToLocalTime(evt.time);
-      evtObj["duration"] = evt.duration;
+    if (scheduleModVersion[i] > sinceVersion) {
+      out.printf("%s{\"index\":%d,\"schedule\":", first ? "" : ",", i);
+      if (!printScheduleJson(out, schedulerState.schedules[i], schedulerState.strings)) {
+        return false;
+      }
+      out.print('}');
+      first = false;
     }
   }
-  
-  String response;
-  serializeJson(doc, response);
-  client->text(response);
+  return out.print("]}") == 2;
 }
 
 // Reset the editing session
 void resetSession() {
+  releaseScheduleEvents(currentSession.pendingSchedule);
   currentSession.sessionId = "";
   currentSession.lastActivity = 0;
   currentSession.mode = MODE_VIEW_ONLY;
@@ -1369,13 +1759,25 @@ void sendErrorResponse(AsyncWebSocketClient* client, const String& message) {
   client->text(response);
 }
 
-// Broadcast scheduler update to all connected clients
-void broadcastSchedulerUpdate() {
-  DynamicJsonDocument doc(512);
-  doc["type"] = "data_changed";
+// Push the changes made since fromVersion to all connected clients.
+// The patch is serialized once and shared by every client; clients whose
+// version does not match fromVersion request get_state with their own.
+void broadcastSchedulerUpdate(uint32_t fromVersion) {
+  if (schedulerWs.count() == 0) {
+    return;
+  }
   
-  String response;
-  serializeJson(doc, response);
+  StreamString response;
+  if (!serializeSchedulerPatch(fromVersion, response)) {
+    // Schedules moved (or the patch did not fit in memory); announce the
+    // new version and let clients resync
+    response = "";
+    DynamicJsonDocument doc(256);
+    doc["type"] = "data_changed";
+    doc["stateId"] = schedulerStateId;
+    doc["version"] = schedulerStateVersion;
+    serializeJson(doc, response);
+  }
   schedulerWs.textAll(response);
 }
 
@@ -1453,97 +1855,35 @@ void schedulerMonitorTask(void *pvParameters) {
       time_t secondsUntilNextMinute = 60 - timeinfo.tm_sec;
       debugPrintf("Seconds until next check: %ld\n", secondsUntilNextMinute);
       
-      // Find the next upcoming event across all schedules
-      time_t earliestEventTime = INT32_MAX;
-      String earliestEventId = "";
-      String earliestScheduleName = "";
-      uint8_t earliestScheduleRelayMask = 0;
+      // Next few firings from the shared projection
+      UpcomingFiring upcoming[3];
+      uint16_t upcomingCount = 0;
+      SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+      if (snapshot) {
+        upcomingCount = getUpcomingFirings(*snapshot, now, upcoming, 3);
+      }
       
-      for (int scheduleIdx = 0; scheduleIdx < schedulerState.scheduleCount; scheduleIdx++) {
-        Schedule& schedule = schedulerState.schedules[scheduleIdx];
-        
-        // Skip inactive schedules (those without assigned relays)
-        if (schedule.relayMask == 0) {
-          continue;
-        }
-        
-        debugPrintf("\nSchedule: %s (Relay mask: 0x%02X)\n", 
-                  schedule.name.c_str(), schedule.relayMask);
-        
-        for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
-          Event& event = schedule.events[eventIdx];
-          
-          // Parse event time
-          int eventHour = 0, eventMinute = 0;
-          if (sscanf(event.time.c_str(), "%d:%d", &eventHour, &eventMinute) != 2) {
-            debugPrintf("  WARNING: Invalid time format in event: %s\n", event.time.c_str());
-            continue;
-          }
-          
-          // Calculate event time in minutes since midnight
-          int eventMinutes = eventHour * 60 + eventMinute;
-          
-          // Calculate time until this event
-          int minutesUntilEvent;
-          if (eventMinutes > currentMinutes) {
-            // Event is later today
-            minutesUntilEvent = eventMinutes - currentMinutes;
-          } else {
-            // Event is tomorrow
-            minutesUntilEvent = (24 * 60) - currentMinutes + eventMinutes;
-          }
+      if (upcomingCount > 0) {
+        debugPrintln("\n----- NEXT SCHEDULED EVENTS -----");
+        for (uint16_t i = 0; i < upcomingCount; i++) {
+          const UpcomingFiring& firing = upcoming[i];
+          const Schedule& schedule = snapshot->state.schedules[firing.scheduleIdx];
+          time_t secondsUntil = firing.time - now;
           
-          // Check if this event should have executed already today
-          bool shouldHaveExecuted = (eventMinutes <= currentMinutes);
-          bool wasExecuted = (event.executedMask & 0x01) != 0;
-          
-          // Print current time and event time for debugging
-          debugPrintf("  DEBUG: Current time: %02d:%02d (%d minutes since midnight)\n", 
-            timeinfo.tm_hour, timeinfo.tm_min, currentMinutes);
-          debugPrintf("  DEBUG: Event time: %s (%d minutes since midnight)\n", 
-            event.time.c_str(), eventMinutes);
-          debugPrintf("  DEBUG: Minutes until event: %d\n", minutesUntilEvent);
-
-          debugPrintf("  Event %d: Time %s (%d min), Duration %d sec, ID %s\n", 
-                    eventIdx, event.time.c_str(), eventMinutes, event.duration, 
-                    event.id.c_str());
-          debugPrintf("    Minutes until execution: %d\n", minutesUntilEvent);
-          debugPrintf("    Should have executed today: %s\n", shouldHaveExecuted ? "YES" : "NO");
-          debugPrintf("    Was executed today: %s\n", wasExecuted ? "YES" : "NO");
-          
-          // Check if this is the earliest upcoming event
-          if (!wasExecuted && minutesUntilEvent < (earliestEventTime / 60)) {
-            earliestEventTime = minutesUntilEvent * 60;
-            earliestEventId = event.id;
-            earliestScheduleName = schedule.name;
-            earliestScheduleRelayMask = schedule.relayMask;
-          }
+          char timeStr[9];
+          formatSecondOfDay(firing.time % 86400, timeStr);
+          debugPrintf("Event %s in schedule '%s' at %s UTC\n",
+                    schedule.events[firing.eventIdx].id, arenaString(snapshot->state.strings, schedule.name), timeStr);
+          debugPrintf("  Will execute in: %02d:%02d:%02d (HH:MM:SS), relays 0x%02X for %d seconds\n",
+                    (int)(secondsUntil / 3600), (int)((secondsUntil % 3600) / 60), (int)(secondsUntil % 60),
+                    firing.relayMask, firing.duration);
         }
+      } else {
+        debugPrintln("\nNo upcoming events found");
       }
       
-      // Display next event information
-      if (earliestEventTime != INT32_MAX) {
-        int hours = earliestEventTime / 3600;
-        int minutes = (earliestEventTime % 3600) / 60;
-        int seconds = earliestEventTime % 60;
-        
-        debugPrintln("\n----- NEXT SCHEDULED EVENT -----");
-        debugPrintf("Next event: ID %s in schedule '%s'\n", 
-                  earliestEventId.c_str(), earliestScheduleName.c_str());
-        debugPrintf("Will execute in: %02d:%02d:%02d (HH:MM:SS)\n", 
-                  hours, minutes, seconds);
-        debugPrintf("Will activate relays: 0x%02X\n", earliestScheduleRelayMask);
-        
-        // Show which specific relays will be activated
-        debugPrintln("Relays to activate: ");
-        for (int i = 0; i < 8; i++) {
-          if (earliestScheduleRelayMask & (1 << i)) {
-            debugPrintf("%d ", i);
-          }
-        }
-        debugPrintln("");
-      } else {
-        debugPrintln("\nNo upcoming events found or all events executed today");
+      if (snapshot) {
+        releaseSchedulerSnapshot(snapshot);
       }
       
       // Add information about the current relay state
@@ -1578,8 +1918,9 @@ void schedulerMonitorTask(void *pvParameters) {
 
 // Enhanced debug function for scheduler events
 void debugScheduleEvent(const Event& event, bool executed, int minutesUntil) {
-  debugPrintf("EVENT: %s (ID: %s, Duration: %d sec)\n", 
-             event.time.c_str(), event.id.c_str(), event.duration);
+  char timeStr[9];
+  formatSecondOfDay(event.secondOfDay, timeStr);
+  debugPrintf("EVENT: %s (ID: %s, Duration: %d sec)\n", timeStr, event.id, event.duration);
   debugPrintf("  Execution status: %s\n", executed ? "EXECUTED" : "PENDING");
   
   if (!executed) {
@@ -1614,9 +1955,9 @@ bool validateTimeFormat(const char* timeStr) {
 void testRelayControl() {
   debugPrintln("DEBUG: Starting relay control test...");
   
-  // Get the current relay state for reference
-  uint8_t initialState = getRelayState();
-  debugPrintf("DEBUG: Initial relay state: 0x%02X\n", initialState);
+  // Manual relays to restore afterwards (the plan and pulses keep their own)
+  uint8_t initialState = getRelayOwnerMask(RELAY_OWNER_MANUAL);
+  debugPrintf("DEBUG: Initial relay state: 0x%02X, manual 0x%02X\n", getRelayState(), initialState);
   
   // Test each relay individually
   for (int relay = 0; relay < 8; relay++) {
@@ -1651,7 +1992,7 @@ void testRelayControl() {
   }
   
   // Restore original state
-  debugPrintf("DEBUG: Restoring initial relay state: 0x%02X\n", initialState);
+  debugPrintf("DEBUG: Restoring manual relays: 0x%02X\n", initialState);
   setAllRelays(initialState);
   
   debugPrintln("DEBUG: Relay control test complete");
@@ -1693,7 +2034,7 @@ void manuallyTriggerEvent(const char* scheduleName, const char* eventId) {
   Event* targetEvent = nullptr;
   
   for (int i = 0; i < schedulerState.scheduleCount; i++) {
-    if (schedulerState.schedules[i].name == scheduleName) {
+    if (strcmp(arenaString(schedulerState.strings, schedulerState.schedules[i].name), scheduleName) == 0) {
       targetSchedule = &schedulerState.schedules[i];
       break;
     }
@@ -1706,7 +2047,7 @@ void manuallyTriggerEvent(const char* scheduleName, const char* eventId) {
   
   // Find the specified event
   for (int i = 0; i < targetSchedule->eventCount; i++) {
-    if (targetSchedule->events[i].id == eventId) {
+    if (strcmp(targetSchedule->events[i].id, eventId) == 0) {
       targetEvent = &targetSchedule->events[i];
       break;
     }
@@ -1719,8 +2060,9 @@ void manuallyTriggerEvent(const char* scheduleName, const char* eventId) {
   }
   
   // Execute the event
-  debugPrintf("DEBUG: Executing event at %s for %d seconds\n", 
-             targetEvent->time.c_str(), targetEvent->duration);
+  char timeStr[9];
+  formatSecondOfDay(targetEvent->secondOfDay, timeStr);
+  debugPrintf("DEBUG: Executing event at %s for %d seconds\n", timeStr, targetEvent->duration);
   
   // Activate the relays specified by the schedule's relay mask
   for (int relay = 0; relay < 8; relay++) {
@@ -1753,8 +2095,8 @@ void schedulerDiagnosticsTask(void *pvParameters) {
   // Step 2: Test relay control
   debugPrintln("\nDIAGNOSTIC: Testing direct relay control...");
   
-  // Save current relay state
-  uint8_t savedRelayState = getRelayState();
+  // Save the manual relays (the plan and pulses keep their own)
+  uint8_t savedRelayState = getRelayOwnerMask(RELAY_OWNER_MANUAL);
   
   // Test relay 0 only (to minimize disruption)
   debugPrintln("DIAGNOSTIC: Testing relay 0 only");
@@ -1814,12 +2156,13 @@ void schedulerDiagnosticsTask(void *pvParameters) {
     for (int i = 0; i < schedulerState.scheduleCount; i++) {
       Schedule& schedule = schedulerState.schedules[i];
       
+      const char* scheduleName = arenaString(schedulerState.strings, schedule.name);
       debugPrintf("DIAGNOSTIC: Schedule '%s': Relay mask: 0x%02X, Event count: %d\n", 
-                schedule.name.c_str(), schedule.relayMask, schedule.eventCount);
+                scheduleName, schedule.relayMask, schedule.eventCount);
       
       if (schedule.relayMask == 0) {
         debugPrintf("DIAGNOSTIC: ⚠️ Schedule '%s' has no relays assigned (inactive)\n", 
-                  schedule.name.c_str());
+                  scheduleName);
       } else {
         foundActiveSchedule = true;
       }
@@ -1829,9 +2172,9 @@ void schedulerDiagnosticsTask(void *pvParameters) {
       // Check for valid event times
       for (int j = 0; j < schedule.eventCount; j++) {
         Event& event = schedule.events[j];
-        if (!validateTimeFormat(event.time.c_str())) {
-          debugPrintf("DIAGNOSTIC: ❌ Invalid time format in event: '%s'\n", 
-                    event.time.c_str());
+        if (event.secondOfDay >= SECONDS_PER_DAY) {
+          debugPrintf("DIAGNOSTIC: ❌ Invalid time in event '%s': second %u\n", 
+                    event.id, event.secondOfDay);
         } else {
           foundUpcomingEvent = true;
         }
@@ -1929,103 +2272,37 @@ void executeNextScheduledEvent() {
   debugPrintf("Current time (UTC): %s\n", currentTimeStr);
   
   // Find the next event
-  Event* nextEvent = nullptr;
-  Schedule* nextSchedule = nullptr;
-  time_t soonestTime = INT32_MAX;
-  
-  // Search all schedules for the next event
-  for (int scheduleIdx = 0; scheduleIdx < schedulerState.scheduleCount; scheduleIdx++) {
-    Schedule& schedule = schedulerState.schedules[scheduleIdx];
-    
-    // Skip inactive schedules
-    if (schedule.relayMask == 0) continue;
-    
-    for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
-      Event& event = schedule.events[eventIdx];
-      
-      // Parse event time
-      int eventHour = 0, eventMinute = 0;
-      if (sscanf(event.time.c_str(), "%d:%d", &eventHour, &eventMinute) != 2) {
-        debugPrintf("Invalid time format in event: %s\n", event.time.c_str());
-        continue;
-      }
-      
-      int eventMinutes = eventHour * 60 + eventMinute;
-      int currentMinutes = timeinfo.tm_hour * 60 + timeinfo.tm_min;
-      
-      // Calculate time until this event
-      int minutesUntilEvent;
-      if (eventMinutes > currentMinutes) {
-        minutesUntilEvent = eventMinutes - currentMinutes;
-      } else {
-        minutesUntilEvent = (24 * 60) - currentMinutes + eventMinutes;
-      }
-      
-      time_t secondsUntilEvent = minutesUntilEvent * 60;
-      
-      // Check if this is the soonest event
-      if (secondsUntilEvent < soonestTime) {
-        soonestTime = secondsUntilEvent;
-        nextEvent = &event;
-        nextSchedule = &schedule;
-      }
-    }
-  }
-  
-  // Execute the next event if found
-  if (nextEvent && nextSchedule) {
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  UpcomingFiring next;
+  
+  if (snapshot && getUpcomingFirings(*snapshot, now, &next, 1) == 1) {
+    const Schedule& schedule = snapshot->state.schedules[next.scheduleIdx];
+    const Event& event = schedule.events[next.eventIdx];
+    char timeStr[9];
+    formatSecondOfDay(event.secondOfDay, timeStr);
     debugPrintf("Executing event at %s from schedule '%s'\n", 
-               nextEvent->time.c_str(), nextSchedule->name.c_str());
+               timeStr, arenaString(snapshot->state.strings, schedule.name));
     
     // Activate the relays in this schedule
     for (int relay = 0; relay < 8; relay++) {
-      if (nextSchedule->relayMask & (1 << relay)) {
-        debugPrintf("Activating relay %d for %d seconds\n", relay, nextEvent->duration);
-        
-        // Direct relay control instead of using executeRelayCommand
-        setRelay(relay, true);
-        
-        // Create a task to turn off the relay after the duration
-        int duration = nextEvent->duration;
-        int relayNum = relay;
-        
-        // Use a lambda for the task
-        xTaskCreatePinnedToCore(
-          [](void* parameter) {
-            // Extract parameters
-            int* params = (int*)parameter;
-            int relayNum = params[0];
-            int duration = params[1];
-            
-            // Wait for the specified duration
-            vTaskDelay(pdMS_TO_TICKS(duration * 1000));
-            
-            // Turn off the relay
-            setRelay(relayNum, false);
-            debugPrintf("Relay %d turned OFF after %d seconds\n", relayNum, duration);
-            
-            // Free the parameters and delete the task
-            delete[] params;
-            vTaskDelete(NULL);
-          },
-          "RelayOff",
-          4096,
-          new int[2]{relayNum, duration},
-          2,
-          NULL,
-          1
-        );
+      if (next.relayMask & (1 << relay)) {
+        debugPrintf("Activating relay %d for %d seconds\n", relay, next.duration);
+        executeRelayCommand(relay, next.duration);
       }
     }
     
-    // Mark the event as executed
-    nextEvent->executedMask |= 0x01;
+    // Run stamps belong to the executor's snapshot, so a manual run is not
+    // recorded and the event still fires at its scheduled time
     
     debugPrintln("Event execution initiated successfully");
   } else {
     debugPrintln("No upcoming events found to execute");
   }
   
+  if (snapshot) {
+    releaseSchedulerSnapshot(snapshot);
+  }
+  
   debugPrintln("==== MANUAL EXECUTION COMPLETE ====\n");
 }
 
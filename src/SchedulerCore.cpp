@@ -0,0 +1,310 @@
+// SchedulerCore.cpp
+// The parts of the scheduler that do not touch the web server, SPIFFS or
+// the relays: the shared state, the clock, time and string helpers and the
+// executor's step functions. Scheduler.cpp drives them from its task; the
+// simulator and the native tests drive them on a virtual clock.
+#include "Scheduler.h"
+#include <time.h>
+#include "SchedulerSnapshot.h"
+#include "Recurrence.h"
+#include "UtcOffset.h"
+#include "Utils.h"
+
+// Global scheduler state
+SchedulerState schedulerState;
+TaskHandle_t schedulerTaskHandle = NULL;   // Set by startSchedulerTask()
+
+// Default scheduler clock
+static time_t systemSchedulerClock() {
+  return time(NULL);
+}
+
+static SchedulerClock schedulerClock = systemSchedulerClock;
+
+bool parseMinuteOfDay(const char* timeStr, uint16_t& minuteOfDay) {
+  int hours, minutes;
+  if (!timeStr || sscanf(timeStr, "%d:%d", &hours, &minutes) != 2) {
+    return false;
+  }
+  if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+    return false;
+  }
+  minuteOfDay = hours * 60 + minutes;
+  return true;
+}
+
+void formatMinuteOfDay(uint16_t minuteOfDay, char* buffer) {
+  sprintf(buffer, "%02d:%02d", (minuteOfDay / 60) % 24, minuteOfDay % 60);
+}
+
+// Event times accept an optional seconds field; "HH:MM" means second 0
+bool parseSecondOfDay(const char* timeStr, uint32_t& secondOfDay) {
+  int hours, minutes, seconds = 0;
+  if (!timeStr) {
+    return false;
+  }
+  int fields = sscanf(timeStr, "%d:%d:%d", &hours, &minutes, &seconds);
+  if (fields < 2) {
+    return false;
+  }
+  if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59) {
+    return false;
+  }
+  secondOfDay = (uint32_t)hours * 3600 + minutes * 60 + seconds;
+  return true;
+}
+
+// Whole minutes keep the "HH:MM" form older clients expect
+void formatSecondOfDay(uint32_t secondOfDay, char* buffer) {
+  uint32_t hours = (secondOfDay / 3600) % 24;
+  uint32_t minutes = (secondOfDay / 60) % 60;
+  uint32_t seconds = secondOfDay % 60;
+  if (seconds == 0) {
+    sprintf(buffer, "%02u:%02u", hours, minutes);
+  } else {
+    sprintf(buffer, "%02u:%02u:%02u", hours, minutes, seconds);
+  }
+}
+
+// Convert times between local and UTC minutes since midnight using the
+// current UTC offset (cached by TimeManager until the next DST transition)
+uint16_t localMinuteToUTC(uint16_t localMinute) {
+  int32_t offsetMinutes = getUtcOffsetSeconds(time(NULL)) / 60;
+  return (uint16_t)(((int32_t)localMinute - offsetMinutes + 2 * MINUTES_PER_DAY) % MINUTES_PER_DAY);
+}
+
+uint16_t utcMinuteToLocal(uint16_t utcMinute) {
+  int32_t offsetMinutes = getUtcOffsetSeconds(time(NULL)) / 60;
+  return (uint16_t)(((int32_t)utcMinute + offsetMinutes + 2 * MINUTES_PER_DAY) % MINUTES_PER_DAY);
+}
+
+uint32_t localSecondToUTC(uint32_t localSecond) {
+  int32_t offset = getUtcOffsetSeconds(time(NULL));
+  return (uint32_t)(((int32_t)localSecond - offset + 2 * (int32_t)SECONDS_PER_DAY) % (int32_t)SECONDS_PER_DAY);
+}
+
+uint32_t utcSecondToLocal(uint32_t utcSecond) {
+  int32_t offset = getUtcOffsetSeconds(time(NULL));
+  return (uint32_t)(((int32_t)utcSecond + offset + 2 * (int32_t)SECONDS_PER_DAY) % (int32_t)SECONDS_PER_DAY);
+}
+
+// String forms of the conversions above, "HH:MM" in and out
+String localTimeToUTC(const String& localTime) {
+  uint16_t minute;
+  if (!parseMinuteOfDay(localTime.c_str(), minute)) {
+    debugPrintf("ERROR: Invalid time format: %s\n", localTime.c_str());
+    return localTime; // Return unchanged if format is invalid
+  }
+  
+  char buffer[6]; // HH:MM\0
+  formatMinuteOfDay(localMinuteToUTC(minute), buffer);
+  return String(buffer);
+}
+
+String utcToLocalTime(const String& utcTime) {
+  uint16_t minute;
+  if (!parseMinuteOfDay(utcTime.c_str(), minute)) {
+    debugPrintf("ERROR: Invalid time format: %s\n", utcTime.c_str());
+    return utcTime; // Return unchanged if format is invalid
+  }
+  
+  char buffer[6]; // HH:MM\0
+  formatMinuteOfDay(utcMinuteToLocal(minute), buffer);
+  return String(buffer);
+}
+
+bool isValidTimeFormat(const String& timeStr) {
+  uint16_t minute;
+  return parseMinuteOfDay(timeStr.c_str(), minute);
+}
+
+// String arena: strings are stored once, NUL-terminated, and referenced by offset
+const char* arenaString(const StringArena& arena, uint16_t ref) {
+  if (ref == ARENA_NONE || ref >= arena.used) {
+    return "";
+  }
+  return arena.data + ref;
+}
+
+uint16_t internString(StringArena& arena, const char* str) {
+  if (!str || str[0] == 0) {
+    return ARENA_NONE;
+  }
+  
+  // Reuse an identical string if one is already stored
+  uint16_t offset = 0;
+  while (offset < arena.used) {
+    if (strcmp(arena.data + offset, str) == 0) {
+      return offset;
+    }
+    offset += strlen(arena.data + offset) + 1;
+  }
+  
+  size_t length = strlen(str) + 1;
+  if (arena.used + length > SCHEDULER_ARENA_SIZE) {
+    return ARENA_NONE;
+  }
+  
+  offset = arena.used;
+  memcpy(arena.data + offset, str, length);
+  arena.used += length;
+  return offset;
+}
+
+// Drop strings no schedule refers to any more
+static void compactSchedulerStrings() {
+  static StringArena compacted;
+  compacted.used = 0;
+  
+  for (int i = 0; i < schedulerState.scheduleCount; i++) {
+    Schedule& sch = schedulerState.schedules[i];
+    sch.name = internString(compacted, arenaString(schedulerState.strings, sch.name));
+    sch.metadata = internString(compacted, arenaString(schedulerState.strings, sch.metadata));
+  }
+  
+  debugPrintf("DEBUG: Schedule string arena compacted: %d -> %d bytes\n", 
+             schedulerState.strings.used, compacted.used);
+  memcpy(&schedulerState.strings, &compacted, sizeof(StringArena));
+}
+
+uint16_t internSchedulerString(const char* str) {
+  uint16_t ref = internString(schedulerState.strings, str);
+  if (ref == ARENA_NONE && str && str[0] != 0) {
+    compactSchedulerStrings();
+    ref = internString(schedulerState.strings, str);
+    if (ref == ARENA_NONE) {
+      debugPrintf("ERROR: Schedule string arena full, dropping \"%s\"\n", str);
+    }
+  }
+  return ref;
+}
+
+void setSchedulerClock(SchedulerClock clock) {
+  schedulerClock = clock ? clock : systemSchedulerClock;
+  wakeSchedulerTask();
+}
+
+time_t getSchedulerTime() {
+  return schedulerClock();
+}
+
+bool schedulerClockIsSystem() {
+  return schedulerClock == systemSchedulerClock;
+}
+
+// Make the scheduler task re-evaluate its next due time now
+void wakeSchedulerTask() {
+  if (schedulerTaskHandle != NULL) {
+    xTaskNotifyGive(schedulerTaskHandle);
+  }
+}
+
+// Seconds from now until the next timeline entry (possibly tomorrow's first)
+uint32_t secondsUntilNextSchedulerWake(const SchedulerTimeline& timeline, time_t now) {
+  uint32_t secondOfDay = now % 86400;
+
+  if (timeline.count == 0) {
+    return SCHEDULER_MAX_SLEEP_S;
+  }
+
+  // Entries of the current second have already been handled by this point
+  uint32_t wakeSecond;
+  uint16_t next = findFirstTimelineEntry(timeline, secondOfDay + 1);
+  if (next < timeline.count) {
+    wakeSecond = timeline.entries[next].secondOfDay;
+  } else {
+    wakeSecond = SECONDS_PER_DAY + timeline.entries[0].secondOfDay;
+  }
+
+  uint32_t seconds = wakeSecond - secondOfDay;
+  if (seconds > SCHEDULER_MAX_SLEEP_S) {
+    seconds = SCHEDULER_MAX_SLEEP_S;
+  }
+  return seconds > 0 ? seconds : 1;
+}
+
+// Seconds from now until the executor has to look again: the next event,
+// the next relay edge or midnight, when the next day's plan is compiled
+uint32_t secondsUntilNextSchedulerStep(const SchedulerSnapshot& snapshot, time_t now, RelayPlanCursor* cursor) {
+  uint32_t secondOfDay = now % 86400;
+  uint32_t seconds = secondsUntilNextSchedulerWake(snapshot.timeline, now);
+  uint32_t edgeSeconds = cursor ? secondsUntilRelayPlanEdge(snapshot.relayPlan, *cursor, secondOfDay) :
+                                  secondsUntilRelayPlanEdge(snapshot.relayPlan, secondOfDay);
+  if (edgeSeconds > 0 && edgeSeconds < seconds) {
+    seconds = edgeSeconds;
+  }
+  if (SECONDS_PER_DAY - secondOfDay < seconds) {
+    seconds = SECONDS_PER_DAY - secondOfDay;
+  }
+  return seconds;
+}
+
+uint16_t stampDueEvents(SchedulerSnapshot& snapshot, time_t now, SchedulerFiringSink sink, void* context) {
+  SchedulerState& state = snapshot.state;
+  const SchedulerTimeline& timeline = snapshot.timeline;
+  
+  // Run stamps make repeated checks of the same window harmless
+  if (state.scheduleCount == 0) {
+    return 0;
+  }
+  
+  // The task wakes on the exact second, but a late wake (busy core, clock
+  // step, reboot) still picks up entries due within the catch-up window
+  uint32_t currentSecond = now % 86400;
+  uint32_t windowStart = currentSecond >= SCHEDULER_CATCHUP_S ? currentSecond - SCHEDULER_CATCHUP_S + 1 : 0;
+  uint16_t today = schedulerEpochDay(now);
+  uint16_t fired = 0;
+  
+  // Jump straight to the window's slots in the compiled timeline
+  for (uint16_t i = findFirstTimelineEntry(timeline, windowStart);
+       i < timeline.count && timeline.entries[i].secondOfDay <= currentSecond;
+       i++) {
+    const TimelineEntry& entry = timeline.entries[i];
+    Schedule& schedule = state.schedules[entry.scheduleIdx];
+    Event& event = schedule.events[entry.eventIdx];
+    
+    // Check if this event has already been executed today
+    if (schedulerEpochDay(eventLastRun(event)) == today) {
+      continue;
+    }
+    
+    // Recurrence rules are compiled into the snapshot's day bits
+    if (!eventFiresAt(snapshot.recurrence, entry.scheduleIdx, event, now - currentSecond + entry.secondOfDay)) {
+      continue;
+    }
+    
+    if (sink) {
+      sink(snapshot, entry.scheduleIdx, entry.eventIdx, now, context);
+    } else {
+      logSchedulerFiring(snapshot, entry.scheduleIdx, entry.eventIdx);
+    }
+    
+    // Stamp the event so it is only recorded once today, even across a reboot
+    markEventRun(event, now);
+    fired++;
+  }
+  return fired;
+}
+
+// What stampDueEvents() logs for a firing when it has no sink
+void logSchedulerFiring(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx) {
+  const Schedule& schedule = snapshot.state.schedules[scheduleIdx];
+  const Event& event = schedule.events[eventIdx];
+  char timeStr[9];
+  formatSecondOfDay(event.secondOfDay, timeStr);
+  debugPrintf("DEBUG: Event from schedule '%s' started: time %s, duration %d seconds, relayMask 0x%02X\n", 
+             arenaString(snapshot.state.strings, schedule.name), timeStr, event.duration, schedule.relayMask);
+}
+
+uint16_t schedulerEpochDay(time_t t) {
+  return (uint16_t)(t / 86400);
+}
+
+// Record that an event fired at time now, in a single 32-bit store
+void markEventRun(Event& event, time_t now) {
+  __atomic_store_n(&event.lastRun, (uint32_t)now, __ATOMIC_RELAXED);
+}
+
+uint32_t eventLastRun(const Event& event) {
+  return __atomic_load_n(&event.lastRun, __ATOMIC_RELAXED);
+}
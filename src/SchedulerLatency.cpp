@@ -0,0 +1,119 @@
+// SchedulerLatency.cpp
+// Follows each scheduled relay change from its planned instant through the
+// scheduler task, the relayState write and the 74HC595 latch. Only one
+// change is in flight at a time: plan edges are at least a second apart and
+// the relay update task latches every 50 ms.
+#include "SchedulerLatency.h"
+#include <sys/time.h>
+
+// The change currently being followed
+struct PendingLatencySample {
+  bool active;
+  bool written;            // relayState holds the change, waiting for the latch
+  uint32_t sequence;       // relayState write number carrying the change
+  uint32_t pickupUs;       // Planned instant -> pickup
+  uint32_t pickupCycles;
+  uint32_t writeCycles;
+};
+
+static portMUX_TYPE latencyMux = portMUX_INITIALIZER_UNLOCKED;
+static SchedulerLatencyStats latencyStats = {};
+static PendingLatencySample pending = {};
+static volatile bool latchAwaited = false;  // Lets the relay task skip the lock when idle
+
+static uint32_t cyclesToUs(uint32_t cycles) {
+  return cycles / ESP.getCpuFreqMHz();
+}
+
+static void addLatencySample(LatencyStage stage, uint32_t us) {
+  LatencyHistogram& histogram = latencyStats.stages[stage];
+  uint8_t bucket = us == 0 ? 0 : 32 - __builtin_clz(us);
+  if (bucket >= LATENCY_HISTOGRAM_BUCKETS) {
+    bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+  }
+  histogram.buckets[bucket]++;
+  histogram.count++;
+  if (us > histogram.maxUs) {
+    histogram.maxUs = us;
+  }
+}
+
+void beginLatencySample(time_t dueTime) {
+  uint32_t cycles = ESP.getCycleCount();
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  int64_t lateUs = (int64_t)(tv.tv_sec - dueTime) * 1000000LL + tv.tv_usec;
+  if (lateUs < 0) lateUs = 0;
+  if (lateUs > UINT32_MAX) lateUs = UINT32_MAX;
+
+  portENTER_CRITICAL(&latencyMux);
+  if (pending.active) {
+    latencyStats.unlatched++;
+  }
+  pending.active = true;
+  pending.written = false;
+  pending.pickupUs = (uint32_t)lateUs;
+  pending.pickupCycles = cycles;
+  addLatencySample(LATENCY_PICKUP, pending.pickupUs);
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+void recordLatencyWrite(uint32_t sequence, uint32_t writeCycles) {
+  portENTER_CRITICAL(&latencyMux);
+  if (pending.active && !pending.written) {
+    pending.written = true;
+    pending.sequence = sequence;
+    pending.writeCycles = writeCycles;
+    addLatencySample(LATENCY_WRITE, cyclesToUs(writeCycles - pending.pickupCycles));
+    latchAwaited = true;
+  }
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+void recordRelayLatch(uint32_t sequence, uint32_t latchCycles) {
+  if (!latchAwaited) {
+    return;
+  }
+
+  portENTER_CRITICAL(&latencyMux);
+  // Any later write also carries the change, so a newer sequence completes it
+  if (pending.active && pending.written && (int32_t)(sequence - pending.sequence) >= 0) {
+    uint32_t writeUs = cyclesToUs(pending.writeCycles - pending.pickupCycles);
+    uint32_t latchUs = cyclesToUs(latchCycles - pending.writeCycles);
+    addLatencySample(LATENCY_LATCH, latchUs);
+    addLatencySample(LATENCY_TOTAL, pending.pickupUs + writeUs + latchUs);
+    pending.active = false;
+    latchAwaited = false;
+  }
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+SchedulerLatencyStats getSchedulerLatencyStats() {
+  portENTER_CRITICAL(&latencyMux);
+  SchedulerLatencyStats copy = latencyStats;
+  portEXIT_CRITICAL(&latencyMux);
+  return copy;
+}
+
+void resetSchedulerLatencyStats() {
+  portENTER_CRITICAL(&latencyMux);
+  memset(&latencyStats, 0, sizeof(latencyStats));
+  portEXIT_CRITICAL(&latencyMux);
+}
+
+uint32_t latencyPercentileUs(const LatencyHistogram& histogram, uint8_t percentile) {
+  if (histogram.count == 0) {
+    return 0;
+  }
+
+  uint32_t target = ((uint64_t)histogram.count * percentile + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < LATENCY_HISTOGRAM_BUCKETS - 1; b++) {
+    seen += histogram.buckets[b];
+    if (seen >= target) {
+      uint32_t upperUs = (1UL << b) - 1;
+      return upperUs < histogram.maxUs ? upperUs : histogram.maxUs;
+    }
+  }
+  return histogram.maxUs;
+}
@@ -0,0 +1,93 @@
+// SchedulerProjection.cpp
+// The list of upcoming firings only changes when a new generation is
+// published or when its first entry comes due, so it is computed once and
+// served from a cache until then.
+#include "SchedulerProjection.h"
+#include "SchedulerTimeline.h"
+#include "Utils.h"
+
+static UpcomingFiring cachedFirings[SCHEDULER_UPCOMING_MAX];
+static uint16_t cachedCount = 0;
+static uint32_t cachedGeneration = 0;
+static time_t cachedAt = 0;               // Time the cache was computed for
+static bool cacheValid = false;
+static portMUX_TYPE projectionMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t projectFirings(const SchedulerSnapshot& snapshot, time_t now, UpcomingFiring* out, uint16_t n) {
+  const SchedulerTimeline& timeline = snapshot.timeline;
+  if (timeline.count == 0) {
+    return 0;
+  }
+
+  time_t dayStart = now - now % 86400;
+  uint32_t currentSecond = now % 86400;
+
+  // Entries of the current second are handled by the executor already
+  uint16_t i = findFirstTimelineEntry(timeline, currentSecond + 1);
+  uint16_t count = 0;
+
+  // Recurrence bits only exist for the compiled days, which bounds the walk
+  time_t end = recurrenceDaysEnd(snapshot.recurrence);
+
+  while (count < n) {
+    if (i >= timeline.count) {
+      i = 0;
+      dayStart += 86400;
+    }
+
+    const TimelineEntry& entry = timeline.entries[i++];
+    const Schedule& schedule = snapshot.state.schedules[entry.scheduleIdx];
+    const Event& event = schedule.events[entry.eventIdx];
+    time_t start = dayStart + entry.secondOfDay;
+    if (start >= end) {
+      break;
+    }
+    if (!eventFiresAt(snapshot.recurrence, entry.scheduleIdx, event, start)) {
+      continue;
+    }
+
+    UpcomingFiring& firing = out[count++];
+    firing.time = start;
+    firing.duration = event.duration;
+    firing.scheduleIdx = entry.scheduleIdx;
+    firing.eventIdx = entry.eventIdx;
+    firing.relayMask = schedule.relayMask;
+  }
+  return count;
+}
+
+uint16_t getUpcomingFirings(const SchedulerSnapshot& snapshot, time_t now, UpcomingFiring* out, uint16_t n) {
+  if (n > SCHEDULER_UPCOMING_MAX) {
+    n = SCHEDULER_UPCOMING_MAX;
+  }
+
+  // Firings are in UTC, so timezone changes do not affect them; only a new
+  // generation, the first firing coming due or a clock step back does
+  portENTER_CRITICAL(&projectionMux);
+  bool hit = cacheValid && cachedGeneration == snapshot.generation && now >= cachedAt &&
+             (cachedCount == 0 || now < cachedFirings[0].time);
+  if (hit) {
+    if (n > cachedCount) n = cachedCount;
+    memcpy(out, cachedFirings, n * sizeof(UpcomingFiring));
+  }
+  portEXIT_CRITICAL(&projectionMux);
+
+  if (hit) {
+    return n;
+  }
+
+  UpcomingFiring fresh[SCHEDULER_UPCOMING_MAX];
+  uint16_t count = projectFirings(snapshot, now, fresh, SCHEDULER_UPCOMING_MAX);
+
+  portENTER_CRITICAL(&projectionMux);
+  memcpy(cachedFirings, fresh, count * sizeof(UpcomingFiring));
+  cachedCount = count;
+  cachedGeneration = snapshot.generation;
+  cachedAt = now;
+  cacheValid = true;
+  portEXIT_CRITICAL(&projectionMux);
+
+  if (n > count) n = count;
+  memcpy(out, fresh, n * sizeof(UpcomingFiring));
+  return n;
+}
@@ -0,0 +1,134 @@
+// SchedulerReplay.cpp
+// Runs the executor's step logic (stampDueEvents, relay plan lookups, day
+// recompiles) against a private snapshot and a virtual clock. Free of tasks
+// and I/O so the same loop serves the on-device simulator and the native
+// tests. The firing log doubles as a regression record: its digest only
+// changes when the scheduler's behaviour does.
+#include "SchedulerReplay.h"
+#include "EventPool.h"
+#include "UtcOffset.h"
+
+// FNV-1a, folded over every log line
+static uint32_t updateDigest(uint32_t digest, const char* text) {
+  while (*text) {
+    digest ^= (uint8_t)*text++;
+    digest *= 16777619UL;
+  }
+  return digest;
+}
+
+// "YYYY-MM-DDTHH:MM:SS" of t shifted by offsetSeconds
+static void formatReplayTime(time_t t, int32_t offsetSeconds, char* buffer, size_t size) {
+  time_t shifted = t + offsetSeconds;
+  struct tm tm;
+  gmtime_r(&shifted, &tm);
+  strftime(buffer, size, "%Y-%m-%dT%H:%M:%S", &tm);
+}
+
+// Add one line to the firing log: "SIM,<utc>,<local>,<kind>,<details>"
+static void logReplay(SchedulerReplay& replay, const char* kind, const char* details) {
+  char utcStr[20];
+  char localStr[20];
+  char line[160];
+  formatReplayTime(replay.now, 0, utcStr, sizeof(utcStr));
+  formatReplayTime(replay.now, getUtcOffsetSeconds(replay.now), localStr, sizeof(localStr));
+  snprintf(line, sizeof(line), "SIM,%s,%s,%s,%s", utcStr, localStr, kind, details);
+
+  replay.logDigest = updateDigest(replay.logDigest, line);
+  if (replay.sink) {
+    replay.sink(line, replay.context);
+  }
+}
+
+static void onReplayedFiring(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx,
+                             time_t now, void* context) {
+  const Schedule& schedule = snapshot.state.schedules[scheduleIdx];
+  char details[96];
+  snprintf(details, sizeof(details), "fire,%s,%s,%u", arenaString(snapshot.state.strings, schedule.name),
+           schedule.events[eventIdx].id, schedule.events[eventIdx].duration);
+  logReplay(*(SchedulerReplay*)context, "event", details);
+}
+
+bool beginSchedulerReplay(SchedulerReplay& replay, const SchedulerState& source, time_t start, uint16_t days,
+                          ReplayLogSink sink, void* context) {
+  if (!copySchedulerState(replay.snapshot.state, source)) {
+    return false;
+  }
+  for (int s = 0; s < replay.snapshot.state.scheduleCount; s++) {
+    Schedule& sch = replay.snapshot.state.schedules[s];
+    for (int e = 0; e < sch.eventCount; e++) {
+      sch.events[e].lastRun = 0;
+    }
+  }
+
+  replay.now = start;
+  replay.end = start + (time_t)days * SECONDS_PER_DAY;
+  replay.relays = 0;
+  replay.relayCursor.version = 0;
+  replay.compiled = false;
+  replay.firings = 0;
+  replay.relayChanges = 0;
+  replay.recompiles = 0;
+  replay.offsetChanges = 0;
+  replay.logDigest = 2166136261UL;
+  replay.maxRecompileUs = 0;
+  replay.sink = sink;
+  replay.context = context;
+  return true;
+}
+
+bool schedulerReplayDone(const SchedulerReplay& replay) {
+  return replay.now >= replay.end;
+}
+
+const char* stepSchedulerReplay(SchedulerReplay& replay) {
+  SchedulerSnapshot& snapshot = replay.snapshot;
+  time_t now = replay.now;
+
+  // Same order as the scheduler task: recompile, relays, then events
+  if (!replay.compiled || schedulerSnapshotIsStale(snapshot, now)) {
+    int32_t previousOffset = snapshot.recurrence.utcOffset;
+    uint32_t compileUs = micros();
+    if (!compileSchedulerSnapshot(snapshot, now)) {
+      return "out of memory compiling the timeline";
+    }
+    compileUs = micros() - compileUs;
+    if (replay.compiled && snapshot.recurrence.utcOffset != previousOffset) {
+      char details[32];
+      snprintf(details, sizeof(details), "offset,%d", snapshot.recurrence.utcOffset);
+      logReplay(replay, "clock", details);
+      replay.offsetChanges++;
+    }
+    if (compileUs > replay.maxRecompileUs) replay.maxRecompileUs = compileUs;
+    replay.recompiles++;
+    replay.compiled = true;
+  }
+
+  uint8_t desired = relayPlanMaskAt(snapshot.relayPlan, replay.relayCursor, now % SECONDS_PER_DAY);
+  if (desired != replay.relays) {
+    char details[16];
+    snprintf(details, sizeof(details), "0x%02X", desired);
+    logReplay(replay, "relays", details);
+    replay.relayChanges++;
+    replay.relays = desired;
+  }
+
+  replay.firings += stampDueEvents(snapshot, now, onReplayedFiring, &replay);
+  replay.now = now + secondsUntilNextSchedulerStep(snapshot, now, &replay.relayCursor);
+  return NULL;
+}
+
+void endSchedulerReplay(SchedulerReplay& replay) {
+  SchedulerSnapshot& snapshot = replay.snapshot;
+  releaseSchedulerState(snapshot.state);
+  free(snapshot.timeline.entries);
+  snapshot.timeline.entries = NULL;
+  snapshot.timeline.count = 0;
+  snapshot.timeline.capacity = 0;
+  for (uint8_t relay = 0; relay < 8; relay++) {
+    free(snapshot.relayPlan.intervals[relay]);
+    snapshot.relayPlan.intervals[relay] = NULL;
+    snapshot.relayPlan.count[relay] = 0;
+    snapshot.relayPlan.capacity[relay] = 0;
+  }
+}
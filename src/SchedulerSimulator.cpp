@@ -0,0 +1,234 @@
+// SchedulerSimulator.cpp
+// Runs a SchedulerReplay of the published schedules in a background task,
+// so months of schedule run in seconds without touching the live executor.
+// The replay's firing log doubles as a regression record: its digest only
+// changes when the scheduler's behaviour does.
+#include "SchedulerSimulator.h"
+#include <ArduinoJson.h>
+#include "Scheduler.h"
+#include "SchedulerSnapshot.h"
+#include "SchedulerReplay.h"
+#include "Recurrence.h"
+#include "TimeManager.h"
+#include "Utils.h"
+
+// Inputs of a run, handed to the simulator task
+struct SimulationRequest {
+  time_t start;
+  uint16_t days;
+  bool echo;
+};
+
+static SchedulerReplay simReplay = {};   // Only touched by the simulator task
+static SimulationReport report = {};
+static SimulationRequest pendingRequest;
+static portMUX_TYPE reportMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void echoSimulationLine(const char* line, void* context) {
+  Serial.println(line);
+}
+
+static void finishSimulation(const char* error, uint32_t startUs) {
+  endSchedulerReplay(simReplay);
+  portENTER_CRITICAL(&reportMux);
+  report.wallUs = micros() - startUs;
+  report.error = error;
+  report.completed = (error == NULL);
+  report.running = false;
+  portEXIT_CRITICAL(&reportMux);
+
+  if (error) {
+    debugPrintf("ERROR: Scheduler simulation stopped: %s\n", error);
+  } else {
+    debugPrintf("DEBUG: Simulated %u days in %u ms: %u steps, %u firings, %u relay changes, "
+                "%u recompiles, %u offset changes, digest %08X\n",
+               report.days, report.wallUs / 1000, report.steps, report.firings, report.relayChanges,
+               report.recompiles, report.offsetChanges, report.logDigest);
+  }
+}
+
+static void simulatorTask(void* pvParameters) {
+  SimulationRequest request = pendingRequest;
+  uint32_t startUs = micros();
+
+  // Start from the published schedules
+  SchedulerSnapshot* published = acquireSchedulerSnapshot();
+  bool copied = published && beginSchedulerReplay(simReplay, published->state, request.start, request.days,
+                                                  request.echo ? echoSimulationLine : NULL, NULL);
+  releaseSchedulerSnapshot(published);
+  if (!copied) {
+    finishSimulation(published ? "not enough event pool for a copy of the schedules" : "scheduler not loaded", startUs);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  while (!schedulerReplayDone(simReplay)) {
+    uint32_t stepUs = micros();
+    const char* error = stepSchedulerReplay(simReplay);
+    if (error) {
+      finishSimulation(error, startUs);
+      vTaskDelete(NULL);
+      return;
+    }
+    stepUs = micros() - stepUs;
+
+    portENTER_CRITICAL(&reportMux);
+    report.steps++;
+    if (stepUs > report.maxStepUs) report.maxStepUs = stepUs;
+    report.firings = simReplay.firings;
+    report.relayChanges = simReplay.relayChanges;
+    report.recompiles = simReplay.recompiles;
+    report.offsetChanges = simReplay.offsetChanges;
+    report.logDigest = simReplay.logDigest;
+    report.maxRecompileUs = simReplay.maxRecompileUs;
+    portEXIT_CRITICAL(&reportMux);
+
+    // Leave the core to the live tasks now and then
+    if (report.steps % SIMULATOR_YIELD_STEPS == 0) {
+      vTaskDelay(1);
+    }
+  }
+
+  finishSimulation(NULL, startUs);
+  vTaskDelete(NULL);
+}
+
+bool startSchedulerSimulation(time_t start, uint16_t days, bool echo) {
+  if (days == 0 || days > SIMULATOR_MAX_DAYS) {
+    debugPrintf("ERROR: Simulation length must be 1-%d days\n", SIMULATOR_MAX_DAYS);
+    return false;
+  }
+
+  portENTER_CRITICAL(&reportMux);
+  bool busy = report.running;
+  if (!busy) {
+    memset(&report, 0, sizeof(report));
+    report.running = true;
+    report.start = start;
+    report.days = days;
+    report.logDigest = 2166136261UL;
+  }
+  portEXIT_CRITICAL(&reportMux);
+
+  if (busy) {
+    debugPrintln("ERROR: A scheduler simulation is already running");
+    return false;
+  }
+
+  pendingRequest.start = start;
+  pendingRequest.days = days;
+  pendingRequest.echo = echo;
+
+  // Lowest priority, so the live scheduler always goes first
+  if (xTaskCreatePinnedToCore(simulatorTask, "SimulatorTask", SIMULATOR_STACK_SIZE, NULL, 0, NULL, 1) != pdPASS) {
+    portENTER_CRITICAL(&reportMux);
+    report.running = false;
+    report.error = "could not create the simulator task";
+    portEXIT_CRITICAL(&reportMux);
+    debugPrintln("ERROR: Failed to create simulator task");
+    return false;
+  }
+  return true;
+}
+
+SimulationReport getSimulationReport() {
+  portENTER_CRITICAL(&reportMux);
+  SimulationReport copy = report;
+  portEXIT_CRITICAL(&reportMux);
+  return copy;
+}
+
+// UTC instant of local midnight at the start of a "YYYY-MM-DD" date, or of
+// today if date is empty
+static bool parseSimulationStart(const String& date, time_t& start) {
+  uint16_t localDay;
+  if (date.length() == 0) {
+    time_t now = getSchedulerTime();
+    localDay = (now + getUtcOffsetSeconds(now)) / SECONDS_PER_DAY;
+  } else if (!parseRecurrenceDate(date.c_str(), localDay)) {
+    return false;
+  }
+  time_t midnight = (time_t)localDay * SECONDS_PER_DAY;
+  start = midnight - getUtcOffsetSeconds(midnight);
+  return true;
+}
+
+void handleSimulateCommand(const String& args) {
+  // simulate <days> [YYYY-MM-DD] [log]
+  String rest = args;
+  rest.trim();
+  int space = rest.indexOf(' ');
+  long days = (space < 0 ? rest : rest.substring(0, space)).toInt();
+  String date = "";
+  bool echo = false;
+
+  rest = space < 0 ? String("") : rest.substring(space + 1);
+  while (rest.length() > 0) {
+    space = rest.indexOf(' ');
+    String word = space < 0 ? rest : rest.substring(0, space);
+    rest = space < 0 ? String("") : rest.substring(space + 1);
+    if (word == "log") {
+      echo = true;
+    } else if (word.length() > 0) {
+      date = word;
+    }
+  }
+
+  time_t start;
+  if (days < 1 || days > SIMULATOR_MAX_DAYS || !parseSimulationStart(date, start)) {
+    Serial.printf("Usage: simulate <days 1-%d> [YYYY-MM-DD] [log]\n", SIMULATOR_MAX_DAYS);
+    return;
+  }
+  if (startSchedulerSimulation(start, days, echo)) {
+    Serial.printf("Simulating %ld days from %s; the summary is printed when done\n",
+                  days, date.length() ? date.c_str() : "today");
+  }
+}
+
+void handleStartSimulation(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Start scheduler simulation");
+
+  long days = request->hasParam("days") ? request->getParam("days")->value().toInt() : 365;
+  String date = request->hasParam("start") ? request->getParam("start")->value() : String("");
+  time_t start;
+  if (days < 1 || days > SIMULATOR_MAX_DAYS || !parseSimulationStart(date, start)) {
+    request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"days must be 1-3660 and start YYYY-MM-DD\"}");
+    return;
+  }
+
+  if (!startSchedulerSimulation(start, days, false)) {
+    request->send(409, "application/json", "{\"status\":\"error\",\"message\":\"Simulation already running\"}");
+    return;
+  }
+  request->send(202, "application/json", "{\"status\":\"success\",\"message\":\"Simulation started\"}");
+}
+
+void handleGetSimulation(AsyncWebServerRequest *request) {
+  debugPrintln("API request: Scheduler simulation report");
+
+  SimulationReport current = getSimulationReport();
+  DynamicJsonDocument doc(768);
+  char digest[9];
+  sprintf(digest, "%08X", current.logDigest);
+
+  doc["running"] = current.running;
+  doc["completed"] = current.completed;
+  doc["error"] = current.error;
+  doc["start"] = (uint32_t)current.start;
+  doc["days"] = current.days;
+  doc["steps"] = current.steps;
+  doc["firings"] = current.firings;
+  doc["relayChanges"] = current.relayChanges;
+  doc["recompiles"] = current.recompiles;
+  doc["offsetChanges"] = current.offsetChanges;
+  doc["logDigest"] = digest;
+  doc["wallUs"] = current.wallUs;
+  doc["usPerDay"] = current.days > 0 ? current.wallUs / current.days : 0;
+  doc["maxStepUs"] = current.maxStepUs;
+  doc["maxRecompileUs"] = current.maxRecompileUs;
+  doc["cpuMhz"] = ESP.getCpuFreqMHz();
+
+  String response;
+  serializeJson(doc, response);
+  request->send(200, "application/json", response);
+}
@@ -0,0 +1,329 @@
+// SchedulerSnapshot.cpp
+// Two snapshot buffers: one is the current generation, the other is free
+// for the next publish once the executor has moved off it. Readers only
+// take a reference count under a short spinlock, so the executor never
+// waits on an editor.
+//
+// Once the executor runs, editors do not make their copy current
+// themselves: they leave it pending in the spare buffer, and the executor
+// carries its run stamps into it while nobody else can see it, then makes
+// it current. A published snapshot is therefore only ever written by the
+// executor stamping events as they fire, one 32-bit word per stamp, which
+// readers load whole.
+#include "SchedulerSnapshot.h"
+#include <freertos/semphr.h>
+#include "EventPool.h"
+#include "UtcOffset.h"
+#include "Utils.h"
+
+static SchedulerSnapshot snapshots[2];
+static uint8_t snapshotReaders[2] = {0, 0};
+static int8_t publishedSlot = -1;            // -1 until the first publish
+static int8_t pendingSlot = -1;              // Editor copy waiting for the executor, -1 if none
+static bool executorAttached = false;        // The executor holds a generation and adopts pending copies
+static uint32_t generation = 0;
+static portMUX_TYPE snapshotMux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t publishMutex = NULL;
+static SemaphoreHandle_t compileMutex = NULL;   // Created by the first publish, from setup()
+
+bool compileSchedulerSnapshot(SchedulerSnapshot& snapshot, time_t now) {
+  // The relay plan builder keeps its scratch buffer between builds
+  if (compileMutex == NULL) {
+    compileMutex = xSemaphoreCreateMutex();
+  }
+  xSemaphoreTake(compileMutex, portMAX_DELAY);
+
+  bool ok = buildSchedulerTimeline(snapshot.state, snapshot.timeline);
+  if (ok) {
+    snapshot.planDay = now / SECONDS_PER_DAY;
+    compileRecurrenceDays(snapshot.state, now, snapshot.recurrence);
+    buildRelayPlan(snapshot.state, snapshot.recurrence, snapshot.planDay, snapshot.relayPlan);
+  }
+
+  xSemaphoreGive(compileMutex);
+  return ok;
+}
+
+// Wait until the spare buffer has no readers and no pending copy the
+// executor has yet to adopt. Called with publishMutex held. Returns the
+// slot, or -1 if it stayed busy past the timeout (or at once when wait is
+// false).
+static int claimSpareSlot(bool wait) {
+  uint32_t startMs = millis();
+  for (;;) {
+    portENTER_CRITICAL(&snapshotMux);
+    int slot = (publishedSlot == 0) ? 1 : 0;
+    bool busy = snapshotReaders[slot] != 0 || pendingSlot == slot;
+    portEXIT_CRITICAL(&snapshotMux);
+    if (!busy) return slot;
+
+    if (!wait) return -1;
+    if (millis() - startMs > SCHEDULER_PUBLISH_TIMEOUT_MS) {
+      debugPrintln("ERROR: Timed out waiting for scheduler snapshot buffer");
+      return -1;
+    }
+    wakeSchedulerTask();
+    vTaskDelay(1);
+  }
+}
+
+// Make slot the current generation. Called with snapshotMux held.
+static void makeCurrent(int slot) {
+  snapshots[slot].generation = ++generation;
+  publishedSlot = slot;
+}
+
+bool publishSchedulerStateFrom(const SchedulerState& source, bool persist) {
+  // First publish happens from setup(), before any other editor exists
+  if (publishMutex == NULL) {
+    publishMutex = xSemaphoreCreateMutex();
+  }
+  xSemaphoreTake(publishMutex, portMAX_DELAY);
+
+  int slot = claimSpareSlot(true);
+  if (slot < 0) {
+    xSemaphoreGive(publishMutex);
+    return false;
+  }
+
+  // The spare buffer keeps its event blocks and timeline between publishes
+  SchedulerSnapshot& next = snapshots[slot];
+  if (!copySchedulerState(next.state, source) || !compileSchedulerSnapshot(next, getSchedulerTime())) {
+    debugPrintln("ERROR: Not enough memory to publish scheduler state");
+    xSemaphoreGive(publishMutex);
+    return false;
+  }
+  next.persist = persist;
+
+  uint32_t planDay = next.planDay;   // The executor owns next once it is handed over
+
+  portENTER_CRITICAL(&snapshotMux);
+  bool pending = executorAttached;
+  if (pending) {
+    pendingSlot = slot;
+  } else {
+    makeCurrent(slot);
+  }
+  portEXIT_CRITICAL(&snapshotMux);
+
+  xSemaphoreGive(publishMutex);
+
+  debugPrintf("DEBUG: Published scheduler state for day %u%s\n", planDay,
+             pending ? " (pending executor)" : "");
+  wakeSchedulerTask();
+  return true;
+}
+
+bool publishSchedulerState(bool persist) {
+  return publishSchedulerStateFrom(schedulerState, persist);
+}
+
+bool recompileSchedulerSnapshot(SchedulerSnapshot*& held, time_t now) {
+  // An editor holding the lock is about to hand over a pending copy (which
+  // wakes this task); never wait for it here
+  if (publishMutex == NULL || xSemaphoreTake(publishMutex, 0) != pdTRUE) {
+    return false;
+  }
+
+  // A pending copy (newer than held) has to be adopted first
+  int slot = claimSpareSlot(false);
+  if (slot < 0) {
+    xSemaphoreGive(publishMutex);
+    return false;
+  }
+
+  // The executor's own stamps are in held, so nothing needs carrying over
+  SchedulerSnapshot& next = snapshots[slot];
+  if (!copySchedulerState(next.state, held->state) || !compileSchedulerSnapshot(next, now)) {
+    debugPrintln("ERROR: Not enough memory to recompile scheduler snapshot");
+    xSemaphoreGive(publishMutex);
+    return false;
+  }
+  next.persist = false;
+
+  portENTER_CRITICAL(&snapshotMux);
+  makeCurrent(slot);
+  snapshotReaders[slot]++;
+  snapshotReaders[held - snapshots]--;
+  portEXIT_CRITICAL(&snapshotMux);
+  held = &next;
+
+  xSemaphoreGive(publishMutex);
+
+  debugPrintf("DEBUG: Recompiled scheduler generation %u for day %u\n", next.generation, next.planDay);
+  return true;
+}
+
+bool schedulerSnapshotIsStale(const SchedulerSnapshot& snapshot, time_t now) {
+  return now / SECONDS_PER_DAY != snapshot.planDay ||
+         getUtcOffsetSeconds(now) != snapshot.recurrence.utcOffset;
+}
+
+SchedulerSnapshot* acquireSchedulerSnapshot() {
+  SchedulerSnapshot* snapshot = NULL;
+  portENTER_CRITICAL(&snapshotMux);
+  if (publishedSlot >= 0) {
+    snapshotReaders[publishedSlot]++;
+    snapshot = &snapshots[publishedSlot];
+  }
+  portEXIT_CRITICAL(&snapshotMux);
+  return snapshot;
+}
+
+void releaseSchedulerSnapshot(SchedulerSnapshot* snapshot) {
+  if (!snapshot) return;
+  portENTER_CRITICAL(&snapshotMux);
+  snapshotReaders[snapshot - snapshots]--;
+  portEXIT_CRITICAL(&snapshotMux);
+}
+
+// ---- Run stamp carry-over ----
+
+// Event of the previous generation, by (secondOfDay, id, schedule)
+struct StampIndexEntry {
+  const Event* event;
+  uint8_t scheduleIdx;
+};
+
+static int compareStampKey(const Event& a, const Event& b) {
+  if (a.secondOfDay != b.secondOfDay) return a.secondOfDay < b.secondOfDay ? -1 : 1;
+  return strcmp(a.id, b.id);
+}
+
+static int compareStampIndexEntries(const void* a, const void* b) {
+  const StampIndexEntry& x = *(const StampIndexEntry*)a;
+  const StampIndexEntry& y = *(const StampIndexEntry*)b;
+  int order = compareStampKey(*x.event, *y.event);
+  if (order != 0) return order;
+  return (int)x.scheduleIdx - (int)y.scheduleIdx;
+}
+
+// Sorted index of every event of previous (NULL if the heap is short)
+static StampIndexEntry* buildStampIndex(const SchedulerState& previous, int& count) {
+  count = 0;
+  for (int s = 0; s < previous.scheduleCount; s++) {
+    count += previous.schedules[s].eventCount;
+  }
+  StampIndexEntry* index = (StampIndexEntry*)malloc((count ? count : 1) * sizeof(StampIndexEntry));
+  if (!index) {
+    debugPrintf("WARNING: No memory to index %d run stamps, moved events lose theirs\n", count);
+    count = 0;
+    return NULL;
+  }
+  int n = 0;
+  for (int s = 0; s < previous.scheduleCount; s++) {
+    const Schedule& sch = previous.schedules[s];
+    for (int i = 0; i < sch.eventCount; i++) {
+      index[n].event = &sch.events[i];
+      index[n].scheduleIdx = s;
+      n++;
+    }
+  }
+  qsort(index, count, sizeof(StampIndexEntry), compareStampIndexEntries);
+  return index;
+}
+
+// The event in the index, preferring the same schedule (indices shift when
+// schedules are deleted, and ids are only unique within one)
+static const Event* findIndexedEvent(const StampIndexEntry* index, int count, int scheduleIdx, const Event& evt) {
+  int low = 0, high = count;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (compareStampKey(*index[mid].event, evt) < 0) low = mid + 1;
+    else high = mid;
+  }
+  const Event* found = NULL;
+  for (int i = low; i < count && compareStampKey(*index[i].event, evt) == 0; i++) {
+    if (index[i].scheduleIdx == scheduleIdx) return index[i].event;
+    if (!found) found = index[i].event;
+  }
+  return found;
+}
+
+// Editors copy stamps from schedulerState, which lags behind the executor;
+// keep whichever run is newer. Events are matched by id and time: at the
+// same position first (the usual case, O(1)), otherwise through an index of
+// the previous generation built on the first miss (O(N log N) in all).
+static void carryRunStamps(SchedulerState& next, const SchedulerState& previous) {
+  StampIndexEntry* index = NULL;
+  int indexCount = 0;
+  bool indexBuilt = false;
+
+  for (int s = 0; s < next.scheduleCount; s++) {
+    Schedule& sch = next.schedules[s];
+    for (int e = 0; e < sch.eventCount; e++) {
+      Event& evt = sch.events[e];
+      const Event* old = NULL;
+      if (s < previous.scheduleCount && e < previous.schedules[s].eventCount &&
+          compareStampKey(previous.schedules[s].events[e], evt) == 0) {
+        old = &previous.schedules[s].events[e];
+      } else {
+        if (!indexBuilt) {
+          index = buildStampIndex(previous, indexCount);
+          indexBuilt = true;
+        }
+        old = findIndexedEvent(index, indexCount, s, evt);
+      }
+      if (old && old->lastRun > evt.lastRun) {
+        evt.lastRun = old->lastRun;
+      }
+    }
+  }
+  free(index);
+}
+
+bool adoptSchedulerSnapshot(SchedulerSnapshot*& held) {
+  // Claim the pending copy; from here on no editor can reuse its buffer
+  portENTER_CRITICAL(&snapshotMux);
+  executorAttached = true;
+  int slot = pendingSlot;
+  if (slot >= 0) {
+    pendingSlot = -1;
+    snapshotReaders[slot]++;
+  }
+  portEXIT_CRITICAL(&snapshotMux);
+
+  if (slot < 0) {
+    // Before the executor attached, editors made their copies current themselves
+    SchedulerSnapshot* latest = acquireSchedulerSnapshot();
+    if (latest == NULL || latest == held) {
+      releaseSchedulerSnapshot(latest);
+      return false;
+    }
+    releaseSchedulerSnapshot(held);
+    held = latest;
+    return true;
+  }
+
+  // Still invisible to readers, so the stamps can be written freely
+  SchedulerSnapshot& next = snapshots[slot];
+  if (held) {
+    carryRunStamps(next.state, held->state);
+  }
+
+  portENTER_CRITICAL(&snapshotMux);
+  makeCurrent(slot);
+  if (held) {
+    snapshotReaders[held - snapshots]--;
+  }
+  portEXIT_CRITICAL(&snapshotMux);
+
+  held = &next;
+  return true;
+}
+
+uint16_t getPublishedRunDay(int scheduleIdx, int eventIdx) {
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  uint16_t day = 0;
+  if (snapshot && scheduleIdx < snapshot->state.scheduleCount &&
+      eventIdx < snapshot->state.schedules[scheduleIdx].eventCount) {
+    uint32_t lastRun = eventLastRun(snapshot->state.schedules[scheduleIdx].events[eventIdx]);
+    day = lastRun ? schedulerEpochDay(lastRun) : 0;
+  }
+  releaseSchedulerSnapshot(snapshot);
+  return day;
+}
+
+uint32_t getSchedulerGeneration() {
+  return generation;
+}
@@ -0,0 +1,471 @@
+// SchedulerStore.cpp
+// Compact binary persistence for the scheduler state. Every field is packed
+// little-endian into fixed-size records (the arena uses offsets, not
+// pointers), so loading is one read, a CRC check and a pass over the
+// records, and the file does not change with the compiler's struct layout.
+//
+// Payload layout:
+//   prefix    scheduleCount u8, currentScheduleIndex u8, arenaUsed u16
+//   schedule  name u16, metadata u16, lightsOnMinute u16, lightsOffMinute u16,
+//             relayMask u8, maxOpenZones u8, zoneGapSeconds u16, ruleCount u8,
+//             then ruleCount rules, eventCount u16 and eventCount events
+//   rule      weekdays u8, intervalDays u8, anchorDay u16, seasonStart u16, seasonEnd u16
+//   event     id char[EVENT_ID_LEN], rule u8, secondOfDay u32, duration u16, lastRun u32
+//   arena     arenaUsed bytes
+//
+// Run stamps change with every firing, so between saves they go to a
+// journal of fixed-size records (scheduleIdx u8, id char[EVENT_ID_LEN],
+// lastRun u32) appended per executor wake. Loading applies it on top of the
+// store; every save folds it in and removes it.
+#include "SchedulerStore.h"
+#include <SPIFFS.h>
+#include "EventPool.h"
+#include "Utils.h"
+
+#define STORE_PREFIX_SIZE 4
+#define STORE_SCHEDULE_SIZE 13      // Schedule fields up to ruleCount
+#define STORE_RULE_SIZE 8
+#define STORE_EVENT_SIZE (EVENT_ID_LEN + 11)
+#define STORE_RUN_SIZE (EVENT_ID_LEN + 5)
+
+// Largest payload a valid store can have
+#define SCHEDULER_STORE_MAX_PAYLOAD (STORE_PREFIX_SIZE + \
+  MAX_SCHEDULES * (STORE_SCHEDULE_SIZE + SCHEDULE_MAX_RULES * STORE_RULE_SIZE + 2) + \
+  (uint32_t)MAX_SCHEDULES * MAX_EVENTS * STORE_EVENT_SIZE + SCHEDULER_ARENA_SIZE)
+
+static SchedulerStoreStats storeStats = {};
+
+// Standard CRC-32 (IEEE 802.3, reflected), fed in pieces: start with
+// 0xFFFFFFFF and invert the final value
+static uint32_t updateCRC32(uint32_t crc, const uint8_t* buffer, size_t length) {
+  for (size_t pos = 0; pos < length; pos++) {
+    crc ^= buffer[pos];
+    for (int i = 0; i < 8; i++) {
+      if (crc & 1) {
+        crc = (crc >> 1) ^ 0xEDB88320;
+      } else {
+        crc >>= 1;
+      }
+    }
+  }
+  return crc;
+}
+
+static uint32_t calculateCRC32(const uint8_t* buffer, size_t length) {
+  return ~updateCRC32(0xFFFFFFFF, buffer, length);
+}
+
+// Little-endian field packing into a record buffer
+static uint8_t* put8(uint8_t* out, uint8_t value) {
+  *out = value;
+  return out + 1;
+}
+
+static uint8_t* put16(uint8_t* out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+  return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t value) {
+  put16(out, value & 0xFFFF);
+  put16(out + 2, value >> 16);
+  return out + 4;
+}
+
+static uint16_t get16(const uint8_t* in) {
+  return in[0] | (in[1] << 8);
+}
+
+static uint32_t get32(const uint8_t* in) {
+  return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+// Bytes of the payload in order: measured and checksummed in a first pass
+// (file NULL), then written out with the same sizes and CRC
+struct StoreWriter {
+  File* file;
+  uint32_t size;
+  uint32_t crc;
+  size_t written;
+};
+
+static void writeStoreBytes(StoreWriter& writer, const uint8_t* data, size_t length) {
+  writer.crc = updateCRC32(writer.crc, data, length);
+  writer.size += length;
+  if (writer.file && length > 0) {
+    writer.written += writer.file->write(data, length);
+  }
+}
+
+// Bytes of the payload in order, with bounds checks; ok turns false (and
+// stays false) on the first read past the end
+struct StoreReader {
+  const uint8_t* data;
+  uint32_t size;
+  uint32_t offset;
+  bool ok;
+};
+
+static const uint8_t* readStoreBytes(StoreReader& reader, size_t length) {
+  if (!reader.ok || reader.offset + length > reader.size) {
+    reader.ok = false;
+    return NULL;
+  }
+  const uint8_t* bytes = reader.data + reader.offset;
+  reader.offset += length;
+  return bytes;
+}
+
+static void packEvent(const Event& event, uint8_t* out) {
+  memcpy(out, event.id, EVENT_ID_LEN);
+  out += EVENT_ID_LEN;
+  out = put8(out, event.rule);
+  out = put32(out, event.secondOfDay);
+  out = put16(out, event.duration);
+  put32(out, eventLastRun(event));
+}
+
+static void unpackEvent(const uint8_t* in, Event& event) {
+  memcpy(event.id, in, EVENT_ID_LEN);
+  event.id[EVENT_ID_LEN - 1] = '\0';
+  in += EVENT_ID_LEN;
+  event.rule = in[0];
+  event.secondOfDay = get32(in + 1);
+  event.duration = get16(in + 5);
+  event.lastRun = get32(in + 7);
+}
+
+// The whole payload through writer
+static void writePayload(StoreWriter& writer, const SchedulerState& state) {
+  uint8_t record[STORE_EVENT_SIZE];
+
+  uint8_t* out = put8(record, state.scheduleCount);
+  out = put8(out, state.currentScheduleIndex);
+  put16(out, state.strings.used);
+  writeStoreBytes(writer, record, STORE_PREFIX_SIZE);
+
+  for (int i = 0; i < state.scheduleCount; i++) {
+    const Schedule& sch = state.schedules[i];
+    out = put16(record, sch.name);
+    out = put16(out, sch.metadata);
+    out = put16(out, sch.lightsOnMinute);
+    out = put16(out, sch.lightsOffMinute);
+    out = put8(out, sch.relayMask);
+    out = put8(out, sch.maxOpenZones);
+    out = put16(out, sch.zoneGapSeconds);
+    put8(out, sch.ruleCount);
+    writeStoreBytes(writer, record, STORE_SCHEDULE_SIZE);
+
+    for (int r = 0; r < sch.ruleCount; r++) {
+      const Recurrence& rule = sch.rules[r];
+      out = put8(record, rule.weekdays);
+      out = put8(out, rule.intervalDays);
+      out = put16(out, rule.anchorDay);
+      out = put16(out, rule.seasonStart);
+      put16(out, rule.seasonEnd);
+      writeStoreBytes(writer, record, STORE_RULE_SIZE);
+    }
+
+    put16(record, sch.eventCount);
+    writeStoreBytes(writer, record, 2);
+    for (int e = 0; e < sch.eventCount; e++) {
+      packEvent(sch.events[e], record);
+      writeStoreBytes(writer, record, STORE_EVENT_SIZE);
+    }
+  }
+
+  writeStoreBytes(writer, (const uint8_t*)state.strings.data, state.strings.used);
+}
+
+// Read and validate one store file into a freshly allocated payload buffer
+static uint8_t* readStoreFile(const char* path, uint32_t& payloadSize) {
+  File file = SPIFFS.open(path, FILE_READ);
+  if (!file) {
+    return NULL;
+  }
+
+  uint8_t bytes[SCHEDULER_STORE_HEADER_SIZE];
+  if (file.read(bytes, sizeof(bytes)) != sizeof(bytes)) {
+    debugPrintf("ERROR: %s: truncated header\n", path);
+    file.close();
+    return NULL;
+  }
+
+  SchedulerStoreHeader header;
+  header.magic = get32(bytes);
+  header.version = get16(bytes + 4);
+  header.headerSize = get16(bytes + 6);
+  header.payloadSize = get32(bytes + 8);
+  header.crc32 = get32(bytes + 12);
+
+  if (header.magic != SCHEDULER_STORE_MAGIC || header.version != SCHEDULER_STORE_VERSION ||
+      header.headerSize != SCHEDULER_STORE_HEADER_SIZE) {
+    debugPrintf("ERROR: %s: unsupported store (magic 0x%08X, version %d)\n", path, header.magic, header.version);
+    file.close();
+    return NULL;
+  }
+
+  if (header.payloadSize < STORE_PREFIX_SIZE || header.payloadSize > SCHEDULER_STORE_MAX_PAYLOAD) {
+    debugPrintf("ERROR: %s: invalid payload size %u\n", path, header.payloadSize);
+    file.close();
+    return NULL;
+  }
+
+  uint8_t* payload = (uint8_t*)malloc(header.payloadSize);
+  if (!payload) {
+    debugPrintln("ERROR: Out of memory reading scheduler store");
+    file.close();
+    return NULL;
+  }
+
+  size_t bytesRead = file.read(payload, header.payloadSize);
+  file.close();
+
+  if (bytesRead != header.payloadSize || calculateCRC32(payload, header.payloadSize) != header.crc32) {
+    debugPrintf("ERROR: %s: truncated or corrupt payload\n", path);
+    free(payload);
+    return NULL;
+  }
+
+  payloadSize = header.payloadSize;
+  return payload;
+}
+
+// Unpack a validated payload into state
+static bool unpackPayload(const uint8_t* payload, uint32_t payloadSize, SchedulerState& state) {
+  StoreReader reader = {payload, payloadSize, 0, true};
+
+  const uint8_t* in = readStoreBytes(reader, STORE_PREFIX_SIZE);
+  if (!in) return false;
+  uint8_t scheduleCount = in[0];
+  uint8_t currentScheduleIndex = in[1];
+  uint16_t arenaUsed = get16(in + 2);
+  if (scheduleCount > MAX_SCHEDULES || arenaUsed > SCHEDULER_ARENA_SIZE ||
+      !reserveSchedules(state, scheduleCount)) {
+    return false;
+  }
+
+  for (int i = 0; i < scheduleCount; i++) {
+    Schedule& sch = state.schedules[i];
+
+    in = readStoreBytes(reader, STORE_SCHEDULE_SIZE);
+    if (!in) return false;
+    sch.name = get16(in);
+    sch.metadata = get16(in + 2);
+    sch.lightsOnMinute = get16(in + 4);
+    sch.lightsOffMinute = get16(in + 6);
+    sch.relayMask = in[8];
+    sch.maxOpenZones = in[9];
+    sch.zoneGapSeconds = get16(in + 10);
+    sch.ruleCount = in[12];
+    if (sch.ruleCount > SCHEDULE_MAX_RULES) return false;
+
+    memset(sch.rules, 0, sizeof(sch.rules));
+    for (int r = 0; r < sch.ruleCount; r++) {
+      in = readStoreBytes(reader, STORE_RULE_SIZE);
+      if (!in) return false;
+      Recurrence& rule = sch.rules[r];
+      rule.weekdays = in[0];
+      rule.intervalDays = in[1];
+      rule.anchorDay = get16(in + 2);
+      rule.seasonStart = get16(in + 4);
+      rule.seasonEnd = get16(in + 6);
+    }
+
+    in = readStoreBytes(reader, 2);
+    if (!in) return false;
+    uint16_t eventCount = get16(in);
+
+    // The slot owns no block yet; take one sized to the stored events
+    sch.eventCount = 0;
+    sch.events = NULL;
+    sch.eventCapacity = 0;
+    if (eventCount > MAX_EVENTS || !reserveScheduleEvents(sch, eventCount)) return false;
+    state.scheduleCount = i + 1;
+
+    in = readStoreBytes(reader, (size_t)eventCount * STORE_EVENT_SIZE);
+    if (!in) return false;
+    for (int e = 0; e < eventCount; e++) {
+      unpackEvent(in + e * STORE_EVENT_SIZE, sch.events[e]);
+      if (sch.events[e].rule > sch.ruleCount) return false;
+    }
+    sch.eventCount = eventCount;
+  }
+
+  in = readStoreBytes(reader, arenaUsed);
+  if (!in || reader.offset != payloadSize) return false;
+  memcpy(state.strings.data, in, arenaUsed);
+
+  state.strings.used = arenaUsed;
+  state.currentScheduleIndex = currentScheduleIndex;
+  return true;
+}
+
+// Apply the journaled run stamps to a freshly loaded state. Records are
+// matched by schedule and event id; ones that match nothing (the state was
+// edited since) are skipped. A record cut short by a reset is skipped too,
+// and the next append is refused so the store gets saved and the journal
+// starts over aligned.
+static void applySchedulerRuns(SchedulerState& state) {
+  storeStats.runRecords = 0;
+  File file = SPIFFS.open(SCHEDULER_RUNS_FILE, FILE_READ);
+  if (!file) {
+    return;
+  }
+
+  uint8_t record[STORE_RUN_SIZE];
+  uint32_t applied = 0;
+  while (file.read(record, sizeof(record)) == sizeof(record)) {
+    storeStats.runRecords++;
+    uint8_t scheduleIdx = record[0];
+    uint32_t lastRun = get32(record + 1 + EVENT_ID_LEN);
+    if (scheduleIdx >= state.scheduleCount) continue;
+
+    Schedule& sch = state.schedules[scheduleIdx];
+    for (int e = 0; e < sch.eventCount; e++) {
+      Event& event = sch.events[e];
+      if (strncmp(event.id, (const char*)record + 1, EVENT_ID_LEN) == 0) {
+        if (lastRun > event.lastRun) event.lastRun = lastRun;
+        applied++;
+        break;
+      }
+    }
+  }
+  bool torn = file.size() % STORE_RUN_SIZE != 0;
+  file.close();
+  debugPrintf("DEBUG: Applied %u of %u journaled run stamps\n", applied, storeStats.runRecords);
+  if (torn) {
+    debugPrintln("WARNING: Scheduler run journal ends in a partial record");
+    storeStats.runRecords = SCHEDULER_RUNS_COMPACT;
+  }
+}
+
+bool loadSchedulerStore(SchedulerState& state) {
+  uint32_t startUs = micros();
+  uint32_t payloadSize = 0;
+
+  uint8_t* payload = readStoreFile(SCHEDULER_STORE_FILE, payloadSize);
+  releaseSchedulerState(state);
+
+  // A save interrupted between remove and rename leaves only the temp file
+  if (!payload && SPIFFS.exists(SCHEDULER_STORE_TEMP_FILE)) {
+    payload = readStoreFile(SCHEDULER_STORE_TEMP_FILE, payloadSize);
+    if (payload) {
+      debugPrintln("DEBUG: Recovering scheduler store from temp file");
+      SPIFFS.remove(SCHEDULER_STORE_FILE);
+      SPIFFS.rename(SCHEDULER_STORE_TEMP_FILE, SCHEDULER_STORE_FILE);
+    }
+  }
+
+  if (!payload) {
+    return false;
+  }
+
+  bool ok = unpackPayload(payload, payloadSize, state);
+  free(payload);
+
+  if (!ok) {
+    debugPrintln("ERROR: Scheduler store payload is inconsistent or does not fit the event pool");
+    releaseSchedulerState(state);
+    return false;
+  }
+
+  applySchedulerRuns(state);
+
+  storeStats.lastLoadUs = micros() - startUs;
+  debugPrintf("DEBUG: Loaded scheduler store: %u bytes in %u us\n",
+             (unsigned)(SCHEDULER_STORE_HEADER_SIZE + payloadSize), storeStats.lastLoadUs);
+  return true;
+}
+
+bool saveSchedulerStore(const SchedulerState& state) {
+  uint32_t startUs = micros();
+
+  // The payload is written straight from the state, so size and CRC are
+  // computed in a first pass instead of packing a copy that can be as
+  // large as the whole event pool
+  StoreWriter measure = {NULL, 0, 0xFFFFFFFF, 0};
+  writePayload(measure, state);
+
+  uint8_t header[SCHEDULER_STORE_HEADER_SIZE];
+  uint8_t* out = put32(header, SCHEDULER_STORE_MAGIC);
+  out = put16(out, SCHEDULER_STORE_VERSION);
+  out = put16(out, SCHEDULER_STORE_HEADER_SIZE);
+  out = put32(out, measure.size);
+  put32(out, ~measure.crc);
+
+  // Write everything to the temp file first
+  File file = SPIFFS.open(SCHEDULER_STORE_TEMP_FILE, FILE_WRITE);
+  if (!file) {
+    debugPrintln("ERROR: Failed to open scheduler temp file for writing");
+    return false;
+  }
+
+  StoreWriter writer = {&file, 0, 0xFFFFFFFF, 0};
+  writer.written = file.write(header, sizeof(header));
+  writePayload(writer, state);
+  file.close();
+
+  if (writer.written != sizeof(header) + measure.size) {
+    debugPrintln("ERROR: Failed to write scheduler temp file");
+    SPIFFS.remove(SCHEDULER_STORE_TEMP_FILE);
+    return false;
+  }
+
+  // SPIFFS cannot rename over an existing file; the load path recovers from
+  // the temp file if we lose power between these two calls
+  SPIFFS.remove(SCHEDULER_STORE_FILE);
+  if (!SPIFFS.rename(SCHEDULER_STORE_TEMP_FILE, SCHEDULER_STORE_FILE)) {
+    debugPrintln("ERROR: Failed to commit scheduler store");
+    return false;
+  }
+
+  // The store now holds every journaled stamp
+  SPIFFS.remove(SCHEDULER_RUNS_FILE);
+  storeStats.runRecords = 0;
+
+  storeStats.lastSaveUs = micros() - startUs;
+  storeStats.lastBytesWritten = writer.written;
+  storeStats.saveCount++;
+  debugPrintf("DEBUG: Saved scheduler store: %u bytes in %u us\n",
+             (unsigned)writer.written, storeStats.lastSaveUs);
+  return true;
+}
+
+bool appendSchedulerRuns(const SchedulerState& state, const SchedulerRunRef* runs, uint16_t count) {
+  if (storeStats.runRecords + count > SCHEDULER_RUNS_COMPACT) {
+    return false;
+  }
+
+  File file = SPIFFS.open(SCHEDULER_RUNS_FILE, FILE_APPEND);
+  if (!file) {
+    debugPrintln("ERROR: Failed to open scheduler run journal");
+    return false;
+  }
+
+  uint8_t record[STORE_RUN_SIZE];
+  size_t written = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    const Event& event = state.schedules[runs[i].scheduleIdx].events[runs[i].eventIdx];
+    record[0] = runs[i].scheduleIdx;
+    memcpy(record + 1, event.id, EVENT_ID_LEN);
+    put32(record + 1 + EVENT_ID_LEN, eventLastRun(event));
+    written += file.write(record, sizeof(record));
+  }
+  file.close();
+
+  storeStats.runAppends++;
+  if (written != (size_t)count * STORE_RUN_SIZE) {
+    // Refuse further appends until a save replaces the journal
+    debugPrintln("ERROR: Failed to append to scheduler run journal");
+    storeStats.runRecords = SCHEDULER_RUNS_COMPACT;
+    return false;
+  }
+  storeStats.runRecords += count;
+  return true;
+}
+
+SchedulerStoreStats getSchedulerStoreStats() {
+  return storeStats;
+}
@@ -0,0 +1,72 @@
+// SchedulerTimeline.cpp
+#include "SchedulerTimeline.h"
+#include "Utils.h"
+
+// Order by second, then schedule, then event so firing order is deterministic
+static int compareTimelineEntries(const void* a, const void* b) {
+  const TimelineEntry* ea = (const TimelineEntry*)a;
+  const TimelineEntry* eb = (const TimelineEntry*)b;
+  if (ea->secondOfDay != eb->secondOfDay) return ea->secondOfDay < eb->secondOfDay ? -1 : 1;
+  if (ea->scheduleIdx != eb->scheduleIdx) return (int)ea->scheduleIdx - (int)eb->scheduleIdx;
+  return (int)ea->eventIdx - (int)eb->eventIdx;
+}
+
+bool buildSchedulerTimeline(const SchedulerState& state, SchedulerTimeline& timeline) {
+  uint32_t needed = 0;
+  for (int scheduleIdx = 0; scheduleIdx < state.scheduleCount; scheduleIdx++) {
+    if (state.schedules[scheduleIdx].relayMask != 0) {
+      needed += state.schedules[scheduleIdx].eventCount;
+    }
+  }
+
+  if (needed > timeline.capacity) {
+    free(timeline.entries);
+    timeline.entries = (TimelineEntry*)malloc(needed * sizeof(TimelineEntry));
+    timeline.capacity = timeline.entries ? needed : 0;
+    if (!timeline.entries) {
+      debugPrintf("ERROR: Out of memory for %u timeline entries\n", needed);
+      timeline.count = 0;
+      return false;
+    }
+  }
+
+  uint16_t count = 0;
+
+  for (int scheduleIdx = 0; scheduleIdx < state.scheduleCount; scheduleIdx++) {
+    const Schedule& schedule = state.schedules[scheduleIdx];
+
+    // Schedules without relays never fire, so they are left out of the timeline
+    if (schedule.relayMask == 0) {
+      continue;
+    }
+
+    for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
+      TimelineEntry& entry = timeline.entries[count++];
+      entry.secondOfDay = schedule.events[eventIdx].secondOfDay;
+      entry.scheduleIdx = scheduleIdx;
+      entry.eventIdx = eventIdx;
+    }
+  }
+
+  qsort(timeline.entries, count, sizeof(TimelineEntry), compareTimelineEntries);
+  timeline.count = count;
+
+  debugPrintf("DEBUG: Scheduler timeline built: %d entries\n", count);
+  return true;
+}
+
+uint16_t findFirstTimelineEntry(const SchedulerTimeline& timeline, uint32_t secondOfDay) {
+  uint16_t low = 0;
+  uint16_t high = timeline.count;
+
+  while (low < high) {
+    uint16_t mid = (low + high) / 2;
+    if (timeline.entries[mid].secondOfDay < secondOfDay) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
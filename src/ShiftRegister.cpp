@@ -0,0 +1,94 @@
+// ShiftRegister.cpp
+// Bit-banged 74HC595/74HC165 transfers. With the register backend one GPIO
+// register write moves a pin, instead of a digitalWrite() call with its pin
+// lookup; a 24-bit frame takes two or three writes per bit. The display
+// refresh interrupt has its own IRAM copy of the 74HC595 transfer that only
+// ever uses the registers: a backend's functions are not in IRAM.
+#include "ShiftRegister.h"
+#include "PinConfig.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+#define PIN_MASK(pin) (1UL << (pin))
+
+static const ShiftRegisterBackend* activeBackend = NULL;
+
+void setShiftRegisterBackend(const ShiftRegisterBackend* backend) {
+  activeBackend = backend;
+}
+
+// Pin access straight to the GPIO registers, inlined into the transfers
+struct RegisterPins {
+  static inline void set(uint32_t mask) { REG_WRITE(GPIO_OUT_W1TS_REG, mask); }
+  static inline void clear(uint32_t mask) { REG_WRITE(GPIO_OUT_W1TC_REG, mask); }
+  static inline uint32_t read() { return REG_READ(GPIO_IN_REG); }
+};
+
+// Pin access through the installed backend
+struct BackendPins {
+  static inline void set(uint32_t mask) { activeBackend->setPins(mask); }
+  static inline void clear(uint32_t mask) { activeBackend->clearPins(mask); }
+  static inline uint32_t read() { return activeBackend->readPins(); }
+};
+
+// Inlined into each caller, so the interrupt's copy lands in IRAM with it
+template <typename Pins>
+static inline __attribute__((always_inline)) void shiftOut595With(const uint8_t* bytes, uint8_t count) {
+  const uint32_t dataMask = PIN_MASK(SH595_DATA);
+  const uint32_t clockMask = PIN_MASK(SH595_CLOCK);
+  const uint32_t latchMask = PIN_MASK(SH595_LATCH);
+
+  Pins::clear(latchMask);
+  for (uint8_t b = 0; b < count; b++) {
+    uint8_t value = bytes[b];
+    for (uint8_t i = 0; i < 8; i++) {
+      // Clock low together with a low data bit; the 595 samples on the rising edge
+      if (value & 0x80) {
+        Pins::clear(clockMask);
+        Pins::set(dataMask);
+      } else {
+        Pins::clear(clockMask | dataMask);
+      }
+      Pins::set(clockMask);
+      value <<= 1;
+    }
+  }
+  Pins::set(latchMask);
+}
+
+template <typename Pins>
+static uint8_t shiftIn165With() {
+  const uint32_t loadMask = PIN_MASK(LOAD_165);
+  const uint32_t clockMask = PIN_MASK(CLK_165);
+  const uint32_t dataMask = PIN_MASK(DATA165);
+
+  Pins::clear(loadMask);
+  Pins::set(loadMask);
+
+  uint8_t value = 0;
+  for (uint8_t i = 0; i < 8; i++) {
+    Pins::clear(clockMask);
+    value = (value << 1) | ((Pins::read() & dataMask) ? 0 : 1);   // Active low
+    Pins::set(clockMask);
+  }
+  return value;
+}
+
+void shiftOut595(const uint8_t* bytes, uint8_t count) {
+  if (activeBackend) {
+    shiftOut595With<BackendPins>(bytes, count);
+  } else {
+    shiftOut595With<RegisterPins>(bytes, count);
+  }
+}
+
+void IRAM_ATTR shiftOut595FromIsr(const uint8_t* bytes, uint8_t count) {
+  shiftOut595With<RegisterPins>(bytes, count);
+}
+
+uint8_t shiftIn165() {
+  if (activeBackend) {
+    return shiftIn165With<BackendPins>();
+  }
+  return shiftIn165With<RegisterPins>();
+}
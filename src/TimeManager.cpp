@@ -5,6 +5,8 @@
 #include <time.h>
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
+#include "esp_sntp.h"
+#include "Scheduler.h"
 
 // NTP configuration parameters
 const char* ntpServer1 = "pool.ntp.org";
@@ -71,16 +73,25 @@ void loadTimezone() {
   timezoneLoaded = true;
 }
 
+// Called by SNTP whenever the system clock is set or stepped
+static void onTimeSynced(struct timeval* tv) {
+  // Pending scheduler sleeps were computed against the old clock
+  wakeSchedulerTask();
+}
+
 // Initializes time settings but doesn't wait for WiFi
 void initTimeManager() {
   debugPrintln("DEBUG: Initializing time manager");
   
+  sntp_set_time_sync_notification_cb(onTimeSynced);
+  
   // Load timezone from SPIFFS
   loadTimezone();
   
   // Set the timezone using the loaded value
   setenv("TZ", currentTimezone, 1);
   tzset();
+  invalidateUtcOffsetCache();
   debugPrintf("DEBUG: Timezone set to: %s\n", currentTimezone);
   
   // We won't try to sync with NTP here
@@ -100,6 +111,7 @@ bool setTimezone(const char* tz) {
   // Apply the timezone
   setenv("TZ", currentTimezone, 1);
   tzset();
+  invalidateUtcOffsetCache();
   
   // Save to SPIFFS
   saveTimezone();
@@ -206,15 +218,11 @@ void handleGetTimeStatus(AsyncWebServerRequest *request) {
   
   // Add time zone info
   time_t now = time(NULL);
-  struct tm localTime, utcTime;
+  struct tm localTime;
   localtime_r(&now, &localTime);
-  gmtime_r(&now, &utcTime);
 
-  // Calculate time zone offset in hours
-  int offsetHours = localTime.tm_hour - utcTime.tm_hour;
-  // Handle day boundary crossings
-  if (offsetHours > 12) offsetHours -= 24;
-  if (offsetHours < -12) offsetHours += 24;
+  // Time zone offset in hours
+  int offsetHours = getUtcOffsetSeconds(now) / 3600;
 
   // Determine DST status
   bool isDST = localTime.tm_isdst > 0;
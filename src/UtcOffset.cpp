@@ -0,0 +1,98 @@
+// UtcOffset.cpp
+// UTC offset of the process timezone, cached until the next DST transition
+// so conversions do not walk localtime_r() every time. Kept apart from the
+// NTP and WiFi code in TimeManager.cpp so the scheduler logic builds on the
+// host as well.
+#include "UtcOffset.h"
+#include "Utils.h"
+
+// UTC offset of the process TZ, valid for [validFrom, validUntil)
+struct TimezoneOffsetCache {
+  int32_t offsetSeconds;
+  time_t validFrom;
+  time_t validUntil;     // Next DST transition (or end of the search window)
+};
+static TimezoneOffsetCache offsetCache = {0, 0, 0};
+static portMUX_TYPE offsetCacheMux = portMUX_INITIALIZER_UNLOCKED;
+
+#define OFFSET_SEARCH_DAYS 400   // How far ahead to look for the next transition
+
+// Seconds since the epoch for a broken-down UTC time, without touching TZ
+time_t makeUtcTime(const struct tm* tm) {
+  // Days from 1970-01-01 to the given civil date (proleptic Gregorian)
+  int year = tm->tm_year + 1900;
+  int month = tm->tm_mon + 1;
+  year -= month <= 2;
+  int era = (year >= 0 ? year : year - 399) / 400;
+  int yearOfEra = year - era * 400;
+  int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + tm->tm_mday - 1;
+  int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  int64_t days = (int64_t)era * 146097 + dayOfEra - 719468;
+
+  return (time_t)(days * 86400 + tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec);
+}
+
+// Offset of local time from UTC at instant t, using the process TZ
+static int32_t computeUtcOffset(time_t t) {
+  struct tm localTime;
+  localtime_r(&t, &localTime);
+  return (int32_t)(makeUtcTime(&localTime) - t);
+}
+
+// Recompute the cached offset and find when it next changes
+static int32_t refreshOffsetCache(time_t now) {
+  int32_t offset = computeUtcOffset(now);
+
+  // Step forward a day at a time until the offset changes...
+  time_t low = now;
+  time_t high = now;
+  bool found = false;
+  for (int day = 1; day <= OFFSET_SEARCH_DAYS; day++) {
+    high = now + (time_t)day * 86400;
+    if (computeUtcOffset(high) != offset) {
+      found = true;
+      break;
+    }
+    low = high;
+  }
+
+  // ...then bisect that day down to the second
+  if (found) {
+    while (high - low > 1) {
+      time_t mid = low + (high - low) / 2;
+      if (computeUtcOffset(mid) == offset) {
+        low = mid;
+      } else {
+        high = mid;
+      }
+    }
+  }
+
+  portENTER_CRITICAL(&offsetCacheMux);
+  offsetCache.offsetSeconds = offset;
+  offsetCache.validFrom = now;
+  offsetCache.validUntil = high;
+  portEXIT_CRITICAL(&offsetCacheMux);
+
+  debugPrintf("DEBUG: UTC offset %d s, valid for the next %ld s\n", offset, (long)(high - now));
+  return offset;
+}
+
+void invalidateUtcOffsetCache() {
+  portENTER_CRITICAL(&offsetCacheMux);
+  offsetCache.validFrom = 0;
+  offsetCache.validUntil = 0;
+  portEXIT_CRITICAL(&offsetCacheMux);
+}
+
+int32_t getUtcOffsetSeconds(time_t now) {
+  portENTER_CRITICAL(&offsetCacheMux);
+  bool valid = now >= offsetCache.validFrom && now < offsetCache.validUntil;
+  int32_t offset = offsetCache.offsetSeconds;
+  portEXIT_CRITICAL(&offsetCacheMux);
+
+  if (!valid) {
+    offset = refreshOffsetCache(now);
+  }
+  return offset;
+}
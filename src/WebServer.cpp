@@ -2,9 +2,13 @@
 #include "WebServer.h"
 #include "Utils.h"
 #include "IOManager.h"
+#include "AnalogPipeline.h"
+#include "AnalogCalibration.h"
+#include "DigitalInputs.h"
 #include "WiFiManager.h"
 #include "ModbusHandler.h"
 #include "Scheduler.h"
+#include "SchedulerSimulator.h"
 #include "TimeManager.h" // Include TimeManager.h
 #include <SPIFFS.h>
 #include <ArduinoJson.h>
@@ -195,6 +199,18 @@ void initIORoutes() {
     NULL,
     handleSetAllRelays
   );
+  
+  // Route for analog pipeline settings and counters
+  server.on("/api/io/analog", HTTP_GET, handleGetAnalogPipeline);
+  
+  // Route for changing analog pipeline settings (?rate=&oversample=&median=&ema=)
+  server.on("/api/io/analog", HTTP_POST, handleSetAnalogPipeline);
+  
+  // Route for analog calibration points and readings
+  server.on("/api/io/calibration", HTTP_GET, handleGetCalibration);
+  
+  // Route for capturing a calibration reference (?input=V1&value=5000) or resetting one (?reset=1)
+  server.on("/api/io/calibration", HTTP_POST, handleSetCalibration);
 }
 
 // Implement MODBUS routes
@@ -246,19 +262,18 @@ void initSchedulerRoutes() {
 
   // API endpoint to save scheduler state
   server.on("/api/scheduler/save", HTTP_POST, 
-    [](AsyncWebServerRequest *request) {},  // Request handler
+    [](AsyncWebServerRequest *request) {
+      // Request handler: runs after the body. Every chunked-in body has
+      // already been answered by the body handler; only an empty one is left.
+      if (request->contentLength() == 0) {
+        request->send(400, "application/json", "{\"status\":\"error\",\"message\":\"Empty request body\"}");
+      }
+    },
     NULL,  // Upload handler
     [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
-      // Body handler 
-      // Increase the valid content length for large payloads
+      // Body handler: every chunk goes to the streaming parser
       if (len > 0) {
-        // Log the data size for debugging
-        debugPrintf("Received data chunk: %d bytes, index: %d, total: %d\n", len, index, total);
-        
-        // Only process when we have the complete data
-        if (index + len == total) {
-          handleSaveSchedulerState(request, data, len, index, total); // Pass all 5 parameters
-        }
+        handleSaveSchedulerState(request, data, len, index, total);
       }
     }
   );
@@ -266,6 +281,24 @@ void initSchedulerRoutes() {
   // API endpoint to get scheduler status
   server.on("/api/scheduler/status", HTTP_GET, handleSchedulerStatus);
   
+  // API endpoint to get the last run of every event
+  server.on("/api/scheduler/history", HTTP_GET, handleSchedulerHistory);
+  
+  // API endpoint to get projected zone runs after pump sequencing
+  server.on("/api/scheduler/sequence", HTTP_GET, handleSchedulerSequence);
+  
+  // API endpoint to get the next firings (?n=1..32)
+  server.on("/api/scheduler/upcoming", HTTP_GET, handleSchedulerUpcoming);
+  
+  // API endpoint to get scheduled relay actuation latency histograms (?reset=1)
+  server.on("/api/scheduler/latency", HTTP_GET, handleSchedulerLatency);
+  
+  // API endpoint to replay the schedules on a virtual clock (?days=N&start=YYYY-MM-DD)
+  server.on("/api/scheduler/simulate", HTTP_POST, handleStartSimulation);
+  
+  // API endpoint to get the report of the last simulation
+  server.on("/api/scheduler/simulation", HTTP_GET, handleGetSimulation);
+  
   // API endpoint to activate scheduler
   server.on("/api/scheduler/activate", HTTP_POST, handleActivateScheduler);
   
@@ -287,17 +320,23 @@ void initSchedulerRoutes() {
 void handleGetIOStatus(AsyncWebServerRequest *request) {
   debugPrintln("DEBUG: API request received: /api/io/status");
   
+  // One coherent sample of all inputs for the whole response
+  IOSnapshot snapshot;
+  getIOSnapshot(snapshot);
+  
   // Debug print analog values before creating response
   debugPrintln("DEBUG: Analog values being sent:");
-  float* voltageValues = getVoltageValues();
-  float* currentValues = getCurrentValues();
-  
   for (int i = 0; i < 4; i++) {
     debugPrintf("DEBUG: V%d=%.2fV, I%d=%.2fmA\n", 
-              i+1, voltageValues[i], i+1, currentValues[i]);
+              i+1, snapshot.voltages[i], i+1, snapshot.currents[i]);
   }
   
-  DynamicJsonDocument doc(2048); // Increased size to ensure enough space
+  DynamicJsonDocument doc(3072); // Increased size to ensure enough space
+  
+  // Identify the sample: sequence number and age in milliseconds
+  doc["sequence"] = snapshot.sequence;
+  doc["timestampMs"] = snapshot.timestampMs;
+  doc["ageMs"] = snapshot.sequence > 0 ? millis() - snapshot.timestampMs : 0;
   
   // Add relay states
   JsonArray relays = doc.createNestedArray("relays");
@@ -309,28 +348,33 @@ void handleGetIOStatus(AsyncWebServerRequest *request) {
   
   // Add button states
   JsonArray buttons = doc.createNestedArray("buttons");
-  bool* buttonStates = getButtonStates();
   for (int i = 0; i < 4; i++) {
     JsonObject button = buttons.createNestedObject();
     button["id"] = i;
-    button["state"] = buttonStates[i];
+    button["state"] = snapshot.buttons[i];
   }
   
-  // Add input states
+  // Add input states with their debounced edge history
+  DigitalInputState digitalInputs = getDigitalInputs();
   JsonArray inputs = doc.createNestedArray("inputs");
-  bool* inputStates = getInputStates();
   for (int i = 0; i < 8; i++) {
     JsonObject input = inputs.createNestedObject();
     input["id"] = i;
-    input["state"] = inputStates[i];
+    input["state"] = snapshot.inputs[i];
+    input["rising"] = digitalInputs.risingCount[i];
+    input["falling"] = digitalInputs.fallingCount[i];
+    input["changedMs"] = digitalInputs.changedMs[i];
   }
+  JsonObject scanner = doc.createNestedObject("inputScanner");
+  scanner["scans"] = digitalInputs.scans;
+  scanner["unsettledScans"] = digitalInputs.unsettledScans;
   
   // Add voltage inputs
   JsonArray voltageInputsArray = doc.createNestedArray("voltageInputs");
   for (int i = 0; i < 4; i++) {
     JsonObject input = voltageInputsArray.createNestedObject();
     input["id"] = i;
-    input["value"] = voltageValues[i];
+    input["value"] = snapshot.voltages[i];
   }
   
   // Add current inputs
@@ -338,9 +382,23 @@ void handleGetIOStatus(AsyncWebServerRequest *request) {
   for (int i = 0; i < 4; i++) {
     JsonObject input = currentInputsArray.createNestedObject();
     input["id"] = i;
-    input["value"] = currentValues[i];
+    input["value"] = snapshot.currents[i];
   }
   
+  // Add 74HC595 writer counters (time with interrupts off vs. clocking frames out)
+  RelayOutputStats outputs = getRelayOutputStats();
+  uint32_t cpuMhz = ESP.getCpuFreqMHz();
+  uint32_t runningMs = millis() - outputs.startMs;
+  JsonObject outputsObj = doc.createNestedObject("relayOutputs");
+  outputsObj["changeShifts"] = outputs.changeShifts;
+  outputsObj["refreshShifts"] = outputs.refreshShifts;
+  outputsObj["criticalSections"] = outputs.criticalSections;
+  outputsObj["criticalUs"] = (uint32_t)(outputs.criticalCycles / cpuMhz);
+  outputsObj["maxCriticalUs"] = outputs.maxCriticalCycles / cpuMhz;
+  outputsObj["criticalUsPerSecond"] = runningMs > 0 ?
+    (uint32_t)(outputs.criticalCycles * 1000 / cpuMhz / runningMs) : 0;
+  outputsObj["shiftUs"] = (uint32_t)(outputs.shiftCycles / cpuMhz);
+  
   // Debug print the final JSON size
   debugPrintf("DEBUG: JSON document size: %d bytes\n", doc.memoryUsage());
   
@@ -3,7 +3,7 @@
  */
 
 // Maximum number of schedules and events
-export const MAX_SCHEDULES = 8;
+export const MAX_SCHEDULES = 32;
 export const MAX_EVENTS = 50;
 
 // WebSocket heartbeat interval (in milliseconds)
@@ -3,6 +3,7 @@
 #include "WiFiManager.h"
 #include "IOManager.h"
 #include "Scheduler.h"
+#include "SchedulerSimulator.h"
 #include "ModbusHandler.h"
 #include "Utils.h"
 #include <SPIFFS.h>
@@ -115,6 +116,7 @@ void processDebugCommand() {
       Serial.println("  start - Start the scheduler");
       Serial.println("  stop - Stop the scheduler");
       Serial.println("  trigger <schedule> <eventId> - Trigger specific event");
+      Serial.println("  simulate <days> [YYYY-MM-DD] [log] - Replay the schedules on a virtual clock");
       Serial.println("  help - Show this help");
     }
     else if (command == "time") {
@@ -148,6 +150,9 @@ void processDebugCommand() {
         Serial.println("Invalid trigger command. Format: trigger <schedule> <eventId>");
       }
     }
+    else if (command.startsWith("simulate ")) {
+      handleSimulateCommand(command.substring(9));
+    }
     else {
       Serial.println("Unknown command. Type 'help' for available commands.");
     }
@@ -0,0 +1,78 @@
+// ScheduleFixtures.h
+// Helpers the native tests share to build scheduler states in code
+#ifndef SCHEDULE_FIXTURES_H
+#define SCHEDULE_FIXTURES_H
+
+#include <Arduino.h>
+#include <unity.h>
+#include "Scheduler.h"
+#include "EventPool.h"
+#include "Recurrence.h"
+#include "UtcOffset.h"
+#include "NativeHost.h"
+
+#define TORONTO_TZ "EST5EDT,M3.2.0/2,M11.1.0/2"
+
+// Select a POSIX TZ string for the process and the offset cache
+static inline void useTimezone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+  invalidateUtcOffsetCache();
+}
+
+// UTC instant of a UTC calendar time
+static inline time_t utcInstant(int year, int month, int day, int hour = 0, int minute = 0, int second = 0) {
+  struct tm tm = {};
+  tm.tm_year = year - 1900;
+  tm.tm_mon = month - 1;
+  tm.tm_mday = day;
+  tm.tm_hour = hour;
+  tm.tm_min = minute;
+  tm.tm_sec = second;
+  return makeUtcTime(&tm);
+}
+
+// UTC instant of local midnight starting a local calendar day
+static inline time_t localMidnight(int year, int month, int day) {
+  time_t midnight = utcInstant(year, month, day);
+  return midnight - getUtcOffsetSeconds(midnight);
+}
+
+static inline Schedule& addTestSchedule(SchedulerState& state, const char* name, uint8_t relayMask) {
+  TEST_ASSERT_TRUE(reserveSchedules(state, state.scheduleCount + 1));
+  Schedule& sch = state.schedules[state.scheduleCount++];
+  memset(&sch, 0, sizeof(sch));
+  sch.name = internString(state.strings, name);
+  sch.metadata = ARENA_NONE;
+  sch.relayMask = relayMask;
+  return sch;
+}
+
+static inline Event& addTestEvent(Schedule& sch, const char* id, uint32_t secondOfDay, uint16_t duration,
+                                  uint8_t rule = 0) {
+  TEST_ASSERT_TRUE(reserveScheduleEvents(sch, sch.eventCount + 1));
+  Event& event = sch.events[sch.eventCount++];
+  memset(&event, 0, sizeof(event));
+  strncpy(event.id, id, EVENT_ID_LEN - 1);
+  event.secondOfDay = secondOfDay;
+  event.duration = duration;
+  event.rule = rule;
+  return event;
+}
+
+// Event.rule of a weekday rule (bit 0 = Sunday)
+static inline uint8_t addWeekdayRule(Schedule& sch, uint8_t weekdays) {
+  Recurrence rule = {};
+  rule.weekdays = weekdays;
+  uint8_t ruleIdx = internRecurrence(sch, rule);
+  TEST_ASSERT_TRUE(ruleIdx != RECURRENCE_TABLE_FULL);
+  return ruleIdx;
+}
+
+// Empty state with no table and no blocks
+static inline void clearTestState(SchedulerState& state) {
+  freeSchedulerState(state);
+  memset(&state, 0, sizeof(state));
+}
+
+#endif // SCHEDULE_FIXTURES_H
@@ -0,0 +1,250 @@
+// The analog filter kernels and the sampling task, run against a mock
+// backend that stands in for the ADC. The kernels are checked step by step
+// and timed per raw sample; the task is checked for what it publishes, its
+// restarts on a settings change and its overrun count.
+#include <Arduino.h>
+#include <unity.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "AnalogPipeline.h"
+
+// Mock backend: every input reads a constant level with a little noise and
+// now and then a full-scale spike, about 1 ms per read like a DMA frame
+static const uint16_t mockLevels[ANALOG_INPUT_COUNT] = {1000, 2000, 500, 1500, 2500, 3500};
+static std::atomic<uint32_t> mockStarts, mockStops, mockOverrunEvery;
+static std::atomic<uint32_t> mockRate;
+static uint32_t mockReads = 0;
+static uint32_t mockNoise = 1;
+
+static bool mockStart(uint32_t sampleRateHz) {
+  mockRate = sampleRateHz;
+  mockStarts++;
+  return true;
+}
+
+static uint16_t mockRead(AnalogSample* samples, uint16_t maxSamples, bool* overrun) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  uint16_t count = maxSamples - maxSamples % ANALOG_INPUT_COUNT;
+  for (uint16_t i = 0; i < count; i++) {
+    uint8_t input = i % ANALOG_INPUT_COUNT;
+    mockNoise = mockNoise * 1103515245 + 12345;
+    int noise = (int)(mockNoise >> 16) % 5 - 2;
+    samples[i].input = input;
+    samples[i].raw = (mockNoise >> 8) % 97 == 0 ? 4095 : mockLevels[input] + noise;
+  }
+  mockReads++;
+  uint32_t every = mockOverrunEvery;
+  *overrun = every && mockReads % every == 0;
+  return count;
+}
+
+static void mockStop() {
+  mockStops++;
+}
+
+static const AnalogBackend mockBackend = {"mock", mockStart, mockRead, mockStop};
+
+static AnalogPipelineConfig makeConfig(uint32_t rate, uint16_t oversample, uint8_t median, uint8_t ema) {
+  AnalogPipelineConfig config = {rate, oversample, median, ema};
+  return config;
+}
+
+// Wait until every input has produced more than count values
+static bool waitForOutputs(uint32_t count) {
+  for (int i = 0; i < 2000; i++) {
+    AnalogPipelineStats stats = getAnalogPipelineStats();
+    bool done = stats.backend != NULL;
+    for (int input = 0; input < ANALOG_INPUT_COUNT; input++) {
+      if (stats.outputs[input] <= count) done = false;
+    }
+    if (done) return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  return false;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+static void test_oversample_averages_in_fixed_point() {
+  AnalogFilter filter;
+  analogFilterReset(filter);
+  AnalogPipelineConfig config = makeConfig(ANALOG_DMA_MIN_RATE_HZ, 4, 1, 0);
+  uint32_t value = 0;
+
+  TEST_ASSERT_FALSE(analogFilterPush(filter, config, 1, value));
+  TEST_ASSERT_FALSE(analogFilterPush(filter, config, 2, value));
+  TEST_ASSERT_FALSE(analogFilterPush(filter, config, 3, value));
+  TEST_ASSERT_TRUE(analogFilterPush(filter, config, 4, value));
+  TEST_ASSERT_EQUAL(40, value);   // 2.5 counts << 4
+}
+
+static void test_median_rejects_spikes() {
+  AnalogFilter filter;
+  analogFilterReset(filter);
+  AnalogPipelineConfig config = makeConfig(ANALOG_DMA_MIN_RATE_HZ, 1, 5, 0);
+  uint32_t value = 0;
+
+  const uint16_t raw[] = {100, 100, 4095, 100, 0, 100, 4095, 4095, 100, 100};
+  for (uint16_t r : raw) {
+    TEST_ASSERT_TRUE(analogFilterPush(filter, config, r, value));
+  }
+  TEST_ASSERT_EQUAL(100 << ANALOG_FRACTION_BITS, value);
+
+  // Without the median the last spike gets through
+  analogFilterReset(filter);
+  config.medianWindow = 1;
+  analogFilterPush(filter, config, 4095, value);
+  TEST_ASSERT_EQUAL(4095 << ANALOG_FRACTION_BITS, value);
+}
+
+static void test_ema_step_response() {
+  AnalogFilter filter;
+  analogFilterReset(filter);
+  AnalogPipelineConfig config = makeConfig(ANALOG_DMA_MIN_RATE_HZ, 1, 1, 3);
+  uint32_t value = 0;
+
+  analogFilterPush(filter, config, 0, value);
+  TEST_ASSERT_EQUAL(0, value);
+
+  // Weight 1/8: rises monotonically and is within 1% after 40 steps
+  const uint32_t target = 2000 << ANALOG_FRACTION_BITS;
+  uint32_t last = 0;
+  for (int step = 1; step <= 40; step++) {
+    analogFilterPush(filter, config, 2000, value);
+    TEST_ASSERT_TRUE(value >= last);
+    TEST_ASSERT_TRUE(value <= target);
+    last = value;
+    if (step == 1) TEST_ASSERT_EQUAL(target / 8, value);
+  }
+  TEST_ASSERT_TRUE(value >= target * 99 / 100);
+
+  // Settles on the level exactly, and a step down mirrors the step up
+  for (int step = 0; step < 100; step++) analogFilterPush(filter, config, 2000, value);
+  TEST_ASSERT_EQUAL(target, value);
+
+  const uint32_t low = 1000 << ANALOG_FRACTION_BITS;
+  uint32_t down[40], up[40];
+  for (int step = 0; step < 40; step++) {
+    analogFilterPush(filter, config, 1000, value);
+    down[step] = value;
+  }
+  for (int step = 0; step < 100; step++) analogFilterPush(filter, config, 1000, value);
+  TEST_ASSERT_EQUAL(low, value);
+  for (int step = 0; step < 40; step++) {
+    analogFilterPush(filter, config, 2000, value);
+    up[step] = value;
+  }
+  for (int step = 0; step < 40; step++) {
+    TEST_ASSERT_UINT32_WITHIN(1, target - down[step], up[step] - low);
+  }
+  for (int step = 0; step < 100; step++) analogFilterPush(filter, config, 2000, value);
+  TEST_ASSERT_EQUAL(target, value);
+}
+
+static void test_kernel_cost_per_sample() {
+  AnalogFilter filters[ANALOG_INPUT_COUNT];
+  for (int i = 0; i < ANALOG_INPUT_COUNT; i++) analogFilterReset(filters[i]);
+  AnalogPipelineConfig config = makeConfig(ANALOG_DMA_MIN_RATE_HZ, 4, ANALOG_MAX_MEDIAN, 2);
+
+  const uint32_t samples = 6000000;
+  uint32_t value = 0, outputs = 0, checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < samples; i++) {
+    uint16_t raw = (i * 2654435761u >> 20) & 0x0FFF;
+    if (analogFilterPush(filters[i % ANALOG_INPUT_COUNT], config, raw, value)) {
+      outputs++;
+      checksum += value;
+    }
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  printf("analog: %.1f ns per raw sample (oversample %u, median %u), %u outputs, checksum %u\n",
+         ns / samples, config.oversample, config.medianWindow, outputs, checksum);
+
+  TEST_ASSERT_EQUAL(samples / config.oversample, outputs);
+  // Loose bound: the highest rate must leave the host far from busy
+  TEST_ASSERT_TRUE(ns / samples < 1e9 / ANALOG_MAX_RATE_HZ / 10);
+}
+
+static void test_pipeline_publishes_filtered_mock_levels() {
+  setAnalogBackend(&mockBackend);
+  TEST_ASSERT_TRUE(setAnalogPipelineConfig(makeConfig(ANALOG_DMA_MIN_RATE_HZ, 4, 5, 2)));
+  startAnalogSampling(NULL, NULL);
+  TEST_ASSERT_TRUE(waitForOutputs(50));
+
+  AnalogPipelineStats stats = getAnalogPipelineStats();
+  TEST_ASSERT_EQUAL_STRING("mock", stats.backend);
+  TEST_ASSERT_EQUAL(ANALOG_DMA_MIN_RATE_HZ, stats.sampleRateHz);
+  TEST_ASSERT_TRUE(stats.samples > 0);
+  TEST_ASSERT_EQUAL(0, stats.overruns);
+
+  // Noise is +-2 counts and the spikes are caught by the median
+  uint32_t values[ANALOG_INPUT_COUNT];
+  getAnalogFiltered(values);
+  for (int input = 0; input < ANALOG_INPUT_COUNT; input++) {
+    TEST_ASSERT_UINT32_WITHIN(2 << ANALOG_FRACTION_BITS, (uint32_t)mockLevels[input] << ANALOG_FRACTION_BITS,
+                              values[input]);
+  }
+}
+
+static void test_config_change_restarts_the_backend() {
+  AnalogPipelineStats before = getAnalogPipelineStats();
+  uint32_t starts = mockStarts, stops = mockStops;
+
+  TEST_ASSERT_TRUE(setAnalogPipelineConfig(makeConfig(40000, 8, 3, 1)));
+  for (int i = 0; i < 500 && mockStarts == starts; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  TEST_ASSERT_EQUAL(starts + 1, mockStarts);
+  TEST_ASSERT_EQUAL(stops + 1, mockStops);
+  TEST_ASSERT_EQUAL(40000, mockRate);
+
+  TEST_ASSERT_TRUE(waitForOutputs(0));
+  AnalogPipelineStats after = getAnalogPipelineStats();
+  TEST_ASSERT_EQUAL(before.restarts + 1, after.restarts);
+  TEST_ASSERT_EQUAL(40000, after.sampleRateHz);
+  TEST_ASSERT_EQUAL(8, getAnalogPipelineConfig().oversample);
+}
+
+static void test_overruns_are_counted() {
+  uint32_t overruns = getAnalogPipelineStats().overruns;
+  mockOverrunEvery = 3;
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  mockOverrunEvery = 0;
+  TEST_ASSERT_TRUE(getAnalogPipelineStats().overruns > overruns);
+}
+
+static void test_invalid_config_is_rejected() {
+  AnalogPipelineConfig current = getAnalogPipelineConfig();
+  uint32_t starts = mockStarts;
+
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_MIN_RATE_HZ - 1, 4, 5, 2)));
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_MAX_RATE_HZ + 1, 4, 5, 2)));
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_DMA_MIN_RATE_HZ, 0, 5, 2)));
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_DMA_MIN_RATE_HZ, ANALOG_MAX_OVERSAMPLE + 1, 5, 2)));
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_DMA_MIN_RATE_HZ, 4, ANALOG_MAX_MEDIAN + 1, 2)));
+  TEST_ASSERT_FALSE(setAnalogPipelineConfig(makeConfig(ANALOG_DMA_MIN_RATE_HZ, 4, 5, 9)));
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  AnalogPipelineConfig after = getAnalogPipelineConfig();
+  TEST_ASSERT_EQUAL(current.sampleRateHz, after.sampleRateHz);
+  TEST_ASSERT_EQUAL(current.oversample, after.oversample);
+  TEST_ASSERT_EQUAL(starts, mockStarts);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_oversample_averages_in_fixed_point);
+  RUN_TEST(test_median_rejects_spikes);
+  RUN_TEST(test_ema_step_response);
+  RUN_TEST(test_kernel_cost_per_sample);
+  RUN_TEST(test_pipeline_publishes_filtered_mock_levels);
+  RUN_TEST(test_config_change_restarts_the_backend);
+  RUN_TEST(test_overruns_are_counted);
+  RUN_TEST(test_invalid_config_is_rejected);
+  return UNITY_END();
+}
@@ -0,0 +1,303 @@
+// Editors publishing while the executor adopts, stamps and recompiles, each
+// on its own thread. Readers check that every generation they see is whole
+// (one edit throughout) and that run stamps never go backwards, which they
+// did when stamps were carried into a generation already visible to them,
+// nor show the day of one stamp with the time of day of another.
+// The executor's call times are recorded at two edit rates, and with an
+// editor stuck inside a publish.
+#include <Arduino.h>
+#include <unity.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "../ScheduleFixtures.h"
+#include "SchedulerSnapshot.h"
+
+#define TEST_SCHEDULES 8
+#define TEST_EVENTS 60
+#define STRESS_MS 1500
+
+// The executor's generation; it keeps holding one between tests, as the task would
+static SchedulerSnapshot* held = NULL;
+static uint16_t executorDay = 1;
+static uint32_t nextEventId = 0;
+
+static std::atomic<bool> running;
+static std::atomic<uint32_t> tornReads, tornStamps, stampRegressions, readsDone;
+static std::atomic<uint32_t> recompiled, recompileRefused;
+
+static uint64_t nowUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Stamp of the executor's step day: every step changes both the day and the
+// time of day, so a day paired with another stamp's time shows up
+static uint32_t stampOfDay(uint32_t day) {
+  return day * SECONDS_PER_DAY + day * 7919 % SECONDS_PER_DAY;
+}
+
+static void addFreshEvent(Schedule& sch) {
+  char id[EVENT_ID_LEN];
+  snprintf(id, sizeof(id), "ev%u", (unsigned)nextEventId);
+  addTestEvent(sch, id, (nextEventId * 37) % SECONDS_PER_DAY, 1);
+  nextEventId++;
+}
+
+// One edit: every event gets the same duration tag. Some edits also drop
+// an event and add a new one (event indices shift) or rotate the schedules
+// (schedule indices shift), so the stamp carry-over cannot match by position.
+static void editSchedulerState(uint32_t edit) {
+  if (edit % 4 == 0) {
+    Schedule& sch = schedulerState.schedules[edit / 4 % TEST_SCHEDULES];
+    memmove(&sch.events[0], &sch.events[1], (sch.eventCount - 1) * sizeof(Event));
+    sch.eventCount--;
+    addFreshEvent(sch);
+  }
+  if (edit % 16 == 0) {
+    Schedule first = schedulerState.schedules[0];
+    memmove(&schedulerState.schedules[0], &schedulerState.schedules[1], (TEST_SCHEDULES - 1) * sizeof(Schedule));
+    schedulerState.schedules[TEST_SCHEDULES - 1] = first;
+  }
+  uint16_t tag = edit % 60000 + 1;
+  for (int s = 0; s < schedulerState.scheduleCount; s++) {
+    Schedule& sch = schedulerState.schedules[s];
+    for (int e = 0; e < sch.eventCount; e++) {
+      sch.events[e].duration = tag;
+    }
+  }
+}
+
+// The scheduler task's use of the snapshot: adopt, stamp every event, and
+// now and then compile the day again. Returns the time spent in the calls.
+static uint64_t executorStep(uint32_t step) {
+  uint64_t start = nowUs();
+  adoptSchedulerSnapshot(held);
+  if (step % 20 == 0) {
+    if (recompileSchedulerSnapshot(held, getSchedulerTime())) recompiled++;
+    else recompileRefused++;
+  }
+  uint64_t spent = nowUs() - start;
+
+  // Stamps only ever grow; readers check that they never see one go back
+  executorDay++;
+  for (int s = 0; s < held->state.scheduleCount; s++) {
+    Schedule& sch = held->state.schedules[s];
+    for (int e = 0; e < sch.eventCount; e++) {
+      markEventRun(sch.events[e], stampOfDay(executorDay));
+    }
+  }
+  return spent;
+}
+
+static void readerLoop() {
+  std::unordered_map<std::string, uint32_t> seen;
+  uint32_t lastGeneration = 0;
+  while (running) {
+    SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+    if (snapshot->generation < lastGeneration) tornReads++;
+    lastGeneration = snapshot->generation;
+
+    const SchedulerState& state = snapshot->state;
+    uint16_t tag = state.schedules[0].events[0].duration;
+    for (int s = 0; s < state.scheduleCount; s++) {
+      const Schedule& sch = state.schedules[s];
+      if (sch.eventCount != TEST_EVENTS) tornReads++;
+      for (int e = 0; e < sch.eventCount; e++) {
+        const Event& evt = sch.events[e];
+        if (evt.duration != tag) tornReads++;
+        uint32_t stamp = eventLastRun(evt);
+        if (stamp != 0 && stamp != stampOfDay(stamp / SECONDS_PER_DAY)) tornStamps++;
+        uint32_t& last = seen[evt.id];
+        if (stamp < last) stampRegressions++;
+        else last = stamp;
+      }
+    }
+    releaseSchedulerSnapshot(snapshot);
+    readsDone++;
+    std::this_thread::yield();
+  }
+}
+
+struct StressResult {
+  uint32_t publishes;
+  uint32_t failedPublishes;
+  uint32_t executorSteps;
+  uint64_t p50Us, p99Us, maxUs;
+};
+
+static StressResult runStress(uint32_t editPauseUs) {
+  StressResult result = {};
+  tornReads = 0;
+  tornStamps = 0;
+  stampRegressions = 0;
+  readsDone = 0;
+  running = true;
+
+  std::vector<uint64_t> stepUs;
+  std::thread executor([&]() {
+    for (uint32_t step = 0; running; step++) {
+      stepUs.push_back(executorStep(step));
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+  std::thread readerA(readerLoop);
+  std::thread readerB(readerLoop);
+
+  uint64_t end = nowUs() + STRESS_MS * 1000ULL;
+  for (uint32_t edit = 1; nowUs() < end; edit++) {
+    editSchedulerState(edit);
+    if (publishSchedulerState(false)) result.publishes++;
+    else result.failedPublishes++;
+    if (editPauseUs) std::this_thread::sleep_for(std::chrono::microseconds(editPauseUs));
+  }
+
+  running = false;
+  executor.join();
+  readerA.join();
+  readerB.join();
+
+  std::sort(stepUs.begin(), stepUs.end());
+  result.executorSteps = stepUs.size();
+  result.p50Us = stepUs[stepUs.size() / 2];
+  result.p99Us = stepUs[stepUs.size() * 99 / 100];
+  result.maxUs = stepUs.back();
+  return result;
+}
+
+static void printStress(const char* label, const StressResult& r) {
+  printf("publish: %s: %u publishes (%u failed), %u executor steps, call time p50 %u us, p99 %u us, max %u us,"
+         " %u reads, recompiles %u done / %u deferred\n",
+         label, r.publishes, r.failedPublishes, r.executorSteps, (unsigned)r.p50Us, (unsigned)r.p99Us,
+         (unsigned)r.maxUs, (unsigned)readsDone, (unsigned)recompiled, (unsigned)recompileRefused);
+}
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+}
+
+void tearDown() {
+}
+
+static void test_first_publish_is_current_at_once() {
+  clearTestState(schedulerState);
+  for (int s = 0; s < TEST_SCHEDULES; s++) {
+    Schedule& sch = addTestSchedule(schedulerState, "zone", 1 << s);
+    for (int e = 0; e < TEST_EVENTS; e++) {
+      addFreshEvent(sch);
+    }
+  }
+  editSchedulerState(1);
+
+  // No executor yet: the copy becomes current without waiting for one
+  TEST_ASSERT_TRUE(publishSchedulerState(false));
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  TEST_ASSERT_NOT_NULL(snapshot);
+  TEST_ASSERT_EQUAL(TEST_SCHEDULES, snapshot->state.scheduleCount);
+  releaseSchedulerSnapshot(snapshot);
+
+  TEST_ASSERT_TRUE(adoptSchedulerSnapshot(held));
+  TEST_ASSERT_TRUE(held == acquireSchedulerSnapshot());
+  releaseSchedulerSnapshot(held);
+}
+
+static void test_pending_copy_becomes_current_with_stamps() {
+  executorStep(1);
+  uint32_t generation = held->generation;
+
+  // Once the executor runs, an editor's copy waits for it
+  editSchedulerState(2);
+  TEST_ASSERT_TRUE(publishSchedulerState(false));
+  SchedulerSnapshot* snapshot = acquireSchedulerSnapshot();
+  TEST_ASSERT_TRUE(snapshot == held);
+  TEST_ASSERT_EQUAL(generation, snapshot->generation);
+  releaseSchedulerSnapshot(snapshot);
+
+  // Adopting it carries the stamps (the editor's copy has none) before it is visible
+  TEST_ASSERT_TRUE(adoptSchedulerSnapshot(held));
+  TEST_ASSERT_EQUAL(generation + 1, held->generation);
+  for (int s = 0; s < held->state.scheduleCount; s++) {
+    const Schedule& sch = held->state.schedules[s];
+    for (int e = 0; e < sch.eventCount; e++) {
+      // Except the event this edit added
+      if (eventLastRun(sch.events[e]) != stampOfDay(executorDay)) {
+        TEST_ASSERT_EQUAL(0, eventLastRun(sch.events[e]));
+        TEST_ASSERT_EQUAL(TEST_EVENTS - 1, e);
+      }
+    }
+  }
+  TEST_ASSERT_FALSE(adoptSchedulerSnapshot(held));
+}
+
+static void test_concurrent_edits_are_never_torn() {
+  StressResult slow = runStress(20000);
+  printStress("20 ms between edits", slow);
+  TEST_ASSERT_EQUAL(0, tornReads);
+  TEST_ASSERT_EQUAL(0, tornStamps);
+  TEST_ASSERT_EQUAL(0, stampRegressions);
+  TEST_ASSERT_EQUAL(0, slow.failedPublishes);
+
+  StressResult fast = runStress(0);
+  printStress("edits back to back", fast);
+  TEST_ASSERT_EQUAL(0, tornReads);
+  TEST_ASSERT_EQUAL(0, tornStamps);
+  TEST_ASSERT_EQUAL(0, stampRegressions);
+  TEST_ASSERT_EQUAL(0, fast.failedPublishes);
+  TEST_ASSERT_TRUE(fast.publishes > 10 * slow.publishes);
+  TEST_ASSERT_TRUE(readsDone > 0);
+
+  // The executor never waits for an editor: its calls stay far below the
+  // time an editor may take, however often editors publish
+  TEST_ASSERT_TRUE(fast.maxUs < SCHEDULER_PUBLISH_TIMEOUT_MS * 1000 / 10);
+  TEST_ASSERT_TRUE(slow.maxUs < SCHEDULER_PUBLISH_TIMEOUT_MS * 1000 / 10);
+}
+
+static void test_executor_does_not_wait_for_stuck_editor() {
+  // A reader keeps the current generation while the executor moves on, so
+  // the next editor finds the spare buffer busy and waits inside its publish
+  executorStep(1);
+  SchedulerSnapshot* reader = acquireSchedulerSnapshot();
+  editSchedulerState(3);
+  TEST_ASSERT_TRUE(publishSchedulerState(false));
+  TEST_ASSERT_TRUE(adoptSchedulerSnapshot(held));
+  TEST_ASSERT_TRUE(reader != held);
+
+  std::atomic<bool> published(false);
+  std::thread editor([&]() {
+    editSchedulerState(5);
+    published = publishSchedulerState(false);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // Midnight now: the executor gets an answer at once instead of the lock
+  uint64_t start = nowUs();
+  bool recompiledNow = recompileSchedulerSnapshot(held, getSchedulerTime() + SECONDS_PER_DAY);
+  bool adopted = adoptSchedulerSnapshot(held);
+  uint64_t spent = nowUs() - start;
+  printf("publish: executor calls took %u us while an editor waited for the spare buffer\n", (unsigned)spent);
+  TEST_ASSERT_FALSE(recompiledNow);
+  TEST_ASSERT_FALSE(adopted);
+  TEST_ASSERT_TRUE(spent < 10000);
+
+  // Once the reader lets go the editor completes and the executor takes it
+  releaseSchedulerSnapshot(reader);
+  editor.join();
+  TEST_ASSERT_TRUE(published);
+  TEST_ASSERT_TRUE(adoptSchedulerSnapshot(held));
+  TEST_ASSERT_TRUE(recompileSchedulerSnapshot(held, getSchedulerTime() + SECONDS_PER_DAY));
+  TEST_ASSERT_EQUAL(getSchedulerTime() / SECONDS_PER_DAY + 1, held->planDay);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_publish_is_current_at_once);
+  RUN_TEST(test_pending_copy_becomes_current_with_stamps);
+  RUN_TEST(test_concurrent_edits_are_never_torn);
+  RUN_TEST(test_executor_does_not_wait_for_stuck_editor);
+  return UNITY_END();
+}
@@ -0,0 +1,125 @@
+// Recurrence rules: calendar dates, day boundaries across a DST change,
+// and the one field schema every JSON reader applies.
+#include <Arduino.h>
+#include <unity.h>
+#include "../ScheduleFixtures.h"
+#include "ScheduleParser.h"
+
+static SchedulerState state;
+static RecurrenceDays days;
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(state);
+}
+
+void tearDown() {
+  clearTestState(state);
+}
+
+static void test_february_29_only_in_leap_years() {
+  uint16_t day = 0;
+  TEST_ASSERT_FALSE(parseRecurrenceDate("2026-02-29", day));
+  TEST_ASSERT_TRUE(parseRecurrenceDate("2028-02-29", day));
+  TEST_ASSERT_EQUAL(utcInstant(2028, 2, 29) / SECONDS_PER_DAY, day);
+  TEST_ASSERT_TRUE(parseRecurrenceDate("2000-02-29", day));
+  TEST_ASSERT_FALSE(parseRecurrenceDate("2026-04-31", day));
+}
+
+static void test_days_after_dst_change_start_at_their_own_midnight() {
+  useTimezone(TORONTO_TZ);
+
+  // Mondays only, at 04:30 UTC: 23:30 Sunday in EST, 00:30 Monday in EDT
+  Schedule& sch = addTestSchedule(state, "beds", 0x01);
+  Event& event = addTestEvent(sch, "night", 4 * 3600 + 30 * 60, 60, addWeekdayRule(sch, 0x02));
+
+  // Compiled a week before the change to EDT on March 8
+  compileRecurrenceDays(state, utcInstant(2026, 3, 2, 12), days);
+
+  TEST_ASSERT_FALSE(eventFiresAt(days, 0, event, utcInstant(2026, 3, 2, 4, 30)));
+  TEST_ASSERT_TRUE(eventFiresAt(days, 0, event, utcInstant(2026, 3, 2, 5, 30)));
+  TEST_ASSERT_TRUE(eventFiresAt(days, 0, event, utcInstant(2026, 3, 9, 4, 30)));
+  TEST_ASSERT_FALSE(eventFiresAt(days, 0, event, utcInstant(2026, 3, 9, 3, 30)));
+  TEST_ASSERT_FALSE(eventFiresAt(days, 0, event, utcInstant(2026, 3, 10, 4, 30)));
+
+  TEST_ASSERT_EQUAL(localMidnight(2026, 3, 9), days.dayStarts[8]);
+  TEST_ASSERT_EQUAL(utcInstant(2026, 4, 2, 4), recurrenceDaysEnd(days));
+}
+
+struct SchemaCase {
+  const char* fields;
+  bool accepted;
+};
+
+// Parse one event with the given recurrence fields; returns whether it was kept
+static bool parseEventWith(const char* fields, Recurrence& rule) {
+  char json[256];
+  snprintf(json, sizeof(json),
+           "{\"schedules\":[{\"name\":\"s\",\"relayMask\":1,\"events\":["
+           "{\"id\":\"e\",\"time\":\"06:00\",\"duration\":60%s%s}]}]}",
+           fields[0] ? "," : "", fields);
+
+  clearTestState(state);
+  ScheduleParser parser;
+  beginScheduleParser(parser, &state);
+  TEST_ASSERT_TRUE(feedScheduleParser(parser, (const uint8_t*)json, strlen(json)));
+  TEST_ASSERT_TRUE(finishScheduleParser(parser));
+  TEST_ASSERT_EQUAL(1, state.scheduleCount);
+
+  const Schedule& sch = state.schedules[0];
+  if (sch.eventCount == 0) return false;
+  beginRecurrence(rule);
+  if (sch.events[0].rule) rule = sch.rules[sch.events[0].rule - 1];
+  return true;
+}
+
+static void test_parser_applies_the_recurrence_schema() {
+  static const SchemaCase cases[] = {
+    {"", true},
+    {"\"weekdays\":62", true},
+    {"\"weekdays\":0", false},
+    {"\"weekdays\":128", false},
+    {"\"weekdays\":\"62\"", false},
+    {"\"weekdays\":1.5", false},
+    {"\"weekdays\":[1,2]", false},
+    {"\"everyDays\":3,\"anchor\":\"2026-01-01\"", true},
+    {"\"everyDays\":256", false},
+    {"\"everyDays\":-1", false},
+    {"\"everyDays\":3,\"anchor\":\"2026-02-29\"", false},
+    {"\"everyDays\":3,\"anchor\":20260101", false},
+    {"\"seasonStart\":\"04-01\",\"seasonEnd\":\"10-31\"", true},
+    {"\"seasonStart\":\"04-01\"", false},
+    {"\"seasonEnd\":\"10-31\"", false},
+    {"\"seasonStart\":\"02-30\",\"seasonEnd\":\"10-31\"", false},
+    {"\"seasonStart\":{},\"seasonEnd\":\"10-31\"", false},
+  };
+
+  for (const SchemaCase& c : cases) {
+    Recurrence rule;
+    TEST_ASSERT_EQUAL_MESSAGE(c.accepted, parseEventWith(c.fields, rule), c.fields);
+  }
+}
+
+static void test_parser_normalizes_the_rule() {
+  Recurrence rule;
+
+  // An anchor without an interval does not make a distinct rule
+  TEST_ASSERT_TRUE(parseEventWith("\"everyDays\":1,\"anchor\":\"2026-01-01\"", rule));
+  TEST_ASSERT_TRUE(recurrenceIsEveryDay(rule));
+  TEST_ASSERT_EQUAL(0, rule.anchorDay);
+
+  TEST_ASSERT_TRUE(parseEventWith("\"weekdays\":65,\"everyDays\":2,\"anchor\":\"2026-01-01\"", rule));
+  TEST_ASSERT_EQUAL(65, rule.weekdays);
+  TEST_ASSERT_EQUAL(2, rule.intervalDays);
+  TEST_ASSERT_EQUAL(utcInstant(2026, 1, 1) / SECONDS_PER_DAY, rule.anchorDay);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_february_29_only_in_leap_years);
+  RUN_TEST(test_days_after_dst_change_start_at_their_own_midnight);
+  RUN_TEST(test_parser_applies_the_recurrence_schema);
+  RUN_TEST(test_parser_normalizes_the_rule);
+  return UNITY_END();
+}
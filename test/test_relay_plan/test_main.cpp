@@ -0,0 +1,162 @@
+// Pump sequencing across midnight. A schedule whose queue runs past
+// midnight must still hold its pump slots when the next day's events are
+// sequenced, so the relay plan never has more than maxOpenZones relays of
+// the schedule on at once, on either side of midnight.
+#include <Arduino.h>
+#include <unity.h>
+#include "../ScheduleFixtures.h"
+#include "RelayPlan.h"
+
+static SchedulerState state;
+static RecurrenceDays days;
+static RelayPlan plan;
+
+static uint32_t compileDay(time_t midnight) {
+  compileRecurrenceDays(state, midnight, days);
+  uint32_t day = midnight / SECONDS_PER_DAY;
+  buildRelayPlan(state, days, day, plan);
+  return day;
+}
+
+// Most relays of mask the plan holds on at once, and when that happens
+static int mostOpenZones(uint8_t mask, uint32_t& atSecond) {
+  int most = 0;
+  for (uint32_t second = 0; second < SECONDS_PER_DAY; second++) {
+    int open = __builtin_popcount(relayPlanMaskAt(plan, second) & mask);
+    if (open > most) {
+      most = open;
+      atSecond = second;
+    }
+  }
+  return most;
+}
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(state);
+}
+
+void tearDown() {
+  clearTestState(state);
+}
+
+static void test_queue_past_midnight_holds_the_pump() {
+  // Four zones, one at a time, ten minutes each from 23:50: the queue runs
+  // until 00:30. The same zones are due again at 00:05.
+  Schedule& sch = addTestSchedule(state, "beds", 0x0F);
+  sch.maxOpenZones = 1;
+  addTestEvent(sch, "late", 23 * 3600 + 50 * 60, 600);
+  addTestEvent(sch, "early", 5 * 60, 600);
+
+  time_t midnight = utcInstant(2026, 6, 2);
+  compileDay(midnight);
+
+  uint32_t at = 0;
+  TEST_ASSERT_EQUAL(1, mostOpenZones(0x0F, at));
+
+  // Yesterday's queue: relays 1-3 until 00:30, then today's four from 00:30
+  TEST_ASSERT_EQUAL(0x02, relayPlanMaskAt(plan, 5 * 60));
+  TEST_ASSERT_EQUAL(0x08, relayPlanMaskAt(plan, 29 * 60));
+  TEST_ASSERT_EQUAL(0x01, relayPlanMaskAt(plan, 30 * 60));
+  TEST_ASSERT_EQUAL(0x08, relayPlanMaskAt(plan, 69 * 60));
+  TEST_ASSERT_EQUAL(0x00, relayPlanMaskAt(plan, 70 * 60));
+
+  // The evening queue starts the same way
+  TEST_ASSERT_EQUAL(0x01, relayPlanMaskAt(plan, 23 * 3600 + 55 * 60));
+}
+
+static void test_gap_applies_across_midnight() {
+  Schedule& sch = addTestSchedule(state, "beds", 0x03);
+  sch.maxOpenZones = 1;
+  sch.zoneGapSeconds = 60;
+  addTestEvent(sch, "late", 23 * 3600 + 55 * 60, 600);   // Relay 1 runs 00:06-00:16
+  addTestEvent(sch, "early", 10 * 60, 300);
+
+  compileDay(utcInstant(2026, 6, 2));
+
+  uint32_t at = 0;
+  TEST_ASSERT_EQUAL(1, mostOpenZones(0x03, at));
+  TEST_ASSERT_EQUAL(0x02, relayPlanMaskAt(plan, 15 * 60));
+  TEST_ASSERT_EQUAL(0x00, relayPlanMaskAt(plan, 16 * 60 + 30));
+  TEST_ASSERT_EQUAL(0x01, relayPlanMaskAt(plan, 17 * 60));
+}
+
+static void test_sequence_starts_from_midnight_slots() {
+  Schedule& sch = addTestSchedule(state, "beds", 0x0F);
+  sch.maxOpenZones = 2;
+  addTestEvent(sch, "late", 23 * 3600 + 50 * 60, 1200);
+  addTestEvent(sch, "early", 0, 300);
+
+  uint32_t day = compileDay(utcInstant(2026, 6, 2));
+
+  // Two slots: relays 0/1 run 23:50-00:10, relays 2/3 00:10-00:30
+  ZoneRun runs[8];
+  ZoneSlots slots;
+  zoneSlotsAtMidnight(sch, 0, days, day, runs, 8, slots);
+  uint16_t count = sequenceScheduleZones(sch, 0, days, day, runs, 8, slots);
+
+  // The events are sorted by requested start, so "early" comes first
+  TEST_ASSERT_EQUAL(8, count);
+  TEST_ASSERT_EQUAL(30 * 60, runs[0].start);
+  TEST_ASSERT_EQUAL(30 * 60, runs[1].start);
+  TEST_ASSERT_EQUAL(35 * 60, runs[2].start);
+  TEST_ASSERT_EQUAL(35 * 60, runs[3].start);
+
+  uint32_t at = 0;
+  TEST_ASSERT_EQUAL(2, mostOpenZones(0x0F, at));
+}
+
+static void test_unlimited_schedule_is_unchanged() {
+  Schedule& sch = addTestSchedule(state, "beds", 0x0F);
+  addTestEvent(sch, "late", 23 * 3600 + 50 * 60, 1200);
+  addTestEvent(sch, "early", 5 * 60, 600);
+
+  compileDay(utcInstant(2026, 6, 2));
+
+  TEST_ASSERT_EQUAL(0x0F, relayPlanMaskAt(plan, 5 * 60));
+  TEST_ASSERT_EQUAL(0x00, relayPlanMaskAt(plan, 15 * 60));
+}
+
+// Mask and next edge through the cursor, checked against a fresh search
+static void checkCursor(RelayPlanCursor& cursor, uint32_t second) {
+  TEST_ASSERT_EQUAL(relayPlanMaskAt(plan, second), relayPlanMaskAt(plan, cursor, second));
+  TEST_ASSERT_EQUAL(secondsUntilRelayPlanEdge(plan, second), secondsUntilRelayPlanEdge(plan, cursor, second));
+}
+
+static void test_cursor_follows_the_plan() {
+  Schedule& sch = addTestSchedule(state, "beds", 0x0F);
+  char id[EVENT_ID_LEN];
+  for (int e = 0; e < 200; e++) {
+    snprintf(id, sizeof(id), "e%d", e);
+    addTestEvent(sch, id, e * 431 % SECONDS_PER_DAY, 60 + e % 7 * 90);
+  }
+  compileDay(utcInstant(2026, 6, 2));
+
+  // Forward the way the executor goes: to each edge, and now and then early
+  RelayPlanCursor cursor = {};
+  uint32_t second = 0;
+  while (second < SECONDS_PER_DAY) {
+    checkCursor(cursor, second);
+    uint32_t step = secondsUntilRelayPlanEdge(plan, cursor, second);
+    second += (second % 3 == 0 && step > 1) ? step / 2 : step;
+  }
+
+  // The clock stepped back, then the plan was rebuilt under the cursor
+  checkCursor(cursor, 12 * 3600);
+  checkCursor(cursor, 6 * 3600);
+  addTestEvent(sch, "extra", 6 * 3600 + 30, 600);
+  compileDay(utcInstant(2026, 6, 3));
+  checkCursor(cursor, 6 * 3600 + 60);
+  TEST_ASSERT_TRUE(relayPlanMaskAt(plan, cursor, 6 * 3600 + 60) != 0);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_queue_past_midnight_holds_the_pump);
+  RUN_TEST(test_gap_applies_across_midnight);
+  RUN_TEST(test_sequence_starts_from_midnight_slots);
+  RUN_TEST(test_unlimited_schedule_is_unchanged);
+  RUN_TEST(test_cursor_follows_the_plan);
+  return UNITY_END();
+}
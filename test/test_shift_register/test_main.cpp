@@ -0,0 +1,196 @@
+// Shift register driver against models of the 74HC595 chain and the
+// 74HC165 on the emulated GPIO: the bits that reach the outputs, the order
+// of the pin edges, and the number of register writes per frame, through
+// the register path and through an installed backend.
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "NativeHost.h"
+#include "PinConfig.h"
+#include "ShiftRegister.h"
+#include "soc/soc.h"
+#include "soc/gpio_reg.h"
+
+#define PIN_MASK(pin) (1UL << (pin))
+#define FRAME_BITS (SH595_FRAME_BYTES * 8)
+
+// 74HC595 chain: shifts DATA in on a rising CLOCK, copies the shift
+// register to the outputs on a rising LATCH
+struct Chain595 {
+  uint32_t shift;
+  uint32_t outputs;
+  uint32_t latchRises;
+  uint32_t clocksWhileLatchHigh;
+};
+
+// 74HC165: loads its inputs while LOAD is low, shifts on a rising CLOCK,
+// and drives its last stage on DATA
+struct Chip165 {
+  uint8_t inputLevels;
+  uint8_t shift;
+};
+
+static Chain595 chain;
+static Chip165 chip;
+static uint32_t lastLevels;
+static uint32_t writes;
+static std::vector<uint32_t> levelTrace;
+
+static bool rose(uint32_t levels, uint32_t mask) {
+  return (levels & mask) && !(lastLevels & mask);
+}
+
+static void outputsChanged(uint32_t levels) {
+  writes++;
+  levelTrace.push_back(levels);
+
+  if (rose(levels, PIN_MASK(SH595_CLOCK))) {
+    chain.shift = ((chain.shift << 1) | ((levels & PIN_MASK(SH595_DATA)) ? 1 : 0)) & ((1UL << FRAME_BITS) - 1);
+    if (levels & PIN_MASK(SH595_LATCH)) chain.clocksWhileLatchHigh++;
+  }
+  if (rose(levels, PIN_MASK(SH595_LATCH))) {
+    chain.outputs = chain.shift;
+    chain.latchRises++;
+  }
+
+  if (!(levels & PIN_MASK(LOAD_165))) {
+    chip.shift = chip.inputLevels;
+  } else if (rose(levels, PIN_MASK(CLK_165))) {
+    chip.shift = (chip.shift << 1) | 1;   // Serial input tied high
+  }
+  lastLevels = levels;
+}
+
+static uint32_t inputs(uint32_t outputs) {
+  return (chip.shift & 0x80) ? PIN_MASK(DATA165) : 0;
+}
+
+static const NativeGpioDevice device = {outputsChanged, inputs};
+
+static uint32_t readPins() {
+  return nativeRegRead(GPIO_IN_REG);
+}
+
+// A backend as a host mock would install it, on the same emulated pins
+static const ShiftRegisterBackend mockBackend = {nativeGpioSet, nativeGpioClear, readPins};
+
+// A backend that counts its calls
+static uint32_t backendCalls;
+static void countedSet(uint32_t mask) { backendCalls++; nativeGpioSet(mask); }
+static void countedClear(uint32_t mask) { backendCalls++; nativeGpioClear(mask); }
+static uint32_t countedRead() { backendCalls++; return readPins(); }
+static const ShiftRegisterBackend countingBackend = {countedSet, countedClear, countedRead};
+
+static uint32_t frameValue(const uint8_t* frame) {
+  return ((uint32_t)frame[0] << 16) | ((uint32_t)frame[1] << 8) | frame[2];
+}
+
+// Idle levels (latch, clocks and 165 load high, data low) and empty models
+static void resetModels() {
+  nativeRegWrite(GPIO_OUT_REG, PIN_MASK(SH595_LATCH) | PIN_MASK(SH595_CLOCK) | PIN_MASK(LOAD_165) |
+                               PIN_MASK(CLK_165));
+  memset(&chain, 0, sizeof(chain));
+  memset(&chip, 0, sizeof(chip));
+  writes = 0;
+  levelTrace.clear();
+}
+
+void setUp() {
+  setShiftRegisterBackend(NULL);
+  nativeSetGpioDevice(&device);
+  resetModels();
+}
+
+void tearDown() {
+  setShiftRegisterBackend(NULL);
+  nativeSetGpioDevice(NULL);
+}
+
+static void test_frame_reaches_the_outputs() {
+  static const uint8_t frames[][SH595_FRAME_BYTES] = {
+    {0x00, 0x00, 0x00}, {0xFF, 0xFF, 0xFF}, {0xA5, 0x3C, 0x81}, {0x01, 0x80, 0x7E},
+  };
+  for (const auto& frame : frames) {
+    resetModels();
+    shiftOut595(frame, SH595_FRAME_BYTES);
+    // First byte (relays) ends up in the farthest register
+    TEST_ASSERT_EQUAL_HEX32(frameValue(frame), chain.outputs);
+    TEST_ASSERT_EQUAL(1, chain.latchRises);
+    TEST_ASSERT_EQUAL(0, chain.clocksWhileLatchHigh);
+  }
+}
+
+static void test_writes_per_bit() {
+  // A 0 bit is two register writes, a 1 bit three, plus the latch low and high
+  uint8_t frame[SH595_FRAME_BYTES] = {0xF0, 0x01, 0x00};
+  shiftOut595(frame, SH595_FRAME_BYTES);
+  TEST_ASSERT_EQUAL(2 + 2 * FRAME_BITS + 5, writes);
+
+  // The latch falls first and rises last, so the outputs change once
+  TEST_ASSERT_FALSE(levelTrace.front() & PIN_MASK(SH595_LATCH));
+  TEST_ASSERT_TRUE(levelTrace.back() & PIN_MASK(SH595_LATCH));
+  for (size_t i = 0; i + 1 < levelTrace.size(); i++) {
+    TEST_ASSERT_FALSE(levelTrace[i] & PIN_MASK(SH595_LATCH));
+  }
+}
+
+static void test_backend_sees_the_register_sequence() {
+  srand(20);
+  for (int round = 0; round < 500; round++) {
+    uint8_t frame[SH595_FRAME_BYTES];
+    for (int b = 0; b < SH595_FRAME_BYTES; b++) frame[b] = rand() & 0xFF;
+
+    resetModels();
+    shiftOut595(frame, SH595_FRAME_BYTES);
+    std::vector<uint32_t> registerTrace = levelTrace;
+    TEST_ASSERT_EQUAL_HEX32(frameValue(frame), chain.outputs);
+
+    resetModels();
+    setShiftRegisterBackend(&mockBackend);
+    shiftOut595(frame, SH595_FRAME_BYTES);
+    setShiftRegisterBackend(NULL);
+    TEST_ASSERT_EQUAL_HEX32(frameValue(frame), chain.outputs);
+    TEST_ASSERT_TRUE(registerTrace == levelTrace);
+  }
+}
+
+static void test_interrupt_path_ignores_the_backend() {
+  // The display refresh interrupt may fire while a backend is installed;
+  // it must not call into the backend (not in IRAM), only the registers
+  uint8_t frame[SH595_FRAME_BYTES] = {0x24, 0xFD, 0x6D};
+  backendCalls = 0;
+  setShiftRegisterBackend(&countingBackend);
+  shiftOut595FromIsr(frame, SH595_FRAME_BYTES);
+  TEST_ASSERT_EQUAL(0, backendCalls);
+  TEST_ASSERT_EQUAL_HEX32(frameValue(frame), chain.outputs);
+
+  // Task-context transfers still go through it
+  shiftOut595(frame, SH595_FRAME_BYTES);
+  TEST_ASSERT_TRUE(backendCalls > 0);
+}
+
+static void test_inputs_read_active_low() {
+  static const uint8_t activeSets[] = {0x00, 0xFF, 0x81, 0x5A, 0x01};
+  for (uint8_t active : activeSets) {
+    // An active input pulls its pin low
+    chip.inputLevels = ~active;
+    TEST_ASSERT_EQUAL_HEX8(active, shiftIn165());
+
+    setShiftRegisterBackend(&mockBackend);
+    TEST_ASSERT_EQUAL_HEX8(active, shiftIn165());
+    setShiftRegisterBackend(NULL);
+  }
+  // Load was pulsed and the clock left high
+  TEST_ASSERT_TRUE(nativeGpioOutputs() & PIN_MASK(LOAD_165));
+  TEST_ASSERT_TRUE(nativeGpioOutputs() & PIN_MASK(CLK_165));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_reaches_the_outputs);
+  RUN_TEST(test_writes_per_bit);
+  RUN_TEST(test_backend_sees_the_register_sequence);
+  RUN_TEST(test_interrupt_path_ignores_the_backend);
+  RUN_TEST(test_inputs_read_active_low);
+  return UNITY_END();
+}
@@ -0,0 +1,165 @@
+// Replays a year of schedules on the host through the executor's own step
+// functions and checks the firing log around midnight and DST changes.
+#include <Arduino.h>
+#include <unity.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../ScheduleFixtures.h"
+#include "SchedulerReplay.h"
+
+static SchedulerState state;
+static SchedulerReplay replay;
+static std::vector<std::string> logLines;
+
+static void collectLine(const char* line, void* context) {
+  logLines.push_back(line);
+}
+
+void setUp() {
+  useTimezone(TORONTO_TZ);
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(state);
+  memset(&replay, 0, sizeof(replay));
+  logLines.clear();
+
+  // Daily 06:00 EST drip on relays 0-1, and a 23:58 UTC soak that runs
+  // ten minutes past UTC midnight on relay 2
+  Schedule& drip = addTestSchedule(state, "Drip", 0x03);
+  addTestEvent(drip, "drip", 11 * 3600, 300);
+  Schedule& soak = addTestSchedule(state, "Soak", 0x04);
+  addTestEvent(soak, "soak", 23 * 3600 + 58 * 60, 600);
+
+  // Monday, Wednesday and Friday at 12:00 UTC on relay 3
+  Schedule& mwf = addTestSchedule(state, "MWF", 0x08);
+  addTestEvent(mwf, "mwf", 12 * 3600, 120, addWeekdayRule(mwf, 0x2A));
+}
+
+void tearDown() {
+  endSchedulerReplay(replay);
+  clearTestState(state);
+}
+
+static void runYear(time_t start, uint16_t days) {
+  TEST_ASSERT_TRUE(beginSchedulerReplay(replay, state, start, days, collectLine, NULL));
+  uint32_t steps = 0;
+  uint32_t maxStepUs = 0;
+  uint32_t startUs = micros();
+  while (!schedulerReplayDone(replay)) {
+    uint32_t stepUs = micros();
+    TEST_ASSERT_NULL(stepSchedulerReplay(replay));
+    stepUs = micros() - stepUs;
+    if (stepUs > maxStepUs) maxStepUs = stepUs;
+    steps++;
+  }
+  uint32_t wallUs = micros() - startUs;
+
+  char summary[160];
+  snprintf(summary, sizeof(summary), "%u days, %u steps, %u firings in %u us (%u us/day, max step %u us, max compile %u us)",
+           days, steps, replay.firings, wallUs, wallUs / days, maxStepUs, replay.maxRecompileUs);
+  TEST_MESSAGE(summary);
+}
+
+// Log lines are "SIM,<utc>,<local>,<kind>,<details>"
+static std::string field(const std::string& line, int index) {
+  size_t start = 0;
+  for (int i = 0; i < index; i++) {
+    start = line.find(',', start) + 1;
+  }
+  size_t end = line.find(',', start);
+  return line.substr(start, end == std::string::npos ? std::string::npos : end - start);
+}
+
+static void test_every_day_event_fires_once_per_utc_day() {
+  runYear(localMidnight(2026, 1, 1), 365);
+
+  std::map<std::string, int> dripDays;
+  std::map<std::string, int> soakDays;
+  for (const std::string& line : logLines) {
+    if (field(line, 3) != "event") continue;
+    std::string day = field(line, 1).substr(0, 10);
+    if (field(line, 6) == "drip") dripDays[day]++;
+    if (field(line, 6) == "soak") soakDays[day]++;
+  }
+  TEST_ASSERT_EQUAL(365, dripDays.size());
+  TEST_ASSERT_EQUAL(365, soakDays.size());
+  for (auto& day : dripDays) TEST_ASSERT_EQUAL(1, day.second);
+  for (auto& day : soakDays) TEST_ASSERT_EQUAL(1, day.second);
+}
+
+static void test_weekday_rule_follows_local_weekday() {
+  runYear(localMidnight(2026, 1, 1), 365);
+
+  int fired = 0;
+  for (const std::string& line : logLines) {
+    if (field(line, 3) != "event" || field(line, 6) != "mwf") continue;
+    std::string local = field(line, 2);
+    struct tm tm = {};
+    strptime(local.c_str(), "%Y-%m-%dT%H:%M:%S", &tm);
+    time_t localDay = utcInstant(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    struct tm date;
+    gmtime_r(&localDay, &date);
+    TEST_ASSERT_TRUE(date.tm_wday == 1 || date.tm_wday == 3 || date.tm_wday == 5);
+    fired++;
+  }
+  // 2026 has 52 full weeks plus one Thursday
+  TEST_ASSERT_EQUAL(156, fired);
+}
+
+static void test_runs_cross_utc_midnight_without_a_relay_glitch() {
+  runYear(localMidnight(2026, 1, 1), 365);
+
+  int soakOn = 0;
+  for (const std::string& line : logLines) {
+    if (field(line, 3) != "relays") continue;
+    std::string time = field(line, 1).substr(11);
+    // The soak's relay is held through the midnight recompile
+    TEST_ASSERT_TRUE(time != "00:00:00");
+    if (time == "23:58:00") {
+      TEST_ASSERT_TRUE(strtoul(field(line, 4).c_str(), NULL, 16) & 0x04);
+      soakOn++;
+    }
+    if (time == "00:08:00") {
+      TEST_ASSERT_FALSE(strtoul(field(line, 4).c_str(), NULL, 16) & 0x04);
+    }
+  }
+  TEST_ASSERT_EQUAL(365, soakOn);
+}
+
+static void test_dst_changes_recompile_on_the_transition_day() {
+  runYear(localMidnight(2026, 1, 1), 365);
+
+  std::vector<std::string> changes;
+  for (const std::string& line : logLines) {
+    if (field(line, 3) == "clock") {
+      changes.push_back(field(line, 1).substr(0, 10) + "," + field(line, 5));
+    }
+  }
+  TEST_ASSERT_EQUAL(2, replay.offsetChanges);
+  TEST_ASSERT_EQUAL(2, changes.size());
+  TEST_ASSERT_EQUAL_STRING("2026-03-08,-14400", changes[0].c_str());
+  TEST_ASSERT_EQUAL_STRING("2026-11-01,-18000", changes[1].c_str());
+}
+
+static void test_replays_are_deterministic() {
+  runYear(localMidnight(2026, 1, 1), 365);
+  uint32_t digest = replay.logDigest;
+  uint32_t firings = replay.firings;
+  endSchedulerReplay(replay);
+  logLines.clear();
+
+  runYear(localMidnight(2026, 1, 1), 365);
+  TEST_ASSERT_EQUAL_HEX32(digest, replay.logDigest);
+  TEST_ASSERT_EQUAL_UINT32(firings, replay.firings);
+  TEST_ASSERT_EQUAL_UINT32(365 * 2 + 156, replay.firings);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_every_day_event_fires_once_per_utc_day);
+  RUN_TEST(test_weekday_rule_follows_local_weekday);
+  RUN_TEST(test_runs_cross_utc_midnight_without_a_relay_glitch);
+  RUN_TEST(test_dst_changes_recompile_on_the_transition_day);
+  RUN_TEST(test_replays_are_deterministic);
+  return UNITY_END();
+}
@@ -0,0 +1,336 @@
+// The store format, packed here byte by byte from its field list: a saved
+// state must produce exactly these bytes and load back from them, whatever
+// the compiler does to the struct layout.
+#include <Arduino.h>
+#include <unity.h>
+#include <SPIFFS.h>
+#include <vector>
+#include "../ScheduleFixtures.h"
+#include "SchedulerStore.h"
+
+static SchedulerState state;
+static SchedulerState loaded;
+
+// Two schedules with two events each, so a wrong header or event size in
+// the first one shows up as garbage in the second
+struct TestSchedule {
+  const char* name;
+  uint8_t relayMask;
+  uint8_t maxOpenZones;
+  uint16_t zoneGapSeconds;
+  uint16_t lightsOnMinute;
+  uint16_t lightsOffMinute;
+  struct {
+    const char* id;
+    uint16_t minuteOfDay;
+    uint16_t duration;
+    uint32_t lastRun;
+  } events[2];
+};
+
+static const TestSchedule fixtures[2] = {
+  {"Front beds", 0x05, 1, 30, 6 * 60, 20 * 60,
+   {{"1709500000000_1", 7 * 60 + 15, 300, 19800 * 86400UL + 26100}, {"1709500000000_2", 19 * 60, 120, 19801 * 86400UL + 68400}}},
+  {"Greenhouse", 0xF0, 2, 45, 5 * 60 + 30, 21 * 60,
+   {{"1709500000000_3", 0, 60, 0}, {"1709500000000_4", 23 * 60 + 59, 900, 19799 * 86400UL + 86340}}},
+};
+
+// Little-endian packing at explicit offsets
+struct Packer {
+  std::vector<uint8_t> bytes;
+  size_t base = 0;
+
+  void begin(size_t size, uint8_t fill = 0) {
+    base = bytes.size();
+    bytes.resize(base + size, fill);
+  }
+  void put8(size_t at, uint8_t value) { bytes[base + at] = value; }
+  void put16(size_t at, uint16_t value) { put8(at, value & 0xFF); put8(at + 1, value >> 8); }
+  void put32(size_t at, uint32_t value) { put16(at, value & 0xFFFF); put16(at + 2, value >> 16); }
+  void putId(const char* id) { memcpy(&bytes[base], id, strlen(id)); }
+};
+
+static uint32_t crc32Of(const std::vector<uint8_t>& data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (uint8_t byte : data) {
+    crc ^= byte;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+    }
+  }
+  return ~crc;
+}
+
+// Payload of the fixtures in the store format (see SchedulerStore.cpp)
+static std::vector<uint8_t> packPayload() {
+  StringArena arena = {};
+  uint16_t names[2];
+  for (int s = 0; s < 2; s++) {
+    names[s] = internString(arena, fixtures[s].name);
+  }
+
+  Packer p;
+  p.begin(4);
+  p.put8(0, 2);   // scheduleCount
+  p.put8(1, 1);   // currentScheduleIndex
+  p.put16(2, arena.used);
+
+  for (int s = 0; s < 2; s++) {
+    const TestSchedule& f = fixtures[s];
+    p.begin(15);
+    p.put16(0, names[s]);
+    p.put16(2, ARENA_NONE);
+    p.put16(4, f.lightsOnMinute);
+    p.put16(6, f.lightsOffMinute);
+    p.put8(8, f.relayMask);
+    p.put8(9, f.maxOpenZones);
+    p.put16(10, f.zoneGapSeconds);
+    p.put8(12, 0);   // ruleCount
+    p.put16(13, 2);  // eventCount
+
+    for (int e = 0; e < 2; e++) {
+      const auto& ev = f.events[e];
+      p.begin(EVENT_ID_LEN + 11);
+      p.putId(ev.id);
+      p.put8(EVENT_ID_LEN, 0);   // rule
+      p.put32(EVENT_ID_LEN + 1, (uint32_t)ev.minuteOfDay * 60);
+      p.put16(EVENT_ID_LEN + 5, ev.duration);
+      p.put32(EVENT_ID_LEN + 7, ev.lastRun);
+    }
+  }
+
+  p.begin(arena.used);
+  memcpy(&p.bytes[p.base], arena.data, arena.used);
+  return p.bytes;
+}
+
+// Header fields in file order
+static std::vector<uint8_t> packHeader(uint16_t version, const std::vector<uint8_t>& payload) {
+  Packer p;
+  p.begin(SCHEDULER_STORE_HEADER_SIZE);
+  p.put32(0, SCHEDULER_STORE_MAGIC);
+  p.put16(4, version);
+  p.put16(6, SCHEDULER_STORE_HEADER_SIZE);
+  p.put32(8, payload.size());
+  p.put32(12, crc32Of(payload));
+  return p.bytes;
+}
+
+static void writeStoreFile(uint16_t version, const std::vector<uint8_t>& payload) {
+  std::vector<uint8_t> header = packHeader(version, payload);
+  File file = SPIFFS.open(SCHEDULER_STORE_FILE, FILE_WRITE);
+  file.write(header.data(), header.size());
+  file.write(payload.data(), payload.size());
+  file.close();
+}
+
+static std::vector<uint8_t> readStoreFile() {
+  File file = SPIFFS.open(SCHEDULER_STORE_FILE, FILE_READ);
+  std::vector<uint8_t> bytes(file.size());
+  file.read(bytes.data(), bytes.size());
+  file.close();
+  return bytes;
+}
+
+static void checkLoaded() {
+  TEST_ASSERT_EQUAL(2, loaded.scheduleCount);
+  TEST_ASSERT_EQUAL(1, loaded.currentScheduleIndex);
+
+  for (int s = 0; s < 2; s++) {
+    const TestSchedule& f = fixtures[s];
+    const Schedule& sch = loaded.schedules[s];
+    TEST_ASSERT_EQUAL_STRING(f.name, arenaString(loaded.strings, sch.name));
+    TEST_ASSERT_EQUAL_STRING("", arenaString(loaded.strings, sch.metadata));
+    TEST_ASSERT_EQUAL(f.lightsOnMinute, sch.lightsOnMinute);
+    TEST_ASSERT_EQUAL(f.lightsOffMinute, sch.lightsOffMinute);
+    TEST_ASSERT_EQUAL_HEX8(f.relayMask, sch.relayMask);
+    TEST_ASSERT_EQUAL(f.maxOpenZones, sch.maxOpenZones);
+    TEST_ASSERT_EQUAL(f.zoneGapSeconds, sch.zoneGapSeconds);
+    TEST_ASSERT_EQUAL(0, sch.ruleCount);
+    TEST_ASSERT_EQUAL(2, sch.eventCount);
+
+    for (int e = 0; e < 2; e++) {
+      const auto& ev = f.events[e];
+      const Event& event = sch.events[e];
+      TEST_ASSERT_EQUAL_STRING(ev.id, event.id);
+      TEST_ASSERT_EQUAL(0, event.rule);
+      TEST_ASSERT_EQUAL_UINT32((uint32_t)ev.minuteOfDay * 60, event.secondOfDay);
+      TEST_ASSERT_EQUAL(ev.duration, event.duration);
+      TEST_ASSERT_EQUAL_UINT32(ev.lastRun, event.lastRun);
+    }
+  }
+}
+
+void setUp() {
+  nativeFormatSpiffs();
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(state);
+  clearTestState(loaded);
+}
+
+void tearDown() {
+  clearTestState(state);
+  clearTestState(loaded);
+}
+
+// The fixtures as a state, with no recurrence rules
+static void buildFixtureState() {
+  for (int s = 0; s < 2; s++) {
+    const TestSchedule& f = fixtures[s];
+    Schedule& sch = addTestSchedule(state, f.name, f.relayMask);
+    sch.maxOpenZones = f.maxOpenZones;
+    sch.zoneGapSeconds = f.zoneGapSeconds;
+    sch.lightsOnMinute = f.lightsOnMinute;
+    sch.lightsOffMinute = f.lightsOffMinute;
+    for (int e = 0; e < 2; e++) {
+      Event& event = addTestEvent(sch, f.events[e].id, f.events[e].minuteOfDay * 60, f.events[e].duration);
+      event.lastRun = f.events[e].lastRun;
+    }
+  }
+  state.currentScheduleIndex = 1;
+}
+
+static void test_saves_the_packed_format() {
+  buildFixtureState();
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+
+  std::vector<uint8_t> payload = packPayload();
+  std::vector<uint8_t> expected = packHeader(SCHEDULER_STORE_VERSION, payload);
+  expected.insert(expected.end(), payload.begin(), payload.end());
+  std::vector<uint8_t> saved = readStoreFile();
+  TEST_ASSERT_EQUAL(expected.size(), saved.size());
+  TEST_ASSERT_EQUAL_MEMORY(expected.data(), saved.data(), expected.size());
+}
+
+static void test_loads_the_packed_format() {
+  writeStoreFile(SCHEDULER_STORE_VERSION, packPayload());
+  TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+  checkLoaded();
+}
+
+static void test_round_trips_rules() {
+  buildFixtureState();
+
+  // A weekday rule on one event of the second schedule
+  Schedule& second = state.schedules[1];
+  second.events[1].rule = addWeekdayRule(second, 0x3E);
+
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+  TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+
+  Schedule& rules = loaded.schedules[1];
+  TEST_ASSERT_EQUAL(1, rules.ruleCount);
+  TEST_ASSERT_EQUAL_HEX8(0x3E, rules.rules[0].weekdays);
+  TEST_ASSERT_EQUAL(1, rules.events[1].rule);
+  rules.events[1].rule = 0;
+  rules.ruleCount = 0;
+  checkLoaded();
+}
+
+static void test_rejects_corrupt_payload() {
+  writeStoreFile(SCHEDULER_STORE_VERSION, packPayload());
+  File file = SPIFFS.open(SCHEDULER_STORE_FILE, FILE_APPEND);
+  file.seek(SCHEDULER_STORE_HEADER_SIZE + 8);
+  file.write((uint8_t)0x5A);
+  file.close();
+
+  TEST_ASSERT_FALSE(loadSchedulerStore(loaded));
+  TEST_ASSERT_EQUAL(0, loaded.scheduleCount);
+}
+
+static void test_rejects_other_versions() {
+  writeStoreFile(SCHEDULER_STORE_VERSION + 1, packPayload());
+  TEST_ASSERT_FALSE(loadSchedulerStore(loaded));
+  TEST_ASSERT_EQUAL(0, loaded.scheduleCount);
+}
+
+// Fires events of the first fixture schedule, one journal append each
+static void fireEvents(uint16_t count, time_t start) {
+  Schedule& sch = state.schedules[0];
+  for (uint16_t i = 0; i < count; i++) {
+    SchedulerRunRef run = {0, (uint16_t)(i % sch.eventCount)};
+    markEventRun(sch.events[run.eventIdx], start + i);
+    TEST_ASSERT_TRUE(appendSchedulerRuns(state, &run, 1));
+  }
+}
+
+static void test_run_stamps_are_journaled() {
+  buildFixtureState();
+  char id[EVENT_ID_LEN];
+  // 2,000 events in one schedule; only the heap bounds them now
+  for (int e = 0; e < 2000; e++) {
+    snprintf(id, sizeof(id), "bulk_%d", e);
+    addTestEvent(state.schedules[0], id, e * 43 % SECONDS_PER_DAY, 30);
+  }
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+  SchedulerStoreStats saved = getSchedulerStoreStats();
+
+  // A firing costs one small record, not a rewrite of the store
+  size_t before = nativeSpiffsBytesWritten();
+  const time_t start = 19900 * 86400UL;
+  fireEvents(100, start);
+  size_t perFiring = (nativeSpiffsBytesWritten() - before) / 100;
+  printf("store: %u bytes per firing, %u bytes per store save\n", (unsigned)perFiring, saved.lastBytesWritten);
+  TEST_ASSERT_TRUE(perFiring < 32);
+  TEST_ASSERT_EQUAL(saved.saveCount, getSchedulerStoreStats().saveCount);
+  TEST_ASSERT_EQUAL(100, getSchedulerStoreStats().runRecords);
+
+  TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+  for (int e = 0; e < 100; e++) {
+    TEST_ASSERT_EQUAL_UINT32(start + e, loaded.schedules[0].events[e].lastRun);
+  }
+  TEST_ASSERT_EQUAL_UINT32(fixtures[1].events[1].lastRun, loaded.schedules[1].events[1].lastRun);
+}
+
+static void test_full_journal_is_folded_into_the_store() {
+  buildFixtureState();
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+
+  const time_t start = 19900 * 86400UL;
+  fireEvents(SCHEDULER_RUNS_COMPACT, start);
+  SchedulerRunRef run = {0, 0};
+  TEST_ASSERT_FALSE(appendSchedulerRuns(state, &run, 1));
+
+  // The save takes the stamps along and starts the journal over
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+  TEST_ASSERT_FALSE(SPIFFS.exists(SCHEDULER_RUNS_FILE));
+  TEST_ASSERT_TRUE(appendSchedulerRuns(state, &run, 1));
+
+  TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+  TEST_ASSERT_EQUAL_UINT32(start + SCHEDULER_RUNS_COMPACT - 2, loaded.schedules[0].events[0].lastRun);
+  TEST_ASSERT_EQUAL_UINT32(start + SCHEDULER_RUNS_COMPACT - 1, loaded.schedules[0].events[1].lastRun);
+}
+
+static void test_torn_journal_record_is_skipped() {
+  buildFixtureState();
+  TEST_ASSERT_TRUE(saveSchedulerStore(state));
+  const time_t start = 19900 * 86400UL;
+  fireEvents(2, start);
+
+  // A reset in the middle of the next append
+  File file = SPIFFS.open(SCHEDULER_RUNS_FILE, FILE_APPEND);
+  const uint8_t partial[5] = {0, 'x', 'y', 'z', 0};
+  file.write(partial, sizeof(partial));
+  file.close();
+
+  TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+  TEST_ASSERT_EQUAL_UINT32(start, loaded.schedules[0].events[0].lastRun);
+  TEST_ASSERT_EQUAL_UINT32(start + 1, loaded.schedules[0].events[1].lastRun);
+
+  // Appending after the partial record would misalign every later one
+  SchedulerRunRef run = {0, 0};
+  TEST_ASSERT_FALSE(appendSchedulerRuns(loaded, &run, 1));
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_saves_the_packed_format);
+  RUN_TEST(test_loads_the_packed_format);
+  RUN_TEST(test_round_trips_rules);
+  RUN_TEST(test_rejects_corrupt_payload);
+  RUN_TEST(test_rejects_other_versions);
+  RUN_TEST(test_run_stamps_are_journaled);
+  RUN_TEST(test_full_journal_is_folded_into_the_store);
+  RUN_TEST(test_torn_journal_record_is_skipped);
+  return UNITY_END();
+}
@@ -0,0 +1,229 @@
+// Load and save cost of the binary store against the JSON file it replaced,
+// and the bytes each save writes to flash. The JSON side is the original
+// saveSchedulerState()/loadSchedulerState(): one document for the whole
+// state, events as {"id","time","duration"} and loaded into Strings.
+#include <Arduino.h>
+#include <unity.h>
+#include <ArduinoJson.h>
+#include <SPIFFS.h>
+#include "../ScheduleFixtures.h"
+#include "SchedulerStore.h"
+
+#define BENCH_ROUNDS 20
+#define BENCH_SCHEDULES 8                // The old MAX_SCHEDULES, one per relay
+#define LEGACY_JSON_FILE "/scheduler.json"
+#define LEGACY_JSON_CAPACITY 4096        // What the JSON path allocated
+#define BENCH_JSON_CAPACITY (512 * 1024) // Large enough to hold every benchmarked state
+
+// The pre-store Event and Schedule, as loadSchedulerState() filled them
+struct LegacyEvent {
+  String id;
+  String time;
+  uint16_t duration;
+  uint32_t executedMask;
+};
+
+struct LegacySchedule {
+  String name;
+  String metadata;
+  uint8_t relayMask;
+  String lightsOnTime;
+  String lightsOffTime;
+  uint16_t eventCount;
+  LegacyEvent* events;
+};
+
+struct BenchResult {
+  uint32_t saveUs;
+  uint32_t loadUs;
+  uint32_t bytesPerSave;
+};
+
+static SchedulerState state;
+static SchedulerState loaded;
+static LegacySchedule legacy[BENCH_SCHEDULES];
+
+static void fillState(uint16_t eventsPerSchedule) {
+  char text[32];
+  srand(5);
+  for (int s = 0; s < BENCH_SCHEDULES; s++) {
+    snprintf(text, sizeof(text), "Zone group %d", s);
+    Schedule& sch = addTestSchedule(state, text, 1 << s);
+    sch.lightsOnMinute = 6 * 60;
+    sch.lightsOffMinute = 22 * 60;
+    for (int e = 0; e < eventsPerSchedule; e++) {
+      snprintf(text, sizeof(text), "1709500%06d_%d", rand() % 1000000, e);
+      addTestEvent(sch, text, (rand() % MINUTES_PER_DAY) * 60, 30 + rand() % 600);
+    }
+  }
+}
+
+static void saveJson(DynamicJsonDocument& doc) {
+  doc.clear();
+  doc["scheduleCount"] = state.scheduleCount;
+  doc["currentScheduleIndex"] = state.currentScheduleIndex;
+
+  char time[9];
+  JsonArray schedules = doc.createNestedArray("schedules");
+  for (int i = 0; i < state.scheduleCount; i++) {
+    const Schedule& sch = state.schedules[i];
+    JsonObject schObj = schedules.createNestedObject();
+    schObj["name"] = arenaString(state.strings, sch.name);
+    schObj["metadata"] = arenaString(state.strings, sch.metadata);
+    schObj["relayMask"] = sch.relayMask;
+    // char* values are copied into the document, const char* ones are not
+    formatMinuteOfDay(sch.lightsOnMinute, time);
+    schObj["lightsOnTime"] = time;
+    formatMinuteOfDay(sch.lightsOffMinute, time);
+    schObj["lightsOffTime"] = time;
+
+    JsonArray events = schObj.createNestedArray("events");
+    for (int j = 0; j < sch.eventCount; j++) {
+      const Event& evt = sch.events[j];
+      JsonObject evtObj = events.createNestedObject();
+      evtObj["id"] = evt.id;
+      formatMinuteOfDay(evt.secondOfDay / 60, time);
+      evtObj["time"] = time;
+      evtObj["duration"] = evt.duration;
+    }
+  }
+
+  File file = SPIFFS.open(LEGACY_JSON_FILE, FILE_WRITE);
+  TEST_ASSERT_TRUE(serializeJson(doc, file) > 0);
+  file.close();
+}
+
+static uint16_t loadJson(DynamicJsonDocument& doc) {
+  File file = SPIFFS.open(LEGACY_JSON_FILE, FILE_READ);
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  TEST_ASSERT_TRUE(error == DeserializationError::Ok);
+
+  uint16_t count = 0;
+  for (JsonObject schObj : doc["schedules"].as<JsonArray>()) {
+    LegacySchedule& sch = legacy[count++];
+    sch.name = schObj["name"].as<const char*>();
+    sch.metadata = schObj["metadata"].as<const char*>();
+    sch.relayMask = schObj["relayMask"].as<uint8_t>();
+    sch.lightsOnTime = schObj["lightsOnTime"].as<const char*>();
+    sch.lightsOffTime = schObj["lightsOffTime"].as<const char*>();
+
+    JsonArray events = schObj["events"].as<JsonArray>();
+    delete[] sch.events;
+    sch.events = new LegacyEvent[events.size()];
+    sch.eventCount = 0;
+    for (JsonObject evt : events) {
+      LegacyEvent& e = sch.events[sch.eventCount++];
+      e.id = evt["id"].as<const char*>();
+      e.time = evt["time"].as<const char*>();
+      e.duration = evt["duration"].as<uint16_t>();
+      e.executedMask = 0;
+    }
+  }
+  return count;
+}
+
+static BenchResult benchJson() {
+  DynamicJsonDocument doc(BENCH_JSON_CAPACITY);
+  BenchResult result = {};
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    size_t bytesBefore = nativeSpiffsBytesWritten();
+    uint32_t startUs = micros();
+    saveJson(doc);
+    result.saveUs += micros() - startUs;
+    result.bytesPerSave = nativeSpiffsBytesWritten() - bytesBefore;
+
+    startUs = micros();
+    TEST_ASSERT_EQUAL(state.scheduleCount, loadJson(doc));
+    result.loadUs += micros() - startUs;
+  }
+  result.saveUs /= BENCH_ROUNDS;
+  result.loadUs /= BENCH_ROUNDS;
+  return result;
+}
+
+static BenchResult benchStore() {
+  BenchResult result = {};
+  for (int round = 0; round < BENCH_ROUNDS; round++) {
+    size_t bytesBefore = nativeSpiffsBytesWritten();
+    uint32_t startUs = micros();
+    TEST_ASSERT_TRUE(saveSchedulerStore(state));
+    result.saveUs += micros() - startUs;
+    result.bytesPerSave = nativeSpiffsBytesWritten() - bytesBefore;
+
+    startUs = micros();
+    TEST_ASSERT_TRUE(loadSchedulerStore(loaded));
+    result.loadUs += micros() - startUs;
+  }
+  result.saveUs /= BENCH_ROUNDS;
+  result.loadUs /= BENCH_ROUNDS;
+  return result;
+}
+
+static void compare(uint16_t eventsPerSchedule) {
+  fillState(eventsPerSchedule);
+  BenchResult json = benchJson();
+  BenchResult store = benchStore();
+
+  char summary[200];
+  snprintf(summary, sizeof(summary),
+           "%d x %u events: JSON save %u us, load %u us, %u bytes/save | store save %u us, load %u us, %u bytes/save",
+           BENCH_SCHEDULES, eventsPerSchedule, json.saveUs, json.loadUs, json.bytesPerSave,
+           store.saveUs, store.loadUs, store.bytesPerSave);
+  TEST_MESSAGE(summary);
+
+  // The store holds the same schedules, byte for byte
+  TEST_ASSERT_EQUAL(state.scheduleCount, loaded.scheduleCount);
+  for (int s = 0; s < state.scheduleCount; s++) {
+    TEST_ASSERT_EQUAL(state.schedules[s].eventCount, loaded.schedules[s].eventCount);
+    TEST_ASSERT_EQUAL_MEMORY(state.schedules[s].events, loaded.schedules[s].events,
+                             state.schedules[s].eventCount * sizeof(Event));
+  }
+  TEST_ASSERT_LESS_THAN_UINT32(json.bytesPerSave, store.bytesPerSave);
+  TEST_ASSERT_LESS_THAN_UINT32(json.loadUs, store.loadUs);
+}
+
+void setUp() {
+  nativeFormatSpiffs();
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(state);
+  clearTestState(loaded);
+}
+
+void tearDown() {
+  clearTestState(state);
+  clearTestState(loaded);
+  for (int s = 0; s < BENCH_SCHEDULES; s++) {
+    delete[] legacy[s].events;
+    legacy[s].events = NULL;
+  }
+}
+
+static void test_full_schedules_of_the_old_format() {
+  compare(50);
+}
+
+static void test_large_schedules() {
+  compare(200);
+}
+
+// The JSON path's fixed document could not even hold the old full state
+static void test_legacy_document_overflows() {
+  fillState(50);
+  DynamicJsonDocument full(BENCH_JSON_CAPACITY);
+  saveJson(full);
+
+  DynamicJsonDocument doc(LEGACY_JSON_CAPACITY);
+  File file = SPIFFS.open(LEGACY_JSON_FILE, FILE_READ);
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  TEST_ASSERT_TRUE(error == DeserializationError::NoMemory);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_schedules_of_the_old_format);
+  RUN_TEST(test_large_schedules);
+  RUN_TEST(test_legacy_document_overflows);
+  return UNITY_END();
+}
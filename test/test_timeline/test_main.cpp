@@ -0,0 +1,148 @@
+// Per-tick cost of the compiled timeline against the loop it replaced,
+// which scanned every event of every schedule and sscanf'd its "HH:MM"
+// String once a second. Both run over one full day of 1 s ticks with full
+// schedules (8 x 50 events, the old MAX_EVENTS).
+#include <Arduino.h>
+#include <unity.h>
+#include "../ScheduleFixtures.h"
+#include "SchedulerSnapshot.h"
+
+#define BENCH_SCHEDULES 8
+#define BENCH_EVENTS 50
+
+// The pre-timeline Event and the slice of Schedule the loop read
+struct LegacyEvent {
+  String id;
+  String time;
+  uint16_t duration;
+  uint32_t executedMask;
+};
+
+struct LegacySchedule {
+  uint8_t relayMask;
+  uint8_t eventCount;
+  LegacyEvent events[BENCH_EVENTS];
+};
+
+static LegacySchedule legacy[BENCH_SCHEDULES];
+static SchedulerSnapshot snapshot;
+static uint32_t eventMinutes[BENCH_SCHEDULES][BENCH_EVENTS];
+
+// The old checkAndExecuteScheduledEvents() scan, minus its logging
+static uint16_t legacyTick(time_t now) {
+  struct tm utcTime;
+  gmtime_r(&now, &utcTime);
+  int currentMinute = utcTime.tm_hour * 60 + utcTime.tm_min;
+  uint16_t fired = 0;
+
+  for (int scheduleIdx = 0; scheduleIdx < BENCH_SCHEDULES; scheduleIdx++) {
+    LegacySchedule& schedule = legacy[scheduleIdx];
+    if (schedule.relayMask == 0) {
+      continue;
+    }
+    for (int eventIdx = 0; eventIdx < schedule.eventCount; eventIdx++) {
+      LegacyEvent& event = schedule.events[eventIdx];
+      int eventHour = 0, eventMinute = 0;
+      sscanf(event.time.c_str(), "%d:%d", &eventHour, &eventMinute);
+      if (eventHour * 60 + eventMinute == currentMinute && !(event.executedMask & 0x01)) {
+        event.executedMask |= 0x01;
+        fired++;
+      }
+    }
+  }
+  return fired;
+}
+
+static void countFiring(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx, time_t now,
+                        void* context) {
+  (*(uint32_t*)context)++;
+}
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(snapshot.state);
+
+  srand(1);
+  char id[EVENT_ID_LEN];
+  char time[6];
+  for (int s = 0; s < BENCH_SCHEDULES; s++) {
+    snprintf(id, sizeof(id), "Schedule %d", s);
+    Schedule& sch = addTestSchedule(snapshot.state, id, 1 << s);
+    legacy[s].relayMask = 1 << s;
+    legacy[s].eventCount = BENCH_EVENTS;
+    for (int e = 0; e < BENCH_EVENTS; e++) {
+      uint32_t minute = rand() % MINUTES_PER_DAY;
+      eventMinutes[s][e] = minute;
+      snprintf(id, sizeof(id), "1709500000000_%d", s * BENCH_EVENTS + e);
+      addTestEvent(sch, id, minute * 60, 60);
+
+      formatMinuteOfDay(minute, time);
+      legacy[s].events[e].id = id;
+      legacy[s].events[e].time = time;
+      legacy[s].events[e].duration = 60;
+      legacy[s].events[e].executedMask = 0;
+    }
+  }
+}
+
+void tearDown() {
+  clearTestState(snapshot.state);
+}
+
+static void test_timeline_is_sorted_and_complete() {
+  TEST_ASSERT_TRUE(compileSchedulerSnapshot(snapshot, utcInstant(2026, 6, 1)));
+  const SchedulerTimeline& timeline = snapshot.timeline;
+  TEST_ASSERT_EQUAL(BENCH_SCHEDULES * BENCH_EVENTS, timeline.count);
+
+  for (uint16_t i = 0; i < timeline.count; i++) {
+    const TimelineEntry& entry = timeline.entries[i];
+    TEST_ASSERT_EQUAL_UINT32(eventMinutes[entry.scheduleIdx][entry.eventIdx] * 60, entry.secondOfDay);
+    if (i > 0) {
+      TEST_ASSERT_TRUE(timeline.entries[i - 1].secondOfDay <= entry.secondOfDay);
+    }
+  }
+
+  // First entry at or after every second of the day
+  for (uint32_t second = 0; second < SECONDS_PER_DAY; second += 7) {
+    uint16_t first = findFirstTimelineEntry(timeline, second);
+    TEST_ASSERT_TRUE(first == timeline.count || timeline.entries[first].secondOfDay >= second);
+    TEST_ASSERT_TRUE(first == 0 || timeline.entries[first - 1].secondOfDay < second);
+  }
+}
+
+static void test_timeline_tick_is_cheaper_than_the_full_scan() {
+  time_t day = utcInstant(2026, 6, 1);
+  TEST_ASSERT_TRUE(compileSchedulerSnapshot(snapshot, day));
+
+  uint32_t legacyFired = 0;
+  uint32_t startUs = micros();
+  for (uint32_t second = 0; second < SECONDS_PER_DAY; second++) {
+    legacyFired += legacyTick(day + second);
+  }
+  uint32_t legacyUs = micros() - startUs;
+
+  uint32_t timelineFired = 0;
+  startUs = micros();
+  for (uint32_t second = 0; second < SECONDS_PER_DAY; second++) {
+    stampDueEvents(snapshot, day + second, countFiring, &timelineFired);
+  }
+  uint32_t timelineUs = micros() - startUs;
+
+  char summary[160];
+  snprintf(summary, sizeof(summary), "per tick: full scan %.0f ns, timeline %.0f ns (%.1fx)",
+           legacyUs * 1000.0 / SECONDS_PER_DAY, timelineUs * 1000.0 / SECONDS_PER_DAY,
+           timelineUs ? (double)legacyUs / timelineUs : 0.0);
+  TEST_MESSAGE(summary);
+
+  TEST_ASSERT_EQUAL_UINT32(BENCH_SCHEDULES * BENCH_EVENTS, legacyFired);
+  TEST_ASSERT_EQUAL_UINT32(legacyFired, timelineFired);
+  TEST_ASSERT_LESS_THAN_UINT32(legacyUs, timelineUs);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_timeline_is_sorted_and_complete);
+  RUN_TEST(test_timeline_tick_is_cheaper_than_the_full_scan);
+  return UNITY_END();
+}
@@ -0,0 +1,349 @@
+// Chunked /api/scheduler/save uploads. A generated document is fed through
+// the upload session split at random points (down to single bytes) and must
+// parse to exactly what one chunk gives. Peak heap use while receiving is
+// recorded, and concurrent and abandoned uploads are checked to neither
+// stomp the upload in progress nor keep their staging blocks.
+#include <Arduino.h>
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "../ScheduleFixtures.h"
+#include "ScheduleParser.h"
+
+#define SPLIT_ROUNDS 200
+#define MALLOC_HEADERS (16 * 8 * 2)  // Heap overhead of two event blocks per schedule
+#define STAGING_TABLE (8 * sizeof(Schedule) + 16)  // Table of an 8-schedule upload, with its malloc header
+
+// Distinct owners, standing in for AsyncWebServerRequest pointers
+static int clientA, clientB;
+
+struct UploadPeak {
+  long heapBytes;         // Heap outside the event pool, above its use before the first chunk
+  uint32_t poolEvents;    // Event slots owned by the staging state
+};
+
+// Heap in use apart from the event pool's blocks, which stay reserved on its
+// free lists between uploads
+static long heapOutsidePool() {
+  return (long)nativeHeapInUse() - (long)(getEventPoolStats().reservedEvents * sizeof(Event));
+}
+
+// Document with schedules x events, using every field the parser reads and
+// strings that need escapes, so split points land inside every token kind
+static std::string makeDocument(int schedules, int events) {
+  std::string doc = "{ \"currentScheduleIndex\": 1, \"ignored\": [1, {\"a\": null}, true],\n  \"schedules\": [";
+  char buf[256];
+  for (int s = 0; s < schedules; s++) {
+    snprintf(buf, sizeof(buf),
+             "%s\n    {\"name\": \"Zone \\\"%d\\\" \\u00e9\", \"metadata\": \"line\\nbreak\", \"relayMask\": %d,"
+             " \"maxOpenZones\": %d, \"zoneGapSeconds\": %d, \"lightsOnTime\": \"06:%02d\", \"lightsOffTime\": \"18:00\","
+             " \"events\": [",
+             s ? "," : "", s, 1 << (s % 8), s % 3, 5 * s, s);
+    doc += buf;
+    for (int e = 0; e < events; e++) {
+      int second = (e * 613 + s * 97) % SECONDS_PER_DAY;
+      snprintf(buf, sizeof(buf),
+               "%s\n      {\"id\": \"s%d-e%d\", \"time\": \"%02d:%02d:%02d\", \"duration\": %d",
+               e ? "," : "", s, e, second / 3600, second / 60 % 60, second % 60, 10 + e % 50);
+      doc += buf;
+      if (e % 4 == 1) {
+        doc += ", \"weekdays\": 42";
+      } else if (e % 4 == 2) {
+        doc += ", \"everyDays\": 3, \"anchor\": \"2026-05-04\"";
+      } else if (e % 4 == 3) {
+        doc += ", \"weekdays\": 65, \"seasonStart\": \"06-01\", \"seasonEnd\": \"08-31\"";
+      }
+      doc += "}";
+    }
+    doc += "]}";
+  }
+  doc += "\n  ]\n}\n";
+  return doc;
+}
+
+// Feed doc in chunks of the given sizes, checking every answer on the way.
+// Returns the parsed state (owned by the caller) and the peak memory use.
+static SchedulerState* uploadInChunks(const std::string& doc, const std::vector<size_t>& chunks, UploadPeak& peak) {
+  long baseHeap = heapOutsidePool();
+  uint32_t baseEvents = getEventPoolStats().inUseEvents;
+  peak.heapBytes = 0;
+  peak.poolEvents = 0;
+
+  SchedulerState* parsed = NULL;
+  size_t index = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    // Fed straight from the document, so every allocation is the upload's
+    int status = feedScheduleUpload(&clientA, (const uint8_t*)doc.data() + index, chunks[i], index, doc.size(),
+                                    &parsed);
+    index += chunks[i];
+
+    long heap = heapOutsidePool() - baseHeap;
+    if (heap > peak.heapBytes) peak.heapBytes = heap;
+    uint32_t poolEvents = getEventPoolStats().inUseEvents - baseEvents;
+    if (poolEvents > peak.poolEvents) peak.poolEvents = poolEvents;
+
+    if (index < doc.size()) {
+      TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_RECEIVING, status);
+      TEST_ASSERT_TRUE(scheduleUploadInProgress());
+    } else {
+      TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED, status);
+    }
+  }
+  TEST_ASSERT_FALSE(scheduleUploadInProgress());
+  TEST_ASSERT_NOT_NULL(parsed);
+  return parsed;
+}
+
+static std::vector<size_t> oneChunk(const std::string& doc) {
+  return std::vector<size_t>(1, doc.size());
+}
+
+// Random split points up to a TCP segment; a third of the rounds use chunks of 1-4 bytes
+static std::vector<size_t> randomChunks(size_t total, unsigned seed) {
+  srand(seed);
+  size_t largest = (seed % 3 == 0) ? 4 : 1 + rand() % 1460;
+  std::vector<size_t> chunks;
+  for (size_t left = total; left > 0;) {
+    size_t len = 1 + rand() % largest;
+    if (len > left) len = left;
+    chunks.push_back(len);
+    left -= len;
+  }
+  return chunks;
+}
+
+static void assertSameState(const SchedulerState& expected, const SchedulerState& actual) {
+  TEST_ASSERT_EQUAL(expected.scheduleCount, actual.scheduleCount);
+  TEST_ASSERT_EQUAL(expected.currentScheduleIndex, actual.currentScheduleIndex);
+  for (int s = 0; s < expected.scheduleCount; s++) {
+    const Schedule& a = expected.schedules[s];
+    const Schedule& b = actual.schedules[s];
+    TEST_ASSERT_EQUAL_STRING(arenaString(expected.strings, a.name), arenaString(actual.strings, b.name));
+    TEST_ASSERT_EQUAL_STRING(arenaString(expected.strings, a.metadata), arenaString(actual.strings, b.metadata));
+    TEST_ASSERT_EQUAL(a.relayMask, b.relayMask);
+    TEST_ASSERT_EQUAL(a.maxOpenZones, b.maxOpenZones);
+    TEST_ASSERT_EQUAL(a.zoneGapSeconds, b.zoneGapSeconds);
+    TEST_ASSERT_EQUAL(a.lightsOnMinute, b.lightsOnMinute);
+    TEST_ASSERT_EQUAL(a.lightsOffMinute, b.lightsOffMinute);
+    TEST_ASSERT_EQUAL(a.ruleCount, b.ruleCount);
+    TEST_ASSERT_EQUAL_MEMORY(a.rules, b.rules, sizeof(Recurrence) * a.ruleCount);
+    TEST_ASSERT_EQUAL(a.eventCount, b.eventCount);
+    TEST_ASSERT_EQUAL_MEMORY(a.events, b.events, sizeof(Event) * a.eventCount);
+  }
+}
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+}
+
+void tearDown() {
+  abandonScheduleUpload(&clientA);
+  abandonScheduleUpload(&clientB);
+}
+
+static void test_document_parses_in_one_chunk() {
+  std::string doc = makeDocument(8, 60);
+  UploadPeak peak;
+  SchedulerState* parsed = uploadInChunks(doc, oneChunk(doc), peak);
+
+  TEST_ASSERT_EQUAL(8, parsed->scheduleCount);
+  TEST_ASSERT_EQUAL(1, parsed->currentScheduleIndex);
+  TEST_ASSERT_EQUAL_STRING("Zone \"3\" \xc3\xa9", arenaString(parsed->strings, parsed->schedules[3].name));
+  TEST_ASSERT_EQUAL_STRING("line\nbreak", arenaString(parsed->strings, parsed->schedules[3].metadata));
+  TEST_ASSERT_EQUAL(60, parsed->schedules[7].eventCount);
+  TEST_ASSERT_EQUAL_STRING("s7-e59", parsed->schedules[7].events[59].id);
+  TEST_ASSERT_TRUE(parsed->schedules[0].ruleCount > 1);
+  discardScheduleUpload(parsed);
+  TEST_ASSERT_NULL(parsed);
+}
+
+static void test_random_splits_parse_identically() {
+  std::string doc = makeDocument(8, 60);
+  UploadPeak peak;
+  SchedulerState* reference = uploadInChunks(doc, oneChunk(doc), peak);
+  long referencePeak = peak.heapBytes;
+  uint32_t referenceEvents = peak.poolEvents;
+
+  long worstPeak = 0;
+  size_t chunkCount = 0;
+  for (unsigned seed = 1; seed <= SPLIT_ROUNDS; seed++) {
+    std::vector<size_t> chunks = randomChunks(doc.size(), seed);
+    chunkCount += chunks.size();
+    SchedulerState* parsed = uploadInChunks(doc, chunks, peak);
+    assertSameState(*reference, *parsed);
+    TEST_ASSERT_EQUAL(referenceEvents, peak.poolEvents);
+    discardScheduleUpload(parsed);
+    if (peak.heapBytes > worstPeak) worstPeak = peak.heapBytes;
+  }
+  discardScheduleUpload(reference);
+
+  printf("upload: %u bytes, %u rounds, %u chunks, peak heap %ld bytes (one chunk %ld) + %u pool events,"
+         " staging state %u bytes\n",
+         (unsigned)doc.size(), SPLIT_ROUNDS, (unsigned)chunkCount, worstPeak, referencePeak,
+         (unsigned)referenceEvents, (unsigned)sizeof(SchedulerState));
+
+  // Chunking costs no memory: apart from the staging state and its schedule
+  // table there are only the malloc headers of event blocks that had to come
+  // from the heap. The table may reuse a chunk the C library kept from an
+  // earlier upload, so one run can count it and another not.
+  TEST_ASSERT_TRUE(worstPeak <= referencePeak + (long)STAGING_TABLE + MALLOC_HEADERS);
+  TEST_ASSERT_TRUE(referencePeak < (long)(sizeof(SchedulerState) + STAGING_TABLE) + 64);
+}
+
+static void test_peak_memory_does_not_grow_with_document() {
+  // The staging state and its event blocks are the only allocations; the
+  // document itself is never held, so ten times the text costs nothing extra
+  // beyond the events it describes
+  std::string small = makeDocument(8, 6);
+  std::string large = makeDocument(8, 60);
+  UploadPeak smallPeak, largePeak;
+
+  SchedulerState* parsed = uploadInChunks(small, randomChunks(small.size(), 7), smallPeak);
+  discardScheduleUpload(parsed);
+  parsed = uploadInChunks(large, randomChunks(large.size(), 7), largePeak);
+  discardScheduleUpload(parsed);
+
+  printf("upload: %u byte document peaks at %ld bytes + %u pool events, %u byte document at %ld bytes + %u\n",
+         (unsigned)small.size(), smallPeak.heapBytes, (unsigned)smallPeak.poolEvents,
+         (unsigned)large.size(), largePeak.heapBytes, (unsigned)largePeak.poolEvents);
+
+  TEST_ASSERT_TRUE(largePeak.heapBytes <= smallPeak.heapBytes + MALLOC_HEADERS);
+  TEST_ASSERT_TRUE(largePeak.poolEvents <= 8 * 64);
+}
+
+static void test_concurrent_upload_is_refused() {
+  std::string doc = makeDocument(2, 10);
+  size_t half = doc.size() / 2;
+  SchedulerState* parsed = NULL;
+
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_RECEIVING,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), half, 0, doc.size(), &parsed));
+
+  // A second upload starting meanwhile is turned away, and so are its other chunks
+  TEST_ASSERT_EQUAL(409, feedScheduleUpload(&clientB, (const uint8_t*)doc.data(), half, 0, doc.size(), &parsed));
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_IGNORED,
+                    feedScheduleUpload(&clientB, (const uint8_t*)doc.data() + half, doc.size() - half, half,
+                                       doc.size(), &parsed));
+  abandonScheduleUpload(&clientB);
+  TEST_ASSERT_TRUE(scheduleUploadInProgress());
+
+  // The first one still completes
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data() + half, doc.size() - half, half,
+                                       doc.size(), &parsed));
+  TEST_ASSERT_NOT_NULL(parsed);
+  TEST_ASSERT_EQUAL(2, parsed->scheduleCount);
+  TEST_ASSERT_EQUAL(10, parsed->schedules[1].eventCount);
+  discardScheduleUpload(parsed);
+
+  // And the next upload is accepted again
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientB, (const uint8_t*)doc.data(), doc.size(), 0, doc.size(), &parsed));
+  discardScheduleUpload(parsed);
+}
+
+static void test_abandoned_upload_frees_staging() {
+  std::string doc = makeDocument(8, 60);
+  long baseHeap = heapOutsidePool();
+  uint32_t baseEvents = getEventPoolStats().inUseEvents;
+  SchedulerState* parsed = NULL;
+
+  size_t part = doc.size() * 3 / 4;
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_RECEIVING,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), part, 0, doc.size(), &parsed));
+  TEST_ASSERT_TRUE(getEventPoolStats().inUseEvents > baseEvents);
+
+  // The client disconnects: its staging state and event blocks go back
+  abandonScheduleUpload(&clientA);
+  TEST_ASSERT_FALSE(scheduleUploadInProgress());
+  TEST_ASSERT_EQUAL(baseEvents, getEventPoolStats().inUseEvents);
+  TEST_ASSERT_TRUE(heapOutsidePool() <= baseHeap);
+
+  // Late chunks of the abandoned upload are ignored; another client can upload
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_IGNORED,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data() + part, doc.size() - part, part,
+                                       doc.size(), &parsed));
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientB, (const uint8_t*)doc.data(), doc.size(), 0, doc.size(), &parsed));
+  discardScheduleUpload(parsed);
+}
+
+static void test_rejected_uploads_free_staging() {
+  uint32_t baseEvents = getEventPoolStats().inUseEvents;
+  std::string doc = makeDocument(2, 10);
+  SchedulerState* parsed = NULL;
+
+  // Invalid JSON part way through
+  std::string broken = doc.substr(0, doc.size() / 2) + "}}";
+  TEST_ASSERT_EQUAL(400, feedScheduleUpload(&clientA, (const uint8_t*)broken.data(), broken.size(), 0,
+                                            broken.size(), &parsed));
+  TEST_ASSERT_NULL(parsed);
+  TEST_ASSERT_FALSE(scheduleUploadInProgress());
+
+  // Cut short: the last chunk ends before the document does
+  std::string truncated = doc.substr(0, doc.size() - 4);
+  TEST_ASSERT_EQUAL(400, feedScheduleUpload(&clientA, (const uint8_t*)truncated.data(), truncated.size(), 0,
+                                            truncated.size(), &parsed));
+  TEST_ASSERT_EQUAL(baseEvents, getEventPoolStats().inUseEvents);
+
+  // Too large, refused before anything is allocated
+  TEST_ASSERT_EQUAL(413, feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), 16, 0,
+                                            SCHEDULE_UPLOAD_MAX_BYTES + 1, &parsed));
+  TEST_ASSERT_FALSE(scheduleUploadInProgress());
+}
+
+static void test_events_beyond_the_limit_are_dropped() {
+  std::string doc = makeDocument(1, MAX_EVENTS + 20);
+  SchedulerState* parsed = NULL;
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), doc.size(), 0, doc.size(), &parsed));
+  TEST_ASSERT_EQUAL(MAX_EVENTS, parsed->schedules[0].eventCount);
+  TEST_ASSERT_EQUAL(MAX_EVENTS, parsed->schedules[0].eventCapacity);
+  discardScheduleUpload(parsed);
+
+  doc = makeDocument(MAX_SCHEDULES + 2, 2);
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), doc.size(), 0, doc.size(), &parsed));
+  TEST_ASSERT_EQUAL(MAX_SCHEDULES, parsed->scheduleCount);
+  TEST_ASSERT_EQUAL_STRING("s31-e1", parsed->schedules[MAX_SCHEDULES - 1].events[1].id);
+  discardScheduleUpload(parsed);
+}
+
+static void test_large_plans_are_limited_by_the_heap() {
+  // A freshly booted ESP32 takes 2,000 events in more schedules than one per relay
+  nativeSetFreeHeap(200000);
+  std::string doc = makeDocument(12, 170);
+  TEST_ASSERT_TRUE(doc.size() <= SCHEDULE_UPLOAD_MAX_BYTES);
+  SchedulerState* parsed = NULL;
+  TEST_ASSERT_EQUAL(SCHEDULE_UPLOAD_PARSED,
+                    feedScheduleUpload(&clientA, (const uint8_t*)doc.data(), doc.size(), 0, doc.size(), &parsed));
+  TEST_ASSERT_EQUAL(12, parsed->scheduleCount);
+  for (int s = 0; s < 12; s++) {
+    TEST_ASSERT_EQUAL(170, parsed->schedules[s].eventCount);
+  }
+  discardScheduleUpload(parsed);
+
+  // What is left is the heap above the reserve, unless a budget is set
+  EventPoolStats pool = getEventPoolStats();
+  TEST_ASSERT_EQUAL(0, pool.budgetEvents);
+  TEST_ASSERT_EQUAL((200000 - EVENT_POOL_HEAP_RESERVE) / sizeof(Event), pool.availableEvents);
+  setEventPoolBudget(pool.reservedEvents + 100);
+  TEST_ASSERT_EQUAL(100, getEventPoolStats().availableEvents);
+  setEventPoolBudget(0);
+  nativeSetFreeHeap(EVENT_POOL_HEAP_RESERVE);
+  TEST_ASSERT_EQUAL(0, getEventPoolStats().availableEvents);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_document_parses_in_one_chunk);
+  RUN_TEST(test_random_splits_parse_identically);
+  RUN_TEST(test_peak_memory_does_not_grow_with_document);
+  RUN_TEST(test_concurrent_upload_is_refused);
+  RUN_TEST(test_abandoned_upload_frees_staging);
+  RUN_TEST(test_rejected_uploads_free_staging);
+  RUN_TEST(test_events_beyond_the_limit_are_dropped);
+  RUN_TEST(test_large_plans_are_limited_by_the_heap);
+  return UNITY_END();
+}
@@ -0,0 +1,143 @@
+// Wake counts of the tickless executor over simulated days. The scheduler
+// clock is replaced by a virtual one that jumps by exactly the sleep the
+// executor asked for, so every wake is counted and its time checked.
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "../ScheduleFixtures.h"
+#include "SchedulerSnapshot.h"
+
+static SchedulerSnapshot snapshot;
+static time_t virtualNow;
+static std::vector<uint32_t> firingSeconds;
+
+static time_t virtualClock() {
+  return virtualNow;
+}
+
+static void recordFiring(const SchedulerSnapshot& snapshot, uint8_t scheduleIdx, uint16_t eventIdx, time_t now,
+                         void* context) {
+  firingSeconds.push_back(now % SECONDS_PER_DAY);
+}
+
+// The scheduler task's loop body, once per wake, until end
+static uint32_t runExecutor(time_t end) {
+  uint32_t wakes = 0;
+  bool compiled = false;
+  while (getSchedulerTime() < end) {
+    time_t now = getSchedulerTime();
+    if (!compiled || schedulerSnapshotIsStale(snapshot, now)) {
+      TEST_ASSERT_TRUE(compileSchedulerSnapshot(snapshot, now));
+      compiled = true;
+    }
+    relayPlanMaskAt(snapshot.relayPlan, now % SECONDS_PER_DAY);
+    stampDueEvents(snapshot, now, recordFiring, NULL);
+
+    uint32_t seconds = secondsUntilNextSchedulerStep(snapshot, now);
+    TEST_ASSERT_TRUE(seconds >= 1 && seconds <= SCHEDULER_MAX_SLEEP_S);
+    virtualNow += seconds;
+    wakes++;
+  }
+  return wakes;
+}
+
+void setUp() {
+  useTimezone("UTC0");
+  nativeSetFreeHeap(4 * 1024 * 1024);
+  clearTestState(snapshot.state);
+  firingSeconds.clear();
+  virtualNow = utcInstant(2026, 6, 1);
+  setSchedulerClock(virtualClock);
+}
+
+void tearDown() {
+  setSchedulerClock(NULL);
+  clearTestState(snapshot.state);
+}
+
+static void test_clock_is_injectable() {
+  TEST_ASSERT_FALSE(schedulerClockIsSystem());
+  TEST_ASSERT_EQUAL(utcInstant(2026, 6, 1), getSchedulerTime());
+  virtualNow += 42;
+  TEST_ASSERT_EQUAL(utcInstant(2026, 6, 1) + 42, getSchedulerTime());
+
+  setSchedulerClock(NULL);
+  TEST_ASSERT_TRUE(schedulerClockIsSystem());
+  TEST_ASSERT_INT_WITHIN(2, time(NULL), getSchedulerTime());
+}
+
+static void test_idle_day_wakes_once_an_hour() {
+  addTestSchedule(snapshot.state, "Empty", 0x01);
+  uint32_t wakes = runExecutor(virtualNow + SECONDS_PER_DAY);
+  TEST_ASSERT_EQUAL_UINT32(SECONDS_PER_DAY / SCHEDULER_MAX_SLEEP_S, wakes);
+}
+
+static void test_wakes_only_on_event_edges() {
+  // Six 5-minute events: each needs a wake to start and one to end
+  Schedule& sch = addTestSchedule(snapshot.state, "Six", 0x01);
+  const uint32_t starts[6] = {3600, 3 * 3600, 6 * 3600 + 30, 12 * 3600 + 59, 18 * 3600, 23 * 3600 + 1};
+  char id[EVENT_ID_LEN];
+  for (int e = 0; e < 6; e++) {
+    snprintf(id, sizeof(id), "event_%d", e);
+    addTestEvent(sch, id, starts[e], 300);
+  }
+
+  uint32_t wakes = runExecutor(virtualNow + SECONDS_PER_DAY);
+
+  // Midnight, six starts, six ends, plus the hourly cap across the gaps
+  // longer than an hour (00:00-01:00 is exactly one)
+  uint32_t capWakes = 0;
+  uint32_t previous = 0;
+  for (int e = 0; e <= 6; e++) {
+    uint32_t next = e < 6 ? starts[e] : SECONDS_PER_DAY;
+    uint32_t gapFrom = e == 0 ? 0 : previous + 300;
+    capWakes += (next - gapFrom - 1) / SCHEDULER_MAX_SLEEP_S;
+    previous = next;
+  }
+  TEST_ASSERT_EQUAL_UINT32(1 + 12 + capWakes, wakes);
+  TEST_ASSERT_LESS_THAN_UINT32(40, wakes);   // Against 86400 for the old 1 Hz loop
+
+  // Every event is picked up on its own second
+  TEST_ASSERT_EQUAL(6, firingSeconds.size());
+  for (int e = 0; e < 6; e++) {
+    TEST_ASSERT_EQUAL_UINT32(starts[e], firingSeconds[e]);
+  }
+}
+
+static void test_overlapping_events_share_edges() {
+  Schedule& sch = addTestSchedule(snapshot.state, "Overlap", 0x01);
+  addTestEvent(sch, "a", 8 * 3600, 600);
+  addTestEvent(sch, "b", 8 * 3600 + 300, 600);   // Extends a's relay interval
+
+  runExecutor(virtualNow + SECONDS_PER_DAY);
+  TEST_ASSERT_EQUAL(2, firingSeconds.size());
+
+  // One merged interval: the relay goes on at 08:00 and off at 08:15
+  TEST_ASSERT_EQUAL(1, snapshot.relayPlan.count[0]);
+  TEST_ASSERT_EQUAL_UINT32(8 * 3600, snapshot.relayPlan.intervals[0][0].start);
+  TEST_ASSERT_EQUAL_UINT32(8 * 3600 + 900, snapshot.relayPlan.intervals[0][0].end);
+}
+
+static void test_week_of_wakes_scales_with_events_not_seconds() {
+  Schedule& sch = addTestSchedule(snapshot.state, "Hourly", 0x03);
+  char id[EVENT_ID_LEN];
+  for (int hour = 0; hour < 24; hour++) {
+    snprintf(id, sizeof(id), "h%d", hour);
+    addTestEvent(sch, id, hour * 3600 + 1800, 60);
+  }
+
+  uint32_t wakes = runExecutor(virtualNow + 7 * SECONDS_PER_DAY);
+  TEST_ASSERT_EQUAL(7 * 24, firingSeconds.size());
+  // A start, an end and the midnight boundary per day
+  TEST_ASSERT_EQUAL_UINT32(7 * (24 * 2 + 1), wakes);
+}
+
+int main(int argc, char** argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_clock_is_injectable);
+  RUN_TEST(test_idle_day_wakes_once_an_hour);
+  RUN_TEST(test_wakes_only_on_event_edges);
+  RUN_TEST(test_overlapping_events_share_edges);
+  RUN_TEST(test_week_of_wakes_scales_with_events_not_seconds);
+  return UNITY_END();
+}